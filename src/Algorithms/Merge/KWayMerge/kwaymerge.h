@@ -0,0 +1,214 @@
+// K-way merge of pre-sorted sequences based on a loser (tournament) tree.
+// + Every produced element costs ceil(log2(k)) comparisons: only the path from the winner's leaf to the root is replayed.
+// + The tree is a flat array of range indexes, the current heads of the ranges are stored contiguously.
+// + Pull based: elements are produced one by one, so the caller can stop at any moment.
+// + Stable: equal elements are produced in the order of their ranges.
+#pragma once
+#include <vector>
+#include <iterator>
+#include <utility>
+#include "head.h"
+#include "comparators.h"
+
+template<typename Iterator, typename Comparator = ComparatorGreater<typename std::iterator_traits<Iterator>::value_type>>
+class LoserTree {
+public:
+    using value_type = typename std::iterator_traits<Iterator>::value_type;
+    using reference = typename std::iterator_traits<Iterator>::reference;
+    using range_type = std::pair<Iterator, Iterator>;
+    using size_type = size_t;
+
+    // Input iterator for range-based for loops. Every increment pulls the next element from the tree.
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = typename LoserTree::value_type;
+        using difference_type = std::ptrdiff_t;
+        using reference = typename LoserTree::reference;
+
+        CONSTEXPR20 iterator() = default;
+        CONSTEXPR20 explicit iterator(LoserTree* tree) : tree(tree) {}
+
+        NODISCARD CONSTEXPR20 reference operator*() const {
+            return tree->peek();
+        }
+
+        CONSTEXPR20 iterator& operator++() {
+            tree->pop();
+            return *this;
+        }
+
+        CONSTEXPR20 void operator++(int) {
+            tree->pop();
+        }
+
+        NODISCARD CONSTEXPR20 bool operator==(std::default_sentinel_t) const {
+            return !tree || tree->isEmpty();
+        }
+
+    private:
+        LoserTree* tree{};
+    };
+
+    CONSTEXPR20 LoserTree() = default;
+
+    // Every range must be sorted by comp: comp(a, b) == true means that "a" goes before "b".
+    CONSTEXPR20 explicit LoserTree(const std::vector<range_type>& ranges, Comparator comp = Comparator()) :
+            ranges{ ranges },
+            comp{ comp }
+    {
+        build();
+    }
+
+    CONSTEXPR20 explicit LoserTree(std::vector<range_type>&& ranges, Comparator comp = Comparator()) :
+            ranges{ std::move(ranges) },
+            comp{ comp }
+    {
+        build();
+    }
+
+    CONSTEXPR20 ~LoserTree() = default;
+
+    NODISCARD CONSTEXPR20 bool isEmpty() const {
+        return ranges.empty() || isExhausted(winner);
+    }
+
+    // The next element of the merged sequence. The tree must not be empty.
+    NODISCARD CONSTEXPR20 reference peek() const {
+        return *ranges[winner].first;
+    }
+
+    // Index of the range which holds the next element of the merged sequence.
+    NODISCARD CONSTEXPR20 size_type peekSource() const {
+        return winner;
+    }
+
+    // Drop the next element of the merged sequence. The tree must not be empty.
+    CONSTEXPR20 void pop() {
+        ++ranges[winner].first;
+        replay();
+    }
+
+    // Take the next element of the merged sequence. The tree must not be empty.
+    CONSTEXPR20 value_type next() {
+        value_type value = *ranges[winner].first;
+        pop();
+        return value;
+    }
+
+    NODISCARD CONSTEXPR20 iterator begin() {
+        return iterator{ this };
+    }
+
+    NODISCARD CONSTEXPR20 std::default_sentinel_t end() const {
+        return std::default_sentinel;
+    }
+
+private:
+    std::vector<range_type> ranges{};
+    // losers[node] is the range index which lost the match at the internal node. Index 0 is unused.
+    // Leaves are not stored: the leaf of range "index" is the node (index + k).
+    std::vector<size_type> losers{};
+    size_type winner{ 0 };
+    Comparator comp{};
+
+    CONSTEXPR20 void build() {
+        const auto k = ranges.size();
+        if (k == 0) {
+            return;
+        }
+
+        losers.assign(k, 0);
+
+        // Play all matches bottom-up. winners[node] is the winner of the subtree of node.
+        std::vector<size_type> winners(2 * k);
+        for (size_type index = 0; index < k; index++) {
+            winners[k + index] = index;
+        }
+
+        for (auto node = k - 1; node != 0; node--) {
+            const auto left = winners[2 * node];
+            const auto right = winners[2 * node + 1];
+
+            if (beats(left, right)) {
+                winners[node] = left;
+                losers[node] = right;
+            } else {
+                winners[node] = right;
+                losers[node] = left;
+            }
+        }
+
+        winner = winners[1];
+    }
+
+    CONSTEXPR20 void replay() {
+        const auto k = ranges.size();
+        auto current = winner;
+
+        // Go up from the leaf of the previous winner. The stored loser challenges the current candidate.
+        for (auto node = (current + k) / 2; node != 0; node /= 2) {
+            if (beats(losers[node], current)) {
+                std::swap(losers[node], current);
+            }
+        }
+
+        winner = current;
+    }
+
+    NODISCARD CONSTEXPR20 bool isExhausted(size_type index) const {
+        return ranges[index].first == ranges[index].second;
+    }
+
+    // Returns true if the head of range "first" goes before the head of range "second".
+    // Only one comparison is needed: ties are resolved in favour of the range with the lower index.
+    NODISCARD CONSTEXPR20 bool beats(size_type first, size_type second) const {
+        if (isExhausted(first)) {
+            return false;
+        }
+
+        if (isExhausted(second)) {
+            return true;
+        }
+
+        if (first < second) {
+            return !comp(*ranges[second].first, *ranges[first].first);
+        }
+
+        return comp(*ranges[first].first, *ranges[second].first);
+    }
+};
+
+// Merge sorted ranges into the output iterator. Returns the output iterator past the last written element.
+template<typename Iterator, typename OutputIterator, typename Comparator>
+CONSTEXPR20 OutputIterator kWayMerge(const std::vector<std::pair<Iterator, Iterator>>& ranges, OutputIterator output, Comparator comp) {
+    LoserTree<Iterator, Comparator> tree{ ranges, comp };
+
+    while (!tree.isEmpty()) {
+        *output = tree.peek();
+        ++output;
+        tree.pop();
+    }
+
+    return output;
+}
+
+// Merge sorted sequences into a new vector.
+template<typename DataType, typename Comparator = ComparatorGreater<DataType>>
+NODISCARD CONSTEXPR20 std::vector<DataType> kWayMerge(const std::vector<std::vector<DataType>>& sequences, Comparator comp = Comparator()) {
+    using const_iterator = typename std::vector<DataType>::const_iterator;
+
+    std::vector<std::pair<const_iterator, const_iterator>> ranges{};
+    ranges.reserve(sequences.size());
+    size_t total_size = 0;
+
+    for (const auto& sequence : sequences) {
+        ranges.emplace_back(sequence.cbegin(), sequence.cend());
+        total_size += sequence.size();
+    }
+
+    std::vector<DataType> result{};
+    result.reserve(total_size);
+    kWayMerge(ranges, std::back_inserter(result), comp);
+    return result;
+}
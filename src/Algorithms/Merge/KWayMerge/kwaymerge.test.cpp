@@ -0,0 +1,183 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include "kwaymerge.h"
+
+using test_data_type = int;
+using test_data_count = size_t;
+
+class KWayMergeTest : public ::testing::Test {
+protected:
+    KWayMergeTest() = default;
+
+    std::vector<std::vector<test_data_type>> sequences_less {
+            {1, 4, 7, 10, 13},
+            {},
+            {2, 2, 5, 99},
+            {3},
+            {0, 6, 6, 6, 100},
+            {8, 9}
+    };
+    std::vector<test_data_type> result_less {0, 1, 2, 2, 3, 4, 5, 6, 6, 6, 7, 8, 9, 10, 13, 99, 100};
+
+public:
+    class ObjectA {
+    public:
+        CONSTEXPR20 ObjectA() = default;
+
+        CONSTEXPR20 explicit ObjectA(test_data_type value, test_data_count source = 0) :
+                value{ value },
+                source{ source }
+        {
+
+        }
+
+        NODISCARD CONSTEXPR20 bool operator> (const ObjectA& obj) const {
+            return this->value > obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 bool operator< (const ObjectA& obj) const {
+            return this->value < obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 test_data_type get() const {
+            return value;
+        }
+
+        NODISCARD CONSTEXPR20 test_data_count getSource() const {
+            return source;
+        }
+
+    private:
+        test_data_type value{};
+        test_data_count source{};
+    };
+};
+
+using object_type = KWayMergeTest::ObjectA;
+using store_smart_ptr_type = std::shared_ptr<object_type>;
+
+TEST_F(KWayMergeTest, Less) {
+    auto merged = kWayMerge(sequences_less, ComparatorLess<test_data_type>());
+    ASSERT_EQ(merged, result_less);
+}
+
+TEST_F(KWayMergeTest, Greater) {
+    auto sequences_greater = sequences_less;
+    for (auto& sequence : sequences_greater) {
+        std::reverse(sequence.begin(), sequence.end());
+    }
+
+    auto merged = kWayMerge(sequences_greater, ComparatorGreater<test_data_type>());
+    std::vector<test_data_type> result_greater(result_less.rbegin(), result_less.rend());
+    ASSERT_EQ(merged, result_greater);
+}
+
+TEST_F(KWayMergeTest, StableObject) {
+    // Equal values must come out in the order of their sequences.
+    std::vector<std::vector<object_type>> sequences(sequences_less.size());
+    for (test_data_count source = 0; source < sequences_less.size(); source++) {
+        for (const auto value : sequences_less[source]) {
+            sequences[source].emplace_back(value, source);
+        }
+    }
+
+    auto merged = kWayMerge(sequences, ComparatorLess<object_type>());
+    ASSERT_EQ(merged.size(), result_less.size());
+
+    for (test_data_count index = 1; index < merged.size(); index++) {
+        ASSERT_LE(merged[index - 1].get(), merged[index].get());
+        if (merged[index - 1].get() == merged[index].get()) {
+            ASSERT_LE(merged[index - 1].getSource(), merged[index].getSource());
+        }
+    }
+}
+
+TEST_F(KWayMergeTest, PointersWithCustomComparator) {
+    std::vector<std::vector<store_smart_ptr_type>> sequences(sequences_less.size());
+    for (test_data_count source = 0; source < sequences_less.size(); source++) {
+        for (const auto value : sequences_less[source]) {
+            sequences[source].push_back(std::make_shared<object_type>(value, source));
+        }
+    }
+
+    auto merged = kWayMerge(sequences, compPtrMin<store_smart_ptr_type>);
+    ASSERT_EQ(merged.size(), result_less.size());
+
+    for (test_data_count index = 0; index < merged.size(); index++) {
+        ASSERT_EQ(merged[index]->get(), result_less[index]);
+    }
+}
+
+TEST_F(KWayMergeTest, LazyPull) {
+    using iterator_type = std::vector<test_data_type>::const_iterator;
+    std::vector<std::pair<iterator_type, iterator_type>> ranges{};
+    for (const auto& sequence : sequences_less) {
+        ranges.emplace_back(sequence.cbegin(), sequence.cend());
+    }
+
+    LoserTree<iterator_type, ComparatorLess<test_data_type>> tree{ ranges };
+
+    // Stop after the first five elements.
+    for (test_data_count index = 0; index < 5; index++) {
+        ASSERT_FALSE(tree.isEmpty());
+        ASSERT_EQ(tree.next(), result_less[index]);
+    }
+
+    // The rest is still available.
+    ASSERT_EQ(tree.peek(), result_less[5]);
+    ASSERT_EQ(tree.peekSource(), static_cast<test_data_count>(0));
+
+    test_data_count index = 5;
+    for (const auto value : tree) {
+        ASSERT_EQ(value, result_less[index]);
+        index++;
+    }
+
+    ASSERT_EQ(index, result_less.size());
+    ASSERT_TRUE(tree.isEmpty());
+}
+
+TEST_F(KWayMergeTest, OutputIterator) {
+    using iterator_type = std::vector<test_data_type>::const_iterator;
+    std::vector<std::pair<iterator_type, iterator_type>> ranges{};
+    for (const auto& sequence : sequences_less) {
+        ranges.emplace_back(sequence.cbegin(), sequence.cend());
+    }
+
+    std::vector<test_data_type> merged(result_less.size());
+    auto output_end = kWayMerge(ranges, merged.begin(), ComparatorLess<test_data_type>());
+    ASSERT_EQ(output_end, merged.end());
+    ASSERT_EQ(merged, result_less);
+}
+
+TEST_F(KWayMergeTest, ManySequences) {
+    // Number of sequences is not a power of two.
+    const test_data_count sequences_count = 37;
+    std::vector<std::vector<test_data_type>> sequences(sequences_count);
+    std::vector<test_data_type> expected{};
+
+    for (test_data_count source = 0; source < sequences_count; source++) {
+        for (test_data_type value = static_cast<test_data_type>(source); value < 1000; value += static_cast<test_data_type>(source + 1)) {
+            sequences[source].push_back(value);
+            expected.push_back(value);
+        }
+    }
+
+    std::sort(expected.begin(), expected.end());
+    ASSERT_EQ(kWayMerge(sequences, ComparatorLess<test_data_type>()), expected);
+}
+
+TEST_F(KWayMergeTest, Empty) {
+    ASSERT_TRUE(kWayMerge(std::vector<std::vector<test_data_type>>{}, ComparatorLess<test_data_type>()).empty());
+    ASSERT_TRUE(kWayMerge(std::vector<std::vector<test_data_type>>{{}, {}}, ComparatorLess<test_data_type>()).empty());
+
+    LoserTree<std::vector<test_data_type>::const_iterator> tree{};
+    ASSERT_TRUE(tree.isEmpty());
+    ASSERT_TRUE(tree.begin() == tree.end());
+}
+
+TEST_F(KWayMergeTest, SingleSequence) {
+    std::vector<std::vector<test_data_type>> sequences{ {1, 2, 3} };
+    ASSERT_EQ(kWayMerge(sequences, ComparatorLess<test_data_type>()), sequences[0]);
+}
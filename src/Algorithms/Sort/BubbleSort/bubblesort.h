@@ -1,24 +1,28 @@
 #pragma once
 #include "swap.h"
 #include "comparators.h"
+#include "projection.h"
 
 using size_type = size_t;
 
-template<typename DataType, typename Comparator>
+// Stable: equal elements keep their relative order.
+template<typename Stats = NoStats, typename DataType, typename Comparator>
 CONSTEXPR20 void bubbleSort(std::vector<DataType>& vec, Comparator comp = ComparatorGreater<DataType>()) {
     const auto size = vec.size();
     if (size < 2) {
         return;
     }
 
+    const StatsComparator<Comparator, Stats> counted_comp{ comp };
+
     // Iterate over the array with a number equal to the size of the array minus one.
     for (size_type iteration = 0; iteration < size - 1; iteration++) {
         // For each iteration, go through all adjacent numbers, find the peak number among each pair, and swap their places in sort order.
         bool swapped = false;
 
         for (size_type sub_iteration = 0; sub_iteration < size - 1; sub_iteration++) {
-            if (comp(vec[sub_iteration + 1], vec[sub_iteration])) {
-                swap(vec, sub_iteration + 1, sub_iteration);
+            if (counted_comp(vec[sub_iteration + 1], vec[sub_iteration])) {
+                swap<Stats>(vec, sub_iteration + 1, sub_iteration);
                 swapped = true;
             }
         }
@@ -28,4 +32,18 @@ CONSTEXPR20 void bubbleSort(std::vector<DataType>& vec, Comparator comp = Compar
             return;
         }
     }
+}
+
+// Sort by projected keys: comp(proj(a), proj(b)). Stable.
+template<typename Stats = NoStats, typename DataType, typename Comparator, typename Projection>
+CONSTEXPR20 void bubbleSort(std::vector<DataType>& vec, Comparator comp, Projection proj) {
+    bubbleSort<Stats>(vec, ProjectedComparator<Comparator, Projection>{ comp, proj });
+}
+
+// Sort by projected keys computing every key once (decorate-sort-undecorate). Stable.
+template<typename Stats = NoStats, typename DataType, typename Comparator, typename Projection>
+CONSTEXPR20 void bubbleSortCachedKeys(std::vector<DataType>& vec, Comparator comp, Projection proj) {
+    sortByCachedKeys(vec, comp, proj, [](auto& keys, auto keys_comp) {
+        bubbleSort<Stats>(keys, keys_comp);
+    });
 }
\ No newline at end of file
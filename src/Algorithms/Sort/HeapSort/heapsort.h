@@ -1,10 +1,19 @@
 #pragma once
 #include "swap.h"
 #include "comparators.h"
+#include "projection.h"
+#include "heap_levels.h"
+#include "thread_pool.h"
 
 using size_type = size_t;
 
-template<typename DataType, typename Comparator>
+template<typename Stats = NoStats, typename DataType, typename Comparator>
+CONSTEXPR20 void heapifyStart(std::vector<DataType>& vec, size_type size, Comparator comp);
+template<typename Stats = NoStats, typename DataType, typename Comparator>
+CONSTEXPR20 void heapify(std::vector<DataType>& vec, size_type current_element, size_type size, Comparator comp);
+
+// Not stable: equal elements may change their relative order. Use heapSortCachedKeys() for a stable order.
+template<typename Stats = NoStats, typename DataType, typename Comparator>
 CONSTEXPR20 void heapSort(std::vector<DataType>& vec, Comparator comp = ComparatorGreater<DataType>()) {
     const auto size = vec.size();
     if (size < 2) {
@@ -12,30 +21,47 @@ CONSTEXPR20 void heapSort(std::vector<DataType>& vec, Comparator comp = Comparat
     }
 
     // Build heap.
-    heapifyStart(vec, vec.size(), comp);
+    heapifyStart<Stats>(vec, vec.size(), comp);
 
     // Sort
+    const StatsComparator<Comparator, Stats> counted_comp{ comp };
     for (auto index = size - 1; index != 0; index--) {
-        swap(vec, static_cast<size_type>(0), index);
+        swap<Stats>(vec, static_cast<size_type>(0), index);
 
         if (index > 1) { // Don't swap left child with peak when index == 1 inside heapify().
-            heapify(vec, 0, index, comp);
+            heapify<Stats>(vec, 0, index, counted_comp);
         }
     }
 }
 
-template<typename DataType, typename Comparator>
+// Sort by projected keys: comp(proj(a), proj(b)).
+template<typename Stats = NoStats, typename DataType, typename Comparator, typename Projection>
+CONSTEXPR20 void heapSort(std::vector<DataType>& vec, Comparator comp, Projection proj) {
+    heapSort<Stats>(vec, ProjectedComparator<Comparator, Projection>{ comp, proj });
+}
+
+// Sort by projected keys computing every key once (decorate-sort-undecorate). Stable.
+template<typename Stats = NoStats, typename DataType, typename Comparator, typename Projection>
+CONSTEXPR20 void heapSortCachedKeys(std::vector<DataType>& vec, Comparator comp, Projection proj) {
+    sortByCachedKeys(vec, comp, proj, [](auto& keys, auto keys_comp) {
+        heapSort<Stats>(keys, keys_comp);
+    });
+}
+
+template<typename Stats, typename DataType, typename Comparator>
 CONSTEXPR20 void heapifyStart(std::vector<DataType>& vec, size_type size, Comparator comp) {
+    const StatsComparator<Comparator, Stats> counted_comp{ comp };
     auto index = size / 2;
     if (index != 0) {
         do {
             index--;
-            heapify(vec, index, size, comp);
+            heapify<Stats>(vec, index, size, counted_comp);
         } while (index != 0); // we can use unsigned type
     }
 }
 
-template<typename DataType, typename Comparator>
+// Counts the swaps only: the callers pass a StatsComparator to count the comparisons.
+template<typename Stats, typename DataType, typename Comparator>
 CONSTEXPR20 void heapify(std::vector<DataType>& vec, size_type current_element, size_type size, Comparator comp) {
     auto local_peek_node_index = current_element;
     const auto left_node_index = 2 * current_element + 1;
@@ -57,11 +83,48 @@ CONSTEXPR20 void heapify(std::vector<DataType>& vec, size_type current_element,
 
     if (local_peek_node_index != current_element) {
         // Swap elements
-        swap(vec, current_element, local_peek_node_index);
+        swap<Stats>(vec, current_element, local_peek_node_index);
 
         const auto left_node_index_next = 2 * local_peek_node_index + 1;
         if (left_node_index_next < size) {
-            heapify(vec, local_peek_node_index, size, comp);
+            heapify<Stats>(vec, local_peek_node_index, size, comp);
+        }
+    }
+}
+
+// Parallel build of the heap: heapifyLevelsParallel() (heap_levels.h) schedules the levels.
+template<typename Stats = NoStats, typename DataType, typename Comparator>
+void heapifyStartParallel(std::vector<DataType>& vec, size_type size, Comparator comp, ThreadPool& pool, size_type grain_size = default_grain_size) {
+    if (size < grain_size || pool.size() < 2) {
+        heapifyStart<Stats>(vec, size, comp);
+        return;
+    }
+
+    // Called from the pool threads: use ThreadLocalStats to count a parallel build.
+    const StatsComparator<Comparator, Stats> counted_comp{ comp };
+    heapifyLevelsParallel(size, pool, grain_size, [&vec, size, &counted_comp](size_type index) {
+        heapify<Stats>(vec, index, size, counted_comp);
+    });
+}
+
+// Not stable. The heap is built in parallel, the extraction phase is serial.
+template<typename Stats = NoStats, typename DataType, typename Comparator>
+void heapSortParallel(std::vector<DataType>& vec, Comparator comp, ThreadPool& pool, size_type grain_size = default_grain_size) {
+    const auto size = vec.size();
+    if (size < 2) {
+        return;
+    }
+
+    // Build heap.
+    heapifyStartParallel<Stats>(vec, size, comp, pool, grain_size);
+
+    // Sort
+    const StatsComparator<Comparator, Stats> counted_comp{ comp };
+    for (auto index = size - 1; index != 0; index--) {
+        swap<Stats>(vec, static_cast<size_type>(0), index);
+
+        if (index > 1) { // Don't swap left child with peak when index == 1 inside heapify().
+            heapify<Stats>(vec, 0, index, counted_comp);
         }
     }
-}
\ No newline at end of file
+}
@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <random>
 #include "heapsort.h"
 
 using test_data_type = int;
@@ -169,4 +171,126 @@ TEST_F(HeapSortTest, LessPointersWithCustomComparator) {
 TEST_F(HeapSortTest, SizeLessTwo) {
     std::vector<test_data_type> vec(array_values, array_values + 1);
     heapSort(vec, ComparatorGreater<test_data_type>());
+}
+
+TEST_F(HeapSortTest, Projection) {
+    std::vector<object_type> vec{};
+    for (test_data_count index = 0; index < array_values_elements_count; index++) {
+        vec.emplace_back(array_values[index]);
+    }
+
+    heapSort(vec, ComparatorLess<test_data_type>(), &object_type::get);
+
+    for (test_data_count index = 1; index < array_values_elements_count; index++) {
+        ASSERT_LE(vec[index - 1].get(), vec[index].get());
+    }
+}
+
+TEST_F(HeapSortTest, CachedKeysStable) {
+    // Records (key, original position) with duplicate keys.
+    std::vector<std::pair<test_data_type, test_data_count>> records{};
+    for (test_data_count index = 0; index < array_values_elements_count; index++) {
+        records.emplace_back(array_values[index] % 3, index);
+    }
+
+    test_data_count projections_count = 0;
+    heapSortCachedKeys(records, ComparatorGreater<test_data_type>(), [&projections_count](const auto& record) {
+        projections_count++;
+        return record.first;
+    });
+
+    // Every key is computed once.
+    ASSERT_EQ(projections_count, array_values_elements_count);
+
+    for (test_data_count index = 1; index < array_values_elements_count; index++) {
+        ASSERT_GE(records[index - 1].first, records[index].first);
+        if (records[index - 1].first == records[index].first) {
+            ASSERT_LT(records[index - 1].second, records[index].second) << "Equal keys changed their order.";
+        }
+    }
+}
+
+TEST_F(HeapSortTest, ParallelBuildSameAsSerial) {
+    ThreadPool pool{ 4 };
+    std::mt19937 generator{ 1337 };
+    std::vector<test_data_type> vec(100000);
+    for (auto& value : vec) {
+        value = static_cast<test_data_type>(generator() % 1000);
+    }
+
+    // Nodes of one level are independent, so the parallel build makes exactly the same swaps.
+    auto vec_serial = vec;
+    heapifyStart(vec_serial, vec_serial.size(), ComparatorGreater<test_data_type>());
+    heapifyStartParallel(vec, vec.size(), ComparatorGreater<test_data_type>(), pool, 256);
+    ASSERT_EQ(vec, vec_serial);
+}
+
+TEST_F(HeapSortTest, ParallelGreater) {
+    ThreadPool pool{ 4 };
+    std::mt19937 generator{ 1337 };
+    std::vector<test_data_type> vec(50000);
+    for (auto& value : vec) {
+        value = static_cast<test_data_type>(generator());
+    }
+
+    auto expected = vec;
+    std::sort(expected.begin(), expected.end(), std::greater<>());
+
+    heapSortParallel(vec, ComparatorGreater<test_data_type>(), pool, 1024);
+    ASSERT_EQ(vec, expected);
+}
+
+TEST_F(HeapSortTest, ParallelSmallArrayStaysSerial) {
+    ThreadPool pool{ 2 };
+    std::vector<test_data_type> vec(array_values, array_values + array_values_elements_count);
+
+    heapSortParallel(vec, ComparatorLess<test_data_type>(), pool);
+
+    for (test_data_count index = 1; index < array_values_elements_count; index++) {
+        ASSERT_LE(vec[index - 1], vec[index]);
+    }
+}
+
+TEST_F(HeapSortTest, Stats) {
+    using stats_type = CountingStats<struct HeapSortStatsTag>;
+    std::vector<test_data_type> vec(array_values, array_values + array_values_elements_count);
+    auto vec_plain = vec;
+
+    stats_type::reset();
+    heapSort<stats_type>(vec, ComparatorLess<test_data_type>());
+    heapSort(vec_plain, ComparatorLess<test_data_type>());
+
+    // The instrumentation doesn't change the result.
+    ASSERT_EQ(vec, vec_plain);
+
+    const auto stats = stats_type::snapshot();
+    ASSERT_GE(stats[StatsEvent::comparison], array_values_elements_count - 1);
+    ASSERT_NE(stats[StatsEvent::swap], 0u);
+    ASSERT_EQ(NoStats::snapshot()[StatsEvent::comparison], 0u);
+
+    // The projection overload reports through the same policy.
+    stats_type::reset();
+    heapSort<stats_type>(vec, ComparatorGreater<test_data_type>(), [](test_data_type value) { return value; });
+    ASSERT_GE(stats_type::snapshot()[StatsEvent::comparison], array_values_elements_count - 1);
+}
+
+TEST_F(HeapSortTest, StatsParallel) {
+    // The heap is built by the pool threads: ThreadLocalStats sums the counters of all threads.
+    using stats_type = ThreadLocalStats<struct HeapSortParallelStatsTag>;
+    ThreadPool pool{ 4 };
+    std::mt19937 generator{ 1337 };
+    std::vector<test_data_type> vec(20000);
+    for (auto& value : vec) {
+        value = static_cast<test_data_type>(generator());
+    }
+    auto vec_serial = vec;
+
+    using serial_stats_type = CountingStats<struct HeapSortSerialStatsTag>;
+    heapSortParallel<stats_type>(vec, ComparatorGreater<test_data_type>(), pool, 1024);
+    heapSort<serial_stats_type>(vec_serial, ComparatorGreater<test_data_type>());
+    ASSERT_EQ(vec, vec_serial);
+
+    // The parallel build does the same work as the serial one.
+    ASSERT_EQ(stats_type::snapshot()[StatsEvent::comparison], serial_stats_type::snapshot()[StatsEvent::comparison]);
+    ASSERT_EQ(stats_type::snapshot()[StatsEvent::swap], serial_stats_type::snapshot()[StatsEvent::swap]);
 }
\ No newline at end of file
@@ -1,21 +1,25 @@
 #pragma once
 #include "swap.h"
 #include "comparators.h"
+#include "projection.h"
 
 using size_type = size_t;
 
-template<typename DataType, typename Comparator>
+// Stable: equal elements keep their relative order.
+template<typename Stats = NoStats, typename DataType, typename Comparator>
 CONSTEXPR20 void insertionSort(std::vector<DataType>& vec, Comparator comp = ComparatorGreater<DataType>()) {
     const auto size = vec.size();
     if (size < 2) {
         return;
     }
 
+    const StatsComparator<Comparator, Stats> counted_comp{ comp };
+
     // Iterate over the array from element index = 1 to the number of array elements.
     for (size_type iteration = 1; iteration < size; iteration++) {
 
         // If the left element is the peak element against the current one.
-        if (comp(vec[iteration], vec[iteration - 1])) {
+        if (counted_comp(vec[iteration], vec[iteration - 1])) {
             DataType temp = std::move(vec[iteration]);
             size_type sub_iteration = iteration;
 
@@ -27,11 +31,27 @@ CONSTEXPR20 void insertionSort(std::vector<DataType>& vec, Comparator comp = Com
                     sub_iteration != 0 // (we can use unsigned type)
                     &&
                     // If the left element is the peak element against the current one.
-                    comp(temp, vec[sub_iteration - 1])
+                    counted_comp(temp, vec[sub_iteration - 1])
                 );
 
             // Move our key element by the current index.
             vec[sub_iteration] = std::move(temp);
+            // The key out and back plus the shifted elements.
+            Stats::add(StatsEvent::move, iteration - sub_iteration + 2);
         }
     }
+}
+
+// Sort by projected keys: comp(proj(a), proj(b)). Stable.
+template<typename Stats = NoStats, typename DataType, typename Comparator, typename Projection>
+CONSTEXPR20 void insertionSort(std::vector<DataType>& vec, Comparator comp, Projection proj) {
+    insertionSort<Stats>(vec, ProjectedComparator<Comparator, Projection>{ comp, proj });
+}
+
+// Sort by projected keys computing every key once (decorate-sort-undecorate). Stable.
+template<typename Stats = NoStats, typename DataType, typename Comparator, typename Projection>
+CONSTEXPR20 void insertionSortCachedKeys(std::vector<DataType>& vec, Comparator comp, Projection proj) {
+    sortByCachedKeys(vec, comp, proj, [](auto& keys, auto keys_comp) {
+        insertionSort<Stats>(keys, keys_comp);
+    });
 }
\ No newline at end of file
@@ -1,25 +1,41 @@
 #pragma once
 #include "swap.h"
 #include "comparators.h"
+#include "projection.h"
 
 using size_type = size_t;
 
-template<typename DataType, typename Comparator>
+template<typename Stats, typename DataType, typename Comparator>
 static CONSTEXPR20 void mergeSortInternal(std::vector<DataType>& vec, size_type low, size_type high, Comparator comp);
-template<typename DataType, typename Comparator>
+template<typename Stats, typename DataType, typename Comparator>
 static CONSTEXPR20 void merge(std::vector<DataType>& vec, size_type low, size_type divided_border, size_type high, Comparator comp);
 
-template<typename DataType, typename Comparator>
+// Stable: equal elements keep their relative order.
+template<typename Stats = NoStats, typename DataType, typename Comparator>
 CONSTEXPR20 void mergeSort(std::vector<DataType>& vec, Comparator comp = ComparatorGreater<DataType>()) {
     const auto size = vec.size();
     if (size < 2) {
         return;
     }
 
-    mergeSortInternal(vec, 0, size - 1, comp);
+    mergeSortInternal<Stats>(vec, 0, size - 1, StatsComparator<Comparator, Stats>{ comp });
 }
 
-template<typename DataType, typename Comparator>
+// Sort by projected keys: comp(proj(a), proj(b)). Stable.
+template<typename Stats = NoStats, typename DataType, typename Comparator, typename Projection>
+CONSTEXPR20 void mergeSort(std::vector<DataType>& vec, Comparator comp, Projection proj) {
+    mergeSort<Stats>(vec, ProjectedComparator<Comparator, Projection>{ comp, proj });
+}
+
+// Sort by projected keys computing every key once (decorate-sort-undecorate). Stable.
+template<typename Stats = NoStats, typename DataType, typename Comparator, typename Projection>
+CONSTEXPR20 void mergeSortCachedKeys(std::vector<DataType>& vec, Comparator comp, Projection proj) {
+    sortByCachedKeys(vec, comp, proj, [](auto& keys, auto keys_comp) {
+        mergeSort<Stats>(keys, keys_comp);
+    });
+}
+
+template<typename Stats, typename DataType, typename Comparator>
 static CONSTEXPR20 void mergeSortInternal(std::vector<DataType>& vec, size_type low, size_type high, Comparator comp) {
     // Note: Check before call function faster than call and check inside function.
     const auto divided_border = low + (high - low) / 2;
@@ -31,20 +47,20 @@ static CONSTEXPR20 void mergeSortInternal(std::vector<DataType>& vec, size_type
             &&
             low < divided_border
             ) {
-        mergeSortInternal<DataType, Comparator>(vec, low, divided_border, comp);
+        mergeSortInternal<Stats, DataType, Comparator>(vec, low, divided_border, comp);
     }
 
     // Divide right subarray.
     const auto new_low = divided_border + 1;
     if (new_low < high) {
-        mergeSortInternal<DataType, Comparator>(vec, new_low, high, comp);
+        mergeSortInternal<Stats, DataType, Comparator>(vec, new_low, high, comp);
     }
 
     // Conquer and combine array data.
-    merge(vec, low, divided_border, high, comp);
+    merge<Stats>(vec, low, divided_border, high, comp);
 }
 
-template<typename DataType, typename Comparator>
+template<typename Stats, typename DataType, typename Comparator>
 static CONSTEXPR20 void merge(std::vector<DataType>& vec, size_type low, size_type divided_border, size_type high, Comparator comp) {
     size_type left_subarray_index = 0,
         right_subarray_index = 0,
@@ -61,9 +77,13 @@ static CONSTEXPR20 void merge(std::vector<DataType>& vec, size_type low, size_ty
             std::make_move_iterator(vec.begin() + divided_border + 1),
             std::make_move_iterator(vec.begin() + high + 1)
             );
+    // Every element goes to a sub array and back.
+    Stats::add(StatsEvent::allocation, 2);
+    Stats::add(StatsEvent::move, 2 * (high - low + 1));
 
     do {
-        if (comp(vec_left[left_subarray_index], vec_right[right_subarray_index])) {
+        // Take the right element only if it strictly goes before the left one, so equal elements keep their order.
+        if (!comp(vec_right[right_subarray_index], vec_left[left_subarray_index])) {
             vec[main_array_index] = std::move(vec_left[left_subarray_index]);
             left_subarray_index++;
         }
@@ -169,4 +169,82 @@ TEST_F(MergeSortTest, LessPointersWithCustomComparator) {
 TEST_F(MergeSortTest, SizeLessTwo) {
     std::vector<test_data_type> vec(array_values, array_values + 1);
     mergeSort(vec, ComparatorGreater<test_data_type>());
+}
+
+TEST_F(MergeSortTest, Projection) {
+    std::vector<object_type> vec{};
+    for (test_data_count index = 0; index < array_values_elements_count; index++) {
+        vec.emplace_back(array_values[index]);
+    }
+
+    mergeSort(vec, ComparatorLess<test_data_type>(), &object_type::get);
+
+    for (test_data_count index = 1; index < array_values_elements_count; index++) {
+        ASSERT_LE(vec[index - 1].get(), vec[index].get());
+    }
+}
+
+TEST_F(MergeSortTest, Stable) {
+    // Records (key, original position) with duplicate keys.
+    std::vector<std::pair<test_data_type, test_data_count>> records{};
+    for (test_data_count index = 0; index < array_values_elements_count; index++) {
+        records.emplace_back(array_values[index] % 3, index);
+    }
+
+    mergeSort(records, ComparatorLess<test_data_type>(), [](const auto& record) { return record.first; });
+
+    for (test_data_count index = 1; index < array_values_elements_count; index++) {
+        ASSERT_LE(records[index - 1].first, records[index].first);
+        if (records[index - 1].first == records[index].first) {
+            ASSERT_LT(records[index - 1].second, records[index].second) << "Equal keys changed their order.";
+        }
+    }
+}
+
+TEST_F(MergeSortTest, CachedKeysStable) {
+    // Records (key, original position) with duplicate keys.
+    std::vector<std::pair<test_data_type, test_data_count>> records{};
+    for (test_data_count index = 0; index < array_values_elements_count; index++) {
+        records.emplace_back(array_values[index] % 3, index);
+    }
+
+    test_data_count projections_count = 0;
+    mergeSortCachedKeys(records, ComparatorGreater<test_data_type>(), [&projections_count](const auto& record) {
+        projections_count++;
+        return record.first;
+    });
+
+    // Every key is computed once.
+    ASSERT_EQ(projections_count, array_values_elements_count);
+
+    for (test_data_count index = 1; index < array_values_elements_count; index++) {
+        ASSERT_GE(records[index - 1].first, records[index].first);
+        if (records[index - 1].first == records[index].first) {
+            ASSERT_LT(records[index - 1].second, records[index].second) << "Equal keys changed their order.";
+        }
+    }
+}
+
+TEST_F(MergeSortTest, Stats) {
+    using stats_type = CountingStats<struct MergeSortStatsTag>;
+    std::vector<test_data_type> vec(array_values, array_values + array_values_elements_count);
+    auto vec_plain = vec;
+
+    stats_type::reset();
+    mergeSort<stats_type>(vec, ComparatorLess<test_data_type>());
+    mergeSort(vec_plain, ComparatorLess<test_data_type>());
+
+    // The instrumentation doesn't change the result.
+    ASSERT_EQ(vec, vec_plain);
+
+    const auto stats = stats_type::snapshot();
+    ASSERT_GE(stats[StatsEvent::comparison], array_values_elements_count - 1);
+    ASSERT_NE(stats[StatsEvent::move], 0u);
+    ASSERT_NE(stats[StatsEvent::allocation], 0u);
+    ASSERT_EQ(NoStats::snapshot()[StatsEvent::comparison], 0u);
+
+    // The projection overload reports through the same policy.
+    stats_type::reset();
+    mergeSort<stats_type>(vec, ComparatorGreater<test_data_type>(), [](test_data_type value) { return value; });
+    ASSERT_GE(stats_type::snapshot()[StatsEvent::comparison], array_values_elements_count - 1);
 }
\ No newline at end of file
@@ -1,31 +1,48 @@
 #pragma once
 #include "swap.h"
 #include "comparators.h"
+#include "projection.h"
 
 using size_type = size_t;
 
-template<typename DataType, typename Comparator>
+template<typename Stats, typename DataType, typename Comparator>
 static CONSTEXPR20 void quickSortInternal(std::vector<DataType>& vec, size_type low, size_type high, Comparator comp);
-template<typename DataType, typename Comparator>
-static CONSTEXPR20 size_type partition(std::vector<DataType>& vec, size_type low, size_type high);
-template<typename DataType, typename Comparator>
+template<typename Stats, typename DataType, typename Comparator>
+static CONSTEXPR20 size_type partition(std::vector<DataType>& vec, size_type low, size_type high, Comparator comp);
+template<typename Stats, typename DataType, typename Comparator>
 NODISCARD static CONSTEXPR20 bool searchLessThanPivot(std::vector<DataType>& vec, DataType pivot, size_type index_search_greater, size_type high, Comparator comp);
 
-template<typename DataType, typename Comparator>
+// Not stable: equal elements may change their relative order. Use quickSortCachedKeys() for a stable order.
+template<typename Stats = NoStats, typename DataType, typename Comparator>
 CONSTEXPR20 void quickSort(std::vector<DataType>& vec, Comparator comp = ComparatorGreater<DataType>()) {
     const auto size = vec.size();
     if (size < 2) {
         return;
     }
 
-    quickSortInternal<DataType, Comparator>(vec, 0, size - 1, comp);
+    using counted_comparator = StatsComparator<Comparator, Stats>;
+    quickSortInternal<Stats, DataType, counted_comparator>(vec, 0, size - 1, counted_comparator{ comp });
 }
 
-template<typename DataType, typename Comparator>
+// Sort by projected keys: comp(proj(a), proj(b)).
+template<typename Stats = NoStats, typename DataType, typename Comparator, typename Projection>
+CONSTEXPR20 void quickSort(std::vector<DataType>& vec, Comparator comp, Projection proj) {
+    quickSort<Stats>(vec, ProjectedComparator<Comparator, Projection>{ comp, proj });
+}
+
+// Sort by projected keys computing every key once (decorate-sort-undecorate). Stable.
+template<typename Stats = NoStats, typename DataType, typename Comparator, typename Projection>
+CONSTEXPR20 void quickSortCachedKeys(std::vector<DataType>& vec, Comparator comp, Projection proj) {
+    sortByCachedKeys(vec, comp, proj, [](auto& keys, auto keys_comp) {
+        quickSort<Stats>(keys, keys_comp);
+    });
+}
+
+template<typename Stats, typename DataType, typename Comparator>
 static CONSTEXPR20 void quickSortInternal(std::vector<DataType>& vec, size_type low, size_type high, Comparator comp) {
     // Note: Check before call function faster than call and check inside function.
     // Sorting and separation.
-    const auto pivot_index = partition<DataType, Comparator>(vec, low, high, comp);
+    const auto pivot_index = partition<Stats, DataType, Comparator>(vec, low, high, comp);
 
     // Sorting left part.
     const auto new_high = pivot_index - 1;
@@ -33,16 +50,16 @@ static CONSTEXPR20 void quickSortInternal(std::vector<DataType>& vec, size_type
             pivot_index != 0 &&
             low < new_high
     ) {
-        quickSortInternal<DataType, Comparator>(vec, low, new_high, comp);
+        quickSortInternal<Stats, DataType, Comparator>(vec, low, new_high, comp);
     }
 
     // Sorting right part.
     if (pivot_index + 1 < high) {
-        quickSortInternal<DataType, Comparator>(vec, pivot_index + 1, high, comp);
+        quickSortInternal<Stats, DataType, Comparator>(vec, pivot_index + 1, high, comp);
     }
 }
 
-template<typename DataType, typename Comparator>
+template<typename Stats, typename DataType, typename Comparator>
 static CONSTEXPR20 size_type partition(std::vector<DataType>& vec, size_type low, size_type high, Comparator comp) {
     // Always choose the last element as the pivot.
     const auto pivot = vec[high];
@@ -51,7 +68,7 @@ static CONSTEXPR20 size_type partition(std::vector<DataType>& vec, size_type low
     for (size_type index_search_greater = low; index_search_greater < high; index_search_greater++) {
         if (!comp(vec[index_search_greater], pivot)) {
             second_pointer = index_search_greater;
-            if (!searchLessThanPivot<DataType, Comparator>(vec, pivot, index_search_greater, high, comp)) {
+            if (!searchLessThanPivot<Stats, DataType, Comparator>(vec, pivot, index_search_greater, high, comp)) {
                 return second_pointer;
             }
         }
@@ -61,17 +78,17 @@ static CONSTEXPR20 size_type partition(std::vector<DataType>& vec, size_type low
     return second_pointer;
 }
 
-template<typename DataType, typename Comparator>
+template<typename Stats, typename DataType, typename Comparator>
 NODISCARD static CONSTEXPR20 bool searchLessThanPivot(std::vector<DataType>& vec, DataType pivot, size_type index_search_greater, size_type high, Comparator comp) {
     for (size_type index_search_less = index_search_greater + 1; index_search_less < high; index_search_less++) {
         if (comp(vec[index_search_less], pivot)) {
             // swap the element which is greater than pivot with the element which is less than pivot.
-            swap(vec, index_search_greater, index_search_less);
+            swap<Stats>(vec, index_search_greater, index_search_less);
             return true;
         }
     }
 
     // No element less than pivot wasn't found. Swap the greater element with pivot.
-    swap(vec, index_search_greater, high);
+    swap<Stats>(vec, index_search_greater, high);
     return false;
 }
\ No newline at end of file
@@ -1,30 +1,48 @@
 #pragma once
 #include "swap.h"
 #include "comparators.h"
+#include "projection.h"
 
 using size_type = size_t;
 
-template<typename DataType, typename Comparator>
+// Not stable: equal elements may change their relative order. Use selectionSortCachedKeys() for a stable order.
+template<typename Stats = NoStats, typename DataType, typename Comparator>
 CONSTEXPR20 void selectionSort(std::vector<DataType>& vec, Comparator comp = ComparatorGreater<DataType>()) {
     const auto size = vec.size();
     if (size < 2) {
         return;
     }
 
+    const StatsComparator<Comparator, Stats> counted_comp{ comp };
+
     // Iterate over the array with a number equal to the size of the array minus one.
     for (size_type iteration = 0; iteration < size - 1; iteration++) {
         size_type smallest_element = iteration;
 
         // Search for the peak (minimum/maximum) element from all unsorted elements of each cell of the array.
         for (size_type sub_iteration = iteration + 1; sub_iteration < size; sub_iteration++) {
-            if (comp(vec[sub_iteration], vec[smallest_element])) {
+            if (counted_comp(vec[sub_iteration], vec[smallest_element])) {
                 smallest_element = sub_iteration;
             }
         }
 
         if (smallest_element != iteration) {
             // If a peak element is found, swap it with the element by the iteration index.
-            swap(vec, smallest_element, iteration);
+            swap<Stats>(vec, smallest_element, iteration);
         }
     }
+}
+
+// Sort by projected keys: comp(proj(a), proj(b)).
+template<typename Stats = NoStats, typename DataType, typename Comparator, typename Projection>
+CONSTEXPR20 void selectionSort(std::vector<DataType>& vec, Comparator comp, Projection proj) {
+    selectionSort<Stats>(vec, ProjectedComparator<Comparator, Projection>{ comp, proj });
+}
+
+// Sort by projected keys computing every key once (decorate-sort-undecorate). Stable.
+template<typename Stats = NoStats, typename DataType, typename Comparator, typename Projection>
+CONSTEXPR20 void selectionSortCachedKeys(std::vector<DataType>& vec, Comparator comp, Projection proj) {
+    sortByCachedKeys(vec, comp, proj, [](auto& keys, auto keys_comp) {
+        selectionSort<Stats>(keys, keys_comp);
+    });
 }
\ No newline at end of file
@@ -0,0 +1,89 @@
+// Memory and speed of the compact trees (32-bit index links, packed color/balance bits) against the shared_ptr trees.
+// Usage: CompactTreesBenchmark [elements count] [--perf] [--json=<file>]
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "redblacktree.h"
+#include "redblacktreecompact.h"
+#include "avltree.h"
+#include "avltreecompact.h"
+
+using bench_data_type = int;
+
+// Live bytes requested from operator new. Every block carries its size in front of it.
+namespace {
+    size_t allocated_bytes = 0;
+    constexpr size_t header_size = alignof(std::max_align_t);
+}
+
+void* operator new(size_t size) {
+    auto block = static_cast<char*>(std::malloc(size + header_size));
+    if (!block) {
+        throw std::bad_alloc{};
+    }
+
+    *reinterpret_cast<size_t*>(block) = size;
+    allocated_bytes += size;
+    return block + header_size;
+}
+
+void operator delete(void* pointer) noexcept {
+    if (pointer) {
+        auto block = static_cast<char*>(pointer) - header_size;
+        allocated_bytes -= *reinterpret_cast<size_t*>(block);
+        std::free(block);
+    }
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    operator delete(pointer);
+}
+
+namespace {
+    template<class Tree>
+    void runTree(BenchmarkRunner& runner, const std::string& name, const std::vector<bench_data_type>& values) {
+        {
+            const auto bytes_before = allocated_bytes;
+            Tree tree{ values };
+            const auto bytes_per_key = static_cast<double>(allocated_bytes - bytes_before) / static_cast<double>(values.size());
+            std::cout << "memory: " << name << ": " << std::fixed << std::setprecision(2) << bytes_per_key << " bytes per key" << std::endl;
+        }
+
+        runner.run("insert: " + name, values.size(), [&values]() {
+            Tree tree{ values };
+            doNotOptimize(tree);
+        });
+
+        const Tree tree{ values };
+        runner.run("search: " + name, values.size(), [&tree, &values]() {
+            size_t found = 0;
+            for (const auto value : values) {
+                found += tree.search(value) ? 1 : 0;
+            }
+            doNotOptimize(found);
+        });
+    }
+}
+
+int main(int argc, char** argv) {
+    const auto elements_count = benchmarkElementsCount(argc, argv, 1 << 20);
+
+    std::mt19937 generator{ 1337 };
+    std::vector<bench_data_type> values(elements_count);
+    for (auto& value : values) {
+        value = static_cast<bench_data_type>(generator());
+    }
+
+    BenchmarkRunner runner{ "Compact trees", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    runTree<RedBlackTreeLoop<bench_data_type>>(runner, "RedBlackTreeLoop", values);
+    runTree<RedBlackTreeCompact<bench_data_type>>(runner, "RedBlackTreeCompact", values);
+    runTree<AVLTreeLoop<bench_data_type>>(runner, "AVLTreeLoop", values);
+    runTree<AVLTreeCompact<bench_data_type>>(runner, "AVLTreeCompact", values);
+
+    return 0;
+}
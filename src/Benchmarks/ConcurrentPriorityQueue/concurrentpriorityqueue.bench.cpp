@@ -0,0 +1,120 @@
+// Throughput of the concurrent priority queues across thread counts.
+// Every thread alternates insert and remove on a prefilled queue.
+// Usage: ConcurrentPriorityQueueBenchmark [operations count] [--perf] [--json=<file>]
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "benchmark.h"
+#include "heap.h"
+#include "multiqueue.h"
+
+using bench_data_type = int;
+using bench_comparator = ComparatorLess<bench_data_type>;
+
+namespace {
+    // One Heap behind one global lock: the baseline.
+    class LockedHeap {
+    public:
+        void insert(bench_data_type value) {
+            std::lock_guard<std::mutex> lock{ mutex };
+            heap.insert(value);
+        }
+
+        bool tryRemove(bench_data_type& value) {
+            std::lock_guard<std::mutex> lock{ mutex };
+            if (heap.isEmpty()) {
+                return false;
+            }
+
+            value = heap.extract();
+            return true;
+        }
+
+    private:
+        std::mutex mutex{};
+        Heap<bench_data_type, bench_comparator> heap{};
+    };
+
+    template<class Queue>
+    void prefill(Queue& queue, size_t count) {
+        std::minstd_rand generator{ 1337 };
+        for (size_t index = 0; index < count; index++) {
+            queue.insert(static_cast<bench_data_type>(generator() % 1000000000));
+        }
+    }
+
+    template<class Queue>
+    void alternateInsertRemove(Queue& queue, size_t threads_count, size_t operations_count) {
+        std::vector<std::thread> threads{};
+        threads.reserve(threads_count);
+
+        for (size_t thread_index = 0; thread_index < threads_count; thread_index++) {
+            threads.emplace_back([&queue, thread_index, operations_per_thread = operations_count / threads_count]() {
+                std::minstd_rand generator{ static_cast<unsigned>(thread_index + 1) };
+                long long checksum = 0;
+                bench_data_type value{};
+
+                for (size_t index = 0; index < operations_per_thread; index += 2) {
+                    queue.insert(static_cast<bench_data_type>(generator() % 1000000000));
+                    if (queue.tryRemove(value)) {
+                        checksum += value;
+                    }
+                }
+
+                doNotOptimize(checksum);
+            });
+        }
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const auto operations_count = benchmarkElementsCount(argc, argv, 2000000);
+    const size_t prefill_count = 100000;
+    const size_t hardware_threads = std::thread::hardware_concurrency() != 0 ? std::thread::hardware_concurrency() : 1;
+
+    BenchmarkRunner runner{ "Concurrent priority queues", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    for (size_t threads_count = 1; threads_count <= 2 * hardware_threads; threads_count *= 2) {
+        const auto suffix = ", threads " + std::to_string(threads_count);
+
+        runner.run("locked Heap" + suffix, operations_count,
+            [prefill_count]() {
+                auto queue = std::make_unique<LockedHeap>();
+                prefill(*queue, prefill_count);
+                return queue;
+            },
+            [threads_count, operations_count](auto& queue) {
+                alternateInsertRemove(*queue, threads_count, operations_count);
+            });
+
+        // From strict to relaxed.
+        const std::vector<std::pair<std::string, std::pair<size_t, size_t>>> configurations{
+            { "MultiQueue strict (all choices)", { 4 * threads_count, 4 * threads_count } },
+            { "MultiQueue 4 choices", { 4 * threads_count, 4 } },
+            { "MultiQueue 2 choices", { 4 * threads_count, 2 } },
+        };
+
+        for (const auto& [name, configuration] : configurations) {
+            const auto [shards_count, choices] = configuration;
+            runner.run(name + suffix, operations_count,
+                [prefill_count, shards_count = shards_count, choices = choices]() {
+                    auto queue = std::make_unique<MultiQueue<bench_data_type, bench_comparator>>(shards_count, choices);
+                    prefill(*queue, prefill_count);
+                    return queue;
+                },
+                [threads_count, operations_count](auto& queue) {
+                    alternateInsertRemove(*queue, threads_count, operations_count);
+                });
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+// Frozen Eytzinger index vs search() on the live trees.
+// Usage: EytzingerIndexBenchmark [elements count] [--perf] [--json=<file>]
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "benchmark.h"
+#include "redblacktree.h"
+#include "avltree.h"
+#include "eytzingerindex.h"
+
+using bench_data_type = int;
+
+namespace {
+    template<class Search>
+    void searchAll(const std::vector<bench_data_type>& queries, Search search) {
+        size_t found = 0;
+        for (const auto query : queries) {
+            found += search(query) ? 1 : 0;
+        }
+
+        doNotOptimize(found);
+    }
+}
+
+int main(int argc, char** argv) {
+    const auto elements_count = benchmarkElementsCount(argc, argv, 1 << 20);
+
+    // Even keys are stored, odd queries are misses: half of the queries hit.
+    std::mt19937 generator{ 1337 };
+    std::vector<bench_data_type> keys(elements_count);
+    for (auto& key : keys) {
+        key = static_cast<bench_data_type>(generator() % (4 * elements_count)) & ~1;
+    }
+
+    std::vector<bench_data_type> queries(elements_count);
+    for (size_t index = 0; index < elements_count; index++) {
+        queries[index] = index % 2 ? keys[generator() % elements_count] : static_cast<bench_data_type>(generator() % (4 * elements_count)) | 1;
+    }
+
+    RedBlackTreeLoop<bench_data_type> rbtree{ keys };
+    AVLTreeLoop<bench_data_type> avltree{ keys };
+
+    BenchmarkRunner runner{ "Eytzinger index", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    runner.run("build: EytzingerIndex::fromTree", elements_count, [&rbtree]() {
+        auto index = EytzingerIndex<bench_data_type>::fromTree(rbtree);
+        doNotOptimize(index.size());
+    });
+
+    const auto index = EytzingerIndex<bench_data_type>::fromTree(rbtree);
+    std::vector<bench_data_type> sorted{};
+    rbtree.forEachInOrder([&sorted](const bench_data_type& key) { sorted.push_back(key); });
+
+    runner.run("search: RedBlackTreeLoop", elements_count, [&queries, &rbtree]() {
+        searchAll(queries, [&rbtree](bench_data_type key) { return rbtree.search(key); });
+    });
+    runner.run("search: AVLTreeLoop", elements_count, [&queries, &avltree]() {
+        searchAll(queries, [&avltree](bench_data_type key) { return avltree.search(key); });
+    });
+    runner.run("search: std::binary_search on sorted array", elements_count, [&queries, &sorted]() {
+        searchAll(queries, [&sorted](bench_data_type key) { return std::binary_search(sorted.begin(), sorted.end(), key); });
+    });
+    runner.run("search: EytzingerIndex", elements_count, [&queries, &index]() {
+        searchAll(queries, [&index](bench_data_type key) { return index.search(key); });
+    });
+
+    return 0;
+}
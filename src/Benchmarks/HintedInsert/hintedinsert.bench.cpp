@@ -0,0 +1,136 @@
+// Append-mostly insert streams into AVLTreeLoop and RedBlackTreeLoop: the plain insert with the finger
+// of the last insert, the hint at end() and the hint at the last inserted key. Random keys are the control.
+// The key comparisons per insert are counted in a separate pass with CountingStats.
+// Usage: HintedInsertBenchmark [elements count] [--perf] [--json=<file>]
+#include <random>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "stats.h"
+#include "redblacktree.h"
+#include "avltree.h"
+
+using bench_data_type = int;
+
+namespace {
+    std::vector<bench_data_type> makeAppend(size_t count) {
+        std::vector<bench_data_type> keys(count);
+        for (size_t index = 0; index < count; index++) {
+            keys[index] = static_cast<bench_data_type>(index);
+        }
+
+        return keys;
+    }
+
+    // Timestamps which arrive up to about 8 positions out of order.
+    std::vector<bench_data_type> makeJittered(size_t count, std::mt19937& generator) {
+        std::vector<bench_data_type> keys(count);
+        for (size_t index = 0; index < count; index++) {
+            keys[index] = static_cast<bench_data_type>(index * 8 + generator() % 64);
+        }
+
+        return keys;
+    }
+
+    // Appends and 5% of late keys up to 1024 positions back.
+    std::vector<bench_data_type> makeLateArrivals(size_t count, std::mt19937& generator) {
+        std::vector<bench_data_type> keys(count);
+        for (size_t index = 0; index < count; index++) {
+            const auto time = static_cast<bench_data_type>(index * 2);
+            keys[index] = generator() % 100 < 5 ? time - static_cast<bench_data_type>(generator() % 2048) : time;
+        }
+
+        return keys;
+    }
+
+    std::vector<bench_data_type> makeRandom(size_t count, std::mt19937& generator) {
+        std::vector<bench_data_type> keys(count);
+        for (auto& key : keys) {
+            key = static_cast<bench_data_type>(generator());
+        }
+
+        return keys;
+    }
+
+    enum class Mode { finger, hint_end, hint_last };
+
+    template<class Tree>
+    void insertKeys(Tree& tree, const std::vector<bench_data_type>& keys, Mode mode) {
+        switch (mode) {
+            case Mode::finger:
+                for (const auto key : keys) {
+                    tree.insert(key);
+                }
+                break;
+            case Mode::hint_end:
+                for (const auto key : keys) {
+                    doNotOptimize(tree.insert(tree.end(), key));
+                }
+                break;
+            case Mode::hint_last: {
+                auto hint = tree.end();
+                for (const auto key : keys) {
+                    hint = tree.insert(hint, key);
+                }
+                break;
+            }
+        }
+    }
+
+    using stats_type = CountingStats<struct HintedInsertBenchmarkTag>;
+
+    // CountedTree is Tree with stats_type.
+    template<class Tree, class CountedTree>
+    void runTree(BenchmarkRunner& runner, const std::string& name, const std::string& stream_name,
+                 const std::vector<bench_data_type>& keys) {
+        const std::pair<Mode, std::string> modes[] = {
+            { Mode::finger, "insert(key)" },
+            { Mode::hint_end, "insert(end(), key)" },
+            { Mode::hint_last, "insert(last, key)" }
+        };
+
+        for (const auto& [mode, mode_name] : modes) {
+            const auto run_name = stream_name + ": " + name + " " + mode_name;
+            {
+                CountedTree tree{};
+                stats_type::reset();
+                insertKeys(tree, keys, mode);
+                const auto stats = stats_type::snapshot();
+                std::cout << "comparisons: " << run_name << ": " << std::fixed << std::setprecision(3)
+                          << static_cast<double>(stats[StatsEvent::comparison]) / static_cast<double>(keys.size())
+                          << " per insert" << std::endl;
+            }
+
+            runner.run(run_name, keys.size(), []() {
+                return Tree{};
+            }, [&keys, mode](Tree& tree) {
+                insertKeys(tree, keys, mode);
+                doNotOptimize(tree);
+            });
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const auto elements_count = benchmarkElementsCount(argc, argv, 1 << 18);
+
+    std::mt19937 generator{ 1337 };
+    const std::pair<std::string, std::vector<bench_data_type>> streams[] = {
+        { "append", makeAppend(elements_count) },
+        { "jittered", makeJittered(elements_count, generator) },
+        { "late arrivals 5%", makeLateArrivals(elements_count, generator) },
+        { "random", makeRandom(elements_count, generator) }
+    };
+
+    BenchmarkRunner runner{ "Hinted insert", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    for (const auto& [stream_name, keys] : streams) {
+        runTree<AVLTreeLoop<bench_data_type>, AVLTreeLoop<bench_data_type, size_t, stats_type>>(
+                runner, "AVLTreeLoop", stream_name, keys);
+        runTree<RedBlackTreeLoop<bench_data_type>, RedBlackTreeLoop<bench_data_type, size_t, stats_type>>(
+                runner, "RedBlackTreeLoop", stream_name, keys);
+    }
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+// MappedBPlusTree in a temporary file against RedBlackTreeLoop in memory: random inserts with a commit per update
+// and with batched commits, and random searches in an index opened just before them.
+// Usage: MappedBPlusTreeBenchmark [elements count] [--perf] [--json=<file>]
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "benchmark.h"
+#include "mappedbplustree.h"
+#include "redblacktree.h"
+
+using bench_data_type = int;
+
+int main(int argc, char** argv) {
+    const auto elements_count = benchmarkElementsCount(argc, argv, 1 << 18);
+    const auto path = (std::filesystem::temp_directory_path() / ("mappedbplustree_bench_" + std::to_string(::getpid()))).string();
+
+    std::mt19937 generator{ 1337 };
+    std::vector<bench_data_type> values(elements_count);
+    for (auto& value : values) {
+        value = static_cast<bench_data_type>(generator());
+    }
+
+    BenchmarkRunner runner{ "MappedBPlusTree", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    runner.run("insert: RedBlackTreeLoop", values.size(), [&values]() {
+        RedBlackTreeLoop<bench_data_type> tree{};
+        for (const auto value : values) {
+            tree.insert(value);
+        }
+        doNotOptimize(tree.getRoot());
+    });
+
+    // A commit flushes the pages of the transaction: the batches share the flushes and the copies of the pages.
+    for (const size_t commit_every : { 1, 64, 4096, 0 }) {
+        // The commit per update is measured on a part of the keys.
+        const auto inserts_count = commit_every == 1 ? std::min<size_t>(values.size(), 4096) : values.size();
+        const auto name = commit_every == 0 ? std::string{ "one commit" } : "commit every " + std::to_string(commit_every);
+        runner.run("insert: MappedBPlusTree, " + name, inserts_count, [&values, &path, commit_every, inserts_count]() {
+            std::filesystem::remove(path);
+            MappedBPlusTree<bench_data_type> tree{ path, commit_every };
+            for (size_t index = 0; index < inserts_count; index++) {
+                tree.insert(values[index]);
+            }
+            tree.commit();
+        });
+    }
+
+    std::vector<bench_data_type> keys_search(values);
+    std::shuffle(keys_search.begin(), keys_search.end(), generator);
+    {
+        const RedBlackTreeLoop<bench_data_type> tree{ values };
+        runner.run("search: RedBlackTreeLoop", keys_search.size(), [&tree, &keys_search]() {
+            size_t found = 0;
+            for (const auto key : keys_search) {
+                found += tree.search(key);
+            }
+            doNotOptimize(found);
+        });
+    }
+
+    // The file is mapped anew for every run: the searches load the pages they touch.
+    runner.run("search: MappedBPlusTree, open + search", keys_search.size(), [&path, &keys_search]() {
+        const MappedBPlusTree<bench_data_type> tree{ path };
+        size_t found = 0;
+        for (const auto key : keys_search) {
+            found += tree.search(key);
+        }
+        doNotOptimize(found);
+    });
+
+    std::filesystem::remove(path);
+    return 0;
+}
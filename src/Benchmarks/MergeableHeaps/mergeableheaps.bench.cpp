@@ -0,0 +1,137 @@
+// Binary heap vs pairing heap vs Fibonacci heap.
+// Usage: MergeableHeapsBenchmark [elements count] [--perf] [--json=<file>]
+#include <random>
+#include <vector>
+#include "benchmark.h"
+#include "heap.h"
+#include "pairingheap.h"
+#include "fibonacciheap.h"
+
+using bench_data_type = int;
+using bench_comparator = ComparatorLess<bench_data_type>;
+
+namespace {
+    // Count of heaps in the meld benchmark.
+    constexpr size_t meld_heaps_count = 64;
+
+    std::vector<bench_data_type> makeValues(size_t count, unsigned seed) {
+        std::mt19937 generator{ seed };
+        std::vector<bench_data_type> values(count);
+        for (auto& value : values) {
+            value = static_cast<bench_data_type>(generator() % 1000000000);
+        }
+
+        return values;
+    }
+
+    // Insert all values, then pop all of them.
+    template<class HeapType, class Pop>
+    void insertPopAll(const std::vector<bench_data_type>& values, Pop pop) {
+        HeapType heap{};
+        for (const auto value : values) {
+            heap.insert(value);
+        }
+
+        long long checksum = 0;
+        while (!heap.isEmpty()) {
+            checksum += heap.peek();
+            pop(heap);
+        }
+
+        doNotOptimize(checksum);
+    }
+
+    // Split the values into meld_heaps_count heaps.
+    template<class HeapType>
+    std::vector<HeapType> makeHeaps(const std::vector<bench_data_type>& values) {
+        std::vector<HeapType> heaps(meld_heaps_count);
+        for (size_t index = 0; index < values.size(); index++) {
+            heaps[index % meld_heaps_count].insert(values[index]);
+        }
+
+        return heaps;
+    }
+
+    // Insert all values, then decrease every second one below its current value and pop half of the heap.
+    template<class HeapType>
+    void decreaseKeyPopHalf(const std::vector<bench_data_type>& values) {
+        HeapType heap{};
+        std::vector<typename HeapType::Handle> handles{};
+        handles.reserve(values.size());
+        for (const auto value : values) {
+            handles.push_back(heap.insert(value));
+        }
+
+        // Pop once so the heaps have a real structure before the decrease.
+        heap.remove();
+        for (size_t index = 1; index < handles.size(); index += 2) {
+            heap.decreaseKey(handles[index], handles[index].value() / 2);
+        }
+
+        long long checksum = 0;
+        for (size_t index = 0; index < values.size() / 2; index++) {
+            checksum += heap.peek();
+            heap.remove();
+        }
+
+        doNotOptimize(checksum);
+    }
+}
+
+int main(int argc, char** argv) {
+    const auto elements_count = benchmarkElementsCount(argc, argv, 200000);
+    const auto values = makeValues(elements_count, 1337);
+
+    using binary_heap_type = Heap<bench_data_type, bench_comparator>;
+    using pairing_heap_type = PairingHeap<bench_data_type, bench_comparator>;
+    using fibonacci_heap_type = FibonacciHeap<bench_data_type, bench_comparator>;
+
+    BenchmarkRunner runner{ "Mergeable heaps", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    // Insert and pop.
+    runner.run("insert + pop: Heap", elements_count, [&values]() {
+        insertPopAll<binary_heap_type>(values, [](auto& heap) { heap.remove(0); });
+    });
+    runner.run("insert + pop: PairingHeap", elements_count, [&values]() {
+        insertPopAll<pairing_heap_type>(values, [](auto& heap) { heap.remove(); });
+    });
+    runner.run("insert + pop: FibonacciHeap", elements_count, [&values]() {
+        insertPopAll<fibonacci_heap_type>(values, [](auto& heap) { heap.remove(); });
+    });
+
+    // Meld of many heaps.
+    ThreadPool pool{ 1 };
+    runner.run("meld 64 heaps: Heap::mergeHeaps", elements_count,
+        [&values]() { return makeHeaps<binary_heap_type>(values); },
+        [&pool](auto& heaps) {
+            auto merged = binary_heap_type::mergeHeaps(heaps, pool);
+            doNotOptimize(merged.peek());
+        });
+    runner.run("meld 64 heaps: PairingHeap::meld", elements_count,
+        [&values]() { return makeHeaps<pairing_heap_type>(values); },
+        [](auto& heaps) {
+            for (size_t index = 1; index < heaps.size(); index++) {
+                heaps[0].meld(heaps[index]);
+            }
+            doNotOptimize(heaps[0].peek());
+        });
+    runner.run("meld 64 heaps: FibonacciHeap::meld", elements_count,
+        [&values]() { return makeHeaps<fibonacci_heap_type>(values); },
+        [](auto& heaps) {
+            for (size_t index = 1; index < heaps.size(); index++) {
+                heaps[0].meld(heaps[index]);
+            }
+            doNotOptimize(heaps[0].peek());
+        });
+
+    // Decrease key, the binary heap has no handles.
+    runner.run("decreaseKey + pop half: PairingHeap", elements_count, [&values]() {
+        decreaseKeyPopHalf<pairing_heap_type>(values);
+    });
+    runner.run("decreaseKey + pop half: FibonacciHeap", elements_count, [&values]() {
+        decreaseKeyPopHalf<fibonacci_heap_type>(values);
+    });
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+// Aggregation over every key of RedBlackTreeLoop: the serial in-order walk against the parallel traversals
+// on 1, 2, 4, ... threads. A sum (parallelReduce) and an ordered export into a vector (parallelExport).
+// Usage: ParallelTraversalBenchmark [elements count] [--perf] [--json=<file>]
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "benchmark.h"
+#include "redblacktree.h"
+
+using bench_data_type = int;
+
+int main(int argc, char** argv) {
+    const auto elements_count = benchmarkElementsCount(argc, argv, 1 << 22);
+    const size_t hardware_threads = std::thread::hardware_concurrency() != 0 ? std::thread::hardware_concurrency() : 1;
+
+    std::mt19937 generator{ 1337 };
+    std::vector<bench_data_type> values(elements_count);
+    for (auto& value : values) {
+        value = static_cast<bench_data_type>(generator());
+    }
+
+    // Inserted in random order: the nodes are spread over the heap like in a long-lived tree.
+    const RedBlackTreeLoop<bench_data_type> tree{ values };
+
+    BenchmarkRunner runner{ "Parallel traversal", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    runner.run("sum: forEachInOrder", elements_count, [&tree]() {
+        long long sum = 0;
+        tree.forEachInOrder([&sum](bench_data_type key) {
+            sum += key;
+        });
+        doNotOptimize(sum);
+    });
+    runner.run("export: forEachInOrder + push_back", elements_count, [&tree]() {
+        std::vector<bench_data_type> keys{};
+        tree.forEachInOrder([&keys](bench_data_type key) {
+            keys.push_back(key);
+        });
+        doNotOptimize(keys.data());
+    });
+
+    for (size_t pool_threads = 1; pool_threads <= hardware_threads; pool_threads *= 2) {
+        const auto suffix = ", threads " + std::to_string(pool_threads);
+        ThreadPool pool{ pool_threads };
+        runner.run("sum: parallelReduce" + suffix, elements_count, [&tree, &pool]() {
+            const auto sum = tree.parallelReduce(0LL, [](long long result, long long value) {
+                return result + value;
+            }, pool);
+            doNotOptimize(sum);
+        });
+        runner.run("export: parallelExport" + suffix, elements_count, [&tree, &pool]() {
+            const auto keys = tree.parallelExport(pool);
+            doNotOptimize(keys.data());
+        });
+    }
+
+    return 0;
+}
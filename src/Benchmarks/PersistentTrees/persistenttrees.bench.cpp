@@ -0,0 +1,162 @@
+// Version churn: a stream of random inserts and deletes, every update makes a new version and the last K versions
+// stay alive, like the point-in-time views of readers. Live bytes of the kept versions against one version, for the
+// persistent AVL and red-black trees and the snapshot() of AVLTreeRecursion. The time per update against the
+// in-place updates of AVLTreeRecursion.
+// Usage: PersistentTreesBenchmark [elements count] [--perf] [--json=<file>]
+#include <cstdlib>
+#include <deque>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "avltree.h"
+#include "avltreepersistent.h"
+#include "redblacktreepersistent.h"
+
+using bench_data_type = int;
+
+// Live bytes requested from operator new. Every block carries its size in front of it.
+namespace {
+    size_t allocated_bytes = 0;
+    constexpr size_t header_size = alignof(std::max_align_t);
+}
+
+void* operator new(size_t size) {
+    auto block = static_cast<char*>(std::malloc(size + header_size));
+    if (!block) {
+        throw std::bad_alloc{};
+    }
+
+    *reinterpret_cast<size_t*>(block) = size;
+    allocated_bytes += size;
+    return block + header_size;
+}
+
+void operator delete(void* pointer) noexcept {
+    if (pointer) {
+        auto block = static_cast<char*>(pointer) - header_size;
+        allocated_bytes -= *reinterpret_cast<size_t*>(block);
+        std::free(block);
+    }
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    operator delete(pointer);
+}
+
+namespace {
+    struct Update {
+        bench_data_type key{};
+        bool insert{};
+    };
+
+    // Inserts of new keys and deletes of the keys of the tree, one by one.
+    std::vector<Update> makeUpdates(const std::vector<bench_data_type>& values, size_t count, std::mt19937& generator) {
+        std::vector<Update> updates(count);
+        for (size_t index = 0; index < count; index++) {
+            updates[index] = index % 2 == 0
+                    ? Update{ static_cast<bench_data_type>(generator()), true }
+                    : Update{ values[generator() % values.size()], false };
+        }
+
+        return updates;
+    }
+
+    template<class Tree>
+    Tree nextPersistentVersion(const Tree& tree, const Update& update) {
+        return update.insert ? tree.insert(update.key) : tree.deleteValue(update.key);
+    }
+
+    AVLTreeRecursion<bench_data_type> nextSnapshotVersion(const AVLTreeRecursion<bench_data_type>& tree, const Update& update) {
+        auto version = tree.snapshot();
+        if (update.insert) {
+            version.insert(update.key);
+        } else {
+            version.deleteValue(update.key);
+        }
+
+        return version;
+    }
+
+    // The first pass keeps only the last version: the bytes of one version at the end of the stream.
+    template<class Tree, class NextVersion>
+    void reportMemory(const std::string& name, const std::vector<bench_data_type>& values,
+                      const std::vector<Update>& updates, NextVersion&& next_version) {
+        size_t bytes_version = 0;
+        for (const size_t kept_count : { 1, 16, 256, 4096 }) {
+            const auto bytes_before = allocated_bytes;
+            std::deque<Tree> versions{};
+            versions.emplace_back(values);
+            for (const auto& update : updates) {
+                versions.push_back(next_version(versions.back(), update));
+                if (versions.size() > kept_count) {
+                    versions.pop_front();
+                }
+            }
+
+            const auto bytes_kept = allocated_bytes - bytes_before;
+            if (versions.size() == 1) {
+                bytes_version = bytes_kept;
+                std::cout << "memory: " << name << ", 1 version: " << bytes_version << " bytes" << std::endl;
+                continue;
+            }
+
+            std::cout << "memory: " << name << ", " << versions.size() << " versions: " << std::fixed << std::setprecision(2)
+                      << static_cast<double>(bytes_kept) / static_cast<double>(bytes_version) << "x one version, "
+                      << static_cast<double>(bytes_kept - bytes_version) / static_cast<double>(versions.size() - 1)
+                      << " bytes per extra version" << std::endl;
+        }
+    }
+
+    template<class Tree, class NextVersion>
+    void runTree(BenchmarkRunner& runner, const std::string& name, const std::vector<bench_data_type>& values,
+                 const std::vector<Update>& updates, NextVersion next_version) {
+        reportMemory<Tree>(name, values, updates, next_version);
+
+        runner.run("updates: " + name, updates.size(), [&values]() {
+            return Tree{ values };
+        }, [&updates, &next_version](Tree& tree) {
+            for (const auto& update : updates) {
+                tree = next_version(tree, update);
+            }
+            doNotOptimize(tree);
+        });
+    }
+}
+
+int main(int argc, char** argv) {
+    const auto elements_count = benchmarkElementsCount(argc, argv, 1 << 16);
+
+    std::mt19937 generator{ 1337 };
+    std::vector<bench_data_type> values(elements_count);
+    for (auto& value : values) {
+        value = static_cast<bench_data_type>(generator());
+    }
+    const auto updates = makeUpdates(values, elements_count, generator);
+
+    BenchmarkRunner runner{ "Persistent trees", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    runTree<AVLTreePersistent<bench_data_type>>(runner, "AVLTreePersistent", values, updates,
+                                                nextPersistentVersion<AVLTreePersistent<bench_data_type>>);
+    runTree<RedBlackTreePersistent<bench_data_type>>(runner, "RedBlackTreePersistent", values, updates,
+                                                     nextPersistentVersion<RedBlackTreePersistent<bench_data_type>>);
+    runTree<AVLTreeRecursion<bench_data_type>>(runner, "AVLTreeRecursion snapshot()", values, updates, nextSnapshotVersion);
+
+    // The baseline without versions.
+    runner.run("updates: AVLTreeRecursion in place", updates.size(), [&values]() {
+        return AVLTreeRecursion<bench_data_type>{ values };
+    }, [&updates](AVLTreeRecursion<bench_data_type>& tree) {
+        for (const auto& update : updates) {
+            if (update.insert) {
+                tree.insert(update.key);
+            } else {
+                tree.deleteValue(update.key);
+            }
+        }
+        doNotOptimize(tree);
+    });
+
+    return 0;
+}
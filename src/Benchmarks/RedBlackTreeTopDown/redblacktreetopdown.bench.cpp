@@ -0,0 +1,70 @@
+// Top-down single-pass red-black tree against the bottom-up ones: RedBlackTreeLoop (shared_ptr nodes with parent links)
+// and RedBlackTreeCompact (the same index pool nodes, fixup on the way up from a path stack).
+// Usage: RedBlackTreeTopDownBenchmark [elements count] [--perf] [--json=<file>]
+#include <random>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "redblacktree.h"
+#include "redblacktreecompact.h"
+#include "redblacktreetopdown.h"
+
+using bench_data_type = int;
+
+namespace {
+    template<class Tree>
+    void runTree(BenchmarkRunner& runner, const std::string& name,
+                 const std::vector<bench_data_type>& values, const std::vector<bench_data_type>& sorted_values) {
+        runner.run("insert random: " + name, values.size(), [&values]() {
+            Tree tree{ values };
+            doNotOptimize(tree);
+        });
+
+        runner.run("insert sorted: " + name, sorted_values.size(), [&sorted_values]() {
+            Tree tree{ sorted_values };
+            doNotOptimize(tree);
+        });
+
+        const Tree tree{ values };
+        runner.run("search: " + name, values.size(), [&tree, &values]() {
+            size_t found = 0;
+            for (const auto value : values) {
+                found += tree.search(value) ? 1 : 0;
+            }
+            doNotOptimize(found);
+        });
+
+        // The build is part of the case, the insert cases above give its share.
+        runner.run("insert + delete: " + name, values.size(), [&values]() {
+            Tree tree{ values };
+            for (const auto value : values) {
+                tree.deleteValue(value);
+            }
+            doNotOptimize(tree);
+        });
+    }
+}
+
+int main(int argc, char** argv) {
+    const auto elements_count = benchmarkElementsCount(argc, argv, 1 << 20);
+
+    std::mt19937 generator{ 1337 };
+    std::vector<bench_data_type> values(elements_count);
+    for (auto& value : values) {
+        value = static_cast<bench_data_type>(generator());
+    }
+
+    std::vector<bench_data_type> sorted_values(elements_count);
+    for (size_t index = 0; index < elements_count; index++) {
+        sorted_values[index] = static_cast<bench_data_type>(index);
+    }
+
+    BenchmarkRunner runner{ "Red-black tree top-down", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    runTree<RedBlackTreeLoop<bench_data_type>>(runner, "RedBlackTreeLoop", values, sorted_values);
+    runTree<RedBlackTreeCompact<bench_data_type>>(runner, "RedBlackTreeCompact", values, sorted_values);
+    runTree<RedBlackTreeTopDown<bench_data_type>>(runner, "RedBlackTreeTopDown", values, sorted_values);
+
+    return 0;
+}
@@ -0,0 +1,82 @@
+// Restart of a RedBlackTreeLoop and a Heap: rebuilding by inserting the keys one by one against reading a binary
+// snapshot (snapshot.h) from a temporary file, which builds the tree without comparisons and adopts the heap array.
+// Usage: SnapshotBenchmark [elements count] [--perf] [--json=<file>]
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "benchmark.h"
+#include "heap.h"
+#include "redblacktree.h"
+
+using bench_data_type = int;
+
+int main(int argc, char** argv) {
+    const auto elements_count = benchmarkElementsCount(argc, argv, 1 << 20);
+
+    std::mt19937 generator{ 1337 };
+    std::vector<bench_data_type> values(elements_count);
+    for (auto& value : values) {
+        value = static_cast<bench_data_type>(generator());
+    }
+
+    const RedBlackTreeLoop<bench_data_type> tree{ values };
+    const Heap<bench_data_type> heap{ values.data(), values.data() + values.size() };
+    std::FILE* tree_file = std::tmpfile();
+    std::FILE* heap_file = std::tmpfile();
+    if (!tree_file || !heap_file) {
+        std::cerr << "Can't create the temporary files." << std::endl;
+        return 1;
+    }
+
+    const auto tree_descriptor = snapshot_io::fileDescriptor(tree_file);
+    const auto heap_descriptor = snapshot_io::fileDescriptor(heap_file);
+
+    BenchmarkRunner runner{ "Snapshot", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    // The tree keys come in ascending order like in a text dump of the tree.
+    std::vector<bench_data_type> keys_sorted{};
+    tree.forEachInOrder([&keys_sorted](bench_data_type key) {
+        keys_sorted.push_back(key);
+    });
+    runner.run("tree: insert the sorted keys", keys_sorted.size(), [&keys_sorted]() {
+        const RedBlackTreeLoop<bench_data_type> tree_rebuilt{ keys_sorted };
+        doNotOptimize(tree_rebuilt.getRoot());
+    });
+    runner.run("tree: fromSorted", keys_sorted.size(), [&keys_sorted]() {
+        const auto tree_rebuilt = RedBlackTreeLoop<bench_data_type>::fromSorted(keys_sorted.data(), keys_sorted.data() + keys_sorted.size());
+        doNotOptimize(tree_rebuilt.getRoot());
+    });
+    runner.run("tree: writeSnapshot", keys_sorted.size(), [&tree, tree_descriptor]() {
+        snapshot_io::truncate(tree_descriptor, 0);
+        snapshot_io::seek(tree_descriptor, 0);
+        tree.writeSnapshot(tree_descriptor);
+    });
+    runner.run("tree: readSnapshot", keys_sorted.size(), [tree_descriptor]() {
+        snapshot_io::seek(tree_descriptor, 0);
+        const auto tree_restored = RedBlackTreeLoop<bench_data_type>::readSnapshot(tree_descriptor);
+        doNotOptimize(tree_restored.getRoot());
+    });
+
+    runner.run("heap: insert the array", values.size(), [&values]() {
+        Heap<bench_data_type> heap_rebuilt{ values.size() };
+        for (const auto value : values) {
+            heap_rebuilt.insert(value);
+        }
+        doNotOptimize(heap_rebuilt.peek());
+    });
+    runner.run("heap: writeSnapshot", values.size(), [&heap, heap_descriptor]() {
+        snapshot_io::truncate(heap_descriptor, 0);
+        snapshot_io::seek(heap_descriptor, 0);
+        heap.writeSnapshot(heap_descriptor);
+    });
+    runner.run("heap: readSnapshot", values.size(), [heap_descriptor]() {
+        snapshot_io::seek(heap_descriptor, 0);
+        const auto heap_restored = Heap<bench_data_type>::readSnapshot(heap_descriptor);
+        doNotOptimize(heap_restored.peek());
+    });
+
+    std::fclose(tree_file);
+    std::fclose(heap_file);
+    return 0;
+}
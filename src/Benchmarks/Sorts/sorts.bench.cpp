@@ -0,0 +1,48 @@
+// The O(n log n) sorts against std::sort on random keys.
+// Usage: SortsBenchmark [elements count] [--perf] [--json=<file>]
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "benchmark.h"
+#include "heapsort.h"
+#include "mergesort.h"
+#include "quicksort.h"
+
+using bench_data_type = int;
+
+int main(int argc, char** argv) {
+    // quickSort scans ahead for every element greater than the pivot, random keys make it far slower than the others.
+    const auto elements_count = benchmarkElementsCount(argc, argv, 1 << 17);
+
+    std::mt19937 generator{ 1337 };
+    std::vector<bench_data_type> values(elements_count);
+    for (auto& value : values) {
+        value = static_cast<bench_data_type>(generator());
+    }
+
+    BenchmarkRunner runner{ "Sorts", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    const auto setup = [&values]() {
+        return values;
+    };
+
+    runner.run("std::sort", elements_count, setup, [](auto& vec) {
+        std::sort(vec.begin(), vec.end());
+        doNotOptimize(vec.front());
+    });
+    runner.run("heapSort", elements_count, setup, [](auto& vec) {
+        heapSort(vec, ComparatorLess<bench_data_type>());
+        doNotOptimize(vec.front());
+    });
+    runner.run("mergeSort", elements_count, setup, [](auto& vec) {
+        mergeSort(vec, ComparatorLess<bench_data_type>());
+        doNotOptimize(vec.front());
+    });
+    runner.run("quickSort", elements_count, setup, [](auto& vec) {
+        quickSort(vec, ComparatorLess<bench_data_type>());
+        doNotOptimize(vec.front());
+    });
+
+    return 0;
+}
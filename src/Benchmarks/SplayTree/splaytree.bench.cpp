@@ -0,0 +1,90 @@
+// Splay tree against AVLTreeLoop for lookups with uniform and Zipfian key popularity.
+// With the Zipf exponent 1.2 about 90% of the lookups go to 1% of the keys.
+// Usage: SplayTreeBenchmark [elements count] [--perf] [--json=<file>]
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "avltree.h"
+#include "splaytree.h"
+
+using bench_data_type = int;
+
+namespace {
+    // Lookups of keys where the key of rank r is drawn with the probability proportional to 1 / r^exponent.
+    std::vector<bench_data_type> makeZipfianLookups(const std::vector<bench_data_type>& keys, size_t count,
+                                                    double exponent, std::mt19937& generator) {
+        std::vector<double> cumulative(keys.size());
+        double sum = 0.0;
+        for (size_t rank = 0; rank < keys.size(); rank++) {
+            sum += 1.0 / std::pow(static_cast<double>(rank + 1), exponent);
+            cumulative[rank] = sum;
+        }
+
+        std::uniform_real_distribution<double> distribution{ 0.0, sum };
+        std::vector<bench_data_type> lookups(count);
+        for (auto& lookup : lookups) {
+            const auto it = std::lower_bound(cumulative.begin(), cumulative.end(), distribution(generator));
+            const auto rank = std::min(static_cast<size_t>(it - cumulative.begin()), keys.size() - 1);
+            lookup = keys[rank];
+        }
+
+        return lookups;
+    }
+
+    std::vector<bench_data_type> makeUniformLookups(const std::vector<bench_data_type>& keys, size_t count, std::mt19937& generator) {
+        std::vector<bench_data_type> lookups(count);
+        for (auto& lookup : lookups) {
+            lookup = keys[generator() % keys.size()];
+        }
+
+        return lookups;
+    }
+
+    template<class Tree>
+    void runSearch(BenchmarkRunner& runner, const std::string& name, Tree& tree, const std::vector<bench_data_type>& lookups) {
+        runner.run(name, lookups.size(), [&tree, &lookups]() {
+            size_t found = 0;
+            for (const auto value : lookups) {
+                found += tree.search(value) ? 1 : 0;
+            }
+            doNotOptimize(found);
+        });
+    }
+}
+
+int main(int argc, char** argv) {
+    const auto elements_count = benchmarkElementsCount(argc, argv, 1 << 20);
+
+    // The keys in random order: the rank of a key is its position, so the hot keys are spread over the key space.
+    std::mt19937 generator{ 1337 };
+    std::vector<bench_data_type> keys(elements_count);
+    for (size_t index = 0; index < elements_count; index++) {
+        keys[index] = static_cast<bench_data_type>(index);
+    }
+    std::shuffle(keys.begin(), keys.end(), generator);
+
+    const std::vector<std::pair<std::string, std::vector<bench_data_type>>> streams{
+        { "uniform", makeUniformLookups(keys, elements_count, generator) },
+        { "zipf 1.2", makeZipfianLookups(keys, elements_count, 1.2, generator) }
+    };
+
+    BenchmarkRunner runner{ "Splay tree", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    for (const auto& stream : streams) {
+        // Every case runs on its own tree: the splay trees keep the shape left by the previous repetition.
+        AVLTreeLoop<bench_data_type> avl_tree{ keys };
+        runSearch(runner, "search " + stream.first + ": AVLTreeLoop", avl_tree, stream.second);
+
+        for (const size_t period : { 1, 4, 16 }) {
+            SplayTree<bench_data_type> splay_tree{ keys };
+            splay_tree.setSearchSplayPeriod(period);
+            runSearch(runner, "search " + stream.first + ": SplayTree, splay every " + std::to_string(period), splay_tree, stream.second);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+// Timer queue churn: one timer scheduled per tick with a timeout of 0.1-60 thousand ticks (1% far past the span of
+// the wheels), most of them cancelled before they fire, like the timeouts of requests which complete in time.
+// TimingWheel cancels in O(1). Heap has no search for the position which remove(index) takes, so the timer queue on
+// it cancels lazily: a flag per timer, the entry stays in the heap until its deadline.
+// Usage: TimingWheelBenchmark [elements count] [--perf] [--json=<file>]
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "heap.h"
+#include "timingwheel.h"
+
+using time_type = uint64_t;
+using timer_id = uint32_t;
+
+namespace {
+    // The timers cancelled at a tick and the deadline of the timer scheduled at it.
+    struct Tick {
+        time_type deadline{};
+        std::vector<timer_id> cancels{};
+    };
+
+    // Timer i is scheduled at tick i. A cancelled timer is cancelled before its deadline.
+    std::vector<Tick> makeTicks(size_t count, unsigned cancel_percent, std::mt19937_64& generator) {
+        std::vector<Tick> ticks(count);
+        for (size_t tick = 0; tick < count; tick++) {
+            const auto timeout = generator() % 100 == 0 ? (time_type{ 1 } << 34) : 100 + generator() % 60000;
+            ticks[tick].deadline = tick + timeout;
+            if (generator() % 100 < cancel_percent) {
+                const auto cancel_tick = tick + 1 + generator() % std::min<time_type>(timeout - 1, 2000);
+                if (cancel_tick < count) {
+                    ticks[cancel_tick].cancels.push_back(static_cast<timer_id>(tick));
+                }
+            }
+        }
+
+        return ticks;
+    }
+
+    struct HeapTimer {
+        time_type deadline{};
+        timer_id id{};
+
+        bool operator<(const HeapTimer& other) const {
+            return deadline < other.deadline;
+        }
+    };
+
+    // Schedule, cancel, then advance by one tick. Returns the sum of the ids of the fired timers.
+    unsigned long long runHeap(const std::vector<Tick>& ticks) {
+        Heap<HeapTimer, ComparatorLess<HeapTimer>> heap{};
+        std::vector<bool> cancelled(ticks.size());
+        unsigned long long checksum = 0;
+        for (size_t tick = 0; tick < ticks.size(); tick++) {
+            heap.insert(HeapTimer{ ticks[tick].deadline, static_cast<timer_id>(tick) });
+            for (const auto id : ticks[tick].cancels) {
+                cancelled[id] = true;
+            }
+
+            while (!heap.isEmpty() && heap.peek().deadline <= tick + 1) {
+                const auto timer = heap.extract();
+                if (!cancelled[timer.id]) {
+                    checksum += timer.id;
+                }
+            }
+        }
+
+        return checksum;
+    }
+
+    unsigned long long runWheel(const std::vector<Tick>& ticks) {
+        TimingWheel<timer_id> wheel{};
+        std::vector<TimingWheel<timer_id>::Handle> handles(ticks.size());
+        unsigned long long checksum = 0;
+        for (size_t tick = 0; tick < ticks.size(); tick++) {
+            handles[tick] = wheel.schedule(ticks[tick].deadline, static_cast<timer_id>(tick));
+            for (const auto id : ticks[tick].cancels) {
+                wheel.cancel(handles[id]);
+            }
+
+            wheel.advance(tick + 1, [&checksum](time_type, timer_id id) {
+                checksum += id;
+            });
+        }
+
+        return checksum;
+    }
+}
+
+int main(int argc, char** argv) {
+    const auto elements_count = benchmarkElementsCount(argc, argv, 1 << 20);
+
+    BenchmarkRunner runner{ "Timing wheel", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    for (const unsigned cancel_percent : { 90u, 0u }) {
+        std::mt19937_64 generator{ 1337 };
+        const auto ticks = makeTicks(elements_count, cancel_percent, generator);
+        if (runHeap(ticks) != runWheel(ticks)) {
+            std::cerr << "Heap and TimingWheel fired different timers." << std::endl;
+            return 1;
+        }
+
+        const auto suffix = ", " + std::to_string(cancel_percent) + "% cancelled";
+        runner.run("Heap, lazy cancel" + suffix, elements_count, [&ticks]() {
+            doNotOptimize(runHeap(ticks));
+        });
+        runner.run("TimingWheel" + suffix, elements_count, [&ticks]() {
+            doNotOptimize(runWheel(ticks));
+        });
+    }
+
+    return 0;
+}
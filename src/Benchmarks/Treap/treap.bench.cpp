@@ -0,0 +1,86 @@
+// Sliding time window: every round appends a sorted batch of new timestamps and drops everything older than
+// the window. Treap range operations against one key at a time in the treap and in AVLTreeLoop.
+// Usage: TreapBenchmark [elements count] [--perf] [--json=<file>]
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "avltree.h"
+#include "treap.h"
+
+using bench_data_type = int;
+
+namespace {
+    constexpr size_t rounds_count = 64;
+
+    std::vector<bench_data_type> makeRange(size_t first, size_t count) {
+        std::vector<bench_data_type> values(count);
+        for (size_t index = 0; index < count; index++) {
+            values[index] = static_cast<bench_data_type>(first + index);
+        }
+
+        return values;
+    }
+}
+
+int main(int argc, char** argv) {
+    const auto elements_count = benchmarkElementsCount(argc, argv, 1 << 18);
+    // The window holds elements_count keys, every round replaces one batch.
+    const auto batch_size = std::max<size_t>(elements_count / rounds_count, 1);
+    const auto window = makeRange(0, elements_count);
+    std::vector<std::vector<bench_data_type>> batches{};
+    for (size_t round = 0; round < rounds_count; round++) {
+        batches.push_back(makeRange(elements_count + round * batch_size, batch_size));
+    }
+
+    BenchmarkRunner runner{ "Treap", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    const auto operations_count = 2 * rounds_count * batch_size;
+    runner.run("window: Treap insertSortedBatch + eraseRange", operations_count, [&window]() {
+        Treap<bench_data_type> tree{};
+        tree.insertSortedBatch(window);
+        return tree;
+    }, [&batches, batch_size](Treap<bench_data_type>& tree) {
+        bench_data_type oldest = 0;
+        for (const auto& batch : batches) {
+            tree.insertSortedBatch(batch);
+            oldest += static_cast<bench_data_type>(batch_size);
+            doNotOptimize(tree.eraseRange(oldest - static_cast<bench_data_type>(batch_size), oldest));
+        }
+    });
+
+    runner.run("window: Treap insert + deleteValue", operations_count, [&window]() {
+        Treap<bench_data_type> tree{};
+        tree.insertSortedBatch(window);
+        return tree;
+    }, [&batches, batch_size](Treap<bench_data_type>& tree) {
+        bench_data_type oldest = 0;
+        for (const auto& batch : batches) {
+            for (const auto value : batch) {
+                tree.insert(value);
+            }
+            for (size_t index = 0; index < batch_size; index++) {
+                tree.deleteValue(oldest++);
+            }
+        }
+        doNotOptimize(tree);
+    });
+
+    runner.run("window: AVLTreeLoop insert + deleteValue", operations_count, [&window]() {
+        return AVLTreeLoop<bench_data_type>{ window };
+    }, [&batches, batch_size](AVLTreeLoop<bench_data_type>& tree) {
+        bench_data_type oldest = 0;
+        for (const auto& batch : batches) {
+            for (const auto value : batch) {
+                tree.insert(value);
+            }
+            for (size_t index = 0; index < batch_size; index++) {
+                tree.deleteValue(oldest++);
+            }
+        }
+        doNotOptimize(tree);
+    });
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+// search() key by key vs searchBatch() with the interleaved prefetching.
+// Use a tree bigger than the last level cache to see the memory-level parallelism.
+// Usage: TreeSearchBatchBenchmark [elements count] [--perf] [--json=<file>]
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "redblacktree.h"
+#include "avltree.h"
+
+using bench_data_type = int;
+
+namespace {
+    template<class Tree>
+    void searchOneByOne(const Tree& tree, const std::vector<bench_data_type>& queries) {
+        size_t found = 0;
+        for (const auto query : queries) {
+            found += tree.search(query) ? 1 : 0;
+        }
+
+        doNotOptimize(found);
+    }
+
+    template<class Tree>
+    void searchBatches(const Tree& tree, const std::vector<bench_data_type>& queries, size_t batch_size) {
+        const auto results = std::make_unique<bool[]>(batch_size);
+        size_t found = 0;
+
+        for (size_t first = 0; first < queries.size(); first += batch_size) {
+            const auto count = queries.size() - first < batch_size ? queries.size() - first : batch_size;
+            tree.searchBatch(std::span<const bench_data_type>{ queries.data() + first, count }, std::span<bool>{ results.get(), count });
+            for (size_t index = 0; index < count; index++) {
+                found += results[index] ? 1 : 0;
+            }
+        }
+
+        doNotOptimize(found);
+    }
+
+    template<class Tree>
+    void runTree(BenchmarkRunner& runner, const std::string& name, const Tree& tree, const std::vector<bench_data_type>& queries) {
+        runner.run("search: " + name, queries.size(), [&tree, &queries]() {
+            searchOneByOne(tree, queries);
+        });
+
+        for (const size_t batch_size : { 64, 512 }) {
+            runner.run("searchBatch " + std::to_string(batch_size) + ": " + name, queries.size(), [&tree, &queries, batch_size]() {
+                searchBatches(tree, queries, batch_size);
+            });
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const auto elements_count = benchmarkElementsCount(argc, argv, 1 << 21);
+
+    // Half of the queries hit.
+    std::mt19937 generator{ 1337 };
+    std::vector<bench_data_type> keys(elements_count);
+    for (auto& key : keys) {
+        key = static_cast<bench_data_type>(generator() % (4 * elements_count)) & ~1;
+    }
+
+    std::vector<bench_data_type> queries(elements_count);
+    for (size_t index = 0; index < elements_count; index++) {
+        queries[index] = index % 2 ? keys[generator() % elements_count] : static_cast<bench_data_type>(generator() % (4 * elements_count)) | 1;
+    }
+
+    BenchmarkRunner runner{ "Tree batch search", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    {
+        RedBlackTreeLoop<bench_data_type> rbtree{ keys };
+        runTree(runner, "RedBlackTreeLoop", rbtree, queries);
+    }
+    {
+        AVLTreeLoop<bench_data_type> avltree{ keys };
+        runTree(runner, "AVLTreeLoop", avltree, queries);
+    }
+
+    return 0;
+}
@@ -0,0 +1,77 @@
+// Union and difference of two trees: insert()/deleteValue() key by key vs the join-based set operations.
+// Usage: TreeSetOperationsBenchmark [elements count] [--perf] [--json=<file>]
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "benchmark.h"
+#include "redblacktree.h"
+#include "avltree.h"
+
+using bench_data_type = int;
+
+namespace {
+    std::vector<bench_data_type> makeValues(size_t count, unsigned seed) {
+        std::mt19937 generator{ seed };
+        std::vector<bench_data_type> values(count);
+        for (auto& value : values) {
+            value = static_cast<bench_data_type>(generator() % 1000000000);
+        }
+
+        return values;
+    }
+
+    template<class Tree>
+    void runTree(BenchmarkRunner& runner, const std::string& name, const std::vector<bench_data_type>& first_values,
+                 const std::vector<bench_data_type>& second_values, size_t threads_count) {
+        const auto setup = [&first_values, &second_values]() {
+            return std::make_pair(Tree{ first_values }, Tree{ second_values });
+        };
+
+        runner.run("union by insert: " + name, second_values.size(), setup, [&second_values](auto& trees) {
+            for (const auto value : second_values) {
+                trees.first.insert(value);
+            }
+            doNotOptimize(trees.first.getRoot());
+        });
+        runner.run("difference by deleteValue: " + name, second_values.size(), setup, [&second_values](auto& trees) {
+            for (const auto value : second_values) {
+                trees.first.deleteValue(value);
+            }
+            doNotOptimize(trees.first.getRoot());
+        });
+
+        for (size_t pool_threads = 1; pool_threads <= threads_count; pool_threads *= 2) {
+            const auto suffix = ", threads " + std::to_string(pool_threads) + ": " + name;
+            ThreadPool pool{ pool_threads };
+            runner.run("setUnion" + suffix, second_values.size(), setup, [&pool](auto& trees) {
+                auto result = Tree::setUnion(std::move(trees.first), std::move(trees.second), pool);
+                doNotOptimize(result.getRoot());
+            });
+            runner.run("setDifference" + suffix, second_values.size(), setup, [&pool](auto& trees) {
+                auto result = Tree::setDifference(std::move(trees.first), std::move(trees.second), pool);
+                doNotOptimize(result.getRoot());
+            });
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    const auto elements_count = benchmarkElementsCount(argc, argv, 1 << 18);
+    const size_t hardware_threads = std::thread::hardware_concurrency() != 0 ? std::thread::hardware_concurrency() : 1;
+    const auto first_values = makeValues(elements_count, 1337);
+
+    BenchmarkRunner runner{ "Tree set operations", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    // The work of the set operations depends on the ratio of the sizes.
+    for (const size_t ratio : { 1, 16 }) {
+        const auto second_values = makeValues(elements_count / ratio, 7331);
+        const auto suffix = " (1:" + std::to_string(ratio) + ")";
+        runTree<RedBlackTreeLoop<bench_data_type>>(runner, "RedBlackTreeLoop" + suffix, first_values, second_values, hardware_threads);
+        runTree<AVLTreeLoop<bench_data_type>>(runner, "AVLTreeLoop" + suffix, first_values, second_values, hardware_threads);
+    }
+
+    return 0;
+}
@@ -0,0 +1,132 @@
+// WAVL tree against AVLTreeLoop and RedBlackTreeLoop on mixed workloads of inserts, deletes and searches.
+// The rotations and rebalance steps per update are counted in a separate pass with CountingStats.
+// Usage: WAVLTreeBenchmark [elements count] [--perf] [--json=<file>]
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+#include "stats.h"
+#include "redblacktree.h"
+#include "avltree.h"
+#include "wavltree.h"
+
+using bench_data_type = int;
+
+namespace {
+    struct Operation {
+        enum class Type { insert, remove, search } type;
+        bench_data_type key;
+    };
+
+    // Operations on a tree built from the initial keys: the deleted keys are alive, the inserted ones are new.
+    // delete_share and search_share are percents, the rest are inserts.
+    std::vector<Operation> makeWorkload(const std::vector<bench_data_type>& initial, size_t count,
+                                        unsigned delete_share, unsigned search_share, std::mt19937& generator) {
+        std::vector<bench_data_type> alive = initial;
+        std::vector<Operation> operations{};
+        operations.reserve(count);
+
+        for (size_t index = 0; index < count; index++) {
+            const auto roll = generator() % 100;
+            if (roll < delete_share && !alive.empty()) {
+                const auto position = generator() % alive.size();
+                operations.push_back({ Operation::Type::remove, alive[position] });
+                alive[position] = alive.back();
+                alive.pop_back();
+            } else if (roll < delete_share + search_share && !alive.empty()) {
+                operations.push_back({ Operation::Type::search, alive[generator() % alive.size()] });
+            } else {
+                const auto key = static_cast<bench_data_type>(generator());
+                operations.push_back({ Operation::Type::insert, key });
+                alive.push_back(key);
+            }
+        }
+
+        return operations;
+    }
+
+    template<class Tree>
+    size_t runOperations(Tree& tree, const std::vector<Operation>& operations) {
+        size_t found = 0;
+        for (const auto& operation : operations) {
+            switch (operation.type) {
+                case Operation::Type::insert:
+                    tree.insert(operation.key);
+                    break;
+                case Operation::Type::remove:
+                    tree.deleteValue(operation.key);
+                    break;
+                case Operation::Type::search:
+                    found += tree.search(operation.key) ? 1 : 0;
+                    break;
+            }
+        }
+
+        return found;
+    }
+
+    using stats_type = CountingStats<struct WAVLTreeBenchmarkTag>;
+
+    // CountedTree is Tree with stats_type.
+    template<class Tree, class CountedTree>
+    void runTree(BenchmarkRunner& runner, const std::string& name, const std::vector<bench_data_type>& initial,
+                 const std::string& workload_name, const std::vector<Operation>& operations) {
+        {
+            CountedTree tree{ initial };
+            stats_type::reset();
+            doNotOptimize(runOperations(tree, operations));
+            const auto stats = stats_type::snapshot();
+            const auto operations_count = static_cast<double>(operations.size());
+            std::cout << "rebalancing: " << workload_name << ": " << name << ": " << std::fixed << std::setprecision(3)
+                      << static_cast<double>(stats[StatsEvent::rotation]) / operations_count << " rotations, "
+                      << static_cast<double>(stats[StatsEvent::rebalance]) / operations_count << " rebalance steps per operation"
+                      << std::endl;
+        }
+
+        // The build of the initial tree is not measured.
+        runner.run(workload_name + ": " + name, operations.size(), [&initial]() {
+            return Tree{ initial };
+        }, [&operations](Tree& tree) {
+            doNotOptimize(runOperations(tree, operations));
+        });
+    }
+}
+
+int main(int argc, char** argv) {
+    const auto elements_count = benchmarkElementsCount(argc, argv, 1 << 18);
+
+    std::mt19937 generator{ 1337 };
+    std::vector<bench_data_type> initial(elements_count);
+    for (auto& value : initial) {
+        value = static_cast<bench_data_type>(generator());
+    }
+
+    // Named by the percents of inserts/deletes/searches.
+    struct Workload {
+        std::string name;
+        unsigned delete_share;
+        unsigned search_share;
+    };
+    const std::vector<Workload> workloads{
+        { "balanced 25/25/50", 25, 50 },
+        { "delete-heavy 30/60/10", 60, 10 },
+        { "churn 50/50/0", 50, 0 }
+    };
+
+    BenchmarkRunner runner{ "WAVL tree", parseBenchmarkOptions(argc, argv) };
+    runner.printHeader(std::cout);
+
+    for (const auto& workload : workloads) {
+        const auto operations = makeWorkload(initial, elements_count, workload.delete_share, workload.search_share, generator);
+
+        runTree<AVLTreeLoop<bench_data_type>, AVLTreeLoop<bench_data_type, size_t, stats_type>>(
+                runner, "AVLTreeLoop", initial, workload.name, operations);
+        runTree<RedBlackTreeLoop<bench_data_type>, RedBlackTreeLoop<bench_data_type, size_t, stats_type>>(
+                runner, "RedBlackTreeLoop", initial, workload.name, operations);
+        runTree<WAVLTree<bench_data_type>, WAVLTree<bench_data_type, uint32_t, stats_type>>(
+                runner, "WAVLTree", initial, workload.name, operations);
+    }
+
+    return 0;
+}
@@ -1,4 +1,7 @@
 ﻿#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include <utility>
 #include <vector>
 #include "binary_search_tree.h"
 
@@ -326,6 +329,24 @@ TEST_F(BinarySearchTreeLoopTest, Search) {
     std::cout << "TEST_F(BinarySearchTreeLoopTest, Search) end" << std::endl;
 }
 
+TEST_F(BinarySearchTreeLoopTest, ForEachInOrder) {
+    std::cout << "TEST_F(BinarySearchTreeLoopTest, ForEachInOrder) start" << std::endl;
+    std::vector<test_data_type> keys{};
+    BinarySearchTreeLoop<test_data_type> bstree{};
+    // Empty structure.
+    bstree.forEachInOrder([&keys](const test_data_type& key) { keys.push_back(key); });
+    ASSERT_TRUE(keys.empty());
+
+    bstree = BinarySearchTreeLoop<test_data_type>{array_values};
+    bstree.forEachInOrder([&keys](const test_data_type& key) { keys.push_back(key); });
+
+    auto expected = array_values;
+    std::sort(expected.begin(), expected.end());
+    expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+    ASSERT_EQ(keys, expected);
+    std::cout << "TEST_F(BinarySearchTreeLoopTest, ForEachInOrder) end" << std::endl;
+}
+
 TEST_F(BinarySearchTreeLoopTest, FailedVerify) {
     std::cout << "TEST_F(BinarySearchTreeLoopTest, Search) start" << std::endl;
     BinarySearchTreeLoop<test_data_type> bstree{};
@@ -336,4 +357,67 @@ TEST_F(BinarySearchTreeLoopTest, FailedVerify) {
     ASSERT_FALSE(bstree.verifyCorrectness(std::vector<test_data_type>{31, 0}));
     ASSERT_FALSE(bstree.verifyCorrectness(std::vector<test_data_type>{31, 13, 0}));
     std::cout << "TEST_F(BinarySearchTreeLoopTest, Search) end" << std::endl;
-}
\ No newline at end of file
+}
+
+TEST_F(BinarySearchTreeLoopTest, Clear) {
+    std::cout << "TEST_F(BinarySearchTreeLoopTest, Clear) start" << std::endl;
+    // Sorted keys make a chain as deep as the tree.
+    const test_data_type keys_count = 4096;
+    BinarySearchTreeLoop<test_data_type> bstree{};
+    for (test_data_type key = 0; key < keys_count; key++) {
+        bstree.insert(key);
+    }
+
+    auto node_deepest = bstree.getRoot();
+    while (node_deepest->right) {
+        node_deepest = node_deepest->right;
+    }
+    const std::weak_ptr<BinarySearchTreeNodeLoop<test_data_type>> root_weak = bstree.getRoot();
+    const std::weak_ptr<BinarySearchTreeNodeLoop<test_data_type>> deepest_weak = node_deepest;
+    node_deepest.reset();
+
+    // The moved tree owns the nodes.
+    auto bstree_moved = std::move(bstree);
+    ASSERT_TRUE(bstree.isEmpty());
+    ASSERT_TRUE(bstree_moved.search(keys_count - 1));
+
+    bstree_moved.clear();
+    ASSERT_TRUE(bstree_moved.isEmpty());
+    ASSERT_TRUE(root_weak.expired());
+    ASSERT_TRUE(deepest_weak.expired());
+
+    // The trees stay usable.
+    bstree_moved.insert(31);
+    bstree.insert(13);
+    ASSERT_TRUE(bstree_moved.search(31));
+    ASSERT_TRUE(bstree.search(13));
+    std::cout << "TEST_F(BinarySearchTreeLoopTest, Clear) end" << std::endl;
+}
+
+TEST_F(BinarySearchTreeLoopTest, Copy) {
+    std::cout << "TEST_F(BinarySearchTreeLoopTest, Copy) start" << std::endl;
+    BinarySearchTreeLoop<test_data_type> bstree{ array_values };
+
+    // The copy has the same shape and its own nodes.
+    auto bstree_copy = bstree;
+    ASSERT_TRUE(bstree_copy.verifyCorrectness(array_values_result));
+    ASSERT_NE(bstree_copy.getRoot(), bstree.getRoot());
+
+    bstree_copy.deleteValue(30);
+    bstree.insert(50);
+    ASSERT_TRUE(bstree.search(30));
+    ASSERT_FALSE(bstree_copy.search(50));
+
+    // A degenerate tree as deep as its keys is copied without recursion.
+    const test_data_type keys_count = 4096;
+    BinarySearchTreeLoop<test_data_type> bstree_chain{};
+    for (test_data_type key = 0; key < keys_count; key++) {
+        bstree_chain.insert(key);
+    }
+
+    bstree_copy = bstree_chain;
+    bstree_chain.clear();
+    ASSERT_TRUE(bstree_copy.search(0));
+    ASSERT_TRUE(bstree_copy.search(keys_count - 1));
+    std::cout << "TEST_F(BinarySearchTreeLoopTest, Copy) end" << std::endl;
+}
@@ -1,7 +1,11 @@
 ﻿#pragma once
 #include <iostream>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 #include "head.h"
+#include "stats.h"
 
 template <class DataType, class SizeType = size_t>
 struct BinarySearchTreeNodeLoop {
@@ -20,7 +24,8 @@ struct BinarySearchTreeNodeLoop {
     CONSTEXPR20 ~BinarySearchTreeNodeLoop() = default;
 };
 
-template <class DataType, class SizeType = size_t>
+// Stats: instrumentation policy (stats.h), reports key comparisons and node allocations.
+template <class DataType, class SizeType = size_t, class Stats = NoStats>
 class BinarySearchTreeLoop {
 private:
     using value_type = DataType;
@@ -48,7 +53,38 @@ public:
         }
     }
 
-    CONSTEXPR20 ~BinarySearchTreeLoop() = default;
+    CONSTEXPR20 BinarySearchTreeLoop(BinarySearchTreeLoop &&other) noexcept :
+            root{ std::exchange(other.root, nullptr) }
+    {
+    }
+
+    CONSTEXPR20 BinarySearchTreeLoop &operator=(BinarySearchTreeLoop &&other) noexcept {
+        if (this != &other) {
+            clear();
+            root = std::exchange(other.root, nullptr);
+        }
+
+        return *this;
+    }
+
+    // Structural copy: the nodes are copied level by level, so nothing is rebalanced. O(n).
+    CONSTEXPR20 BinarySearchTreeLoop(const BinarySearchTreeLoop &other) :
+            root{ cloneNodes(other.root) }
+    {
+    }
+
+    CONSTEXPR20 BinarySearchTreeLoop &operator=(const BinarySearchTreeLoop &other) {
+        if (this != &other) {
+            *this = BinarySearchTreeLoop{ other };
+        }
+
+        return *this;
+    }
+
+    // The destructor of the root would release the nodes recursively, as deep as the tree.
+    CONSTEXPR20 ~BinarySearchTreeLoop() {
+        clear();
+    }
 
     NODISCARD CONSTEXPR20 bool search(const value_type &&value) const {
         return searchElement(value);
@@ -74,10 +110,51 @@ public:
         deleteElement(value);
     }
 
+    NODISCARD CONSTEXPR20 bool isEmpty() const {
+        return !root;
+    }
+
+    // Release the nodes without recursion and without extra memory in O(n): the left child is rotated up
+    // until the node has none, then the node goes with both links empty.
+    CONSTEXPR20 void clear() {
+        auto node = std::exchange(root, nullptr);
+        while (node) {
+            if (node->left) {
+                auto node_left = std::move(node->left);
+                node->left = std::move(node_left->right);
+                node_left->right = std::move(node);
+                node = std::move(node_left);
+            } else {
+                node = std::move(node->right);
+            }
+        }
+    }
+
     CONSTEXPR20 auto getRoot() const {
         return root;
     }
 
+    // Visit the keys in ascending order without recursion. The stack holds the path to the current node.
+    template<class Visitor>
+    CONSTEXPR20 void forEachInOrder(Visitor&& visitor) const {
+        const node_type* const node_end = nullptr;
+        std::vector<const node_type*> stack{};
+        const node_type* node_current = root.get();
+
+        while (node_current != node_end || !stack.empty()) {
+            // Move down to the leftmost node.
+            while (node_current != node_end) {
+                stack.push_back(node_current);
+                node_current = node_current->left.get();
+            }
+
+            node_current = stack.back();
+            stack.pop_back();
+            visitor(node_current->key);
+            node_current = node_current->right.get();
+        }
+    }
+
     // Print the tree
     void printTree(node_type_ptr node) {
         if (node) {
@@ -289,7 +366,41 @@ private:
         root = node;
     }
 
+    // Copy the subtree level by level without recursion, the copy has the same shape.
+    NODISCARD CONSTEXPR20 node_type_ptr cloneNodes(const node_type_ptr &node) const {
+        if (!node) {
+            return nullptr;
+        }
+
+        auto node_root = cloneNode(*node);
+        std::vector<std::pair<const node_type *, node_type *>> level{ { node.get(), node_root.get() } };
+        std::vector<std::pair<const node_type *, node_type *>> level_next{};
+        while (!level.empty()) {
+            for (const auto &[node_source, node_copy] : level) {
+                if (node_source->left) {
+                    node_copy->left = cloneNode(*node_source->left);
+                    level_next.emplace_back(node_source->left.get(), node_copy->left.get());
+                }
+
+                if (node_source->right) {
+                    node_copy->right = cloneNode(*node_source->right);
+                    level_next.emplace_back(node_source->right.get(), node_copy->right.get());
+                }
+            }
+
+            level.swap(level_next);
+            level_next.clear();
+        }
+
+        return node_root;
+    }
+
+    NODISCARD CONSTEXPR20 node_type_ptr cloneNode(const node_type &node) const {
+        return createNewNode(node.key);
+    }
+
     CONSTEXPR20 node_type_ptr createNewNode(const value_type& key) const {
+        Stats::add(StatsEvent::allocation);
         return std::make_shared<node_type>(key);
     }
 
@@ -407,21 +518,25 @@ private:
 
     template<class T>
     NODISCARD CONSTEXPR20 bool isGreater(std::shared_ptr<T> smart_obj_a, std::shared_ptr<T> smart_obj_b) const {
+        Stats::add(StatsEvent::comparison);
         return *smart_obj_a > *smart_obj_b;
     }
 
     template<class T>
     NODISCARD CONSTEXPR20 bool isGreater(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
         return value_a > value_b;
     }
 
     template<class T>
     NODISCARD CONSTEXPR20 bool isLess(std::shared_ptr<T> smart_obj_a, std::shared_ptr<T> smart_obj_b) const {
+        Stats::add(StatsEvent::comparison);
         return *smart_obj_a < *smart_obj_b;
     }
 
     template<class T>
     NODISCARD CONSTEXPR20 bool isLess(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
         return value_a < value_b;
     }
 };
\ No newline at end of file
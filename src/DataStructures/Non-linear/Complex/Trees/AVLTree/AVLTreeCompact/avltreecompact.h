@@ -0,0 +1,439 @@
+// AVL tree with compact nodes.
+// + The nodes live in an IndexPool and are linked by SizeType indices instead of shared_ptr: no reference counts,
+//   12 bytes per node for int keys with uint32_t links instead of about 100 bytes of AVLTreeLoop.
+// + The node keeps its balance factor (-1, 0, 1) instead of the height. It takes the top two bits of the left link,
+//   so the tree holds up to 2^30 - 1 nodes with uint32_t links.
+// + No parent link: insert and delete keep the path from the root in a fixed array on the stack.
+#pragma once
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "head.h"
+#include "comparators.h"
+#include "index_pool.h"
+#include "stats.h"
+
+template <class DataType, class SizeType = uint32_t>
+struct AVLTreeNodeCompact {
+    using value_type = DataType;
+    using size_type = SizeType;
+
+    static constexpr int balance_shift = std::numeric_limits<size_type>::digits - 2;
+    static constexpr size_type balance_bits = static_cast<size_type>(size_type{ 3 } << balance_shift);
+    static constexpr size_type index_mask = static_cast<size_type>(~balance_bits);
+
+    value_type key{};
+    // Index of the left child. The top two bits hold the balance factor + 1.
+    size_type left_balance{};
+    size_type right{};
+
+    CONSTEXPR20 AVLTreeNodeCompact() = default;
+    // A new node is balanced.
+    CONSTEXPR20 explicit AVLTreeNodeCompact(const value_type& key) : key(key), left_balance{ static_cast<size_type>(size_type{ 1 } << balance_shift) } {}
+
+    NODISCARD CONSTEXPR20 size_type getLeft() const {
+        return static_cast<size_type>(left_balance & index_mask);
+    }
+
+    CONSTEXPR20 void setLeft(size_type index) {
+        left_balance = static_cast<size_type>((left_balance & balance_bits) | index);
+    }
+
+    // Height of the right subtree minus height of the left subtree.
+    NODISCARD CONSTEXPR20 int getBalance() const {
+        return static_cast<int>(left_balance >> balance_shift) - 1;
+    }
+
+    CONSTEXPR20 void setBalance(int balance) {
+        left_balance = static_cast<size_type>((left_balance & index_mask) | (static_cast<size_type>(balance + 1) << balance_shift));
+    }
+};
+
+// Stats: instrumentation policy (stats.h), reports key comparisons, node allocations, rotations and rebalance steps.
+template <class DataType, class SizeType = uint32_t, class Stats = NoStats>
+class AVLTreeCompact {
+private:
+    using value_type = DataType;
+    using const_reference = const DataType &;
+    using size_type = SizeType;
+    using node_type = AVLTreeNodeCompact<value_type, size_type>;
+    using pool_type = IndexPool<node_type, size_type>;
+
+    static constexpr size_type null_index = 0;
+    // The height is at most 1.44 * log2(n + 2).
+    static constexpr size_t max_path_length = 2 * std::numeric_limits<size_type>::digits;
+    using path_type = std::array<size_type, max_path_length>;
+
+    pool_type pool{ node_type::index_mask };
+    size_type root{ null_index };
+
+public:
+    CONSTEXPR20 AVLTreeCompact() = default;
+
+    CONSTEXPR20 explicit AVLTreeCompact(const std::vector<value_type> &vec) {
+        pool.reserve(vec.size());
+        for (const auto& value : vec) {
+            insert(value);
+        }
+    }
+
+    CONSTEXPR20 explicit AVLTreeCompact(const value_type *start, const value_type *end) {
+        pool.reserve(static_cast<size_t>(end - start));
+        for (auto it = start; it != end; it++) {
+            insert(*it);
+        }
+    }
+
+    CONSTEXPR20 ~AVLTreeCompact() = default;
+
+    NODISCARD CONSTEXPR20 bool search(const value_type &&value) const {
+        return searchElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 bool search(const value_type &value) const {
+        return searchElement(value);
+    }
+
+    // Throws std::length_error when SizeType can't index more nodes.
+    CONSTEXPR20 void insert(const value_type &&value) {
+        insertElement(value);
+    }
+
+    CONSTEXPR20 void insert(const value_type &value) {
+        insertElement(value);
+    }
+
+    CONSTEXPR20 void deleteValue(const value_type &&value) {
+        deleteElement(value);
+    }
+
+    CONSTEXPR20 void deleteValue(const value_type &value) {
+        deleteElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 size_t size() const {
+        return pool.size();
+    }
+
+    NODISCARD CONSTEXPR20 bool isEmpty() const {
+        return root == null_index;
+    }
+
+    CONSTEXPR20 void reserve(size_t count) {
+        pool.reserve(count);
+    }
+
+    // Bytes held by the nodes.
+    NODISCARD CONSTEXPR20 size_t memoryUsage() const {
+        return pool.memoryUsage();
+    }
+
+    // Visit the keys in ascending order without recursion. The stack holds the path to the current node.
+    template<class Visitor>
+    CONSTEXPR20 void forEachInOrder(Visitor&& visitor) const {
+        path_type stack{};
+        size_t depth = 0;
+        auto node_current = root;
+
+        while (node_current != null_index || depth != 0) {
+            // Move down to the leftmost node.
+            while (node_current != null_index) {
+                stack[depth++] = node_current;
+                node_current = pool[node_current].getLeft();
+            }
+
+            node_current = stack[--depth];
+            visitor(pool[node_current].key);
+            node_current = pool[node_current].right;
+        }
+    }
+
+    // Check the order of the keys and the balance factors against the real heights.
+    NODISCARD CONSTEXPR20 bool verifyProperties() const {
+        bool valid = true;
+        size_t count = 0;
+        verifyNode(root, valid, count);
+        return valid && count == size();
+    }
+
+private:
+    CONSTEXPR20 bool searchElement(const value_type &key) const {
+        auto node_current = root;
+        while (node_current != null_index) {
+            const auto& node = pool[node_current];
+            if (isLess(key, node.key)) {
+                node_current = node.getLeft();
+            } else if (isGreater(key, node.key)) {
+                node_current = node.right;
+            } else {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    CONSTEXPR20 void insertElement(const value_type &key) {
+        if (root == null_index) {
+            root = createNewNode(key);
+            return;
+        }
+
+        // Search the parent of the new node.
+        path_type path{};
+        size_t depth = 0;
+        bool insert_left = false;
+        auto node_current = root;
+        while (node_current != null_index) {
+            path[depth++] = node_current;
+            const auto& node = pool[node_current];
+            if (isLess(key, node.key)) {
+                insert_left = true;
+                node_current = node.getLeft();
+            } else if (isGreater(key, node.key)) {
+                insert_left = false;
+                node_current = node.right;
+            } else {
+                // The key is already in the tree.
+                return;
+            }
+        }
+
+        // The pool may move the nodes: no references are held across createNewNode().
+        const auto node_new = createNewNode(key);
+        if (insert_left) {
+            pool[path[depth - 1]].setLeft(node_new);
+        } else {
+            pool[path[depth - 1]].right = node_new;
+        }
+
+        rebalanceInsert(path, depth, node_new);
+    }
+
+    // path[0, depth) is the path from the root to the parent of node. Update the balance factors while the subtree grows.
+    CONSTEXPR20 void rebalanceInsert(const path_type &path, size_t depth, size_type node) {
+        auto node_child = node;
+
+        while (depth != 0) {
+            Stats::add(StatsEvent::rebalance);
+            const auto node_current = path[--depth];
+            const int balance = pool[node_current].getBalance() + (pool[node_current].right == node_child ? 1 : -1);
+
+            if (balance == 0) {
+                // The shorter side grew: the height of the subtree is the same.
+                pool[node_current].setBalance(0);
+                return;
+            }
+
+            if (balance == 1 || balance == -1) {
+                pool[node_current].setBalance(balance);
+                node_child = node_current;
+                continue;
+            }
+
+            // One rotation brings the subtree back to its height before the insert.
+            rebalanceNode(node_current, balance, parentOf(path, depth));
+            return;
+        }
+    }
+
+    CONSTEXPR20 void deleteElement(const value_type &key) {
+        path_type path{};
+        size_t depth = 0;
+        auto node_current = root;
+        while (node_current != null_index) {
+            const auto& node = pool[node_current];
+            if (isLess(key, node.key)) {
+                path[depth++] = node_current;
+                node_current = node.getLeft();
+            } else if (isGreater(key, node.key)) {
+                path[depth++] = node_current;
+                node_current = node.right;
+            } else {
+                break;
+            }
+        }
+
+        if (node_current == null_index) {
+            // The key was not found.
+            return;
+        }
+
+        // A node with two children takes the key of its successor, the node of the successor is deleted instead.
+        auto node_delete = node_current;
+        if (pool[node_current].getLeft() != null_index && pool[node_current].right != null_index) {
+            path[depth++] = node_current;
+            node_delete = pool[node_current].right;
+            while (pool[node_delete].getLeft() != null_index) {
+                path[depth++] = node_delete;
+                node_delete = pool[node_delete].getLeft();
+            }
+
+            pool[node_current].key = std::move(pool[node_delete].key);
+        }
+
+        // The deleted node has one child at most.
+        const auto node_parent = depth != 0 ? path[depth - 1] : null_index;
+        const auto node_child = pool[node_delete].getLeft() != null_index ? pool[node_delete].getLeft() : pool[node_delete].right;
+        const bool deleted_left = node_parent != null_index && pool[node_parent].getLeft() == node_delete;
+        replaceChild(node_parent, node_delete, node_child);
+        deleteNode(node_delete);
+
+        rebalanceDelete(path, depth, deleted_left);
+    }
+
+    // path[0, depth) is the path from the root to the parent of the removed node.
+    // Update the balance factors while the subtree gets lower.
+    CONSTEXPR20 void rebalanceDelete(const path_type &path, size_t depth, bool from_left) {
+        while (depth != 0) {
+            Stats::add(StatsEvent::rebalance);
+            const auto node_current = path[--depth];
+            const int balance = pool[node_current].getBalance() + (from_left ? 1 : -1);
+
+            if (balance == 1 || balance == -1) {
+                // The taller side got lower: the height of the subtree is the same.
+                pool[node_current].setBalance(balance);
+                return;
+            }
+
+            auto node_top = node_current;
+            if (balance == 0) {
+                pool[node_current].setBalance(0);
+            } else {
+                const auto node_sibling = balance > 0 ? pool[node_current].right : pool[node_current].getLeft();
+                const int balance_sibling = pool[node_sibling].getBalance();
+                node_top = rebalanceNode(node_current, balance, parentOf(path, depth));
+                if (balance_sibling == 0) {
+                    // A single rotation over a balanced sibling keeps the height.
+                    return;
+                }
+            }
+
+            from_left = depth != 0 && pool[path[depth - 1]].getLeft() == node_top;
+        }
+    }
+
+    // Rotate the node with the balance factor +2 or -2. Returns the new root of the subtree.
+    CONSTEXPR20 size_type rebalanceNode(size_type node, int balance, size_type node_parent) {
+        if (balance > 0) {
+            const auto node_right = pool[node].right;
+            const int balance_right = pool[node_right].getBalance();
+            if (balance_right >= 0) {
+                // Right Right case.
+                rotateLeft(node, node_parent);
+                pool[node].setBalance(1 - balance_right);
+                pool[node_right].setBalance(balance_right - 1);
+                return node_right;
+            }
+
+            // Right Left case.
+            const auto node_middle = pool[node_right].getLeft();
+            const int balance_middle = pool[node_middle].getBalance();
+            rotateRight(node_right, node);
+            rotateLeft(node, node_parent);
+            pool[node].setBalance(balance_middle > 0 ? -1 : 0);
+            pool[node_right].setBalance(balance_middle < 0 ? 1 : 0);
+            pool[node_middle].setBalance(0);
+            return node_middle;
+        }
+
+        const auto node_left = pool[node].getLeft();
+        const int balance_left = pool[node_left].getBalance();
+        if (balance_left <= 0) {
+            // Left Left case.
+            rotateRight(node, node_parent);
+            pool[node].setBalance(-1 - balance_left);
+            pool[node_left].setBalance(balance_left + 1);
+            return node_left;
+        }
+
+        // Left Right case.
+        const auto node_middle = pool[node_left].right;
+        const int balance_middle = pool[node_middle].getBalance();
+        rotateLeft(node_left, node);
+        rotateRight(node, node_parent);
+        pool[node].setBalance(balance_middle < 0 ? 1 : 0);
+        pool[node_left].setBalance(balance_middle > 0 ? -1 : 0);
+        pool[node_middle].setBalance(0);
+        return node_middle;
+    }
+
+    NODISCARD CONSTEXPR20 size_type parentOf(const path_type &path, size_t position) const {
+        return position != 0 ? path[position - 1] : null_index;
+    }
+
+    // Rotations link the new root of the subtree to node_parent (the root if null). The balance factors are set by the caller.
+    CONSTEXPR20 void rotateLeft(size_type node, size_type node_parent) {
+        Stats::add(StatsEvent::rotation);
+        const auto right_node = pool[node].right;
+        pool[node].right = pool[right_node].getLeft();
+        pool[right_node].setLeft(node);
+        replaceChild(node_parent, node, right_node);
+    }
+
+    CONSTEXPR20 void rotateRight(size_type node, size_type node_parent) {
+        Stats::add(StatsEvent::rotation);
+        const auto left_node = pool[node].getLeft();
+        pool[node].setLeft(pool[left_node].right);
+        pool[left_node].right = node;
+        replaceChild(node_parent, node, left_node);
+    }
+
+    CONSTEXPR20 void replaceChild(size_type node_parent, size_type node_old, size_type node_new) {
+        if (node_parent == null_index) {
+            root = node_new;
+        } else if (pool[node_parent].getLeft() == node_old) {
+            pool[node_parent].setLeft(node_new);
+        } else {
+            pool[node_parent].right = node_new;
+        }
+    }
+
+    NODISCARD CONSTEXPR20 size_type createNewNode(const value_type& key) {
+        Stats::add(StatsEvent::allocation);
+        return pool.create(key);
+    }
+
+    CONSTEXPR20 void deleteNode(size_type node) {
+        pool.destroy(node);
+    }
+
+    // Returns the height of the subtree.
+    CONSTEXPR20 int verifyNode(size_type node, bool &valid, size_t &count) const {
+        if (node == null_index) {
+            return 0;
+        }
+
+        count++;
+        const auto& node_ref = pool[node];
+        const auto left = node_ref.getLeft();
+        const auto right = node_ref.right;
+        if ((left != null_index && !isLess(pool[left].key, node_ref.key)) ||
+            (right != null_index && !isGreater(pool[right].key, node_ref.key))) {
+            valid = false;
+        }
+
+        const auto height_left = verifyNode(left, valid, count);
+        const auto height_right = verifyNode(right, valid, count);
+        if (height_right - height_left != node_ref.getBalance()) {
+            valid = false;
+        }
+
+        return (height_left > height_right ? height_left : height_right) + 1;
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isGreater(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) > comparedKey(value_b);
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isLess(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) < comparedKey(value_b);
+    }
+};
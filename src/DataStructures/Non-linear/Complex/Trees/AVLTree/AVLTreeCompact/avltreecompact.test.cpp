@@ -0,0 +1,202 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <vector>
+#include "avltreecompact.h"
+
+using test_data_type = int;
+using test_data_count = size_t;
+
+class AVLTreeCompactTest : public ::testing::Test {
+protected:
+    AVLTreeCompactTest() = default;
+
+    std::vector<test_data_type> array_values {30, 35, 40, 20, 10, 24, 39};
+
+public:
+    class ObjectA {
+    public:
+        CONSTEXPR20 ObjectA() = default;
+
+        CONSTEXPR20 explicit ObjectA(test_data_type value) :
+                value{ value }
+        {
+        }
+
+        NODISCARD CONSTEXPR20 bool operator> (const ObjectA& obj) const {
+            return this->value > obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 bool operator< (const ObjectA& obj) const {
+            return this->value < obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 test_data_type get() const {
+            return value;
+        }
+
+    private:
+        test_data_type value{};
+    };
+};
+
+using object_type = AVLTreeCompactTest::ObjectA;
+using store_smart_ptr_type = std::shared_ptr<object_type>;
+
+template<class Tree>
+std::vector<test_data_type> collectKeys(const Tree& tree) {
+    std::vector<test_data_type> keys{};
+    tree.forEachInOrder([&keys](test_data_type key) {
+        keys.push_back(key);
+    });
+
+    return keys;
+}
+
+TEST_F(AVLTreeCompactTest, Empty) {
+    std::cout << "TEST_F(AVLTreeCompactTest, Empty) start" << std::endl;
+    AVLTreeCompact<test_data_type> tree{};
+    ASSERT_TRUE(tree.isEmpty());
+    ASSERT_EQ(tree.size(), 0u);
+    ASSERT_FALSE(tree.search(10));
+    tree.deleteValue(10);
+    ASSERT_TRUE(tree.verifyProperties());
+    std::cout << "TEST_F(AVLTreeCompactTest, Empty) end" << std::endl;
+}
+
+TEST_F(AVLTreeCompactTest, InsertSearch) {
+    std::cout << "TEST_F(AVLTreeCompactTest, InsertSearch) start" << std::endl;
+    AVLTreeCompact<test_data_type> tree{ array_values };
+    ASSERT_EQ(tree.size(), array_values.size());
+    ASSERT_TRUE(tree.verifyProperties());
+
+    for (const auto value : array_values) {
+        ASSERT_TRUE(tree.search(value));
+    }
+    ASSERT_FALSE(tree.search(0));
+    ASSERT_FALSE(tree.search(25));
+
+    // Duplicates are ignored.
+    tree.insert(30);
+    ASSERT_EQ(tree.size(), array_values.size());
+
+    auto sorted = array_values;
+    std::sort(sorted.begin(), sorted.end());
+    ASSERT_EQ(collectKeys(tree), sorted);
+    std::cout << "TEST_F(AVLTreeCompactTest, InsertSearch) end" << std::endl;
+}
+
+TEST_F(AVLTreeCompactTest, RandomInsertDelete) {
+    std::cout << "TEST_F(AVLTreeCompactTest, RandomInsertDelete) start" << std::endl;
+    std::mt19937 generator{ 1337 };
+    AVLTreeCompact<test_data_type> tree{};
+    std::set<test_data_type> expected{};
+
+    for (test_data_count index = 0; index < 20000; index++) {
+        const auto value = static_cast<test_data_type>(generator() % 4000);
+        if (generator() % 3 != 0) {
+            tree.insert(value);
+            expected.insert(value);
+        } else {
+            tree.deleteValue(value);
+            expected.erase(value);
+        }
+
+        if (index % 1000 == 0) {
+            ASSERT_TRUE(tree.verifyProperties()) << index;
+        }
+    }
+
+    ASSERT_TRUE(tree.verifyProperties());
+    ASSERT_EQ(tree.size(), expected.size());
+    ASSERT_EQ(collectKeys(tree), std::vector<test_data_type>(expected.begin(), expected.end()));
+
+    // Delete everything: the freed indices are reused by the next inserts.
+    for (const auto value : expected) {
+        tree.deleteValue(value);
+    }
+    ASSERT_TRUE(tree.isEmpty());
+    const auto memory_usage = tree.memoryUsage();
+    for (test_data_type value = 0; value < 1000; value++) {
+        tree.insert(value);
+    }
+    ASSERT_TRUE(tree.verifyProperties());
+    ASSERT_EQ(tree.memoryUsage(), memory_usage);
+    std::cout << "TEST_F(AVLTreeCompactTest, RandomInsertDelete) end" << std::endl;
+}
+
+TEST_F(AVLTreeCompactTest, Pointers) {
+    std::cout << "TEST_F(AVLTreeCompactTest, Pointers) start" << std::endl;
+    AVLTreeCompact<store_smart_ptr_type> tree{};
+    for (const auto value : array_values) {
+        tree.insert(std::make_shared<object_type>(value));
+    }
+
+    ASSERT_TRUE(tree.search(std::make_shared<object_type>(24)));
+    tree.deleteValue(std::make_shared<object_type>(24));
+    ASSERT_FALSE(tree.search(std::make_shared<object_type>(24)));
+    ASSERT_TRUE(tree.verifyProperties());
+
+    test_data_type prev_value = 0;
+    tree.forEachInOrder([&prev_value](const store_smart_ptr_type& key) {
+        ASSERT_LT(prev_value, key->get());
+        prev_value = key->get();
+    });
+    std::cout << "TEST_F(AVLTreeCompactTest, Pointers) end" << std::endl;
+}
+
+TEST_F(AVLTreeCompactTest, CompactNode) {
+    std::cout << "TEST_F(AVLTreeCompactTest, CompactNode) start" << std::endl;
+    // The key and two 32-bit links, the balance factor is packed into the left link.
+    ASSERT_EQ(sizeof(AVLTreeNodeCompact<test_data_type, uint32_t>), 12u);
+
+    AVLTreeCompact<test_data_type> tree{};
+    tree.reserve(1000);
+    for (test_data_type value = 0; value < 1000; value++) {
+        tree.insert(value);
+    }
+    ASSERT_TRUE(tree.verifyProperties());
+    ASSERT_LE(tree.memoryUsage(), 1001u * 12u);
+    std::cout << "TEST_F(AVLTreeCompactTest, CompactNode) end" << std::endl;
+}
+
+TEST_F(AVLTreeCompactTest, IndexLimit) {
+    std::cout << "TEST_F(AVLTreeCompactTest, IndexLimit) start" << std::endl;
+    // 8-bit links leave 63 indices for the nodes.
+    AVLTreeCompact<test_data_type, uint8_t> tree{};
+    for (test_data_type value = 0; value < 63; value++) {
+        tree.insert(value);
+    }
+    ASSERT_TRUE(tree.verifyProperties());
+    ASSERT_THROW(tree.insert(63), std::length_error);
+
+    // A freed index can be used again.
+    tree.deleteValue(0);
+    tree.insert(63);
+    ASSERT_TRUE(tree.search(63));
+    ASSERT_TRUE(tree.verifyProperties());
+    std::cout << "TEST_F(AVLTreeCompactTest, IndexLimit) end" << std::endl;
+}
+
+TEST_F(AVLTreeCompactTest, Stats) {
+    std::cout << "TEST_F(AVLTreeCompactTest, Stats) start" << std::endl;
+    using stats_type = CountingStats<struct AVLTreeCompactStatsTag>;
+    AVLTreeCompact<test_data_type, uint32_t, stats_type> tree{};
+    const test_data_type keys_count = 127;
+
+    stats_type::reset();
+    for (test_data_type key = 0; key < keys_count; key++) {
+        tree.insert(key);
+    }
+
+    const auto stats = stats_type::snapshot();
+    ASSERT_EQ(stats[StatsEvent::allocation], static_cast<uint64_t>(keys_count));
+    ASSERT_NE(stats[StatsEvent::comparison], 0u);
+    ASSERT_NE(stats[StatsEvent::rotation], 0u);
+    ASSERT_NE(stats[StatsEvent::rebalance], 0u);
+    std::cout << "TEST_F(AVLTreeCompactTest, Stats) end" << std::endl;
+}
@@ -3,19 +3,35 @@
 // + Lower performance costs than the recursion method.
 // - It uses an extra field in node for store a link to parent.
 #pragma once
+#include <algorithm>
+#include <bit>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <span>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "duplicate_keys.h"
 #include "head.h"
+#include "comparators.h"
+#include "stats.h"
+#include "thread_pool.h"
 
-template <class DataType, class SizeType = size_t>
+template <class DataType, class SizeType = size_t, class Duplicates = UniqueKeys>
 struct AVLTreeNodeLoop {
     using value_type = DataType;
     using size_type = SizeType;
     using signed_size_type = std::make_signed_t<size_type>;
-    using node_type = AVLTreeNodeLoop<value_type, size_type>;
+    using node_type = AVLTreeNodeLoop<value_type, size_type, Duplicates>;
     using node_type_ptr = std::shared_ptr<node_type>;
 
     value_type key {0};
+    // The keys equal to the key, nothing for UniqueKeys.
+    NO_UNIQUE_ADDRESS NodeDuplicates<value_type, size_type, Duplicates> duplicates{};
     node_type_ptr left{};
     node_type_ptr right{};
     node_type_ptr parent{};
@@ -56,19 +72,142 @@ struct AVLTreeNodeLoop {
     }
 };
 
-template <class DataType, class SizeType = size_t>
+// Stats: instrumentation policy (stats.h), reports key comparisons, node allocations, rotations and rebalance steps.
+// Duplicates: duplicate key policy (duplicate_keys.h), UniqueKeys, CountedKeys or ChainedKeys.
+template <class DataType, class SizeType = size_t, class Stats = NoStats, class Duplicates = UniqueKeys>
 class AVLTreeLoop {
 private:
     using value_type = DataType;
     using const_reference = const DataType &;
     using size_type = SizeType;
     using signed_size_type = std::make_signed_t<size_type>;
-    using node_type = AVLTreeNodeLoop<value_type, size_type>;
+    using node_type = AVLTreeNodeLoop<value_type, size_type, Duplicates>;
     using node_type_ptr = std::shared_ptr<node_type>;
 
+    static constexpr bool unique_keys = std::is_same_v<Duplicates, UniqueKeys>;
+
     node_type_ptr root{};
+    // The finger of insert(): the last inserted node and its neighbours in the key order, nullptr is the end of the keys.
+    // node_last is the maximum or nullptr if unknown. Dropped by the operations which remove nodes.
+    node_type *node_finger{};
+    node_type *node_finger_prev{};
+    node_type *node_finger_next{};
+    node_type *node_last{};
+
 
 public:
+    // Read-only bidirectional iterator over the keys in ascending order, it steps along the parent links.
+    // The equal keys of ChainedKeys come in insertion order, the count of CountedKeys repeats the key.
+    // Invalidated by the operations which take the tree apart. Removing a key invalidates only the iterators to it:
+    // the nodes of the other keys stay where they are in memory.
+    class ConstIterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = DataType;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const DataType *;
+        using reference = const DataType &;
+
+        CONSTEXPR20 ConstIterator() = default;
+
+        NODISCARD CONSTEXPR20 reference operator*() const {
+            return node->duplicates.key(node->key, index);
+        }
+
+        NODISCARD CONSTEXPR20 pointer operator->() const {
+            return &**this;
+        }
+
+        CONSTEXPR20 ConstIterator &operator++() {
+            if (++index == node->duplicates.count()) {
+                node = tree->successorNode(node);
+                index = 0;
+            }
+
+            return *this;
+        }
+
+        CONSTEXPR20 ConstIterator operator++(int) {
+            auto iterator = *this;
+            ++*this;
+            return iterator;
+        }
+
+        // The end steps back to the maximum.
+        CONSTEXPR20 ConstIterator &operator--() {
+            if (node && index != 0) {
+                index--;
+                return *this;
+            }
+
+            node = node ? tree->predecessorNode(node) : tree->maximumNode(tree->root.get());
+            index = node->duplicates.count() - 1;
+            return *this;
+        }
+
+        CONSTEXPR20 ConstIterator operator--(int) {
+            auto iterator = *this;
+            --*this;
+            return iterator;
+        }
+
+        NODISCARD CONSTEXPR20 bool operator==(const ConstIterator &other) const {
+            return node == other.node && index == other.index;
+        }
+
+        NODISCARD CONSTEXPR20 bool operator!=(const ConstIterator &other) const {
+            return !(*this == other);
+        }
+
+    private:
+        friend class AVLTreeLoop;
+
+        CONSTEXPR20 ConstIterator(node_type *node, const AVLTreeLoop *tree, size_type index = 0) :
+                node{ node },
+                tree{ tree },
+                index{ index }
+        {
+        }
+
+        node_type *node{};
+        const AVLTreeLoop *tree{};
+        // The position among the equal keys of the node.
+        size_type index{};
+    };
+
+    // A node unlinked by extract(). insert(NodeHandle&&) links it into a tree of the same type without an allocation.
+    // The node carries all the keys equal to its key.
+    class NodeHandle {
+    public:
+        CONSTEXPR20 NodeHandle() = default;
+        CONSTEXPR20 NodeHandle(NodeHandle &&) noexcept = default;
+        CONSTEXPR20 NodeHandle &operator=(NodeHandle &&) noexcept = default;
+        NodeHandle(const NodeHandle &) = delete;
+        NodeHandle &operator=(const NodeHandle &) = delete;
+
+        NODISCARD CONSTEXPR20 bool empty() const {
+            return !node;
+        }
+
+        CONSTEXPR20 explicit operator bool() const {
+            return !empty();
+        }
+
+        NODISCARD CONSTEXPR20 const value_type &value() const {
+            return node->key;
+        }
+
+    private:
+        friend class AVLTreeLoop;
+
+        CONSTEXPR20 explicit NodeHandle(node_type_ptr node) :
+                node{ std::move(node) }
+        {
+        }
+
+        node_type_ptr node{};
+    };
+
     CONSTEXPR20 AVLTreeLoop() = default;
 
     CONSTEXPR20 explicit AVLTreeLoop(const std::vector<value_type> &vec) {
@@ -85,7 +224,46 @@ public:
         }
     }
 
-    CONSTEXPR20 ~AVLTreeLoop() = default;
+    CONSTEXPR20 AVLTreeLoop(AVLTreeLoop &&other) noexcept :
+            root{ std::exchange(other.root, nullptr) },
+            node_finger{ std::exchange(other.node_finger, nullptr) },
+            node_finger_prev{ std::exchange(other.node_finger_prev, nullptr) },
+            node_finger_next{ std::exchange(other.node_finger_next, nullptr) },
+            node_last{ std::exchange(other.node_last, nullptr) }
+    {
+    }
+
+    CONSTEXPR20 AVLTreeLoop &operator=(AVLTreeLoop &&other) noexcept {
+        if (this != &other) {
+            clear();
+            root = std::exchange(other.root, nullptr);
+            node_finger = std::exchange(other.node_finger, nullptr);
+            node_finger_prev = std::exchange(other.node_finger_prev, nullptr);
+            node_finger_next = std::exchange(other.node_finger_next, nullptr);
+            node_last = std::exchange(other.node_last, nullptr);
+        }
+
+        return *this;
+    }
+
+    // Structural copy: the nodes are copied level by level with their heights, so nothing is rebalanced. O(n).
+    CONSTEXPR20 AVLTreeLoop(const AVLTreeLoop &other) :
+            root{ cloneNodes(other.root) }
+    {
+    }
+
+    CONSTEXPR20 AVLTreeLoop &operator=(const AVLTreeLoop &other) {
+        if (this != &other) {
+            *this = AVLTreeLoop{ other };
+        }
+
+        return *this;
+    }
+
+    // The parent links make cycles of shared_ptr: the nodes must be unlinked to be released.
+    CONSTEXPR20 ~AVLTreeLoop() {
+        clear();
+    }
 
     NODISCARD CONSTEXPR20 bool search(const value_type &&value) const {
         return searchElement(value);
@@ -95,14 +273,61 @@ public:
         return searchElement(value);
     }
 
-    CONSTEXPR20 void insert(const value_type &&value) {
-        insertElement(value);
+    // Search many keys at once: results[i] = search(keys[i]). results must be at least as long as keys.
+    // The lookups of a group advance together one level per step. The next node of every lookup is prefetched
+    // while the other lookups of the group are compared, so their cache misses overlap instead of being serialized.
+    CONSTEXPR20 void searchBatch(std::span<const value_type> keys, std::span<bool> results) const {
+        searchBatchGroups(keys, [&results](size_type index, const node_type* node) {
+            results[index] = node != nullptr;
+        });
+    }
+
+    // Same, found[i] points to the key stored in the tree or is nullptr.
+    CONSTEXPR20 void searchBatch(std::span<const value_type> keys, std::span<const value_type*> found) const {
+        searchBatchGroups(keys, [&found](size_type index, const node_type* node) {
+            found[index] = node ? &node->key : nullptr;
+        });
+    }
+
+    // The last inserted node and its neighbours are kept as a finger: a key which goes between them
+    // (an append, a near-sorted stream) is linked without the search from the root.
+    // Returns the iterator to the key in the tree and whether it was inserted.
+    // CountedKeys and ChainedKeys add the equal key to the node of the key in O(1) and always insert.
+    CONSTEXPR20 std::pair<ConstIterator, bool> insert(const value_type &&value) {
+        return insert(value);
     }
 
-    CONSTEXPR20 void insert(const value_type &value) {
-        insertElement(value);
+    CONSTEXPR20 std::pair<ConstIterator, bool> insert(const value_type &value) {
+        return insertAt(searchPosition(value), value);
     }
 
+    // Insert the key next to the hint, like std::set::insert(hint, key). O(1) search if the key goes right before
+    // or right after the hint, otherwise the search climbs from the hint only up to the lowest ancestor whose subtree
+    // holds the key and descends from there. Returns the iterator to the key in the tree.
+    // The equal keys of ChainedKeys stay in insertion order whatever the hint.
+    CONSTEXPR20 ConstIterator insert(ConstIterator hint, const value_type &key) {
+        return insertAt(searchPositionNearHint(hint.node, key), key).first;
+    }
+
+    // Link the node of the handle without an allocation. If the key is in the tree, the handle keeps the node.
+    CONSTEXPR20 std::pair<ConstIterator, bool> insert(NodeHandle &&handle) {
+        if (handle.empty()) {
+            return { end(), false };
+        }
+
+        const auto position = searchPosition(handle.node->key);
+        if (position.found) {
+            return { { position.node, this }, false };
+        }
+
+        auto &node = handle.node;
+        node->left = nullptr;
+        node->right = nullptr;
+        node->height = 1;
+        return { { linkNode(position, std::move(node)), this }, true };
+    }
+
+    // Removes the key with all its equal keys.
     CONSTEXPR20 void deleteValue(const value_type &&value) {
         deleteElement(value);
     }
@@ -111,10 +336,186 @@ public:
         deleteElement(value);
     }
 
+    // Erase the key at the iterator without a search. Returns the iterator to the next key.
+    // An equal key of CountedKeys and ChainedKeys is removed from its node, the node stays.
+    CONSTEXPR20 ConstIterator erase(ConstIterator position) {
+        auto node = position.node;
+        if constexpr (!unique_keys) {
+            auto &duplicates = node->duplicates;
+            if (duplicates.count() > 1) {
+                duplicates.remove(node->key, position.index);
+                if (position.index < duplicates.count()) {
+                    return { node, this, position.index };
+                }
+
+                return { successorNode(node), this };
+            }
+        }
+
+        auto node_next = successorNode(node);
+        eraseNode(sharedNode(node));
+        return { node_next, this };
+    }
+
+    // Unlink the node of the key at the iterator without a search, the handle owns it with all the equal keys.
+    NODISCARD CONSTEXPR20 NodeHandle extract(ConstIterator position) {
+        return NodeHandle{ eraseNode(sharedNode(position.node)) };
+    }
+
+    // The handle is empty if the key is not in the tree.
+    NODISCARD CONSTEXPR20 NodeHandle extract(const value_type &key) {
+        const auto position = find(key);
+        if (position == end()) {
+            return {};
+        }
+
+        return extract(position);
+    }
+
+    NODISCARD CONSTEXPR20 ConstIterator begin() const {
+        return { minimumNode(root.get()), this };
+    }
+
+    NODISCARD CONSTEXPR20 ConstIterator end() const {
+        return { nullptr, this };
+    }
+
+    // The first of the equal keys.
+    NODISCARD CONSTEXPR20 ConstIterator find(const value_type &key) const {
+        const auto [node, found] = lowerBoundNode(key);
+        return found ? ConstIterator{ node, this } : end();
+    }
+
+    // The number of the keys equal to the key: the count of its node. O(log n).
+    NODISCARD CONSTEXPR20 size_type count(const value_type &key) const {
+        const auto [node, found] = lowerBoundNode(key);
+        return found ? node->duplicates.count() : 0;
+    }
+
+    // The first key not less than the key.
+    NODISCARD CONSTEXPR20 ConstIterator lower_bound(const value_type &key) const {
+        return { lowerBoundNode(key).first, this };
+    }
+
+    // The first key greater than the key.
+    NODISCARD CONSTEXPR20 ConstIterator upper_bound(const value_type &key) const {
+        const auto [node, found] = lowerBoundNode(key);
+        return { found ? successorNode(node) : node, this };
+    }
+
+    // The keys equal to the key. One search: the equal keys share a node, the range ends at its successor. O(log n).
+    NODISCARD CONSTEXPR20 std::pair<ConstIterator, ConstIterator> equal_range(const value_type &key) const {
+        const auto [node, found] = lowerBoundNode(key);
+        const ConstIterator first{ node, this };
+        return { first, found ? ConstIterator{ successorNode(node), this } : first };
+    }
+
+    // Join the trees and the key, the keys of left go before the key and the keys of right go after it.
+    // O(|h(left) - h(right)| + 1). The operand trees become empty.
+    NODISCARD static AVLTreeLoop join(AVLTreeLoop &&left, const value_type &key, AVLTreeLoop &&right) {
+        AVLTreeLoop result{};
+        result.root = result.joinNodes(left.takeRoot(), result.createNewNode(key), right.takeRoot());
+        return result;
+    }
+
+    // Join the trees, the keys of left go before the keys of right. O(log n). The operand trees become empty.
+    NODISCARD static AVLTreeLoop join2(AVLTreeLoop &&left, AVLTreeLoop &&right) {
+        AVLTreeLoop result{};
+        result.root = result.join2Nodes(left.takeRoot(), right.takeRoot());
+        return result;
+    }
+
+    // Split the tree into the keys before the key and the keys after it. O(log n).
+    // The flag tells whether the key was in the tree. The tree becomes empty.
+    NODISCARD std::tuple<AVLTreeLoop, bool, AVLTreeLoop> split(const value_type &key) {
+        auto [left, found, right] = splitNodes(takeRoot(), key);
+        AVLTreeLoop left_tree{};
+        AVLTreeLoop right_tree{};
+        left_tree.root = left;
+        right_tree.root = right;
+        return { std::move(left_tree), found, std::move(right_tree) };
+    }
+
+    // Set operations on join and split: the work is O(m log(n / m + 1)) for the sizes m <= n.
+    // Both halves of a subproblem go to the pool while the trees are higher than log2(grain_size).
+    // The operand trees become empty.
+    NODISCARD static AVLTreeLoop setUnion(AVLTreeLoop &&first, AVLTreeLoop &&second, ThreadPool &pool,
+                                          size_type grain_size = default_grain_size) {
+        static_assert(unique_keys, "The set operations are defined for UniqueKeys.");
+        AVLTreeLoop result{};
+        result.root = result.unionNodes(first.takeRoot(), second.takeRoot(), pool, parallelHeight(grain_size));
+        return result;
+    }
+
+    NODISCARD static AVLTreeLoop setIntersection(AVLTreeLoop &&first, AVLTreeLoop &&second, ThreadPool &pool,
+                                                 size_type grain_size = default_grain_size) {
+        static_assert(unique_keys, "The set operations are defined for UniqueKeys.");
+        AVLTreeLoop result{};
+        result.root = result.intersectionNodes(first.takeRoot(), second.takeRoot(), pool, parallelHeight(grain_size));
+        return result;
+    }
+
+    // The keys of first which are not in second.
+    NODISCARD static AVLTreeLoop setDifference(AVLTreeLoop &&first, AVLTreeLoop &&second, ThreadPool &pool,
+                                               size_type grain_size = default_grain_size) {
+        static_assert(unique_keys, "The set operations are defined for UniqueKeys.");
+        AVLTreeLoop result{};
+        result.root = result.differenceNodes(first.takeRoot(), second.takeRoot(), pool, parallelHeight(grain_size));
+        return result;
+    }
+
+    NODISCARD CONSTEXPR20 bool isEmpty() const {
+        return !root;
+    }
+
+    // Release the nodes without recursion and without extra memory in O(n): the left child is rotated up
+    // until the node has none, then the node goes with all links empty.
+    CONSTEXPR20 void clear() {
+        setFinger(nullptr, nullptr, nullptr);
+        auto node = std::exchange(root, nullptr);
+        while (node) {
+            node->parent = nullptr;
+            if (node->left) {
+                auto node_left = std::move(node->left);
+                node->left = std::move(node_left->right);
+                node_left->right = std::move(node);
+                node = std::move(node_left);
+            } else {
+                node = std::move(node->right);
+            }
+        }
+    }
+
     CONSTEXPR20 auto getRoot() const {
         return root;
     }
 
+    // Visit the keys in ascending order without recursion, the equal keys in the order of the iterator.
+    // The stack holds the path to the current node.
+    template<class Visitor>
+    CONSTEXPR20 void forEachInOrder(Visitor&& visitor) const {
+        const node_type* const node_end = nullptr;
+        std::vector<const node_type*> stack{};
+        const node_type* node_current = root.get();
+
+        while (node_current != node_end || !stack.empty()) {
+            // Move down to the leftmost node.
+            while (node_current != node_end) {
+                stack.push_back(node_current);
+                node_current = node_current->left.get();
+            }
+
+            node_current = stack.back();
+            stack.pop_back();
+            const auto &duplicates = node_current->duplicates;
+            for (size_type index = 0; index < duplicates.count(); index++) {
+                visitor(duplicates.key(node_current->key, index));
+            }
+
+            node_current = node_current->right.get();
+        }
+    }
+
     // Print the tree
     void printTree(node_type_ptr node, bool leftNode = false) {
         if (!node) {
@@ -236,82 +637,400 @@ private:
         return true;
     }
 
-    CONSTEXPR20 void insertElement(const value_type &key) {
-        if (root) {
-            root = insertNodeInTree(root, key);
-        } else {
-            root = createNewNode(key);
+    // Number of lookups advanced together by searchBatch(). Enough misses in flight to use the memory-level parallelism.
+    static constexpr size_type batch_group_size = 16;
+
+    template<class OnResult>
+    CONSTEXPR20 void searchBatchGroups(std::span<const value_type> keys, OnResult&& on_result) const {
+        const node_type* const node_end = nullptr;
+        const node_type* nodes[batch_group_size];
+        const size_type keys_count = keys.size();
+
+        for (size_type group_first = 0; group_first < keys_count; group_first += batch_group_size) {
+            const size_type group_size = keys_count - group_first < batch_group_size ? keys_count - group_first : batch_group_size;
+            const node_type* const node_root = root.get();
+            for (size_type index = 0; index < group_size; index++) {
+                nodes[index] = node_root;
+            }
+
+            // Every step moves each unfinished lookup one level down.
+            size_type active_count = node_root != node_end ? group_size : 0;
+            while (active_count != 0) {
+                active_count = 0;
+
+                for (size_type index = 0; index < group_size; index++) {
+                    auto node_current = nodes[index];
+                    if (!node_current) {
+                        // The lookup is finished.
+                        continue;
+                    }
+
+                    const auto& key = keys[group_first + index];
+                    if (isLess(key, node_current->key)) {
+                        // left subtree
+                        node_current = node_current->left.get();
+                    } else if (isGreater(key, node_current->key)) {
+                        // right subtree
+                        node_current = node_current->right.get();
+                    } else {
+                        // Node found.
+                        on_result(group_first + index, node_current);
+                        nodes[index] = nullptr;
+                        continue;
+                    }
+
+                    if (node_current == node_end) {
+                        // The Node was not found.
+                        on_result(group_first + index, nullptr);
+                        nodes[index] = nullptr;
+                        continue;
+                    }
+
+                    // Fetch the next node while the other lookups of the group are processed.
+                    PREFETCH(node_current);
+                    nodes[index] = node_current;
+                    active_count++;
+                }
+            }
+
+            if (node_root == node_end) {
+                for (size_type index = 0; index < group_size; index++) {
+                    on_result(group_first + index, nullptr);
+                }
+            }
         }
     }
 
-    CONSTEXPR20 node_type_ptr insertNodeInTree(node_type_ptr node, const value_type &key) {
-        // Search the node to insert.
-        auto node_current = searchNodeForInsert(node, key);
-        if (!node_current) {
-            // The same key value already exist in tree.
-            return root;
+    // Where the key goes: the node with the key if it is found, otherwise the parent of the new leaf
+    // (nullptr in the empty tree), the side of the leaf and its neighbours in the key order.
+    struct InsertPosition {
+        node_type *node{};
+        bool found{};
+        bool right_child{};
+        node_type *node_prev{};
+        node_type *node_next{};
+    };
+
+    // A found key is not inserted again, CountedKeys and ChainedKeys add it to the node.
+    CONSTEXPR20 std::pair<ConstIterator, bool> insertAt(const InsertPosition &position, const value_type &key) {
+        if (position.found) {
+            if constexpr (unique_keys) {
+                return {{position.node, this}, false};
+            } else {
+                auto &duplicates = position.node->duplicates;
+                duplicates.add(key);
+                return {{position.node, this, duplicates.count() - 1}, true};
+            }
         }
 
-        // Create and insert node.
-        auto node_new = createNewNode(key);
-        // Make a link with the previous node.
-        makeLinkWithPreviousNode(node_new, node_current);
+        return {{linkNode(position, createNewNode(key)), this}, true};
+    }
 
-        // Node has inserted in tree.
-        return processModifiedNodesAfterInsert(key, node_current);
+    NODISCARD CONSTEXPR20 InsertPosition searchPosition(const value_type &key) const {
+        if (!root) {
+            return {};
+        }
+
+        if (node_finger) {
+            return searchPositionNearFinger(key);
+        }
+
+        return searchPositionInSubtree(root.get(), key, nullptr, nullptr);
     }
 
-    CONSTEXPR20 node_type_ptr searchNodeForInsert(node_type_ptr node, const value_type &key) {
-        auto node_next = node;
-        node_type_ptr node_current;
+    // Between the finger and its neighbours or after the maximum, otherwise search from the neighbour on its side.
+    NODISCARD CONSTEXPR20 InsertPosition searchPositionNearFinger(const value_type &key) const {
+        if (isGreater(key, node_finger->key)) {
+            if (!node_finger_next || isLess(key, node_finger_next->key)) {
+                return positionBetween(node_finger, node_finger_next);
+            }
+
+            if (node_last && isGreater(key, node_last->key)) {
+                // A new maximum.
+                return positionBetween(node_last, nullptr);
+            }
+
+            return searchPositionFromNode(node_finger_next, key, finger_climb_limit);
+        }
+
+        if (isLess(key, node_finger->key)) {
+            if (!node_finger_prev || isGreater(key, node_finger_prev->key)) {
+                return positionBetween(node_finger_prev, node_finger);
+            }
+
+            return searchPositionFromNode(node_finger_prev, key, finger_climb_limit);
+        }
+
+        return {node_finger, true};
+    }
+
+    // Right before or right after the hint, otherwise search from the neighbour on the side of the key.
+    // nullptr is the end().
+    NODISCARD CONSTEXPR20 InsertPosition searchPositionNearHint(node_type *node_hint, const value_type &key) const {
+        if (!root) {
+            return {};
+        }
+
+        if (!node_hint || isLess(key, node_hint->key)) {
+            auto node_before = node_hint ? predecessorNode(node_hint) : lastNode();
+            if (!node_before || isGreater(key, node_before->key)) {
+                return positionBetween(node_before, node_hint);
+            }
+
+            return searchPositionFromNode(node_before, key, std::numeric_limits<size_type>::max());
+        }
+
+        if (isGreater(key, node_hint->key)) {
+            auto node_after = successorNode(node_hint);
+            if (!node_after || isLess(key, node_after->key)) {
+                return positionBetween(node_hint, node_after);
+            }
+
+            if (node_last && isGreater(key, node_last->key)) {
+                // A new maximum.
+                return positionBetween(node_last, nullptr);
+            }
+
+            return searchPositionFromNode(node_after, key, std::numeric_limits<size_type>::max());
+        }
+
+        return {node_hint, true};
+    }
+
+    // Between the adjacent nodes, nullptr is the end of the keys. No comparisons:
+    // either the right child of the predecessor is free or the successor is the leftmost node of that subtree.
+    NODISCARD CONSTEXPR20 InsertPosition positionBetween(node_type *node_prev, node_type *node_next) const {
+        if (node_prev && !node_prev->right) {
+            return {node_prev, false, true, node_prev, node_next};
+        }
+
+        return {node_next, false, false, node_prev, node_next};
+    }
+
+    // The keys far from the finger are searched from the root: the climb of the random key would go up to the root
+    // and double the search. The subtree of this height holds at least 2^(limit / 2) nodes around the finger.
+    static constexpr size_type finger_climb_limit = 4;
+
+    // Finger search: climb from the node while the key is outside of its subtree, then descend from there.
+    // A right child is climbed without a comparison when the key is greater than the node, a left child when it is less.
+    // The key equal to an ancestor is found by the descent. After climb_limit levels the search starts from the root.
+    NODISCARD CONSTEXPR20 InsertPosition searchPositionFromNode(node_type *node, const value_type &key, size_type climb_limit) const {
+        node_type *node_prev = nullptr;
+        node_type *node_next = nullptr;
+
+        if (isGreater(key, node->key)) {
+            for (auto node_parent = node->parent.get(); node_parent; node = node_parent, node_parent = node->parent.get()) {
+                if (climb_limit-- == 0) {
+                    return searchPositionInSubtree(root.get(), key, nullptr, nullptr);
+                }
+
+                if (node_parent->left.get() == node && isLess(key, node_parent->key)) {
+                    node_next = node_parent;
+                    break;
+                }
+            }
+        } else if (isLess(key, node->key)) {
+            for (auto node_parent = node->parent.get(); node_parent; node = node_parent, node_parent = node->parent.get()) {
+                if (climb_limit-- == 0) {
+                    return searchPositionInSubtree(root.get(), key, nullptr, nullptr);
+                }
+
+                if (node_parent->right.get() == node && isGreater(key, node_parent->key)) {
+                    node_prev = node_parent;
+                    break;
+                }
+            }
+        } else {
+            return {node, true};
+        }
+
+        return searchPositionInSubtree(node, key, node_prev, node_next);
+    }
+
+    // Search the subtree, node_prev and node_next are the nearest keys around it.
+    // The bounds narrow down on the way, so they are the neighbours of the new leaf at the end.
+    NODISCARD CONSTEXPR20 InsertPosition searchPositionInSubtree(node_type *node, const value_type &key,
+                                                                node_type *node_prev, node_type *node_next) const {
+        auto node_next_step = node;
+        node_type *node_current;
 
         do {
-            node_current = node_next;
+            node_current = node_next_step;
 
             if (isLess(key, node_current->key)) {
                 // left subtree
-                node_next = node_current->left;
+                node_next = node_current;
+                node_next_step = node_current->left.get();
             } else if (isGreater(key, node_current->key)) {
                 // right subtree
-                node_next = node_current->right;
+                node_prev = node_current;
+                node_next_step = node_current->right.get();
             } else {
                 // The same key value already exist in tree.
-                return nullptr;
+                return {node_current, true};
             }
-        } while (node_next);
+        } while (node_next_step);
 
-        return node_current;
+        return {node_current, false, node_prev == node_current, node_prev, node_next};
+    }
+
+    // Link the node as a new leaf at the position and rebalance.
+    CONSTEXPR20 node_type *linkNode(const InsertPosition &position, node_type_ptr node_new) {
+        const auto node = node_new.get();
+        const auto node_parent = position.node;
+        if (!node_parent) {
+            root = std::move(node_new);
+            setFinger(node, nullptr, nullptr);
+            return node;
+        }
+
+        node_new->parent = sharedNode(node_parent);
+        (position.right_child ? node_parent->right : node_parent->left) = std::move(node_new);
+        setFinger(node, position.node_prev, position.node_next);
+
+        // Node has inserted in tree.
+        root = processModifiedNodesAfterInsert(node->key, node->parent);
+
+        return node;
+    }
+
+    CONSTEXPR20 void setFinger(node_type *node, node_type *node_prev, node_type *node_next) {
+        node_finger = node;
+        node_finger_prev = node_prev;
+        node_finger_next = node_next;
+        if (!node_next) {
+            node_last = node;
+        }
+    }
+
+    // The owning pointer of the node: the link from its parent or the root.
+    NODISCARD CONSTEXPR20 const node_type_ptr &sharedNode(const node_type *node) const {
+        const auto &node_parent = node->parent;
+        if (!node_parent) {
+            return root;
+        }
+
+        return node_parent->left.get() == node ? node_parent->left : node_parent->right;
     }
 
+    // The node with the key, otherwise the node of the first greater key or nullptr.
+    NODISCARD CONSTEXPR20 std::pair<node_type *, bool> lowerBoundNode(const value_type &key) const {
+        const node_type* const node_end = nullptr;
+        node_type *node_bound = nullptr;
+        auto node_current = root.get();
+        while (node_current != node_end) {
+            if (isLess(key, node_current->key)) {
+                node_bound = node_current;
+                node_current = node_current->left.get();
+            } else if (isGreater(key, node_current->key)) {
+                node_current = node_current->right.get();
+            } else {
+                return {node_current, true};
+            }
+        }
+
+        return {node_bound, false};
+    }
+
+    NODISCARD CONSTEXPR20 node_type *minimumNode(node_type *node) const {
+        if (!node) {
+            return nullptr;
+        }
+
+        while (node->left) {
+            node = node->left.get();
+        }
+
+        return node;
+    }
+
+    NODISCARD CONSTEXPR20 node_type *maximumNode(node_type *node) const {
+        if (!node) {
+            return nullptr;
+        }
+
+        while (node->right) {
+            node = node->right.get();
+        }
+
+        return node;
+    }
+
+    NODISCARD CONSTEXPR20 node_type *lastNode() const {
+        if (node_last) {
+            return node_last;
+        }
+
+        return maximumNode(root.get());
+    }
+
+    // The next node in the key order or nullptr.
+    NODISCARD CONSTEXPR20 node_type *successorNode(node_type *node) const {
+        if (node->right) {
+            return minimumNode(node->right.get());
+        }
+
+        // Climb while the node is the right child.
+        auto node_parent = node->parent.get();
+        while (node_parent && node_parent->right.get() == node) {
+            node = node_parent;
+            node_parent = node->parent.get();
+        }
+
+        return node_parent;
+    }
+
+    NODISCARD CONSTEXPR20 node_type *predecessorNode(node_type *node) const {
+        if (node->left) {
+            return maximumNode(node->left.get());
+        }
+
+        // Climb while the node is the left child.
+        auto node_parent = node->parent.get();
+        while (node_parent && node_parent->left.get() == node) {
+            node = node_parent;
+            node_parent = node->parent.get();
+        }
+
+        return node_parent;
+    }
+
+    // Update the heights and rebalance up to the first subtree whose height didn't change:
+    // the nodes above it keep their heights. Returns the root.
     NODISCARD CONSTEXPR20 node_type_ptr processModifiedNodesAfterInsert(const value_type& key, node_type_ptr from_node) {
-        // Update the height and rebalance.
         auto node_next = from_node;
         node_type_ptr node_current;
 
         do {
             node_current = node_next;
+            const auto height_before = node_current->height;
             // Update the height.
             node_current->updateHeight();
             // Rebalance the node.
-            node_current = rebalanceInsert(node_current, key);
+            auto node_top = rebalanceInsert(node_current, key);
             // Get parent node.
-            node_next = node_current->parent;
-            if (node_next) {
-                // Set node_current to parent node.
-                if (isLess(key, node_next->key)) {
-                    // left subtree
-                    node_next->left = node_current;
-                } else if (isGreater(key, node_next->key)) {
-                    // Right Left case.
-                    node_next->right = node_current;
+            node_next = node_top->parent;
+            if (node_next && node_top != node_current) {
+                // The rotated subtree takes the place of the node in the parent.
+                if (node_next->left == node_current) {
+                    node_next->left = node_top;
+                } else {
+                    node_next->right = node_top;
                 }
             }
+
+            if (node_top->height == height_before) {
+                return node_next ? root : node_top;
+            }
+
+            node_current = node_top;
         } while (node_next);
 
         return node_current;
     }
 
     CONSTEXPR20 node_type_ptr rebalanceInsert(node_type_ptr node, const value_type &key) {
+        Stats::add(StatsEvent::rebalance);
         const signed_size_type balance_factor = node->getBalanceFactor();
         if (balance_factor > 1) {
             if (isLess(key, node->left->key)) {
@@ -344,33 +1063,37 @@ private:
 
     CONSTEXPR20 void deleteElement(const value_type &key) {
         if (root) {
-            root = deleteNodeInTree(root, key);
+            deleteNodeInTree(root, key);
         }
     }
 
-    CONSTEXPR20 node_type_ptr deleteNodeInTree(node_type_ptr node, const value_type &key) {
+    CONSTEXPR20 void deleteNodeInTree(node_type_ptr node, const value_type &key) {
         // Search the node to delete.
         auto node_current = searchNodeForDelete(node, key);
-        if (!node_current) {
-            // The Node was not found.
-            return root;
+        if (node_current) {
+            eraseNode(node_current);
         }
+    }
+
+    // Unlink the node and rebalance. Returns the unlinked node. The other nodes keep their keys,
+    // so the iterators to them stay valid.
+    CONSTEXPR20 node_type_ptr eraseNode(node_type_ptr node) {
+        setFinger(nullptr, nullptr, nullptr);
+        auto node_removed = node;
 
         // Delete the node.
-        auto node_parent = node_current->parent;
-        node_current = deleteNodePreProcess(node_current, node_parent);
+        auto node_parent = node->parent;
+        auto node_current = deleteNodePreProcess(node, node_parent);
         if (!node_current) {
-            // The node has no children and rebalance is not needed.
-            if (!node_parent) {
-                return root;
-            }
-
-            // The rebalance is needed for parent node.
+            // The node had no children, the rebalance is needed for parent node.
             node_current = node_parent;
         }
 
-        // The Node was found.
-        return processModifiedNodesAfterDelete(key, node_current);
+        if (node_current) {
+            root = processModifiedNodesAfterDelete(node_current);
+        }
+
+        return node_removed;
     }
 
     CONSTEXPR20 node_type_ptr searchNodeForDelete(node_type_ptr node, const value_type &key) {
@@ -395,22 +1118,33 @@ private:
     CONSTEXPR20 node_type_ptr deleteNodePreProcess(node_type_ptr node, node_type_ptr node_parent) {
         if (node->left && node->right) {
             // Node has two children.
-            // Get inorder successor. Smallest in the right tree.
+            // Get inorder successor. Smallest in the right tree. It has no left child.
             auto node_min = getMinimumValueNode(node->right);
-            auto node_old = node;
             auto node_min_parent = node_min->parent;
-            const auto node_min_key = node_min->key;
-            node->key = node_min->key;
-            // Delete the old value's node.
-            // This one time recursion. The min node will never have a left child, only a right child maybe that grater than current node.
-            node_min = deleteNodePreProcess(node_min, node_min_parent);
-            if (node_min) {
-                node->right = processModifiedNodesAfterDelete(node_min_key, node_min, node_old);
-            }
-            else if (node != node_min_parent) { // The "else if" Check is necessary.
-                node->right = processModifiedNodesAfterDelete(node_min_key, node_min_parent, node_old);
-            }
-            // The rebalance is not needed.
+            // The successor node itself takes the place of the node, like std::map: the keys don't move between nodes.
+            if (node_min_parent == node) {
+                node_min_parent = node_min;
+            } else {
+                node_min_parent->left = node_min->right;
+                if (node_min_parent->left) {
+                    node_min_parent->left->parent = node_min_parent;
+                }
+
+                node_min->right = node->right;
+                node_min->right->parent = node_min;
+            }
+
+            if (node_parent) {
+                swapChildNodeForParent(node, node_parent, node_min);
+            } else {
+                node_min->parent = nullptr;
+            }
+
+            node_min->left = node->left;
+            node_min->left->parent = node_min;
+            deleteNode(node);
+            // The rebalance is needed from the old parent of the successor, or from the successor if it was the child.
+            node = node_min_parent;
         } else {
             if (node->left) {
                 // Node has only left child.
@@ -418,6 +1152,9 @@ private:
                 // Fix relations.
                 if (node_parent) {
                     swapChildNodeForParent(node, node_parent, left_node);
+                } else {
+                    // The child becomes the root.
+                    left_node->parent = nullptr;
                 }
                 // Delete the node.
                 deleteNode(node);
@@ -429,6 +1166,9 @@ private:
                 // Fix relations.
                 if (node_parent) {
                     swapChildNodeForParent(node, node_parent, right_node);
+                } else {
+                    // The child becomes the root.
+                    right_node->parent = nullptr;
                 }
                 // Delete the node.
                 deleteNode(node);
@@ -450,7 +1190,8 @@ private:
         return node;
     }
 
-    NODISCARD CONSTEXPR20 node_type_ptr processModifiedNodesAfterDelete(const value_type& key, node_type_ptr from_node, node_type_ptr to_node = nullptr) {
+    // Update the heights and rebalance from the node up to to_node, returns the top of the subtree below to_node.
+    NODISCARD CONSTEXPR20 node_type_ptr processModifiedNodesAfterDelete(node_type_ptr from_node, node_type_ptr to_node = nullptr) {
         auto node_next = from_node;
         node_type_ptr node_current;
 
@@ -459,26 +1200,26 @@ private:
             // Update the height.
             node_current->updateHeight();
             // Rebalance the node.
-            node_current = rebalanceDelete(node_current);
+            auto node_top = rebalanceDelete(node_current);
             // Get parent node.
-            node_next = node_current->parent;
-            if (node_next) {
-                // Set node_current to parent node.
-                if (isLess(key, node_next->key)) {
-                    // left subtree
-                    node_next->left = node_current;
-                }
-                else if (isGreater(key, node_next->key)) {
-                    // Right Left case.
-                    node_next->right = node_current;
+            node_next = node_top->parent;
+            if (node_next && node_top != node_current) {
+                // The rotated subtree takes the place of the node in the parent.
+                if (node_next->left == node_current) {
+                    node_next->left = node_top;
+                } else {
+                    node_next->right = node_top;
                 }
             }
+
+            node_current = node_top;
         } while(node_next != to_node);
 
         return node_current;
     }
 
     CONSTEXPR20 node_type_ptr rebalanceDelete(node_type_ptr node) {
+        Stats::add(StatsEvent::rebalance);
         const signed_size_type balance_factor = node->getBalanceFactor();
         if (balance_factor > 1) {
             if (node->left->getBalanceFactor() >= 0) {
@@ -507,6 +1248,7 @@ private:
     }
 
     CONSTEXPR20 auto rotateLeft(node_type_ptr node) {
+        Stats::add(StatsEvent::rotation);
         const auto right_node = node->right;
 
         node->right = right_node->left;
@@ -525,6 +1267,7 @@ private:
     }
 
     CONSTEXPR20 auto rotateRight(node_type_ptr node) {
+        Stats::add(StatsEvent::rotation);
         const auto left_node = node->left;
 
         node->left = left_node->right;
@@ -542,20 +1285,332 @@ private:
         return left_node;
     }
 
-    CONSTEXPR20 node_type_ptr createNewNode(const value_type& key) const {
-        return std::make_shared<node_type>(key);
+    NODISCARD CONSTEXPR20 node_type_ptr takeRoot() {
+        setFinger(nullptr, nullptr, nullptr);
+        auto node = std::exchange(root, nullptr);
+        if (node) {
+            node->parent = nullptr;
+        }
+
+        return node;
+    }
+
+    NODISCARD static CONSTEXPR20 size_type getHeight(const node_type_ptr &node) {
+        return node ? node->height : 0;
+    }
+
+    // Cut the node out of its subtree, the children become roots.
+    CONSTEXPR20 std::pair<node_type_ptr, node_type_ptr> detachChildren(const node_type_ptr &node) const {
+        auto left_node = std::exchange(node->left, nullptr);
+        auto right_node = std::exchange(node->right, nullptr);
+        if (left_node) {
+            left_node->parent = nullptr;
+        }
+
+        if (right_node) {
+            right_node->parent = nullptr;
+        }
+
+        node->parent = nullptr;
+        node->height = 1;
+        return {std::move(left_node), std::move(right_node)};
+    }
+
+    CONSTEXPR20 const node_type_ptr &linkChildren(const node_type_ptr &node, const node_type_ptr &left_node, const node_type_ptr &right_node) const {
+        node->left = left_node;
+        if (left_node) {
+            left_node->parent = node;
+        }
+
+        node->right = right_node;
+        if (right_node) {
+            right_node->parent = node;
+        }
+
+        node->updateHeight();
+        return node;
+    }
+
+    // Join two detached subtrees and the detached middle node, the keys of left < the middle key < the keys of right.
+    NODISCARD CONSTEXPR20 node_type_ptr joinNodes(node_type_ptr left, node_type_ptr node_middle, node_type_ptr right) {
+        const size_type left_height = getHeight(left);
+        const size_type right_height = getHeight(right);
+        node_type_ptr node_top;
+
+        if (left_height > right_height + 1) {
+            node_top = joinRight(left, node_middle, right);
+        } else if (right_height > left_height + 1) {
+            node_top = joinLeft(left, node_middle, right);
+        } else {
+            node_top = linkChildren(node_middle, left, right);
+        }
+
+        node_top->parent = nullptr;
+        return node_top;
+    }
+
+    // The left tree is higher: replace the first subtree of its right spine which is not higher than right + 1
+    // by the middle node, then rebalance up to the root like after an insert.
+    CONSTEXPR20 node_type_ptr joinRight(const node_type_ptr &left, const node_type_ptr &node_middle, const node_type_ptr &right) {
+        const size_type right_height = getHeight(right);
+        node_type_ptr node_parent;
+        auto node_current = left;
+        do {
+            node_parent = node_current;
+            node_current = node_current->right;
+        } while (getHeight(node_current) > right_height + 1);
+
+        node_parent->right = linkChildren(node_middle, node_current, right);
+        node_middle->parent = node_parent;
+
+        auto node_next = node_parent;
+        do {
+            node_current = node_next;
+            node_current->updateHeight();
+            node_current = rebalanceDelete(node_current);
+            node_next = node_current->parent;
+            if (node_next) {
+                node_next->right = node_current;
+            }
+        } while (node_next);
+
+        return node_current;
+    }
+
+    // Mirror of joinRight().
+    CONSTEXPR20 node_type_ptr joinLeft(const node_type_ptr &left, const node_type_ptr &node_middle, const node_type_ptr &right) {
+        const size_type left_height = getHeight(left);
+        node_type_ptr node_parent;
+        auto node_current = right;
+        do {
+            node_parent = node_current;
+            node_current = node_current->left;
+        } while (getHeight(node_current) > left_height + 1);
+
+        node_parent->left = linkChildren(node_middle, left, node_current);
+        node_middle->parent = node_parent;
+
+        auto node_next = node_parent;
+        do {
+            node_current = node_next;
+            node_current->updateHeight();
+            node_current = rebalanceDelete(node_current);
+            node_next = node_current->parent;
+            if (node_next) {
+                node_next->left = node_current;
+            }
+        } while (node_next);
+
+        return node_current;
+    }
+
+    // Cut the search path out of the tree, then join the subtrees hanging off it bottom-up.
+    // The joins of one side have increasing heights, so their costs telescope to O(log n).
+    CONSTEXPR20 std::tuple<node_type_ptr, bool, node_type_ptr> splitNodes(node_type_ptr node, const value_type &key) {
+        std::vector<node_type_ptr> path{};
+        node_type_ptr left_part;
+        node_type_ptr right_part;
+        bool found = false;
+        auto node_current = std::move(node);
+
+        while (node_current) {
+            node_current->parent = nullptr;
+            node_type_ptr node_next;
+            if (isLess(key, node_current->key)) {
+                // left subtree
+                node_next = std::exchange(node_current->left, nullptr);
+            } else if (isGreater(key, node_current->key)) {
+                // right subtree
+                node_next = std::exchange(node_current->right, nullptr);
+            } else {
+                // Node found, its subtrees start the parts.
+                std::tie(left_part, right_part) = detachChildren(node_current);
+                found = true;
+                break;
+            }
+
+            path.push_back(std::move(node_current));
+            node_current = std::move(node_next);
+        }
+
+        for (auto it = path.rbegin(); it != path.rend(); it++) {
+            const bool key_before = isLess(key, (*it)->key);
+            auto [left_node, right_node] = detachChildren(*it);
+            if (key_before) {
+                // The node and its right subtree go after the key.
+                right_part = joinNodes(std::move(right_part), std::move(*it), std::move(right_node));
+            } else {
+                left_part = joinNodes(std::move(left_node), std::move(*it), std::move(left_part));
+            }
+        }
+
+        return {std::move(left_part), found, std::move(right_part)};
     }
 
-    CONSTEXPR20 void makeLinkWithPreviousNode(node_type_ptr node, node_type_ptr node_prev) const {
-        node->parent = node_prev;
+    // Cut the maximum node out of the tree. Returns the rest of the tree and the detached node.
+    CONSTEXPR20 std::pair<node_type_ptr, node_type_ptr> splitLast(node_type_ptr node) {
+        std::vector<node_type_ptr> path{};
+        auto node_current = std::move(node);
+        while (node_current->right) {
+            node_current->parent = nullptr;
+            auto node_next = std::exchange(node_current->right, nullptr);
+            path.push_back(std::move(node_current));
+            node_current = std::move(node_next);
+        }
 
-        if (isLess(node->key, node_prev->key)) {
-            // left subtree
-            node_prev->left = node;
-        } else if (isGreater(node->key, node_prev->key)) {
-            // right subtree
-            node_prev->right = node;
+        auto rest = std::move(detachChildren(node_current).first);
+        for (auto it = path.rbegin(); it != path.rend(); it++) {
+            auto left_node = std::move(detachChildren(*it).first);
+            rest = joinNodes(std::move(left_node), std::move(*it), std::move(rest));
         }
+
+        return {std::move(rest), std::move(node_current)};
+    }
+
+    NODISCARD CONSTEXPR20 node_type_ptr join2Nodes(node_type_ptr left, node_type_ptr right) {
+        if (!left) {
+            return right;
+        }
+
+        auto [rest, node_last] = splitLast(std::move(left));
+        return joinNodes(std::move(rest), std::move(node_last), std::move(right));
+    }
+
+    // Trees of this height hold at least about grain_size / 2 keys.
+    NODISCARD static CONSTEXPR20 size_type parallelHeight(size_type grain_size) {
+        return static_cast<size_type>(std::bit_width(grain_size));
+    }
+
+    // The subtrees are moved through the recursion: a copied shared_ptr costs two atomic operations.
+    NODISCARD CONSTEXPR20 node_type_ptr unionNodes(node_type_ptr first, node_type_ptr second, ThreadPool &pool, size_type parallel_height) {
+        if (!first) {
+            return second;
+        }
+
+        if (!second) {
+            return first;
+        }
+
+        // The root of the first tree splits the second one, the equal key of the second tree is dropped.
+        const bool parallel = std::max(first->height, second->height) >= parallel_height;
+        auto [first_left, first_right] = detachChildren(first);
+        auto [second_left, found, second_right] = splitNodes(std::move(second), first->key);
+        auto [left, right] = pool.forkJoin(parallel,
+            [&, first_left = std::move(first_left), second_left = std::move(second_left)]() mutable {
+                return unionNodes(std::move(first_left), std::move(second_left), pool, parallel_height);
+            },
+            [&, first_right = std::move(first_right), second_right = std::move(second_right)]() mutable {
+                return unionNodes(std::move(first_right), std::move(second_right), pool, parallel_height);
+            });
+        return joinNodes(std::move(left), std::move(first), std::move(right));
+    }
+
+    NODISCARD CONSTEXPR20 node_type_ptr intersectionNodes(node_type_ptr first, node_type_ptr second, ThreadPool &pool, size_type parallel_height) {
+        if (!first || !second) {
+            releaseSubtree(std::move(first));
+            releaseSubtree(std::move(second));
+            return nullptr;
+        }
+
+        const bool parallel = std::max(first->height, second->height) >= parallel_height;
+        auto [first_left, first_right] = detachChildren(first);
+        auto [second_left, found, second_right] = splitNodes(std::move(second), first->key);
+        auto [left, right] = pool.forkJoin(parallel,
+            [&, first_left = std::move(first_left), second_left = std::move(second_left)]() mutable {
+                return intersectionNodes(std::move(first_left), std::move(second_left), pool, parallel_height);
+            },
+            [&, first_right = std::move(first_right), second_right = std::move(second_right)]() mutable {
+                return intersectionNodes(std::move(first_right), std::move(second_right), pool, parallel_height);
+            });
+        if (found) {
+            return joinNodes(std::move(left), std::move(first), std::move(right));
+        }
+
+        return join2Nodes(std::move(left), std::move(right));
+    }
+
+    NODISCARD CONSTEXPR20 node_type_ptr differenceNodes(node_type_ptr first, node_type_ptr second, ThreadPool &pool, size_type parallel_height) {
+        if (!first || !second) {
+            releaseSubtree(std::move(second));
+            return first;
+        }
+
+        // The root of the second tree splits the first one and is dropped with the equal key.
+        const bool parallel = std::max(first->height, second->height) >= parallel_height;
+        auto [second_left, second_right] = detachChildren(second);
+        auto [first_left, found, first_right] = splitNodes(std::move(first), second->key);
+        auto [left, right] = pool.forkJoin(parallel,
+            [&, first_left = std::move(first_left), second_left = std::move(second_left)]() mutable {
+                return differenceNodes(std::move(first_left), std::move(second_left), pool, parallel_height);
+            },
+            [&, first_right = std::move(first_right), second_right = std::move(second_right)]() mutable {
+                return differenceNodes(std::move(first_right), std::move(second_right), pool, parallel_height);
+            });
+        return join2Nodes(std::move(left), std::move(right));
+    }
+
+    // The parent links form cycles with the child links: break them, otherwise the dropped nodes are never freed.
+    CONSTEXPR20 void releaseSubtree(node_type_ptr node) const {
+        std::vector<node_type_ptr> stack{};
+        if (node) {
+            stack.push_back(node);
+        }
+
+        while (!stack.empty()) {
+            auto node_current = stack.back();
+            stack.pop_back();
+            node_current->parent = nullptr;
+            if (node_current->left) {
+                stack.push_back(std::exchange(node_current->left, nullptr));
+            }
+
+            if (node_current->right) {
+                stack.push_back(std::exchange(node_current->right, nullptr));
+            }
+        }
+    }
+
+    // Copy the subtree level by level without recursion, the copy has the same shape.
+    NODISCARD CONSTEXPR20 node_type_ptr cloneNodes(const node_type_ptr &node) const {
+        if (!node) {
+            return nullptr;
+        }
+
+        auto node_root = cloneNode(*node);
+        std::vector<std::pair<const node_type *, node_type_ptr>> level{ { node.get(), node_root } };
+        std::vector<std::pair<const node_type *, node_type_ptr>> level_next{};
+        while (!level.empty()) {
+            for (const auto &[node_source, node_copy] : level) {
+                if (node_source->left) {
+                    node_copy->left = cloneNode(*node_source->left);
+                    node_copy->left->parent = node_copy;
+                    level_next.emplace_back(node_source->left.get(), node_copy->left);
+                }
+
+                if (node_source->right) {
+                    node_copy->right = cloneNode(*node_source->right);
+                    node_copy->right->parent = node_copy;
+                    level_next.emplace_back(node_source->right.get(), node_copy->right);
+                }
+            }
+
+            level.swap(level_next);
+            level_next.clear();
+        }
+
+        return node_root;
+    }
+
+    NODISCARD CONSTEXPR20 node_type_ptr cloneNode(const node_type &node) const {
+        auto node_copy = createNewNode(node.key);
+        node_copy->duplicates = node.duplicates;
+        node_copy->height = node.height;
+        return node_copy;
+    }
+
+    CONSTEXPR20 node_type_ptr createNewNode(const value_type& key) const {
+        Stats::add(StatsEvent::allocation);
+        return std::make_shared<node_type>(key);
     }
 
     CONSTEXPR20 void swapChildNodeForParent(node_type_ptr node, node_type_ptr node_parent, node_type_ptr node_new_child) const {
@@ -668,33 +1723,20 @@ private:
         return true;
     }
 
-    template<class T>
-    NODISCARD CONSTEXPR20 bool areEqual(std::shared_ptr<T> smart_obj_a, std::shared_ptr<T> smart_obj_b) const {
-        return *smart_obj_a == *smart_obj_b;
-    }
-
     template<class T>
     NODISCARD CONSTEXPR20 bool areEqual(const T& value_a, const T& value_b) const {
-        return value_a == value_b;
-    }
-
-    template<class T>
-    NODISCARD CONSTEXPR20 bool isGreater(std::shared_ptr<T> smart_obj_a, std::shared_ptr<T> smart_obj_b) const {
-        return *smart_obj_a > *smart_obj_b;
+        return comparedKey(value_a) == comparedKey(value_b);
     }
 
     template<class T>
     NODISCARD CONSTEXPR20 bool isGreater(const T& value_a, const T& value_b) const {
-        return value_a > value_b;
-    }
-
-    template<class T>
-    NODISCARD CONSTEXPR20 bool isLess(std::shared_ptr<T> smart_obj_a, std::shared_ptr<T> smart_obj_b) const {
-        return *smart_obj_a < *smart_obj_b;
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) > comparedKey(value_b);
     }
 
     template<class T>
     NODISCARD CONSTEXPR20 bool isLess(const T& value_a, const T& value_b) const {
-        return value_a < value_b;
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) < comparedKey(value_b);
     }
 };
\ No newline at end of file
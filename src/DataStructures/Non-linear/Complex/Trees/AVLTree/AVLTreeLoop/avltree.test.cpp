@@ -1,4 +1,11 @@
 ﻿#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <set>
+#include <span>
 #include <vector>
 #include "avltree.h"
 
@@ -84,6 +91,52 @@ std::ostream& operator<<(std::ostream& os, const std::shared_ptr<T> &psobj) {
 using object_type = AVLTreeLoopTest::ObjectA;
 using store_smart_ptr_type = std::shared_ptr<object_type>;
 
+// Check the heights, the balance and the parent links below the node and collect its keys in order.
+// Returns the height or -1.
+template<class NodePtr>
+int checkAVLNode(const NodePtr& node, const NodePtr& parent, std::vector<test_data_type>& keys) {
+    if (!node) {
+        return 0;
+    }
+
+    if (node->parent != parent) {
+        return -1;
+    }
+
+    const int left_height = checkAVLNode(node->left, node, keys);
+    keys.push_back(node->key);
+    const int right_height = checkAVLNode(node->right, node, keys);
+    if (left_height < 0 || right_height < 0 || std::abs(left_height - right_height) > 1) {
+        return -1;
+    }
+
+    const int height = std::max(left_height, right_height) + 1;
+    return static_cast<int>(node->height) == height ? height : -1;
+}
+
+// The tree is a valid AVL tree with exactly the expected keys, one node per key.
+template<class Tree>
+bool isValidAVLTree(const Tree& avltree, const std::set<test_data_type>& expected) {
+    const auto root = avltree.getRoot();
+    std::vector<test_data_type> keys{};
+    if (checkAVLNode(root, decltype(root){}, keys) < 0) {
+        return false;
+    }
+
+    return std::equal(keys.begin(), keys.end(), expected.begin(), expected.end());
+}
+
+// The owning pointer of the node with the key.
+template<class Tree>
+auto sharedNodeOf(const Tree& tree, test_data_type key) {
+    auto node = tree.getRoot();
+    while (node->key != key) {
+        node = key < node->key ? node->left : node->right;
+    }
+
+    return node;
+}
+
 /*
 input: 33 13 53 9 21 61 8 11 32 14 54 10
 
@@ -353,6 +406,57 @@ TEST_F(AVLTreeLoopTest, Search) {
     std::cout << "TEST_F(AVLTreeLoopTest, Search) end" << std::endl;
 }
 
+TEST_F(AVLTreeLoopTest, SearchBatch) {
+    std::cout << "TEST_F(AVLTreeLoopTest, SearchBatch) start" << std::endl;
+    // More keys than one group, the last group is not full.
+    std::vector<test_data_type> keys{};
+    for (test_data_type key = 0; key < 45; key++) {
+        keys.push_back(key);
+    }
+
+    const auto results = std::make_unique<bool[]>(keys.size());
+    std::vector<const test_data_type*> found(keys.size());
+    AVLTreeLoop<test_data_type> avltree{};
+    // Search in empty structure.
+    avltree.searchBatch(keys, std::span<bool>{ results.get(), keys.size() });
+    avltree.searchBatch(keys, found);
+    for (test_data_count index = 0; index < keys.size(); index++) {
+        ASSERT_FALSE(results[index]);
+        ASSERT_EQ(found[index], nullptr);
+    }
+
+    avltree = AVLTreeLoop<test_data_type>{array_values};
+    avltree.searchBatch(keys, std::span<bool>{ results.get(), keys.size() });
+    avltree.searchBatch(keys, found);
+    for (test_data_count index = 0; index < keys.size(); index++) {
+        ASSERT_EQ(results[index], avltree.search(keys[index])) << keys[index];
+        if (results[index]) {
+            ASSERT_EQ(*found[index], keys[index]);
+        } else {
+            ASSERT_EQ(found[index], nullptr);
+        }
+    }
+    std::cout << "TEST_F(AVLTreeLoopTest, SearchBatch) end" << std::endl;
+}
+
+TEST_F(AVLTreeLoopTest, ForEachInOrder) {
+    std::cout << "TEST_F(AVLTreeLoopTest, ForEachInOrder) start" << std::endl;
+    std::vector<test_data_type> keys{};
+    AVLTreeLoop<test_data_type> avltree{};
+    // Empty structure.
+    avltree.forEachInOrder([&keys](const test_data_type& key) { keys.push_back(key); });
+    ASSERT_TRUE(keys.empty());
+
+    avltree = AVLTreeLoop<test_data_type>{array_values};
+    avltree.forEachInOrder([&keys](const test_data_type& key) { keys.push_back(key); });
+
+    auto expected = array_values;
+    std::sort(expected.begin(), expected.end());
+    expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+    ASSERT_EQ(keys, expected);
+    std::cout << "TEST_F(AVLTreeLoopTest, ForEachInOrder) end" << std::endl;
+}
+
 TEST_F(AVLTreeLoopTest, FailedVerify) {
     std::cout << "TEST_F(AVLTreeLoopTest, Search) start" << std::endl;
     AVLTreeLoop<test_data_type> avltree{};
@@ -364,4 +468,538 @@ TEST_F(AVLTreeLoopTest, FailedVerify) {
     ASSERT_FALSE(avltree.verifyCorrectness(std::vector<test_data_type>{31, 13, 0}));
     ASSERT_TRUE(avltree.verifyCorrectness(std::vector<test_data_type>{31, 13}));
     std::cout << "TEST_F(AVLTreeLoopTest, Search) end" << std::endl;
-}
\ No newline at end of file
+}
+
+TEST_F(AVLTreeLoopTest, JoinSplit) {
+    std::cout << "TEST_F(AVLTreeLoopTest, JoinSplit) start" << std::endl;
+    // Trees of very different heights.
+    AVLTreeLoop<test_data_type> left{};
+    AVLTreeLoop<test_data_type> right{};
+    std::set<test_data_type> expected{};
+    for (test_data_type value = 0; value < 1000; value++) {
+        left.insert(value);
+        expected.insert(value);
+    }
+    for (test_data_type value = 1001; value < 1004; value++) {
+        right.insert(value);
+        expected.insert(value);
+    }
+    expected.insert(1000);
+
+    auto joined = AVLTreeLoop<test_data_type>::join(std::move(left), 1000, std::move(right));
+    ASSERT_TRUE(isValidAVLTree(joined, expected));
+    ASSERT_TRUE(isValidAVLTree(left, {}));
+    ASSERT_TRUE(isValidAVLTree(right, {}));
+
+    // Split by every kind of key: present, absent, out of range.
+    for (const test_data_type key : {500, 1000, 1003, 0, -5, 5000}) {
+        auto [before, found, after] = joined.split(key);
+        ASSERT_EQ(found, expected.count(key) == 1) << key;
+        ASSERT_TRUE(isValidAVLTree(before, { expected.begin(), expected.lower_bound(key) })) << key;
+        ASSERT_TRUE(isValidAVLTree(after, { expected.upper_bound(key), expected.end() })) << key;
+        ASSERT_TRUE(isValidAVLTree(joined, {}));
+
+        // Put the parts back together.
+        joined = found ? AVLTreeLoop<test_data_type>::join(std::move(before), key, std::move(after))
+                       : AVLTreeLoop<test_data_type>::join2(std::move(before), std::move(after));
+        ASSERT_TRUE(isValidAVLTree(joined, expected)) << key;
+    }
+    std::cout << "TEST_F(AVLTreeLoopTest, JoinSplit) end" << std::endl;
+}
+
+TEST_F(AVLTreeLoopTest, Join2) {
+    std::cout << "TEST_F(AVLTreeLoopTest, Join2) start" << std::endl;
+    AVLTreeLoop<test_data_type> empty_left{};
+    AVLTreeLoop<test_data_type> empty_right{};
+    auto joined = AVLTreeLoop<test_data_type>::join2(std::move(empty_left), std::move(empty_right));
+    ASSERT_TRUE(isValidAVLTree(joined, {}));
+
+    std::set<test_data_type> expected{ array_values.begin(), array_values.end() };
+    AVLTreeLoop<test_data_type> left{ array_values };
+    AVLTreeLoop<test_data_type> right{};
+    for (test_data_type value = 100; value < 400; value += 3) {
+        right.insert(value);
+        expected.insert(value);
+    }
+
+    joined = AVLTreeLoop<test_data_type>::join2(std::move(left), std::move(right));
+    ASSERT_TRUE(isValidAVLTree(joined, expected));
+    std::cout << "TEST_F(AVLTreeLoopTest, Join2) end" << std::endl;
+}
+
+TEST_F(AVLTreeLoopTest, SetOperations) {
+    std::cout << "TEST_F(AVLTreeLoopTest, SetOperations) start" << std::endl;
+    ThreadPool pool{ 4 };
+    std::mt19937 generator{ 1337 };
+
+    // Sizes from equal to very different. The small grain size forces the parallel recursion.
+    for (const test_data_count second_count : {0, 10, 3000}) {
+        std::set<test_data_type> first_keys{};
+        std::set<test_data_type> second_keys{};
+        for (test_data_count index = 0; index < 3000; index++) {
+            first_keys.insert(static_cast<test_data_type>(generator() % 6000));
+        }
+        for (test_data_count index = 0; index < second_count; index++) {
+            second_keys.insert(static_cast<test_data_type>(generator() % 6000));
+        }
+
+        std::set<test_data_type> union_keys{ first_keys };
+        union_keys.insert(second_keys.begin(), second_keys.end());
+        std::set<test_data_type> intersection_keys{};
+        std::set<test_data_type> difference_keys{};
+        std::set_intersection(first_keys.begin(), first_keys.end(), second_keys.begin(), second_keys.end(),
+                              std::inserter(intersection_keys, intersection_keys.end()));
+        std::set_difference(first_keys.begin(), first_keys.end(), second_keys.begin(), second_keys.end(),
+                            std::inserter(difference_keys, difference_keys.end()));
+
+        const std::vector<test_data_type> first_values{ first_keys.begin(), first_keys.end() };
+        const std::vector<test_data_type> second_values{ second_keys.begin(), second_keys.end() };
+        using tree_type = AVLTreeLoop<test_data_type>;
+
+        auto result = tree_type::setUnion(tree_type{ first_values }, tree_type{ second_values }, pool, 16);
+        ASSERT_TRUE(isValidAVLTree(result, union_keys)) << second_count;
+        result = tree_type::setIntersection(tree_type{ first_values }, tree_type{ second_values }, pool, 16);
+        ASSERT_TRUE(isValidAVLTree(result, intersection_keys)) << second_count;
+        result = tree_type::setDifference(tree_type{ first_values }, tree_type{ second_values }, pool, 16);
+        ASSERT_TRUE(isValidAVLTree(result, difference_keys)) << second_count;
+        // Second operand smaller than the first one and the serial path.
+        result = tree_type::setDifference(tree_type{ second_values }, tree_type{ first_values }, pool);
+        std::set<test_data_type> reverse_difference_keys{};
+        std::set_difference(second_keys.begin(), second_keys.end(), first_keys.begin(), first_keys.end(),
+                            std::inserter(reverse_difference_keys, reverse_difference_keys.end()));
+        ASSERT_TRUE(isValidAVLTree(result, reverse_difference_keys)) << second_count;
+    }
+    std::cout << "TEST_F(AVLTreeLoopTest, SetOperations) end" << std::endl;
+}
+
+TEST_F(AVLTreeLoopTest, Stats) {
+    std::cout << "TEST_F(AVLTreeLoopTest, Stats) start" << std::endl;
+    using stats_type = CountingStats<struct AVLTreeLoopStatsTag>;
+    AVLTreeLoop<test_data_type, size_t, stats_type> tree{};
+    AVLTreeLoop<test_data_type> tree_plain{};
+    const test_data_type keys_count = 127;
+
+    stats_type::reset();
+    // Ascending keys make the tree rotate on every level.
+    for (test_data_type key = 0; key < keys_count; key++) {
+        tree.insert(key);
+        tree_plain.insert(key);
+    }
+
+    auto stats = stats_type::snapshot();
+    ASSERT_EQ(stats[StatsEvent::allocation], static_cast<uint64_t>(keys_count));
+    ASSERT_NE(stats[StatsEvent::comparison], 0u);
+    ASSERT_NE(stats[StatsEvent::rotation], 0u);
+    ASSERT_NE(stats[StatsEvent::rebalance], 0u);
+
+    for (test_data_type key = 0; key < keys_count; key += 2) {
+        tree.deleteValue(key);
+        tree_plain.deleteValue(key);
+    }
+
+    ASSERT_GT(stats_type::snapshot()[StatsEvent::rebalance], stats[StatsEvent::rebalance]);
+
+    // The instrumentation doesn't change the tree.
+    stats = stats_type::snapshot();
+    for (test_data_type key = 0; key < keys_count; key++) {
+        ASSERT_EQ(tree.search(key), tree_plain.search(key)) << key;
+    }
+    ASSERT_GE(stats_type::snapshot()[StatsEvent::comparison], stats[StatsEvent::comparison] + keys_count);
+    std::cout << "TEST_F(AVLTreeLoopTest, Stats) end" << std::endl;
+}
+
+TEST_F(AVLTreeLoopTest, DeleteRootWithOneChild) {
+    std::cout << "TEST_F(AVLTreeLoopTest, DeleteRootWithOneChild) start" << std::endl;
+    AVLTreeLoop<test_data_type> tree_left{ std::vector<test_data_type>{ 1, 0 } };
+    tree_left.deleteValue(1);
+    ASSERT_TRUE(isValidAVLTree(tree_left, { 0 }));
+
+    AVLTreeLoop<test_data_type> tree_right{ std::vector<test_data_type>{ 0, 1 } };
+    tree_right.deleteValue(0);
+    ASSERT_TRUE(isValidAVLTree(tree_right, { 1 }));
+    std::cout << "TEST_F(AVLTreeLoopTest, DeleteRootWithOneChild) end" << std::endl;
+}
+
+TEST_F(AVLTreeLoopTest, Iterator) {
+    std::cout << "TEST_F(AVLTreeLoopTest, Iterator) start" << std::endl;
+    AVLTreeLoop<test_data_type> tree{};
+    ASSERT_TRUE(tree.begin() == tree.end());
+    ASSERT_TRUE(tree.find(30) == tree.end());
+
+    tree = AVLTreeLoop<test_data_type>{ array_values };
+    auto expected = array_values;
+    std::sort(expected.begin(), expected.end());
+    ASSERT_EQ(std::vector<test_data_type>(tree.begin(), tree.end()), expected);
+
+    // Backwards from the end.
+    std::vector<test_data_type> keys{};
+    for (auto it = tree.end(); it != tree.begin();) {
+        keys.push_back(*--it);
+    }
+    std::reverse(keys.begin(), keys.end());
+    ASSERT_EQ(keys, expected);
+
+    auto it = tree.find(30);
+    ASSERT_EQ(*it, 30);
+    ASSERT_EQ(*++it, 35);
+    ASSERT_EQ(*--it, 30);
+    ASSERT_TRUE(tree.find(31) == tree.end());
+    std::cout << "TEST_F(AVLTreeLoopTest, Iterator) end" << std::endl;
+}
+
+TEST_F(AVLTreeLoopTest, HintedInsert) {
+    std::cout << "TEST_F(AVLTreeLoopTest, HintedInsert) start" << std::endl;
+    std::mt19937 generator{ 1337 };
+    AVLTreeLoop<test_data_type> tree{};
+    std::set<test_data_type> expected{};
+
+    // Near-sorted keys, the hints are right, wrong or the end.
+    auto hint = tree.end();
+    for (test_data_type index = 0; index < 3000; index++) {
+        const auto key = index * 4 + static_cast<test_data_type>(generator() % 64) - 32;
+        switch (generator() % 4) {
+            case 0:
+                tree.insert(key);
+                break;
+            case 1:
+                hint = tree.insert(tree.end(), key);
+                ASSERT_EQ(*hint, key);
+                break;
+            case 2:
+                hint = tree.insert(hint, key);
+                ASSERT_EQ(*hint, key);
+                break;
+            default:
+                hint = tree.insert(tree.find(static_cast<test_data_type>(generator() % 12000)), key);
+                ASSERT_EQ(*hint, key);
+                break;
+        }
+        expected.insert(key);
+
+        // The finger is dropped by the delete.
+        if (index % 100 == 0) {
+            tree.deleteValue(key);
+            expected.erase(key);
+            hint = tree.end();
+        }
+
+        if (index % 500 == 0) {
+            ASSERT_TRUE(isValidAVLTree(tree, expected)) << index;
+        }
+    }
+
+    ASSERT_TRUE(isValidAVLTree(tree, expected));
+    std::cout << "TEST_F(AVLTreeLoopTest, HintedInsert) end" << std::endl;
+}
+
+TEST_F(AVLTreeLoopTest, FingerInsertStats) {
+    std::cout << "TEST_F(AVLTreeLoopTest, FingerInsertStats) start" << std::endl;
+    using stats_type = CountingStats<struct AVLTreeLoopFingerStatsTag>;
+    AVLTreeLoop<test_data_type, size_t, stats_type> tree{};
+    AVLTreeLoop<test_data_type, size_t, stats_type> tree_hinted{};
+    const test_data_type keys_count = 4096;
+
+    // The appended keys don't search from the root.
+    stats_type::reset();
+    for (test_data_type key = 0; key < keys_count; key++) {
+        tree.insert(key);
+    }
+    ASSERT_LE(stats_type::snapshot()[StatsEvent::comparison], static_cast<uint64_t>(2 * keys_count));
+
+    stats_type::reset();
+    for (test_data_type key = 0; key < keys_count; key++) {
+        tree_hinted.insert(tree_hinted.end(), key);
+    }
+    ASSERT_LE(stats_type::snapshot()[StatsEvent::comparison], static_cast<uint64_t>(2 * keys_count));
+    ASSERT_TRUE(std::equal(tree.begin(), tree.end(), tree_hinted.begin(), tree_hinted.end()));
+    std::cout << "TEST_F(AVLTreeLoopTest, FingerInsertStats) end" << std::endl;
+}
+
+TEST_F(AVLTreeLoopTest, InsertReturnsIterator) {
+    std::cout << "TEST_F(AVLTreeLoopTest, InsertReturnsIterator) start" << std::endl;
+    AVLTreeLoop<test_data_type> tree{ array_values };
+
+    auto [inserted_it, inserted] = tree.insert(25);
+    ASSERT_TRUE(inserted);
+    ASSERT_EQ(*inserted_it, 25);
+    ASSERT_EQ(*++inserted_it, 30);
+
+    auto [found_it, found_inserted] = tree.insert(39);
+    ASSERT_FALSE(found_inserted);
+    ASSERT_TRUE(found_it == tree.find(39));
+    std::cout << "TEST_F(AVLTreeLoopTest, InsertReturnsIterator) end" << std::endl;
+}
+
+TEST_F(AVLTreeLoopTest, EraseByIterator) {
+    std::cout << "TEST_F(AVLTreeLoopTest, EraseByIterator) start" << std::endl;
+    std::mt19937 generator{ 1337 };
+    AVLTreeLoop<test_data_type> tree{};
+    std::set<test_data_type> expected{};
+
+    // Upsert and expire: the iterator from insert erases the key without a search.
+    for (test_data_type index = 0; index < 2000; index++) {
+        const auto key = static_cast<test_data_type>(generator() % 1000);
+        auto [it, inserted] = tree.insert(key);
+        expected.insert(key);
+        if (!inserted) {
+            auto next = tree.erase(it);
+            auto expected_next = expected.erase(expected.find(key));
+            ASSERT_EQ(next == tree.end(), expected_next == expected.end()) << index;
+            if (next != tree.end()) {
+                ASSERT_EQ(*next, *expected_next) << index;
+            }
+        }
+    }
+    ASSERT_TRUE(isValidAVLTree(tree, expected));
+
+    // Erase everything from the begin.
+    for (auto it = tree.begin(); it != tree.end();) {
+        it = tree.erase(it);
+    }
+    ASSERT_TRUE(isValidAVLTree(tree, {}));
+    std::cout << "TEST_F(AVLTreeLoopTest, EraseByIterator) end" << std::endl;
+}
+
+TEST_F(AVLTreeLoopTest, EraseKeepsIterators) {
+    std::cout << "TEST_F(AVLTreeLoopTest, EraseKeepsIterators) start" << std::endl;
+    // The successor of a node with two children takes its place: the iterator to the successor stays valid.
+    AVLTreeLoop<test_data_type> small{ std::vector<test_data_type>{ 50, 30, 70, 20, 40, 60, 80 } };
+    const auto it_50 = small.find(50);
+    const auto it_60 = small.find(60);
+    ASSERT_EQ(small.erase(it_50), it_60);
+    ASSERT_EQ(*it_60, 60);
+    ASSERT_TRUE(isValidAVLTree(small, { 20, 30, 40, 60, 70, 80 }));
+
+    // Keep the iterators of all the keys and erase them in random order.
+    std::mt19937 generator{ 1337 };
+    AVLTreeLoop<test_data_type> tree{};
+    std::set<test_data_type> expected{};
+    std::vector<std::pair<test_data_type, AVLTreeLoop<test_data_type>::ConstIterator>> iterators{};
+    for (test_data_type key = 0; key < 2000; key++) {
+        iterators.emplace_back(key, tree.insert(key).first);
+        expected.insert(key);
+    }
+    std::shuffle(iterators.begin(), iterators.end(), generator);
+
+    while (!iterators.empty()) {
+        tree.erase(iterators.back().second);
+        expected.erase(iterators.back().first);
+        iterators.pop_back();
+        for (const auto& [key, it] : iterators) {
+            ASSERT_EQ(*it, key);
+        }
+
+        if (iterators.size() % 100 == 0) {
+            ASSERT_TRUE(isValidAVLTree(tree, expected)) << iterators.size();
+        }
+    }
+    ASSERT_TRUE(tree.isEmpty());
+    std::cout << "TEST_F(AVLTreeLoopTest, EraseKeepsIterators) end" << std::endl;
+}
+
+TEST_F(AVLTreeLoopTest, ExtractInsertHandle) {
+    std::cout << "TEST_F(AVLTreeLoopTest, ExtractInsertHandle) start" << std::endl;
+    AVLTreeLoop<test_data_type> source{ array_values };
+    AVLTreeLoop<test_data_type> target{ std::vector<test_data_type>{ 1, 2, 35 } };
+
+    ASSERT_TRUE(source.extract(31).empty());
+
+    // The node moves to the other tree.
+    auto handle = source.extract(source.find(20));
+    ASSERT_FALSE(handle.empty());
+    ASSERT_EQ(handle.value(), 20);
+    auto [it, inserted] = target.insert(std::move(handle));
+    ASSERT_TRUE(inserted);
+    ASSERT_EQ(*it, 20);
+    ASSERT_TRUE(handle.empty());
+
+    // The key is in the target already: the handle keeps the node.
+    handle = source.extract(35);
+    auto [it_found, inserted_found] = target.insert(std::move(handle));
+    ASSERT_FALSE(inserted_found);
+    ASSERT_EQ(*it_found, 35);
+    ASSERT_EQ(handle.value(), 35);
+
+    // A node with two children is unlinked itself too.
+    handle = source.extract(source.find(30));
+    ASSERT_EQ(handle.value(), 30);
+    target.insert(std::move(handle));
+
+    ASSERT_TRUE(isValidAVLTree(source, { 10, 24, 39, 40 }));
+    ASSERT_TRUE(isValidAVLTree(target, { 1, 2, 20, 30, 35 }));
+    std::cout << "TEST_F(AVLTreeLoopTest, ExtractInsertHandle) end" << std::endl;
+}
+
+TEST_F(AVLTreeLoopTest, MultisetCountedKeys) {
+    std::cout << "TEST_F(AVLTreeLoopTest, MultisetCountedKeys) start" << std::endl;
+    AVLTreeLoop<test_data_type, size_t, NoStats, CountedKeys> tree{ array_values };
+    std::multiset<test_data_type> expected{ array_values.begin(), array_values.end() };
+    for (const auto value : { 30, 30, 10, 39, 30 }) {
+        const auto [it, inserted] = tree.insert(value);
+        ASSERT_TRUE(inserted);
+        ASSERT_EQ(*it, value);
+        expected.insert(value);
+    }
+
+    // The equal keys share a node.
+    ASSERT_TRUE(isValidAVLTree(tree, { 10, 20, 24, 30, 35, 39, 40 }));
+    ASSERT_EQ(tree.count(30), 4u);
+    ASSERT_EQ(tree.count(35), 1u);
+    ASSERT_EQ(tree.count(31), 0u);
+
+    const auto [first, last] = tree.equal_range(30);
+    ASSERT_EQ(std::distance(first, last), 4);
+    ASSERT_EQ(*last, 35);
+    ASSERT_TRUE(std::all_of(first, last, [](test_data_type key) { return key == 30; }));
+    const auto [first_absent, last_absent] = tree.equal_range(31);
+    ASSERT_TRUE(first_absent == last_absent);
+    ASSERT_EQ(*first_absent, 35);
+    ASSERT_TRUE(tree.upper_bound(40) == tree.end());
+
+    ASSERT_TRUE(std::equal(tree.begin(), tree.end(), expected.begin(), expected.end()));
+    std::vector<test_data_type> keys{};
+    tree.forEachInOrder([&keys](test_data_type key) {
+        keys.push_back(key);
+    });
+    ASSERT_TRUE(std::equal(keys.begin(), keys.end(), expected.begin(), expected.end()));
+    // Backwards over the counts.
+    ASSERT_TRUE(std::equal(std::make_reverse_iterator(tree.end()), std::make_reverse_iterator(tree.begin()),
+                           expected.rbegin(), expected.rend()));
+
+    // erase() takes one key, deleteValue() takes all of them.
+    auto it = tree.erase(tree.find(30));
+    ASSERT_EQ(*it, 30);
+    ASSERT_EQ(tree.count(30), 3u);
+    tree.deleteValue(10);
+    ASSERT_EQ(tree.count(10), 0u);
+    ASSERT_TRUE(isValidAVLTree(tree, { 20, 24, 30, 35, 39, 40 }));
+    std::cout << "TEST_F(AVLTreeLoopTest, MultisetCountedKeys) end" << std::endl;
+}
+
+TEST_F(AVLTreeLoopTest, MultisetChainedKeys) {
+    std::cout << "TEST_F(AVLTreeLoopTest, MultisetChainedKeys) start" << std::endl;
+    // The objects with equal scores come out in insertion order.
+    AVLTreeLoop<store_smart_ptr_type, size_t, NoStats, ChainedKeys> scores{};
+    std::vector<store_smart_ptr_type> equal_scores{};
+    for (test_data_count index = 0; index < 4; index++) {
+        equal_scores.push_back(std::make_shared<object_type>(50));
+        scores.insert(equal_scores.back());
+        scores.insert(std::make_shared<object_type>(static_cast<test_data_type>(index * 25 + 10)));
+    }
+
+    ASSERT_EQ(scores.count(std::make_shared<object_type>(50)), 4u);
+    auto [first, last] = scores.equal_range(std::make_shared<object_type>(50));
+    std::vector<store_smart_ptr_type> range{ first, last };
+    ASSERT_EQ(range.size(), 4u);
+    ASSERT_TRUE(std::equal(equal_scores.begin(), equal_scores.end(), range.begin()));
+    ASSERT_EQ((*last)->get(), 60);
+
+    // The first key of the chain goes, the next one takes its place.
+    auto it = scores.erase(first);
+    ASSERT_EQ(*it, equal_scores[1]);
+    it = scores.erase(std::next(it));
+    ASSERT_EQ(*it, equal_scores[3]);
+    std::tie(first, last) = scores.equal_range(std::make_shared<object_type>(50));
+    range.assign(first, last);
+    ASSERT_EQ(range.size(), 2u);
+    ASSERT_EQ(range[0], equal_scores[1]);
+    ASSERT_EQ(range[1], equal_scores[3]);
+
+    // Random operations against std::multiset.
+    std::mt19937 generator{ 1337 };
+    AVLTreeLoop<test_data_type, size_t, NoStats, ChainedKeys> tree{};
+    std::multiset<test_data_type> expected{};
+    for (test_data_count index = 0; index < 20000; index++) {
+        const auto value = static_cast<test_data_type>(generator() % 300);
+        if (generator() % 3 != 0) {
+            tree.insert(value);
+            expected.insert(value);
+        } else if (const auto position = tree.find(value); position != tree.end()) {
+            tree.erase(position);
+            expected.erase(expected.find(value));
+        }
+
+        ASSERT_EQ(tree.count(value), expected.count(value));
+    }
+
+    ASSERT_TRUE(isValidAVLTree(tree, std::set<test_data_type>{ expected.begin(), expected.end() }));
+    ASSERT_TRUE(std::equal(tree.begin(), tree.end(), expected.begin(), expected.end()));
+    std::cout << "TEST_F(AVLTreeLoopTest, MultisetChainedKeys) end" << std::endl;
+}
+
+TEST_F(AVLTreeLoopTest, Clear) {
+    std::cout << "TEST_F(AVLTreeLoopTest, Clear) start" << std::endl;
+    using node_type = AVLTreeNodeLoop<test_data_type>;
+    std::set<test_data_type> expected{};
+    std::vector<std::weak_ptr<node_type>> nodes_weak{};
+    {
+        AVLTreeLoop<test_data_type> tree{};
+        for (test_data_type key = 0; key < 1000; key++) {
+            tree.insert(key);
+            expected.insert(key);
+        }
+
+        // The delete fixup links the parents.
+        for (test_data_type key = 0; key < 1000; key += 3) {
+            tree.deleteValue(key);
+            expected.erase(key);
+        }
+
+        nodes_weak.push_back(tree.getRoot());
+        nodes_weak.push_back(sharedNodeOf(tree, *tree.begin()));
+        nodes_weak.push_back(sharedNodeOf(tree, *std::prev(tree.end())));
+
+        // The moved tree owns the nodes.
+        auto tree_moved = std::move(tree);
+        ASSERT_TRUE(tree.isEmpty());
+        ASSERT_TRUE(isValidAVLTree(tree_moved, expected));
+        tree.insert(5);
+        ASSERT_TRUE(isValidAVLTree(tree, { 5 }));
+    }
+
+    // The parent links do not keep the nodes alive.
+    for (const auto &node_weak : nodes_weak) {
+        ASSERT_TRUE(node_weak.expired());
+    }
+
+    AVLTreeLoop<test_data_type> tree{ array_values };
+    const std::weak_ptr<node_type> root_weak = tree.getRoot();
+    tree.clear();
+    ASSERT_TRUE(tree.isEmpty());
+    ASSERT_TRUE(root_weak.expired());
+    ASSERT_TRUE(tree.begin() == tree.end());
+    ASSERT_TRUE(isValidAVLTree(tree, {}));
+    tree.insert(31);
+    ASSERT_TRUE(isValidAVLTree(tree, { 31 }));
+    std::cout << "TEST_F(AVLTreeLoopTest, Clear) end" << std::endl;
+}
+
+TEST_F(AVLTreeLoopTest, Copy) {
+    std::cout << "TEST_F(AVLTreeLoopTest, Copy) start" << std::endl;
+    AVLTreeLoop<test_data_type> avltree{ array_values };
+
+    // The copy has the same shape, its own nodes and its own parent links.
+    auto avltree_copy = avltree;
+    ASSERT_TRUE(avltree_copy.verifyCorrectness(array_values_result));
+    ASSERT_TRUE(isValidAVLTree(avltree_copy, { array_values.begin(), array_values.end() }));
+    ASSERT_NE(avltree_copy.getRoot(), avltree.getRoot());
+
+    avltree_copy.deleteValue(30);
+    avltree.insert(50);
+    ASSERT_TRUE(avltree.search(30));
+    ASSERT_FALSE(avltree_copy.search(50));
+
+    avltree_copy = avltree;
+    ASSERT_TRUE(isValidAVLTree(avltree_copy, { 10, 20, 24, 30, 35, 39, 40, 50 }));
+
+    // The duplicates are copied with their nodes.
+    AVLTreeLoop<test_data_type, size_t, NoStats, ChainedKeys> multiset{};
+    for (test_data_type key = 0; key < 100; key++) {
+        multiset.insert(key % 10);
+    }
+
+    const auto multiset_copy = multiset;
+    ASSERT_EQ(multiset_copy.count(3), 10u);
+    ASSERT_TRUE(std::equal(multiset.begin(), multiset.end(), multiset_copy.begin(), multiset_copy.end()));
+    std::cout << "TEST_F(AVLTreeLoopTest, Copy) end" << std::endl;
+}
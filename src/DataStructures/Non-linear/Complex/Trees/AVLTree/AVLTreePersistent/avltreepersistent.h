@@ -0,0 +1,321 @@
+// Persistent AVL tree: a tree is an immutable version.
+// + insert and deleteValue don't change the tree, they return a new version. The new version copies the nodes on the
+//   path to the key and the nodes of the rotations, O(log n) new nodes, and shares every other subtree with the old one.
+// + The nodes never change after construction, so any number of threads may read any versions without locks while
+//   a writer makes new versions from them. Only the reference counts of std::shared_ptr are written, atomically.
+// + A copy of a version is O(1). A node is released with the last version which reaches it, recursively,
+//   but never deeper than the height of the tree.
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "head.h"
+#include "comparators.h"
+#include "stats.h"
+
+template <class DataType, class SizeType = size_t>
+struct AVLTreeNodePersistent {
+    using value_type = DataType;
+    using size_type = SizeType;
+    using node_type = AVLTreeNodePersistent<value_type, size_type>;
+    using node_type_ptr = std::shared_ptr<const node_type>;
+
+    const value_type key;
+    const node_type_ptr left;
+    const node_type_ptr right;
+    const size_type height;
+
+    CONSTEXPR20 AVLTreeNodePersistent(const value_type& key, node_type_ptr left, node_type_ptr right) :
+            key(key),
+            left(std::move(left)),
+            right(std::move(right)),
+            height(std::max(heightOf(this->left), heightOf(this->right)) + 1)
+    {
+    }
+
+    NODISCARD static CONSTEXPR20 size_type heightOf(const node_type_ptr& node) {
+        return node ? node->height : 0;
+    }
+};
+
+// Stats: instrumentation policy (stats.h), reports key comparisons, node allocations, rotations and rebalance steps.
+template <class DataType, class SizeType = size_t, class Stats = NoStats>
+class AVLTreePersistent {
+public:
+    using value_type = DataType;
+    using size_type = SizeType;
+    using node_type = AVLTreeNodePersistent<value_type, size_type>;
+    using node_type_ptr = std::shared_ptr<const node_type>;
+
+private:
+    node_type_ptr root{};
+    size_type count{ 0 };
+
+    CONSTEXPR20 AVLTreePersistent(node_type_ptr root, size_type count) :
+            root{ std::move(root) },
+            count{ count }
+    {
+    }
+
+public:
+    CONSTEXPR20 AVLTreePersistent() = default;
+
+    CONSTEXPR20 explicit AVLTreePersistent(const std::vector<value_type>& vec) {
+        for (const auto& value : vec) {
+            *this = insert(value);
+        }
+    }
+
+    CONSTEXPR20 explicit AVLTreePersistent(const value_type* start, const value_type* end) {
+        for (auto it = start; it != end; it++) {
+            *this = insert(*it);
+        }
+    }
+
+    NODISCARD CONSTEXPR20 bool search(const value_type&& value) const {
+        return searchElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 bool search(const value_type& value) const {
+        return searchElement(value);
+    }
+
+    // The version with the key. The same version if the key is in the tree.
+    NODISCARD CONSTEXPR20 AVLTreePersistent insert(const value_type&& value) const {
+        return insertElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 AVLTreePersistent insert(const value_type& value) const {
+        return insertElement(value);
+    }
+
+    // The version without the key. The same version if the key is not in the tree.
+    NODISCARD CONSTEXPR20 AVLTreePersistent deleteValue(const value_type&& value) const {
+        return deleteElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 AVLTreePersistent deleteValue(const value_type& value) const {
+        return deleteElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 size_type size() const {
+        return count;
+    }
+
+    NODISCARD CONSTEXPR20 bool isEmpty() const {
+        return !root;
+    }
+
+    // The versions which share the root are equal.
+    NODISCARD CONSTEXPR20 const node_type_ptr& getRoot() const {
+        return root;
+    }
+
+    // Visit the keys in ascending order without recursion. The stack holds the path to the current node.
+    template<class Visitor>
+    CONSTEXPR20 void forEachInOrder(Visitor&& visitor) const {
+        std::vector<const node_type*> stack{};
+        const node_type* node_current = root.get();
+
+        while (node_current || !stack.empty()) {
+            // Move down to the leftmost node.
+            while (node_current) {
+                stack.push_back(node_current);
+                node_current = node_current->left.get();
+            }
+
+            node_current = stack.back();
+            stack.pop_back();
+            visitor(node_current->key);
+            node_current = node_current->right.get();
+        }
+    }
+
+    // Check the order of the keys, the heights and the balance factors.
+    NODISCARD CONSTEXPR20 bool verifyProperties() const {
+        bool valid = true;
+        size_type nodes_count = 0;
+        verifyNode(root, valid, nodes_count);
+        return valid && nodes_count == count;
+    }
+
+private:
+    CONSTEXPR20 bool searchElement(const value_type& key) const {
+        const node_type* node_current = root.get();
+        while (node_current) {
+            if (isLess(key, node_current->key)) {
+                node_current = node_current->left.get();
+            } else if (isGreater(key, node_current->key)) {
+                node_current = node_current->right.get();
+            } else {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    NODISCARD CONSTEXPR20 AVLTreePersistent insertElement(const value_type& key) const {
+        auto root_new = insertNode(root, key);
+        if (root_new == root) {
+            return *this;
+        }
+
+        return AVLTreePersistent{ std::move(root_new), static_cast<size_type>(count + 1) };
+    }
+
+    // The new subtree with the key, the same subtree if the key is in it.
+    NODISCARD CONSTEXPR20 node_type_ptr insertNode(const node_type_ptr& node, const value_type& key) const {
+        if (!node) {
+            return createNewNode(key, nullptr, nullptr);
+        }
+
+        if (isLess(key, node->key)) {
+            // left subtree
+            auto node_left = insertNode(node->left, key);
+            return node_left == node->left ? node : rebalance(node->key, std::move(node_left), node->right);
+        }
+
+        if (isGreater(key, node->key)) {
+            // right subtree
+            auto node_right = insertNode(node->right, key);
+            return node_right == node->right ? node : rebalance(node->key, node->left, std::move(node_right));
+        }
+
+        // The same key value already exist in tree.
+        return node;
+    }
+
+    NODISCARD CONSTEXPR20 AVLTreePersistent deleteElement(const value_type& key) const {
+        auto root_new = deleteNode(root, key);
+        if (root_new == root) {
+            return *this;
+        }
+
+        return AVLTreePersistent{ std::move(root_new), static_cast<size_type>(count - 1) };
+    }
+
+    // The new subtree without the key, the same subtree if the key is not in it.
+    NODISCARD CONSTEXPR20 node_type_ptr deleteNode(const node_type_ptr& node, const value_type& key) const {
+        if (!node) {
+            return node;
+        }
+
+        if (isLess(key, node->key)) {
+            // left subtree
+            auto node_left = deleteNode(node->left, key);
+            return node_left == node->left ? node : rebalance(node->key, std::move(node_left), node->right);
+        }
+
+        if (isGreater(key, node->key)) {
+            // right subtree
+            auto node_right = deleteNode(node->right, key);
+            return node_right == node->right ? node : rebalance(node->key, node->left, std::move(node_right));
+        }
+
+        // Node found: a single child takes its place, else the inorder successor does.
+        if (!node->left) {
+            return node->right;
+        }
+
+        if (!node->right) {
+            return node->left;
+        }
+
+        const node_type* node_min = node->right.get();
+        while (node_min->left) {
+            node_min = node_min->left.get();
+        }
+
+        return rebalance(node_min->key, node->left, deleteMinimum(node->right));
+    }
+
+    NODISCARD CONSTEXPR20 node_type_ptr deleteMinimum(const node_type_ptr& node) const {
+        if (!node->left) {
+            return node->right;
+        }
+
+        return rebalance(node->key, deleteMinimum(node->left), node->right);
+    }
+
+    // The new node over two subtrees whose heights differ by 2 at most.
+    // A single or a double rotation builds the balanced nodes directly instead of copying the node first.
+    NODISCARD CONSTEXPR20 node_type_ptr rebalance(const value_type& key, node_type_ptr left, node_type_ptr right) const {
+        Stats::add(StatsEvent::rebalance);
+        const auto height_left = node_type::heightOf(left);
+        const auto height_right = node_type::heightOf(right);
+        if (height_left > height_right + 1) {
+            if (node_type::heightOf(left->left) >= node_type::heightOf(left->right)) {
+                // Left Left case.
+                Stats::add(StatsEvent::rotation);
+                return createNewNode(left->key, left->left, createNewNode(key, left->right, std::move(right)));
+            }
+
+            // Left Right case.
+            Stats::add(StatsEvent::rotation);
+            Stats::add(StatsEvent::rotation);
+            const auto& node_middle = left->right;
+            return createNewNode(node_middle->key,
+                                 createNewNode(left->key, left->left, node_middle->left),
+                                 createNewNode(key, node_middle->right, std::move(right)));
+        }
+
+        if (height_right > height_left + 1) {
+            if (node_type::heightOf(right->right) >= node_type::heightOf(right->left)) {
+                // Right Right case.
+                Stats::add(StatsEvent::rotation);
+                return createNewNode(right->key, createNewNode(key, std::move(left), right->left), right->right);
+            }
+
+            // Right Left case.
+            Stats::add(StatsEvent::rotation);
+            Stats::add(StatsEvent::rotation);
+            const auto& node_middle = right->left;
+            return createNewNode(node_middle->key,
+                                 createNewNode(key, std::move(left), node_middle->left),
+                                 createNewNode(right->key, node_middle->right, right->right));
+        }
+
+        return createNewNode(key, std::move(left), std::move(right));
+    }
+
+    NODISCARD CONSTEXPR20 node_type_ptr createNewNode(const value_type& key, node_type_ptr left, node_type_ptr right) const {
+        Stats::add(StatsEvent::allocation);
+        return std::make_shared<const node_type>(key, std::move(left), std::move(right));
+    }
+
+    // Returns the height of the subtree.
+    CONSTEXPR20 size_type verifyNode(const node_type_ptr& node, bool& valid, size_type& nodes_count) const {
+        if (!node) {
+            return 0;
+        }
+
+        nodes_count++;
+        if ((node->left && !isLess(node->left->key, node->key)) ||
+            (node->right && !isGreater(node->right->key, node->key))) {
+            valid = false;
+        }
+
+        const auto height_left = verifyNode(node->left, valid, nodes_count);
+        const auto height_right = verifyNode(node->right, valid, nodes_count);
+        if (height_left > height_right + 1 || height_right > height_left + 1 ||
+            node->height != std::max(height_left, height_right) + 1) {
+            valid = false;
+        }
+
+        return node->height;
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isGreater(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) > comparedKey(value_b);
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isLess(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) < comparedKey(value_b);
+    }
+};
@@ -6,8 +6,11 @@
 #include <iostream>
 #include <type_traits>
 #include <string>
+#include <utility>
+#include <vector>
 #include <memory>
 #include "head.h"
+#include "stats.h"
 #include "comparators.h"
 
 template <class DataType, class SizeType = size_t>
@@ -58,7 +61,8 @@ struct AVLTreeNodeRecursion {
     }
 };
 
-template <class DataType, class SizeType = size_t>
+// Stats: instrumentation policy (stats.h), reports key comparisons, node allocations, rotations and rebalance steps.
+template <class DataType, class SizeType = size_t, class Stats = NoStats>
 class AVLTreeRecursion {
 private:
     using value_type = DataType;
@@ -87,7 +91,48 @@ public:
         }
     }
 
-    CONSTEXPR20 ~AVLTreeRecursion() = default;
+    CONSTEXPR20 AVLTreeRecursion(AVLTreeRecursion &&other) noexcept :
+            root{ std::exchange(other.root, nullptr) }
+    {
+    }
+
+    CONSTEXPR20 AVLTreeRecursion &operator=(AVLTreeRecursion &&other) noexcept {
+        if (this != &other) {
+            clear();
+            root = std::exchange(other.root, nullptr);
+        }
+
+        return *this;
+    }
+
+    // Structural copy: the nodes are copied level by level with their heights, so nothing is rebalanced. O(n).
+    CONSTEXPR20 AVLTreeRecursion(const AVLTreeRecursion &other) :
+            root{ cloneNodes(other.root) }
+    {
+    }
+
+    CONSTEXPR20 AVLTreeRecursion &operator=(const AVLTreeRecursion &other) {
+        if (this != &other) {
+            *this = AVLTreeRecursion{ other };
+        }
+
+        return *this;
+    }
+
+    // O(1) snapshot: the new tree shares all the nodes with this one. Either tree copies a shared node before it
+    // changes the node (path copying), so an update copies O(log n) nodes and the untouched subtrees stay shared.
+    // The shared nodes are never changed: a snapshot may be read on other threads while this tree is updated.
+    // The snapshot itself must be taken while this tree is not updated.
+    NODISCARD CONSTEXPR20 AVLTreeRecursion snapshot() const {
+        AVLTreeRecursion tree{};
+        tree.root = root;
+        return tree;
+    }
+
+    // The destructor of the root would release the nodes recursively, as deep as the tree.
+    CONSTEXPR20 ~AVLTreeRecursion() {
+        clear();
+    }
 
     NODISCARD CONSTEXPR20 bool search(const value_type&& value) const {
         return searchElement(value);
@@ -113,10 +158,56 @@ public:
         deleteElement(value);
 	}
 
+    NODISCARD CONSTEXPR20 bool isEmpty() const {
+        return !root;
+    }
+
+    // Release the nodes without recursion and without extra memory in O(n): the left child is rotated up
+    // until the node has none, then the node goes with both links empty.
+    // The nodes shared with a snapshot are only released by this tree, never rotated.
+    CONSTEXPR20 void clear() {
+        auto node = std::exchange(root, nullptr);
+        while (node) {
+            if (node.use_count() > 1) {
+                node = nullptr;
+            } else if (node->left.use_count() > 1) {
+                node->left = nullptr;
+            } else if (node->left) {
+                auto node_left = std::move(node->left);
+                node->left = std::move(node_left->right);
+                node_left->right = std::move(node);
+                node = std::move(node_left);
+            } else {
+                node = std::move(node->right);
+            }
+        }
+    }
+
     CONSTEXPR20 auto getRoot() const {
         return root;
     }
 
+    // Visit the keys in ascending order without recursion. The stack holds the path to the current node.
+    template<class Visitor>
+    CONSTEXPR20 void forEachInOrder(Visitor&& visitor) const {
+        const node_type* const node_end = nullptr;
+        std::vector<const node_type*> stack{};
+        const node_type* node_current = root.get();
+
+        while (node_current != node_end || !stack.empty()) {
+            // Move down to the leftmost node.
+            while (node_current != node_end) {
+                stack.push_back(node_current);
+                node_current = node_current->left.get();
+            }
+
+            node_current = stack.back();
+            stack.pop_back();
+            visitor(node_current->key);
+            node_current = node_current->right.get();
+        }
+    }
+
     // Print the tree
     void printTree(node_type_ptr node) {
         if (node) {
@@ -196,6 +287,7 @@ private:
 
     CONSTEXPR20 void insertElement(const value_type& key) {
         if (root) {
+            makeOwned(root);
             root = insertNodeInTree(root, key);
         }
         else {
@@ -221,11 +313,13 @@ private:
         // Search the node to insert.
         if (isLess(key, node->key)) {
             // left subtree
+            makeOwned(node->left);
             node->left = insertNodeInTree(node->left, key);
             return true;
         }
         else if (isGreater(key, node->key)) {
             // right subtree
+            makeOwned(node->right);
             node->right = insertNodeInTree(node->right, key);
             return true;
         }
@@ -242,6 +336,7 @@ private:
     }
 
     CONSTEXPR20 node_type_ptr rebalanceInsert(node_type_ptr node, const value_type& key) {
+        Stats::add(StatsEvent::rebalance);
         const signed_size_type balance_factor = node->getBalanceFactor();
         if (balance_factor > 1) {
             if (isLess(key, node->left->key)) {
@@ -275,6 +370,7 @@ private:
 
     CONSTEXPR20 void deleteElement(const value_type& key) {
         if (root) {
+            makeOwned(root);
             root = deleteNodeInTree(root, key);
         }
     }
@@ -284,6 +380,7 @@ private:
         if (isLess(key, node->key)) {
             if (node->left) {
                 // left subtree
+                makeOwned(node->left);
                 node->left = deleteNodeInTree(node->left, key);
             }
             else {
@@ -294,6 +391,7 @@ private:
         else if (isGreater(key, node->key)) {
             if (node->right) {
                 // right subtree
+                makeOwned(node->right);
                 node->right = deleteNodeInTree(node->right, key);
             }
             else {
@@ -321,8 +419,10 @@ private:
             const auto node_min = getMinimumValueNode(node->right);
             node->key = node_min->key;
             // This one time recursion. The min node will never have a left child, only a right child maybe that grater than current node.
+            makeOwned(node->right);
             node->right = deleteNodeInTree(node->right, node_min->key);
         } else {
+            // The only child of an AVL node is a leaf: it takes the place of the node as is and may be shared.
             if (node->left) {
                 // Node has only left child.
                 node = node->left;
@@ -332,9 +432,10 @@ private:
             } else {
                 // Node has no children at all.
                 node = nullptr;
-                // Don't rebalance on return.
-                return false;
             }
+
+            // Don't rebalance on return.
+            return false;
         }
 
         // Rebalance on return.
@@ -349,6 +450,7 @@ private:
     }
 
     CONSTEXPR20 node_type_ptr rebalanceDelete(node_type_ptr node) {
+        Stats::add(StatsEvent::rebalance);
         const signed_size_type balance_factor = node->getBalanceFactor();
         if (balance_factor > 1) {
             if (node->left->getBalanceFactor() >= 0) {
@@ -356,6 +458,7 @@ private:
                 return rotateRight(node);
             } else {
                 // Left Right case.
+                makeOwned(node->left);
                 node->left = rotateLeft(node->left);
                 return rotateRight(node);
             }
@@ -367,6 +470,7 @@ private:
             }
             else {
                 // Right Left case.
+                makeOwned(node->right);
                 node->right = rotateRight(node->right);
                 return rotateLeft(node);
             }
@@ -376,6 +480,8 @@ private:
     }
 
     CONSTEXPR20 auto rotateLeft(node_type_ptr node) {
+        Stats::add(StatsEvent::rotation);
+        makeOwned(node->right);
         const auto right_node = node->right;
         node->right = right_node->left;
         right_node->left = node;
@@ -386,6 +492,8 @@ private:
     }
 
     CONSTEXPR20 auto rotateRight(node_type_ptr node) {
+        Stats::add(StatsEvent::rotation);
+        makeOwned(node->left);
         const auto left_node = node->left;
         node->left = left_node->right;
         left_node->right = node;
@@ -395,7 +503,51 @@ private:
         return left_node;
     }
 
+    // Replace a node shared with a snapshot by its copy before it is changed. The copy shares the children.
+    CONSTEXPR20 void makeOwned(node_type_ptr& node) const {
+        if (node.use_count() > 1) {
+            Stats::add(StatsEvent::allocation);
+            node = std::make_shared<node_type>(*node);
+        }
+    }
+
+    // Copy the subtree level by level without recursion, the copy has the same shape.
+    NODISCARD CONSTEXPR20 node_type_ptr cloneNodes(const node_type_ptr &node) const {
+        if (!node) {
+            return nullptr;
+        }
+
+        auto node_root = cloneNode(*node);
+        std::vector<std::pair<const node_type *, node_type *>> level{ { node.get(), node_root.get() } };
+        std::vector<std::pair<const node_type *, node_type *>> level_next{};
+        while (!level.empty()) {
+            for (const auto &[node_source, node_copy] : level) {
+                if (node_source->left) {
+                    node_copy->left = cloneNode(*node_source->left);
+                    level_next.emplace_back(node_source->left.get(), node_copy->left.get());
+                }
+
+                if (node_source->right) {
+                    node_copy->right = cloneNode(*node_source->right);
+                    level_next.emplace_back(node_source->right.get(), node_copy->right.get());
+                }
+            }
+
+            level.swap(level_next);
+            level_next.clear();
+        }
+
+        return node_root;
+    }
+
+    NODISCARD CONSTEXPR20 node_type_ptr cloneNode(const node_type &node) const {
+        auto node_copy = createNewNode(node.key);
+        node_copy->height = node.height;
+        return node_copy;
+    }
+
     CONSTEXPR20 node_type_ptr createNewNode(const value_type& key) const {
+        Stats::add(StatsEvent::allocation);
         return std::make_shared<node_type>(key);
     }
 
@@ -470,21 +622,25 @@ private:
 
     template<class T>
     NODISCARD CONSTEXPR20 bool isGreater(std::shared_ptr<T> smart_obj_a, std::shared_ptr<T> smart_obj_b) const {
+        Stats::add(StatsEvent::comparison);
         return *smart_obj_a > *smart_obj_b;
     }
 
     template<class T>
     NODISCARD CONSTEXPR20 bool isGreater(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
         return value_a > value_b;
     }
 
     template<class T>
     NODISCARD CONSTEXPR20 bool isLess(std::shared_ptr<T> smart_obj_a, std::shared_ptr<T> smart_obj_b) const {
+        Stats::add(StatsEvent::comparison);
         return *smart_obj_a < *smart_obj_b;
     }
 
     template<class T>
     NODISCARD CONSTEXPR20 bool isLess(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
         return value_a < value_b;
     }
 };
\ No newline at end of file
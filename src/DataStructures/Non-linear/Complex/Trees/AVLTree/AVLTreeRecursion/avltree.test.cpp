@@ -1,4 +1,7 @@
 ﻿#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include <utility>
 #include <vector>
 #include "avltree.h"
 
@@ -352,6 +355,24 @@ TEST_F(AVLTreeRecursionTest, Search) {
     std::cout << "TEST_F(AVLTreeRecursionTest, Search) end" << std::endl;
 }
 
+TEST_F(AVLTreeRecursionTest, ForEachInOrder) {
+    std::cout << "TEST_F(AVLTreeRecursionTest, ForEachInOrder) start" << std::endl;
+    std::vector<test_data_type> keys{};
+    AVLTreeRecursion<test_data_type> avltree{};
+    // Empty structure.
+    avltree.forEachInOrder([&keys](const test_data_type& key) { keys.push_back(key); });
+    ASSERT_TRUE(keys.empty());
+
+    avltree = AVLTreeRecursion<test_data_type>{array_values};
+    avltree.forEachInOrder([&keys](const test_data_type& key) { keys.push_back(key); });
+
+    auto expected = array_values;
+    std::sort(expected.begin(), expected.end());
+    expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+    ASSERT_EQ(keys, expected);
+    std::cout << "TEST_F(AVLTreeRecursionTest, ForEachInOrder) end" << std::endl;
+}
+
 TEST_F(AVLTreeRecursionTest, FailedVerify) {
     std::cout << "TEST_F(AVLTreeRecursionTest, Search) start" << std::endl;
     AVLTreeRecursion<test_data_type> avltree{};
@@ -364,6 +385,42 @@ TEST_F(AVLTreeRecursionTest, FailedVerify) {
     std::cout << "TEST_F(AVLTreeRecursionTest, Search) end" << std::endl;
 }
 
+TEST_F(AVLTreeRecursionTest, Stats) {
+    std::cout << "TEST_F(AVLTreeRecursionTest, Stats) start" << std::endl;
+    using stats_type = CountingStats<struct AVLTreeRecursionStatsTag>;
+    AVLTreeRecursion<test_data_type, size_t, stats_type> tree{};
+    AVLTreeRecursion<test_data_type> tree_plain{};
+    const test_data_type keys_count = 127;
+
+    stats_type::reset();
+    // Ascending keys make the tree rotate on every level.
+    for (test_data_type key = 0; key < keys_count; key++) {
+        tree.insert(key);
+        tree_plain.insert(key);
+    }
+
+    auto stats = stats_type::snapshot();
+    ASSERT_EQ(stats[StatsEvent::allocation], static_cast<uint64_t>(keys_count));
+    ASSERT_NE(stats[StatsEvent::comparison], 0u);
+    ASSERT_NE(stats[StatsEvent::rotation], 0u);
+    ASSERT_NE(stats[StatsEvent::rebalance], 0u);
+
+    for (test_data_type key = 0; key < keys_count; key += 2) {
+        tree.deleteValue(key);
+        tree_plain.deleteValue(key);
+    }
+
+    ASSERT_GT(stats_type::snapshot()[StatsEvent::rebalance], stats[StatsEvent::rebalance]);
+
+    // The instrumentation doesn't change the tree.
+    stats = stats_type::snapshot();
+    for (test_data_type key = 0; key < keys_count; key++) {
+        ASSERT_EQ(tree.search(key), tree_plain.search(key)) << key;
+    }
+    ASSERT_GE(stats_type::snapshot()[StatsEvent::comparison], stats[StatsEvent::comparison] + keys_count);
+    std::cout << "TEST_F(AVLTreeRecursionTest, Stats) end" << std::endl;
+}
+
 //void insertUntilStackOverflow(AVLTreeRecursion<test_data_type>& avltree) {
 //    std::cout << "Insert values to avl tree until stack overflow" << std::endl;
 //    for (test_data_count index = 0; index < 1000000000000; index++) {
@@ -379,4 +436,105 @@ TEST_F(AVLTreeRecursionTest, FailedVerify) {
 //    ASSERT_EXIT(insertUntilStackOverflow(avltree), testing::ExitedWithCode(0xc00000fd), "Stack Overflow");
 //
 //    std::cout << "TEST_F(AVLTreeRecursionTest, Insert) StackOverflow" << std::endl;
-//}
\ No newline at end of file
+//}
+
+TEST_F(AVLTreeRecursionTest, Clear) {
+    std::cout << "TEST_F(AVLTreeRecursionTest, Clear) start" << std::endl;
+    AVLTreeRecursion<test_data_type> avltree{ array_values };
+    const std::weak_ptr<AVLTreeNodeRecursion<test_data_type>> root_weak = avltree.getRoot();
+
+    // The moved tree owns the nodes.
+    auto avltree_moved = std::move(avltree);
+    ASSERT_TRUE(avltree.isEmpty());
+    ASSERT_TRUE(avltree_moved.verifyCorrectness(array_values_result));
+
+    avltree_moved.clear();
+    ASSERT_TRUE(avltree_moved.isEmpty());
+    ASSERT_TRUE(root_weak.expired());
+
+    // The trees stay usable.
+    avltree_moved.insert(31);
+    avltree.insert(13);
+    ASSERT_TRUE(avltree_moved.search(31));
+    ASSERT_TRUE(avltree.search(13));
+    std::cout << "TEST_F(AVLTreeRecursionTest, Clear) end" << std::endl;
+}
+
+TEST_F(AVLTreeRecursionTest, Copy) {
+    std::cout << "TEST_F(AVLTreeRecursionTest, Copy) start" << std::endl;
+    AVLTreeRecursion<test_data_type> avltree{ array_values };
+
+    // The copy has the same shape and its own nodes.
+    auto avltree_copy = avltree;
+    ASSERT_TRUE(avltree_copy.verifyCorrectness(array_values_result));
+    ASSERT_NE(avltree_copy.getRoot(), avltree.getRoot());
+
+    avltree_copy.deleteValue(30);
+    avltree.insert(50);
+    ASSERT_TRUE(avltree.search(30));
+    ASSERT_FALSE(avltree_copy.search(50));
+
+    avltree_copy = avltree;
+    ASSERT_TRUE(avltree_copy.search(30));
+    ASSERT_TRUE(avltree_copy.search(50));
+
+    AVLTreeRecursion<test_data_type> avltree_empty{};
+    avltree_copy = avltree_empty;
+    ASSERT_TRUE(avltree_copy.isEmpty());
+    std::cout << "TEST_F(AVLTreeRecursionTest, Copy) end" << std::endl;
+}
+
+TEST_F(AVLTreeRecursionTest, Snapshot) {
+    std::cout << "TEST_F(AVLTreeRecursionTest, Snapshot) start" << std::endl;
+    using stats_type = CountingStats<struct AVLTreeRecursionSnapshotTag>;
+    AVLTreeRecursion<test_data_type, size_t, stats_type> avltree{};
+    const test_data_type keys_count = 1023;
+    for (test_data_type key = 0; key < keys_count; key++) {
+        avltree.insert(key * 2);
+    }
+
+    auto snapshot = avltree.snapshot();
+    ASSERT_EQ(snapshot.getRoot(), avltree.getRoot());
+
+    // An update copies the path to the key, the rest of the nodes stay shared.
+    stats_type::reset();
+    avltree.insert(1);
+    ASSERT_LE(stats_type::snapshot()[StatsEvent::allocation], 12u);
+    ASSERT_NE(snapshot.getRoot(), avltree.getRoot());
+    ASSERT_EQ(snapshot.getRoot()->right, avltree.getRoot()->right);
+
+    // Both trees change independently.
+    for (test_data_type key = 0; key < keys_count; key += 3) {
+        avltree.deleteValue(key * 2);
+        snapshot.insert(key * 2 + 1);
+    }
+
+    std::vector<test_data_type> keys{};
+    std::vector<test_data_type> keys_snapshot{};
+    avltree.forEachInOrder([&keys](const test_data_type& key) { keys.push_back(key); });
+    snapshot.forEachInOrder([&keys_snapshot](const test_data_type& key) { keys_snapshot.push_back(key); });
+
+    std::vector<test_data_type> expected{ 1 };
+    std::vector<test_data_type> expected_snapshot{};
+    for (test_data_type key = 0; key < keys_count; key++) {
+        if (key % 3 != 0) {
+            expected.push_back(key * 2);
+        }
+
+        expected_snapshot.push_back(key * 2);
+        if (key % 3 == 0) {
+            expected_snapshot.push_back(key * 2 + 1);
+        }
+    }
+    std::sort(expected.begin(), expected.end());
+    ASSERT_EQ(keys, expected);
+    ASSERT_EQ(keys_snapshot, expected_snapshot);
+
+    // The nodes shared with a live tree survive clear().
+    auto snapshot_second = snapshot.snapshot();
+    snapshot.clear();
+    keys_snapshot.clear();
+    snapshot_second.forEachInOrder([&keys_snapshot](const test_data_type& key) { keys_snapshot.push_back(key); });
+    ASSERT_EQ(keys_snapshot, expected_snapshot);
+    std::cout << "TEST_F(AVLTreeRecursionTest, Snapshot) end" << std::endl;
+}
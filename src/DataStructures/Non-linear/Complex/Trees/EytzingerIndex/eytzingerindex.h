@@ -0,0 +1,127 @@
+// Frozen read-only search index in the Eytzinger (BFS) layout: the children of the node k are the nodes 2k and 2k + 1.
+// + It is built in O(n) from a sorted range or from any ordered tree with forEachInOrder().
+// + The top levels of the implicit tree share a few cache lines, the array is aligned to the cache line.
+// + The search is branchless: the next index is computed from the comparison result, there is nothing to mispredict.
+// + The 16 descendants of a node four levels below are adjacent, they are prefetched while the upper levels are compared.
+// - No modifications: rebuild the index from the updated tree.
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <vector>
+#include "head.h"
+#include "comparators.h"
+#include "aligned_allocator.h"
+
+template <class DataType, class Comparator = ComparatorLess<DataType>>
+class EytzingerIndex {
+private:
+    using value_type = DataType;
+    using const_reference = const DataType&;
+    using size_type = size_t;
+
+    // Prefetch the descendants this number of levels below the current node.
+    static constexpr size_type prefetch_levels = 4;
+    static constexpr size_type prefetch_block_size = sizeof(value_type) << prefetch_levels;
+
+    // Index 0 is unused, so the root is at the index 1 and the descendants of the node k are at k << prefetch_levels.
+    std::vector<value_type, AlignedAllocator<value_type>> data_array{};
+    size_type count{ 0 };
+    Comparator comp{};
+
+public:
+    CONSTEXPR20 EytzingerIndex() = default;
+
+    // The range must be sorted by the same comparator, e.g. by mergeSort(vec, comp).
+    CONSTEXPR20 explicit EytzingerIndex(const value_type* start, const value_type* end) {
+        build(start, static_cast<size_type>(end - start));
+    }
+
+    CONSTEXPR20 explicit EytzingerIndex(const std::vector<value_type>& sorted) {
+        build(sorted.data(), sorted.size());
+    }
+
+    // Take the keys of the tree in order. The tree must be ordered by the same comparator.
+    template<class Tree>
+    NODISCARD static EytzingerIndex fromTree(const Tree& tree) {
+        std::vector<value_type> sorted{};
+        tree.forEachInOrder([&sorted](const value_type& key) {
+            sorted.push_back(key);
+        });
+
+        return EytzingerIndex{ sorted };
+    }
+
+    NODISCARD bool search(const value_type& key) const {
+        const auto index = lowerBoundIndex(key);
+        return index != 0 && !comp(key, data_array[index]);
+    }
+
+    // The first element which doesn't go before the key or nullptr.
+    NODISCARD const value_type* lowerBound(const value_type& key) const {
+        const auto index = lowerBoundIndex(key);
+        return index != 0 ? &data_array[index] : nullptr;
+    }
+
+    NODISCARD CONSTEXPR20 size_type size() const {
+        return count;
+    }
+
+    NODISCARD CONSTEXPR20 bool isEmpty() const {
+        return count == 0;
+    }
+
+    // Keys in the Eytzinger order, the index 0 is unused.
+    NODISCARD CONSTEXPR20 const value_type* data() const {
+        return data_array.data();
+    }
+
+private:
+    // Fill the implicit tree by the in-order traversal, so the sorted keys are read sequentially.
+    CONSTEXPR20 void build(const value_type* sorted, size_type size) {
+        count = size;
+        data_array.assign(size + 1, value_type{});
+        if (size == 0) {
+            return;
+        }
+
+        // The leftmost node.
+        size_type node = 1;
+        while (2 * node <= size) {
+            node = 2 * node;
+        }
+
+        for (size_type index = 0; index < size; index++) {
+            data_array[node] = sorted[index];
+
+            if (2 * node + 1 <= size) {
+                // The leftmost node of the right subtree.
+                node = 2 * node + 1;
+                while (2 * node <= size) {
+                    node = 2 * node;
+                }
+            } else {
+                // Move up while the node is a right child, then to the parent.
+                node >>= std::countr_one(node) + 1;
+            }
+        }
+    }
+
+    // Index of the first element which doesn't go before the key or 0.
+    NODISCARD size_type lowerBoundIndex(const value_type& key) const {
+        const auto base = reinterpret_cast<std::uintptr_t>(data_array.data());
+        size_type node = 1;
+
+        while (node <= count) {
+            // The address may be past the end: prefetch never faults, the pointer is not dereferenced.
+            const auto descendants = base + (node << prefetch_levels) * sizeof(value_type);
+            for (size_type offset = 0; offset < prefetch_block_size; offset += cache_line_size) {
+                PREFETCH(reinterpret_cast<const void*>(descendants + offset));
+            }
+            node = 2 * node + static_cast<size_type>(comp(data_array[node], key));
+        }
+
+        // Every right turn adds the 1 bit. Cancel the right turns after the last left turn and the left turn itself.
+        node >>= std::countr_one(node) + 1;
+        return node;
+    }
+};
@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+#include "eytzingerindex.h"
+#include "redblacktree.h"
+#include "avltree.h"
+#include "mergesort.h"
+
+using test_data_type = int;
+using test_data_count = size_t;
+
+class EytzingerIndexTest : public ::testing::Test {
+protected:
+    EytzingerIndexTest() :
+            array_values{ 3, 9, min_value_second, 5, min_value, 4, max_value_second, 7, max_value, 6 }
+    {
+    }
+
+    const test_data_type max_value{ 100 };
+    const test_data_type max_value_second{ 99 };
+    const test_data_type min_value{ 1 };
+    const test_data_type min_value_second{ 2 };
+    static const test_data_count array_values_elements_count{ 10 };
+    test_data_type array_values[array_values_elements_count];
+
+public:
+    class ObjectA {
+    public:
+        CONSTEXPR20 ObjectA() = default;
+
+        CONSTEXPR20 explicit ObjectA(test_data_type value) :
+                value{ value }
+        {
+        }
+
+        NODISCARD CONSTEXPR20 bool operator> (const ObjectA& obj) const {
+            return this->value > obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 bool operator< (const ObjectA& obj) const {
+            return this->value < obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 test_data_type get() const {
+            return value;
+        }
+
+    private:
+        test_data_type value{};
+    };
+};
+
+// GCC: "undefined reference" if variables defined inside EytzingerIndexTest
+const test_data_count EytzingerIndexTest::array_values_elements_count;
+
+using object_type = EytzingerIndexTest::ObjectA;
+using store_smart_ptr_type = std::shared_ptr<object_type>;
+
+TEST_F(EytzingerIndexTest, Empty) {
+    EytzingerIndex<test_data_type> index{};
+    ASSERT_TRUE(index.isEmpty());
+    ASSERT_FALSE(index.search(min_value));
+    ASSERT_EQ(index.lowerBound(min_value), nullptr);
+}
+
+TEST_F(EytzingerIndexTest, FromSortedVector) {
+    std::vector<test_data_type> sorted{ array_values, array_values + array_values_elements_count };
+    mergeSort(sorted, ComparatorLess<test_data_type>());
+
+    EytzingerIndex<test_data_type> index{ sorted };
+    ASSERT_EQ(index.size(), array_values_elements_count);
+    // The root is the median.
+    ASSERT_EQ(index.data()[1], sorted[6]);
+
+    for (const auto value : array_values) {
+        ASSERT_TRUE(index.search(value));
+    }
+
+    ASSERT_FALSE(index.search(0));
+    ASSERT_FALSE(index.search(8));
+    ASSERT_FALSE(index.search(1337));
+    ASSERT_EQ(*index.lowerBound(8), 9);
+    ASSERT_EQ(*index.lowerBound(min_value), min_value);
+    ASSERT_EQ(index.lowerBound(max_value + 1), nullptr);
+}
+
+TEST_F(EytzingerIndexTest, FromRedBlackTree) {
+    RedBlackTreeLoop<test_data_type> rbtree{ array_values, array_values + array_values_elements_count };
+    auto index = EytzingerIndex<test_data_type>::fromTree(rbtree);
+    ASSERT_EQ(index.size(), array_values_elements_count);
+
+    for (test_data_type value = 0; value <= max_value + 1; value++) {
+        ASSERT_EQ(index.search(value), rbtree.search(value)) << value;
+    }
+}
+
+TEST_F(EytzingerIndexTest, FromAVLTree) {
+    std::mt19937 generator{ 1337 };
+    AVLTreeLoop<test_data_type> avltree{};
+    for (test_data_count index = 0; index < 5000; index++) {
+        avltree.insert(static_cast<test_data_type>(generator() % 20000));
+    }
+
+    auto index = EytzingerIndex<test_data_type>::fromTree(avltree);
+    for (test_data_type value = -1; value <= 20000; value++) {
+        ASSERT_EQ(index.search(value), avltree.search(value)) << value;
+    }
+}
+
+TEST_F(EytzingerIndexTest, LowerBoundAllSizes) {
+    // Every shape of the last level.
+    for (test_data_count size = 1; size <= 130; size++) {
+        std::vector<test_data_type> sorted{};
+        for (test_data_count index = 0; index < size; index++) {
+            sorted.push_back(static_cast<test_data_type>(2 * index + 1));
+        }
+
+        EytzingerIndex<test_data_type> index{ sorted.data(), sorted.data() + sorted.size() };
+        for (test_data_type key = 0; key <= static_cast<test_data_type>(2 * size + 1); key++) {
+            const auto expected = std::lower_bound(sorted.begin(), sorted.end(), key);
+            const auto result = index.lowerBound(key);
+            if (expected == sorted.end()) {
+                ASSERT_EQ(result, nullptr) << size << " " << key;
+            } else {
+                ASSERT_NE(result, nullptr) << size << " " << key;
+                ASSERT_EQ(*result, *expected) << size << " " << key;
+            }
+        }
+    }
+}
+
+TEST_F(EytzingerIndexTest, Duplicates) {
+    std::vector<test_data_type> sorted{ 1, 2, 2, 2, 3, 5, 5, 8 };
+    EytzingerIndex<test_data_type> index{ sorted };
+    ASSERT_TRUE(index.search(2));
+    ASSERT_TRUE(index.search(5));
+    ASSERT_FALSE(index.search(4));
+    ASSERT_EQ(*index.lowerBound(4), 5);
+}
+
+TEST_F(EytzingerIndexTest, PointersWithCustomComparator) {
+    std::vector<store_smart_ptr_type> sorted{};
+    for (const auto value : array_values) {
+        sorted.push_back(std::make_shared<object_type>(value));
+    }
+    mergeSort(sorted, compPtrMin<store_smart_ptr_type>);
+
+    EytzingerIndex<store_smart_ptr_type, decltype(compPtrMin<store_smart_ptr_type>)> index{ sorted };
+    ASSERT_TRUE(index.search(std::make_shared<object_type>(max_value_second)));
+    ASSERT_FALSE(index.search(std::make_shared<object_type>(8)));
+    ASSERT_EQ((*index.lowerBound(std::make_shared<object_type>(8)))->get(), 9);
+}
+
+TEST_F(EytzingerIndexTest, CacheLineAligned) {
+    std::vector<test_data_type> sorted{ array_values, array_values + array_values_elements_count };
+    std::sort(sorted.begin(), sorted.end());
+    EytzingerIndex<test_data_type> index{ sorted };
+    ASSERT_EQ(reinterpret_cast<std::uintptr_t>(index.data()) % cache_line_size, static_cast<std::uintptr_t>(0));
+}
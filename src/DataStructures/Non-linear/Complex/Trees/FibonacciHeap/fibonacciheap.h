@@ -0,0 +1,374 @@
+// Fibonacci heap: a lazy binomial heap.
+// + insert and meld are O(1): trees are only added to the root list.
+// + decreaseKey is amortized O(1): the node is cut to the root list, marked parents are cut too (cascading cut).
+// + remove (the peek) is amortized O(log n): trees of equal degree are linked together (consolidation).
+// + Nodes are allocated from a NodePool, handles returned by insert stay valid until the element is removed.
+#pragma once
+#include <cstdint>
+#include <type_traits>
+#include "head.h"
+#include "comparators.h"
+#include "node_pool.h"
+
+template <class DataType>
+struct FibonacciHeapNode {
+    using value_type = DataType;
+    using node_type = FibonacciHeapNode<value_type>;
+
+    value_type value{};
+    node_type* parent{};
+    // Any child, the children form a circular list.
+    node_type* child{};
+    // Neighbours in the circular list of siblings.
+    node_type* left{ this };
+    node_type* right{ this };
+    uint8_t degree{ 0 };
+    // The node has lost a child since it became a child itself.
+    bool mark{ false };
+
+    CONSTEXPR20 FibonacciHeapNode() = default;
+    CONSTEXPR20 explicit FibonacciHeapNode(const value_type& value) : value(value) {}
+    CONSTEXPR20 explicit FibonacciHeapNode(value_type&& value) : value(std::move(value)) {}
+
+    CONSTEXPR20 ~FibonacciHeapNode() = default;
+};
+
+template <class DataType, class Comparator = ComparatorGreater<DataType>>
+class FibonacciHeap {
+private:
+    using value_type = DataType;
+    using const_reference = const DataType&;
+    using size_type = size_t;
+    using node_type = FibonacciHeapNode<value_type>;
+    using pool_type = NodePool<node_type>;
+
+    // Degree of a node is less than log_phi(n) + 1 <= 1.45 * 64.
+    static constexpr size_type max_degree = 96;
+
+    // The peek node, it is one of the roots.
+    node_type* top{};
+    pool_type pool{};
+    Comparator comp{};
+
+public:
+    // Reference to an element of the heap. Valid until the element is removed.
+    class Handle {
+    public:
+        CONSTEXPR20 Handle() = default;
+
+        NODISCARD CONSTEXPR20 const_reference value() const {
+            return node->value;
+        }
+
+        NODISCARD CONSTEXPR20 explicit operator bool() const {
+            return node != nullptr;
+        }
+
+    private:
+        friend class FibonacciHeap;
+
+        CONSTEXPR20 explicit Handle(node_type* node) : node(node) {}
+
+        node_type* node{};
+    };
+
+    CONSTEXPR20 FibonacciHeap() = default;
+
+    CONSTEXPR20 explicit FibonacciHeap(const value_type* start, const value_type* end) {
+        for (auto it = start; it != end; it++) {
+            insert(*it);
+        }
+    }
+
+    FibonacciHeap(const FibonacciHeap&) = delete;
+    FibonacciHeap& operator=(const FibonacciHeap&) = delete;
+
+    FibonacciHeap(FibonacciHeap&& other) noexcept :
+            top{ other.top },
+            pool{ std::move(other.pool) },
+            comp{ other.comp }
+    {
+        other.top = nullptr;
+    }
+
+    FibonacciHeap& operator=(FibonacciHeap&& other) noexcept {
+        if (this != &other) {
+            clear();
+            top = other.top;
+            pool = std::move(other.pool);
+            comp = other.comp;
+            other.top = nullptr;
+        }
+
+        return *this;
+    }
+
+    ~FibonacciHeap() {
+        clear();
+    }
+
+    CONSTEXPR20 Handle insert(value_type&& value) {
+        return insertNode(pool.create(std::move(value)));
+    }
+
+    CONSTEXPR20 Handle insert(const value_type& value) {
+        return insertNode(pool.create(value));
+    }
+
+    // Remove the peek.
+    CONSTEXPR20 void remove() {
+        if (!top) {
+            return;
+        }
+
+        auto node = top;
+
+        // Move the children to the root list.
+        if (node->child) {
+            auto child = node->child;
+            do {
+                child->parent = nullptr;
+                child->mark = false;
+                child = child->right;
+            } while (child != node->child);
+
+            spliceLists(node, node->child);
+            node->child = nullptr;
+        }
+
+        // Remove the node from the root list.
+        if (node->right == node) {
+            top = nullptr;
+        } else {
+            top = node->right;
+            unlinkFromList(node);
+            consolidate();
+        }
+
+        pool.destroy(node);
+    }
+
+    // Remove any element.
+    CONSTEXPR20 void remove(Handle handle) {
+        auto node = handle.node;
+        if (node->parent) {
+            auto parent = node->parent;
+            cut(node);
+            cascadingCut(parent);
+        }
+
+        // The node is a root now, remove it as if it were the peek.
+        top = node;
+        remove();
+    }
+
+    // Move the element closer to the peek. The new value must not go after the old one by the comparator.
+    CONSTEXPR20 void decreaseKey(Handle handle, const value_type& value) {
+        auto node = handle.node;
+        node->value = value;
+
+        auto parent = node->parent;
+        if (parent && comp(node->value, parent->value)) {
+            cut(node);
+            cascadingCut(parent);
+        }
+
+        if (comp(node->value, top->value)) {
+            top = node;
+        }
+    }
+
+    // Take all elements of the other heap. O(1), the other heap becomes empty.
+    CONSTEXPR20 void meld(FibonacciHeap& other) {
+        if (this == &other || !other.top) {
+            return;
+        }
+
+        pool.splice(other.pool);
+
+        if (!top) {
+            top = other.top;
+        } else {
+            spliceLists(top, other.top);
+            if (comp(other.top->value, top->value)) {
+                top = other.top;
+            }
+        }
+
+        other.top = nullptr;
+    }
+
+    NODISCARD CONSTEXPR20 const_reference peek() const {
+        return top->value;
+    }
+
+    NODISCARD CONSTEXPR20 size_type size() const {
+        return pool.size();
+    }
+
+    NODISCARD CONSTEXPR20 bool isEmpty() const {
+        return top == nullptr;
+    }
+
+    // Destroy all elements without recursion.
+    void clear() {
+        if constexpr (!std::is_trivially_destructible_v<value_type>) {
+            if (top) {
+                // Break the root list and process it as a stack. Children lists are pushed on top of it.
+                auto node = top->right;
+                top->right = nullptr;
+
+                while (node) {
+                    if (node->child) {
+                        auto child = node->child;
+                        auto last_child = child->left;
+                        last_child->right = node->right;
+                        node->right = child;
+                        node->child = nullptr;
+                    }
+
+                    auto next = node->right;
+                    pool.destroy(node);
+                    node = next;
+                }
+            }
+        }
+
+        top = nullptr;
+        pool.release();
+    }
+
+private:
+    CONSTEXPR20 Handle insertNode(node_type* node) {
+        if (!top) {
+            top = node;
+        } else {
+            spliceLists(top, node);
+            if (comp(node->value, top->value)) {
+                top = node;
+            }
+        }
+
+        return Handle{ node };
+    }
+
+    // Join two circular lists.
+    CONSTEXPR20 void spliceLists(node_type* first, node_type* second) const {
+        auto first_right = first->right;
+        auto second_left = second->left;
+
+        first->right = second;
+        second->left = first;
+        second_left->right = first_right;
+        first_right->left = second_left;
+    }
+
+    CONSTEXPR20 void unlinkFromList(node_type* node) const {
+        node->left->right = node->right;
+        node->right->left = node->left;
+        node->left = node;
+        node->right = node;
+    }
+
+    // Make the second root a child of the first root.
+    CONSTEXPR20 void linkChild(node_type* parent, node_type* child) const {
+        child->parent = parent;
+        child->mark = false;
+
+        if (parent->child) {
+            spliceLists(parent->child, child);
+        } else {
+            parent->child = child;
+        }
+
+        parent->degree++;
+    }
+
+    // Link roots of equal degree until all degrees are different, then find the new peek.
+    CONSTEXPR20 void consolidate() {
+        node_type* roots_by_degree[max_degree]{};
+        size_type degree_last = 0;
+
+        // Break the root list, every root is processed as a single tree.
+        auto node = top;
+        node->left->right = nullptr;
+
+        while (node) {
+            auto next = node->right;
+            node->left = node;
+            node->right = node;
+
+            auto degree = static_cast<size_type>(node->degree);
+            while (roots_by_degree[degree]) {
+                auto other = roots_by_degree[degree];
+                roots_by_degree[degree] = nullptr;
+
+                if (comp(other->value, node->value)) {
+                    std::swap(node, other);
+                }
+
+                linkChild(node, other);
+                degree++;
+            }
+
+            roots_by_degree[degree] = node;
+            if (degree_last < degree) {
+                degree_last = degree;
+            }
+
+            node = next;
+        }
+
+        // Rebuild the root list.
+        top = nullptr;
+        for (size_type degree = 0; degree <= degree_last; degree++) {
+            auto root = roots_by_degree[degree];
+            if (!root) {
+                continue;
+            }
+
+            if (!top) {
+                top = root;
+            } else {
+                spliceLists(top, root);
+                if (comp(root->value, top->value)) {
+                    top = root;
+                }
+            }
+        }
+    }
+
+    // Move the node to the root list.
+    CONSTEXPR20 void cut(node_type* node) {
+        auto parent = node->parent;
+
+        if (node->right == node) {
+            parent->child = nullptr;
+        } else {
+            if (parent->child == node) {
+                parent->child = node->right;
+            }
+
+            unlinkFromList(node);
+        }
+
+        parent->degree--;
+        node->parent = nullptr;
+        node->mark = false;
+        spliceLists(top, node);
+    }
+
+    // Cut marked ancestors, mark the first unmarked one.
+    CONSTEXPR20 void cascadingCut(node_type* node) {
+        while (node->parent) {
+            if (!node->mark) {
+                node->mark = true;
+                return;
+            }
+
+            auto parent = node->parent;
+            cut(node);
+            node = parent;
+        }
+    }
+};
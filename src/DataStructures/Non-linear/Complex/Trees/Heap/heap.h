@@ -1,10 +1,16 @@
 ﻿#pragma once
+#include <algorithm>
 #include <type_traits>
 #include <memory>
 #include "head.h"
 #include "comparators.h"
+#include "heap_levels.h"
+#include "snapshot.h"
+#include "thread_pool.h"
+#include "stats.h"
 
-template <class DataType, class Comparator = ComparatorGreater<DataType>>
+// Stats: instrumentation policy (stats.h), reports comparisons, swaps and growths of the array.
+template <class DataType, class Comparator = ComparatorGreater<DataType>, class Stats = NoStats>
 class Heap {
 private:
 	using value_type = DataType;
@@ -12,7 +18,7 @@ private:
 	using size_type = size_t;
 
 	std::vector<value_type> data_array{};
-	Comparator comp{};
+	StatsComparator<Comparator, Stats> comp{};
 
 public:
 	CONSTEXPR20 Heap() = default;
@@ -34,16 +40,63 @@ public:
 		heapifyStart(size);
 	}
 
+	// Build the heap in parallel. Arrays smaller than grain_size are built serially.
+	explicit Heap(const value_type* start, const value_type* end, ThreadPool& pool, size_type grain_size = default_grain_size) {
+		const size_type size = end - start;
+
+		data_array.resize(size);
+
+		pool.parallelFor(0, size, grain_size, [this, start](size_type first, size_type last) {
+			for (auto index = first; index < last; index++) {
+				data_array[index] = start[index];
+			}
+		});
+
+		heapifyStartParallel(size, pool, grain_size);
+	}
+
 	CONSTEXPR20 ~Heap() = default;
 
+	// Combine many heaps into one in O(n): the arrays are moved into one array concurrently and the heap is rebuilt in parallel.
+	// The source heaps are left empty.
+	NODISCARD static Heap mergeHeaps(std::vector<Heap>& heaps, ThreadPool& pool, size_type grain_size = default_grain_size) {
+		const auto heaps_count = heaps.size();
+		// Position of every source array in the merged array.
+		std::vector<size_type> offsets(heaps_count + 1, 0);
+		for (size_type index = 0; index < heaps_count; index++) {
+			offsets[index + 1] = offsets[index] + heaps[index].size();
+		}
+
+		Heap heap{};
+		const auto size = offsets[heaps_count];
+		heap.data_array.resize(size);
+
+		pool.parallelFor(0, heaps_count, 1, [&heaps, &heap, &offsets](size_type first, size_type last) {
+			for (auto index = first; index < last; index++) {
+				auto& source_array = heaps[index].data_array;
+				std::move(source_array.begin(), source_array.end(), heap.data_array.begin() + offsets[index]);
+				source_array.clear();
+			}
+		});
+
+		heap.heapifyStartParallel(size, pool, grain_size);
+		return heap;
+	}
+
+	// O(log n): the new element is sifted up from the last position.
 	CONSTEXPR20 void insert(value_type&& value) {
-		insertElement(value);
+		reportGrowth();
+		data_array.push_back(std::move(value));
+		siftUp(data_array.size() - 1);
 	}
 
 	CONSTEXPR20 void insert(const value_type& value) {
-		insertElement(value);
+		reportGrowth();
+		data_array.push_back(value);
+		siftUp(data_array.size() - 1);
 	}
 
+	// O(log n): the last element takes the place of the removed one and is sifted up or down.
 	CONSTEXPR20 void remove(size_type index) {
 		const auto size = data_array.size();
 
@@ -54,7 +107,21 @@ public:
         const auto new_size = size - 1;
 		swap(index, new_size);
 		data_array.pop_back();
-		heapifyStart(new_size);
+
+		if (index < new_size) {
+			if (index != 0 && comp(data_array[index], data_array[(index - 1) / 2])) {
+				siftUp(index);
+			} else if (2 * index + 1 < new_size) {
+				heapify(index);
+			}
+		}
+	}
+
+	// Remove the peek and return it.
+	NODISCARD CONSTEXPR20 value_type extract() {
+		value_type value = std::move(data_array.front());
+		remove(0);
+		return value;
 	}
 
 	NODISCARD CONSTEXPR20 const_reference peek() const noexcept(noexcept(data_array.front())) /* strengthened */ {
@@ -74,13 +141,45 @@ public:
 		data_array.reserve(size);
 	}
 
-private:
-	CONSTEXPR20 void insertElement(const value_type& value) {
-		data_array.push_back(value);
-		const size_type size = data_array.size();
+	// Binary snapshot (snapshot.h): the array as it is, already in heap order, in one run around the buffer.
+	void writeSnapshot(int descriptor, size_type buffer_size = default_snapshot_buffer_size) const {
+		SnapshotWriter writer{ descriptor, buffer_size };
+		writer.writeHeader<value_type>(SnapshotKind::heap_array, data_array.size());
+		writer.writeArray(data_array.data(), data_array.size());
+		writer.finish();
+	}
 
-		if (size != 0) {
-			heapifyStart(size);
+	// Restore the heap of a snapshot in O(n) without comparisons: the array is adopted as it is, so the snapshot
+	// must be read with the comparator it was written with. Throws std::runtime_error if the snapshot is damaged.
+	// The count of the header is not trusted before the checksum: the array grows by a buffer of keys at a time,
+	// so a damaged count ends with the stream instead of a huge allocation.
+	NODISCARD static Heap readSnapshot(int descriptor, size_type buffer_size = default_snapshot_buffer_size) {
+		SnapshotReader reader{ descriptor, buffer_size };
+		auto count_left = reader.readHeader<value_type>(SnapshotKind::heap_array);
+		const auto chunk_size = std::max<size_type>(buffer_size / sizeof(value_type), 1);
+		Heap heap{};
+		while (count_left != 0) {
+			const auto count = static_cast<size_type>(std::min<uint64_t>(count_left, chunk_size));
+			const auto size = heap.data_array.size();
+			heap.data_array.resize(size + count);
+			reader.readArray(heap.data_array.data() + size, count);
+			count_left -= count;
+		}
+		reader.finish();
+		return heap;
+	}
+
+private:
+	// Move the element up while it goes before its parent.
+	CONSTEXPR20 void siftUp(size_type index) {
+		while (index != 0) {
+			const auto parent_index = (index - 1) / 2;
+			if (!comp(data_array[index], data_array[parent_index])) {
+				break;
+			}
+
+			this->swap(index, parent_index);
+			index = parent_index;
 		}
 	}
 
@@ -94,6 +193,18 @@ private:
         }
 	}
 
+	// heapifyLevelsParallel() (heap_levels.h) heapifies the nodes of a level concurrently.
+	void heapifyStartParallel(size_type size, ThreadPool& pool, size_type grain_size) {
+		if (size < grain_size || pool.size() < 2) {
+			heapifyStart(size);
+			return;
+		}
+
+		heapifyLevelsParallel(size, pool, grain_size, [this](size_type index) {
+			heapify(index);
+		});
+	}
+
 	CONSTEXPR20 void heapify(size_type current_element) {
 		const auto size = data_array.size();
 		auto local_peek_node_index = current_element;
@@ -125,7 +236,15 @@ private:
 		}
 	}
 
+	// push_back() reallocates the array when it is full.
+	CONSTEXPR20 void reportGrowth() const {
+		if (data_array.size() == data_array.capacity()) {
+			Stats::add(StatsEvent::allocation);
+		}
+	}
+
 	CONSTEXPR20 void swap(size_type index_first, size_type index_second) {
+		Stats::add(StatsEvent::swap);
 		value_type value_temp = std::move(data_array[index_first]);
 		data_array[index_first] = std::move(data_array[index_second]);
 		data_array[index_second] = std::move(value_temp);
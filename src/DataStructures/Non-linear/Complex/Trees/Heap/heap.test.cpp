@@ -1,5 +1,9 @@
 ﻿#include <gtest/gtest.h>
+#include <cstddef>
+#include <cstdio>
 #include <memory>
+#include <random>
+#include <stdexcept>
 #include "heap.h"
 
 using test_data_type = int;
@@ -349,6 +353,30 @@ TEST_F(HeapTest, Deletion) {
 //    ASSERT_EQ(heap.peek(), max_value_second);
 //}
 
+TEST_F(HeapTest, DeletionAnyIndex) {
+    std::mt19937 generator{ 1337 };
+    Heap<test_data_type, ComparatorLess<test_data_type>> heap{};
+
+    for (test_data_count index = 0; index < 2000; index++) {
+        const auto value = static_cast<test_data_type>(generator() % 1000);
+        heap.insert(value);
+    }
+
+    // Remove elements at random positions, the last element may go up or down.
+    for (test_data_count index = 0; index < 1000; index++) {
+        heap.remove(generator() % heap.size());
+    }
+
+    ASSERT_EQ(heap.size(), static_cast<test_data_count>(1000));
+    auto prev_value = heap.peek();
+    while (!heap.isEmpty()) {
+        auto current_value = heap.peek();
+        ASSERT_LE(prev_value, current_value) << "heapify is incorrect when deleting.";
+        prev_value = current_value;
+        heap.remove(0);
+    }
+}
+
 TEST_F(HeapTest, Size) {
     Heap<test_data_type> heap{ array_values, array_values + array_values_elements_count };
     ASSERT_EQ(heap.size(), array_values_elements_count);
@@ -359,4 +387,136 @@ TEST_F(HeapTest, IsEmpty) {
     ASSERT_TRUE(heap.isEmpty());
     heap.insert(array_values[0]);
     ASSERT_FALSE(heap.isEmpty());
-}
\ No newline at end of file
+}
+
+TEST_F(HeapTest, ParallelBuild) {
+    ThreadPool pool{ 4 };
+    std::mt19937 generator{ 1337 };
+    std::vector<test_data_type> values(20000);
+    for (auto& value : values) {
+        value = static_cast<test_data_type>(generator() % 5000);
+    }
+
+    Heap<test_data_type> heap{ values.data(), values.data() + values.size(), pool, 512 };
+    ASSERT_EQ(heap.size(), values.size());
+    ASSERT_EQ(heap.peek(), *std::max_element(values.begin(), values.end()));
+
+    auto prev_value = heap.peek();
+    for (test_data_count index = 0; index < 200; index++) {
+        auto current_value = heap.peek();
+        ASSERT_GE(prev_value, current_value) << "heapify is incorrect when deleting.";
+        prev_value = current_value;
+        heap.remove(0);
+    }
+}
+
+TEST_F(HeapTest, MergeHeaps) {
+    ThreadPool pool{ 4 };
+    std::vector<Heap<test_data_type, ComparatorLess<test_data_type>>> heaps{};
+    test_data_type min_value_all = max_value;
+    test_data_count size_all = 0;
+
+    for (test_data_count heap_index = 0; heap_index < 16; heap_index++) {
+        std::vector<test_data_type> values{};
+        for (test_data_count index = 0; index < 100 + heap_index; index++) {
+            const auto value = static_cast<test_data_type>((index * 7919 + heap_index * 104729) % 10007);
+            values.push_back(value);
+            min_value_all = std::min(min_value_all, value);
+        }
+
+        size_all += values.size();
+        heaps.emplace_back(values.data(), values.data() + values.size());
+    }
+
+    auto heap = Heap<test_data_type, ComparatorLess<test_data_type>>::mergeHeaps(heaps, pool, 64);
+    ASSERT_EQ(heap.size(), size_all);
+    ASSERT_EQ(heap.peek(), min_value_all);
+
+    for (const auto& source_heap : heaps) {
+        ASSERT_TRUE(source_heap.isEmpty());
+    }
+
+    auto prev_value = heap.peek();
+    for (test_data_count index = 0; index < 100; index++) {
+        auto current_value = heap.peek();
+        ASSERT_LE(prev_value, current_value) << "heapify is incorrect when deleting.";
+        prev_value = current_value;
+        heap.remove(0);
+    }
+}
+
+TEST_F(HeapTest, Stats) {
+    using stats_type = CountingStats<struct HeapStatsTag>;
+    Heap<test_data_type, ComparatorLess<test_data_type>, stats_type> heap{};
+    Heap<test_data_type, ComparatorLess<test_data_type>> heap_plain{};
+
+    stats_type::reset();
+    for (const auto value : array_values) {
+        heap.insert(value);
+        heap_plain.insert(value);
+    }
+
+    const auto stats = stats_type::snapshot();
+    ASSERT_NE(stats[StatsEvent::comparison], 0u);
+    ASSERT_NE(stats[StatsEvent::swap], 0u);
+    // The array grows geometrically.
+    ASSERT_NE(stats[StatsEvent::allocation], 0u);
+    ASSERT_LT(stats[StatsEvent::allocation], static_cast<uint64_t>(array_values_elements_count));
+
+    // The instrumentation doesn't change the order.
+    while (!heap_plain.isEmpty()) {
+        ASSERT_EQ(heap.extract(), heap_plain.extract());
+    }
+    ASSERT_GT(stats_type::snapshot()[StatsEvent::comparison], stats[StatsEvent::comparison]);
+}
+
+TEST_F(HeapTest, Snapshot) {
+    using stats_type = CountingStats<struct HeapSnapshotStatsTag>;
+    using heap_type = Heap<test_data_type, ComparatorLess<test_data_type>, stats_type>;
+    std::mt19937 generator{ 1337 };
+    std::vector<test_data_type> values(20000);
+    for (auto& value : values) {
+        value = static_cast<test_data_type>(generator() % 5000);
+    }
+
+    std::FILE* file = std::tmpfile();
+    ASSERT_NE(file, nullptr);
+    const auto descriptor = snapshot_io::fileDescriptor(file);
+
+    // A small buffer: the array goes around it. The empty heap follows in the same stream.
+    heap_type heap{ values.data(), values.data() + values.size() };
+    heap.writeSnapshot(descriptor, 4096);
+    heap_type{}.writeSnapshot(descriptor);
+    snapshot_io::seek(descriptor, 0);
+
+    // The array is adopted without comparisons.
+    stats_type::reset();
+    auto heap_restored = heap_type::readSnapshot(descriptor, 4096);
+    ASSERT_EQ(stats_type::snapshot()[StatsEvent::comparison], 0u);
+    ASSERT_TRUE(heap_type::readSnapshot(descriptor).isEmpty());
+    ASSERT_EQ(heap_restored.size(), heap.size());
+    while (!heap.isEmpty()) {
+        ASSERT_EQ(heap_restored.extract(), heap.extract());
+    }
+
+    // A damaged key fails the checksum, a truncated stream ends too early.
+    const test_data_type flipped = 1 << 20;
+    snapshot_io::seek(descriptor, sizeof(SnapshotHeader) + 100 * sizeof(test_data_type));
+    snapshot_io::writeAll(descriptor, reinterpret_cast<const unsigned char*>(&flipped), sizeof(flipped));
+    snapshot_io::seek(descriptor, 0);
+    ASSERT_THROW(static_cast<void>(heap_type::readSnapshot(descriptor)), std::runtime_error);
+    snapshot_io::truncate(descriptor, 1000);
+    snapshot_io::seek(descriptor, 0);
+    ASSERT_THROW(static_cast<void>(heap_type::readSnapshot(descriptor)), std::runtime_error);
+
+    // A damaged count of a whole snapshot, here about 4 TB of keys, is not allocated up front: the stream ends first.
+    snapshot_io::truncate(descriptor, 0);
+    snapshot_io::seek(descriptor, 0);
+    heap_type{ values.data(), values.data() + values.size() }.writeSnapshot(descriptor);
+    const uint64_t count_damaged = values.size() | (uint64_t{ 1 } << 40);
+    snapshot_io::seek(descriptor, offsetof(SnapshotHeader, count));
+    snapshot_io::writeAll(descriptor, reinterpret_cast<const unsigned char*>(&count_damaged), sizeof(count_damaged));
+    snapshot_io::seek(descriptor, 0);
+    ASSERT_THROW(static_cast<void>(heap_type::readSnapshot(descriptor)), std::runtime_error);
+    std::fclose(file);
+}
@@ -0,0 +1,835 @@
+// B+tree in a memory-mapped file: an ordered set of keys which may be larger than RAM.
+// + The nodes are the pages of the file, PageSize bytes each, and link each other by page numbers instead of pointers.
+//   Opening maps the file and reads the meta page only: the OS loads the other pages when a search touches them.
+// + Copy-on-write: the pages of the last commit never change. An update writes new copies of the pages on its path,
+//   a page written since the last commit is changed in place. commit() flushes the new pages, then switches to them
+//   by writing the older of the two meta pages and flushing it: after a crash the file opens at the last commit.
+// + commit_every batches the flushes: one commit per commit_every updates, 0 leaves the commits to commit() and to
+//   the destructor.
+// + The pages replaced since the last commit are reused after the next one, until then the last commit refers to them.
+//   commit() saves the list of the free pages in the free pages themselves.
+// + The keys are stored as bytes: trivially copyable keys with operator<. One thread at a time.
+// POSIX only: mmap, msync.
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "head.h"
+#include "snapshot.h"
+#include "stats.h"
+
+// Stats: instrumentation policy (stats.h), reports key comparisons and page allocations.
+template <class DataType, size_t PageSize = 4096, class Stats = NoStats>
+class MappedBPlusTree {
+public:
+    using value_type = DataType;
+    using size_type = uint64_t;
+    using page_id = uint64_t;
+
+    // The address space reserved for the file: it may grow up to this size. 16 GiB, 1 GiB where size_t is 32 bits.
+    static constexpr size_t default_map_size = sizeof(size_t) >= 8 ? size_t{ 1 } << 34 : size_t{ 1 } << 30;
+
+private:
+    enum class PageKind : uint32_t {
+        leaf = 1,
+        branch,
+        free_list
+    };
+
+    struct PageHeader {
+        // The transaction which wrote the page: the pages of the current one are changed in place.
+        uint64_t txn;
+        PageKind kind;
+        uint32_t count;
+    };
+
+    // Two meta pages, 0 and 1, the commit writes the older one. The valid one with the greater txn is the current one.
+    struct MetaPage {
+        static constexpr uint64_t magic_value = 0x4545525450424D43;  // "CMBPTREE"
+        static constexpr uint32_t format_version_value = 1;
+
+        uint64_t magic;
+        uint32_t format_version;
+        uint32_t page_size;
+        uint32_t key_size;
+        uint32_t reserved;
+        uint64_t txn;
+        page_id root;
+        size_type levels;
+        size_type count;
+        page_id pages_count;
+        page_id free_list;
+        uint64_t checksum;
+    };
+
+    // A leaf: the header and the keys. A branch: the header, count + 1 children and count separators,
+    // the separator i is the first key of the child i + 1. A page of the free list: the header, the next page
+    // of the list and count free pages.
+    static constexpr size_t leaf_capacity = (PageSize - sizeof(PageHeader)) / sizeof(value_type);
+    static constexpr size_t branch_capacity = (PageSize - sizeof(PageHeader) - sizeof(page_id)) / (sizeof(value_type) + sizeof(page_id));
+    static constexpr size_t free_list_capacity = (PageSize - sizeof(PageHeader) - sizeof(page_id)) / sizeof(page_id);
+    static constexpr size_t leaf_minimum = leaf_capacity / 2;
+    static constexpr size_t branch_minimum = branch_capacity / 2;
+
+    static_assert(std::is_trivially_copyable_v<value_type>, "The keys are stored in the file as bytes.");
+    static_assert(alignof(value_type) <= alignof(page_id), "The keys follow the page numbers in a branch.");
+    static_assert(PageSize % alignof(page_id) == 0 && PageSize >= sizeof(MetaPage), "The page must hold the meta page.");
+    static_assert(leaf_capacity >= 4 && branch_capacity >= 4, "The page is too small for the key.");
+
+    // The step of a search path: the child taken at a branch, the position of the key at the leaf.
+    struct PathStep {
+        page_id page;
+        size_t index;
+    };
+
+    int descriptor{ -1 };
+    unsigned char* map{};
+    size_t map_size{};
+    page_id file_pages{};
+
+    page_id root{};
+    size_type levels{};
+    size_type count{};
+    page_id pages_count{ 2 };
+    // The transaction being built: the last commit is txn - 1.
+    uint64_t txn{ 1 };
+    // Free since the last commit, freed by this transaction and the pages of the saved free list.
+    std::vector<page_id> free_pages{};
+    std::vector<page_id> pending_pages{};
+    std::vector<page_id> free_list_pages{};
+    // The range of the pages allocated by the transaction: the only ones it writes, so the commit flushes only them.
+    page_id dirty_first{ std::numeric_limits<page_id>::max() };
+    page_id dirty_last{};
+    size_type commit_every{};
+    size_type updates_uncommitted{};
+
+public:
+    // Open the index file or create the empty one. Throws std::runtime_error if the file is not an index
+    // of this key type and page size.
+    explicit MappedBPlusTree(const std::string& path, size_type commit_every = 0, size_t map_size = default_map_size) :
+            map_size{ map_size - map_size % PageSize },
+            commit_every{ commit_every }
+    {
+        descriptor = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (descriptor < 0) {
+            fail("can't open " + path);
+        }
+
+        try {
+            struct stat status{};
+            if (::fstat(descriptor, &status) != 0) {
+                fail("can't stat " + path);
+            }
+
+            // 64 bits: the file may be larger than a 32-bit size_t.
+            const auto file_size = static_cast<uint64_t>(status.st_size);
+            if (file_size % PageSize != 0 || file_size > this->map_size) {
+                throw std::runtime_error("MappedBPlusTree: " + path + " is not an index of this page size or outgrew the map size");
+            }
+
+            file_pages = file_size / PageSize;
+            void* address = ::mmap(nullptr, this->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+            if (address == MAP_FAILED) {
+                fail("can't map " + path);
+            }
+
+            map = static_cast<unsigned char*>(address);
+            // The searches jump between the pages: no read-ahead.
+            ::madvise(map, this->map_size, MADV_RANDOM);
+            if (file_pages == 0) {
+                growFile();
+                commitTransaction();
+            } else {
+                loadMeta(path);
+            }
+        } catch (...) {
+            release();
+            throw;
+        }
+    }
+
+    MappedBPlusTree(const MappedBPlusTree&) = delete;
+    MappedBPlusTree& operator=(const MappedBPlusTree&) = delete;
+
+    // A failed commit can't be reported from here: call commit() first to see it.
+    ~MappedBPlusTree() {
+        try {
+            commit();
+        } catch (...) {
+        }
+
+        release();
+    }
+
+    NODISCARD bool search(const value_type&& value) const {
+        return searchElement(value);
+    }
+
+    NODISCARD bool search(const value_type& value) const {
+        return searchElement(value);
+    }
+
+    // Returns whether the key was inserted.
+    bool insert(const value_type&& value) {
+        return insertElement(value);
+    }
+
+    bool insert(const value_type& value) {
+        return insertElement(value);
+    }
+
+    // Returns whether the key was removed.
+    bool deleteValue(const value_type&& value) {
+        return deleteElement(value);
+    }
+
+    bool deleteValue(const value_type& value) {
+        return deleteElement(value);
+    }
+
+    // Make the updates durable: flush the new pages, then the meta page. Nothing to do without updates.
+    void commit() {
+        if (updates_uncommitted != 0) {
+            commitTransaction();
+        }
+    }
+
+    // Ask the OS to load all the pages in the background, e.g. before a scan.
+    void warm() const {
+        ::madvise(map, static_cast<size_t>(pages_count * PageSize), MADV_WILLNEED);
+    }
+
+    NODISCARD size_type size() const {
+        return count;
+    }
+
+    NODISCARD bool isEmpty() const {
+        return root == 0;
+    }
+
+    // The levels of the tree, the leaves are one level.
+    NODISCARD size_type height() const {
+        return levels;
+    }
+
+    // The pages of the file in use, the meta pages and the free pages included.
+    NODISCARD page_id pagesCount() const {
+        return pages_count;
+    }
+
+    // Visit the keys in ascending order. The stack holds the path to the current leaf.
+    template<class Visitor>
+    void forEachInOrder(Visitor&& visitor) const {
+        if (root == 0) {
+            return;
+        }
+
+        std::vector<std::pair<page_id, size_t>> stack{ { root, 0 } };
+        while (!stack.empty()) {
+            const auto [page, index] = stack.back();
+            const auto page_header = header(page);
+            if (page_header->kind == PageKind::leaf) {
+                const auto keys = leafKeys(page);
+                for (size_t key_index = 0; key_index < page_header->count; key_index++) {
+                    visitor(keys[key_index]);
+                }
+                stack.pop_back();
+                continue;
+            }
+
+            if (index > page_header->count) {
+                stack.pop_back();
+                continue;
+            }
+
+            stack.back().second++;
+            stack.emplace_back(branchChildren(page)[index], 0);
+        }
+    }
+
+    // Check the order of the keys, the fill of the pages, the depth of the leaves and the count.
+    NODISCARD bool verifyProperties() const {
+        if (root == 0) {
+            return levels == 0 && count == 0;
+        }
+
+        bool valid = true;
+        size_type keys_count = 0;
+        verifyPage(root, 1, nullptr, nullptr, valid, keys_count);
+        return valid && keys_count == count;
+    }
+
+private:
+    [[noreturn]] static void fail(const std::string& message) {
+        throw std::runtime_error("MappedBPlusTree: " + message + ": " + std::strerror(errno));
+    }
+
+    void release() {
+        if (map) {
+            ::munmap(map, map_size);
+            map = nullptr;
+        }
+
+        if (descriptor >= 0) {
+            ::close(descriptor);
+            descriptor = -1;
+        }
+    }
+
+    NODISCARD unsigned char* page(page_id id) const {
+        return map + id * PageSize;
+    }
+
+    NODISCARD PageHeader* header(page_id id) const {
+        return reinterpret_cast<PageHeader*>(page(id));
+    }
+
+    NODISCARD value_type* leafKeys(page_id id) const {
+        return reinterpret_cast<value_type*>(page(id) + sizeof(PageHeader));
+    }
+
+    NODISCARD page_id* branchChildren(page_id id) const {
+        return reinterpret_cast<page_id*>(page(id) + sizeof(PageHeader));
+    }
+
+    NODISCARD value_type* branchKeys(page_id id) const {
+        return reinterpret_cast<value_type*>(page(id) + sizeof(PageHeader) + (branch_capacity + 1) * sizeof(page_id));
+    }
+
+    NODISCARD MetaPage* meta(size_t slot) const {
+        return reinterpret_cast<MetaPage*>(page(slot));
+    }
+
+    NODISCARD static uint64_t metaChecksum(const MetaPage& meta_page) {
+        SnapshotChecksum checksum{};
+        checksum.update(reinterpret_cast<const unsigned char*>(&meta_page), offsetof(MetaPage, checksum));
+        return checksum.value();
+    }
+
+    NODISCARD bool isValidMeta(const MetaPage& meta_page) const {
+        return meta_page.magic == MetaPage::magic_value &&
+               meta_page.format_version == MetaPage::format_version_value &&
+               meta_page.page_size == PageSize &&
+               meta_page.key_size == sizeof(value_type) &&
+               meta_page.pages_count >= 2 && meta_page.pages_count <= file_pages &&
+               meta_page.checksum == metaChecksum(meta_page);
+    }
+
+    // Take the newest valid meta page and the free list it saved.
+    void loadMeta(const std::string& path) {
+        const MetaPage* meta_current = nullptr;
+        for (size_t slot = 0; slot < 2 && slot < file_pages; slot++) {
+            if (isValidMeta(*meta(slot)) && (!meta_current || meta(slot)->txn > meta_current->txn)) {
+                meta_current = meta(slot);
+            }
+        }
+
+        if (!meta_current) {
+            throw std::runtime_error("MappedBPlusTree: " + path + " is not an index of this key type and page size or both meta pages are damaged");
+        }
+
+        root = meta_current->root;
+        levels = meta_current->levels;
+        count = meta_current->count;
+        pages_count = meta_current->pages_count;
+        txn = meta_current->txn + 1;
+        for (auto list_page = meta_current->free_list; list_page != 0;) {
+            if (list_page >= pages_count || header(list_page)->kind != PageKind::free_list) {
+                throw std::runtime_error("MappedBPlusTree: " + path + " has a damaged free list");
+            }
+
+            free_list_pages.push_back(list_page);
+            const auto entries = branchChildren(list_page);
+            free_pages.insert(free_pages.end(), entries + 1, entries + 1 + header(list_page)->count);
+            list_page = entries[0];
+        }
+    }
+
+    // Save the free list, flush the pages of the transaction, then write and flush the meta page.
+    // The pages freed by the transaction become free: the new meta page doesn't refer to them.
+    void commitTransaction() {
+        // The free list of the last commit is freed like the other pages of the last commit.
+        pending_pages.insert(pending_pages.end(), free_list_pages.begin(), free_list_pages.end());
+        free_list_pages.clear();
+        // A page taken for the list leaves the list.
+        while (free_list_pages.size() * free_list_capacity < free_pages.size() + pending_pages.size()) {
+            free_list_pages.push_back(allocatePage());
+        }
+
+        auto entry_free = free_pages.begin();
+        auto entry_pending = pending_pages.begin();
+        for (size_t list_index = 0; list_index < free_list_pages.size(); list_index++) {
+            const auto list_page = free_list_pages[list_index];
+            const auto entries = branchChildren(list_page);
+            entries[0] = list_index + 1 < free_list_pages.size() ? free_list_pages[list_index + 1] : 0;
+            uint32_t entries_count = 0;
+            for (; entries_count < free_list_capacity && entry_free != free_pages.end(); entries_count++) {
+                entries[1 + entries_count] = *entry_free++;
+            }
+            for (; entries_count < free_list_capacity && entry_pending != pending_pages.end(); entries_count++) {
+                entries[1 + entries_count] = *entry_pending++;
+            }
+
+            header(list_page)->kind = PageKind::free_list;
+            header(list_page)->count = entries_count;
+        }
+
+        flushDirtyPages();
+
+        auto& meta_page = *meta(txn % 2);
+        meta_page = MetaPage{ MetaPage::magic_value, MetaPage::format_version_value, static_cast<uint32_t>(PageSize),
+                              static_cast<uint32_t>(sizeof(value_type)), 0, txn, root, levels, count, pages_count,
+                              free_list_pages.empty() ? 0 : free_list_pages.front(), 0 };
+        meta_page.checksum = metaChecksum(meta_page);
+        flush(txn % 2, txn % 2 + 1);
+
+        free_pages.insert(free_pages.end(), pending_pages.begin(), pending_pages.end());
+        pending_pages.clear();
+        txn++;
+        updates_uncommitted = 0;
+    }
+
+    // One msync for the range: msync skips the clean pages in it, a call per page would cost a sync per page.
+    void flushDirtyPages() {
+        if (dirty_first < dirty_last) {
+            flush(dirty_first, dirty_last);
+        }
+
+        dirty_first = std::numeric_limits<page_id>::max();
+        dirty_last = 0;
+    }
+
+    // msync takes the ranges aligned to the pages of the OS.
+    void flush(page_id first, page_id last) const {
+        static const auto system_page_size = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        const auto begin = static_cast<size_t>(first * PageSize);
+        const auto begin_aligned = begin - begin % system_page_size;
+        if (::msync(map + begin_aligned, static_cast<size_t>(last * PageSize) - begin_aligned, MS_SYNC) != 0) {
+            fail("can't flush the pages");
+        }
+    }
+
+    // The file grows by a half, at least by 1 MiB, within the mapping.
+    void growFile() {
+        const auto map_pages = static_cast<page_id>(map_size / PageSize);
+        const auto pages_new = std::min<page_id>(map_pages, file_pages + std::max<page_id>(file_pages / 2, std::max<size_t>((1 << 20) / PageSize, 2)));
+        if (pages_new <= file_pages) {
+            throw std::length_error("MappedBPlusTree: the file outgrew the map size");
+        }
+
+        if (::ftruncate(descriptor, static_cast<off_t>(pages_new * PageSize)) != 0) {
+            fail("can't grow the file");
+        }
+
+        file_pages = pages_new;
+    }
+
+    NODISCARD page_id allocatePage() {
+        Stats::add(StatsEvent::allocation);
+        page_id id{};
+        if (!free_pages.empty()) {
+            id = free_pages.back();
+            free_pages.pop_back();
+        } else {
+            if (pages_count == file_pages) {
+                growFile();
+            }
+            id = pages_count++;
+        }
+
+        header(id)->txn = txn;
+        dirty_first = std::min(dirty_first, id);
+        dirty_last = std::max(dirty_last, id + 1);
+        return id;
+    }
+
+    // A page of this transaction is free at once, a page of the last commit after the next one.
+    void freePage(page_id id) {
+        (header(id)->txn == txn ? free_pages : pending_pages).push_back(id);
+    }
+
+    // The page itself if this transaction wrote it, otherwise its new copy.
+    NODISCARD page_id writablePage(page_id id) {
+        if (header(id)->txn == txn) {
+            return id;
+        }
+
+        const auto copy = allocatePage();
+        std::memcpy(page(copy), page(id), PageSize);
+        header(copy)->txn = txn;
+        pending_pages.push_back(id);
+        return copy;
+    }
+
+    // Copy the pages of the path top-down, every copy is linked into the parent copied before it.
+    void touchPath(std::vector<PathStep>& path) {
+        for (size_t level = 0; level < path.size(); level++) {
+            const auto id = writablePage(path[level].page);
+            if (id == path[level].page) {
+                continue;
+            }
+
+            if (level == 0) {
+                root = id;
+            } else {
+                branchChildren(path[level - 1].page)[path[level - 1].index] = id;
+            }
+            path[level].page = id;
+        }
+    }
+
+    void updated() {
+        updates_uncommitted++;
+        if (commit_every != 0 && updates_uncommitted >= commit_every) {
+            commitTransaction();
+        }
+    }
+
+    // The first of the keys greater than the key.
+    NODISCARD size_t upperBound(const value_type* keys, size_t keys_count, const value_type& key) const {
+        size_t first = 0;
+        while (keys_count != 0) {
+            const auto half = keys_count / 2;
+            if (!isLess(key, keys[first + half])) {
+                first += half + 1;
+                keys_count -= half + 1;
+            } else {
+                keys_count = half;
+            }
+        }
+
+        return first;
+    }
+
+    // The first of the keys not less than the key.
+    NODISCARD size_t lowerBound(const value_type* keys, size_t keys_count, const value_type& key) const {
+        size_t first = 0;
+        while (keys_count != 0) {
+            const auto half = keys_count / 2;
+            if (isLess(keys[first + half], key)) {
+                first += half + 1;
+                keys_count -= half + 1;
+            } else {
+                keys_count = half;
+            }
+        }
+
+        return first;
+    }
+
+    // Descend to the leaf of the key. Returns whether the leaf holds the key.
+    bool searchPath(const value_type& key, std::vector<PathStep>& path) const {
+        path.clear();
+        auto id = root;
+        for (size_type level = 1; level < levels; level++) {
+            const auto index = upperBound(branchKeys(id), header(id)->count, key);
+            path.push_back({ id, index });
+            id = branchChildren(id)[index];
+        }
+
+        const auto keys_count = header(id)->count;
+        const auto index = lowerBound(leafKeys(id), keys_count, key);
+        path.push_back({ id, index });
+        return index < keys_count && !isLess(key, leafKeys(id)[index]);
+    }
+
+    bool searchElement(const value_type& key) const {
+        if (root == 0) {
+            return false;
+        }
+
+        auto id = root;
+        for (size_type level = 1; level < levels; level++) {
+            id = branchChildren(id)[upperBound(branchKeys(id), header(id)->count, key)];
+        }
+
+        const auto keys_count = header(id)->count;
+        const auto index = lowerBound(leafKeys(id), keys_count, key);
+        return index < keys_count && !isLess(key, leafKeys(id)[index]);
+    }
+
+    bool insertElement(const value_type& key) {
+        if (root == 0) {
+            root = allocatePage();
+            header(root)->kind = PageKind::leaf;
+            header(root)->count = 1;
+            leafKeys(root)[0] = key;
+            levels = 1;
+            count = 1;
+            updated();
+            return true;
+        }
+
+        std::vector<PathStep> path{};
+        if (searchPath(key, path)) {
+            return false;
+        }
+
+        touchPath(path);
+        auto [separator, page_right] = insertIntoLeaf(path.back().page, path.back().index, key);
+        // The splits go up while the parents are full.
+        for (auto level = path.size() - 1; page_right != 0 && level > 0; level--) {
+            std::tie(separator, page_right) = insertIntoBranch(path[level - 1].page, path[level - 1].index, separator, page_right);
+        }
+
+        if (page_right != 0) {
+            const auto root_new = allocatePage();
+            header(root_new)->kind = PageKind::branch;
+            header(root_new)->count = 1;
+            branchChildren(root_new)[0] = root;
+            branchChildren(root_new)[1] = page_right;
+            branchKeys(root_new)[0] = separator;
+            root = root_new;
+            levels++;
+        }
+
+        count++;
+        updated();
+        return true;
+    }
+
+    // Returns the first key of the new right page and the page, page 0 if the leaf didn't split.
+    std::pair<value_type, page_id> insertIntoLeaf(page_id leaf, size_t index, const value_type& key) {
+        const auto keys_count = header(leaf)->count;
+        auto keys = leafKeys(leaf);
+        if (keys_count < leaf_capacity) {
+            std::copy_backward(keys + index, keys + keys_count, keys + keys_count + 1);
+            keys[index] = key;
+            header(leaf)->count++;
+            return { key, 0 };
+        }
+
+        std::vector<value_type> keys_all(keys, keys + keys_count);
+        keys_all.insert(keys_all.begin() + static_cast<std::ptrdiff_t>(index), key);
+        const auto count_left = keys_all.size() / 2;
+        const auto page_right = allocatePage();
+        header(page_right)->kind = PageKind::leaf;
+        header(page_right)->count = static_cast<uint32_t>(keys_all.size() - count_left);
+        header(leaf)->count = static_cast<uint32_t>(count_left);
+        std::copy(keys_all.begin(), keys_all.begin() + static_cast<std::ptrdiff_t>(count_left), keys);
+        std::copy(keys_all.begin() + static_cast<std::ptrdiff_t>(count_left), keys_all.end(), leafKeys(page_right));
+        return { leafKeys(page_right)[0], page_right };
+    }
+
+    // Link the new child after the child at the index. A full branch splits around its middle separator,
+    // which goes up with the new right page.
+    std::pair<value_type, page_id> insertIntoBranch(page_id branch, size_t index, const value_type& separator, page_id child) {
+        const auto keys_count = header(branch)->count;
+        auto keys = branchKeys(branch);
+        auto children = branchChildren(branch);
+        if (keys_count < branch_capacity) {
+            std::copy_backward(keys + index, keys + keys_count, keys + keys_count + 1);
+            std::copy_backward(children + index + 1, children + keys_count + 1, children + keys_count + 2);
+            keys[index] = separator;
+            children[index + 1] = child;
+            header(branch)->count++;
+            return { separator, 0 };
+        }
+
+        std::vector<value_type> keys_all(keys, keys + keys_count);
+        std::vector<page_id> children_all(children, children + keys_count + 1);
+        keys_all.insert(keys_all.begin() + static_cast<std::ptrdiff_t>(index), separator);
+        children_all.insert(children_all.begin() + static_cast<std::ptrdiff_t>(index + 1), child);
+        const auto middle = keys_all.size() / 2;
+        const auto page_right = allocatePage();
+        header(page_right)->kind = PageKind::branch;
+        header(page_right)->count = static_cast<uint32_t>(keys_all.size() - middle - 1);
+        header(branch)->count = static_cast<uint32_t>(middle);
+        std::copy(keys_all.begin(), keys_all.begin() + static_cast<std::ptrdiff_t>(middle), keys);
+        std::copy(children_all.begin(), children_all.begin() + static_cast<std::ptrdiff_t>(middle + 1), children);
+        std::copy(keys_all.begin() + static_cast<std::ptrdiff_t>(middle + 1), keys_all.end(), branchKeys(page_right));
+        std::copy(children_all.begin() + static_cast<std::ptrdiff_t>(middle + 1), children_all.end(), branchChildren(page_right));
+        return { keys_all[middle], page_right };
+    }
+
+    bool deleteElement(const value_type& key) {
+        if (root == 0) {
+            return false;
+        }
+
+        std::vector<PathStep> path{};
+        if (!searchPath(key, path)) {
+            return false;
+        }
+
+        touchPath(path);
+        const auto leaf = path.back().page;
+        auto keys = leafKeys(leaf);
+        std::copy(keys + path.back().index + 1, keys + header(leaf)->count, keys + path.back().index);
+        header(leaf)->count--;
+
+        // An underfilled page borrows a key from a sibling or merges with it, a merge takes a separator of the parent.
+        for (auto level = path.size() - 1; level > 0; level--) {
+            const auto minimum = level == path.size() - 1 ? leaf_minimum : branch_minimum;
+            if (header(path[level].page)->count >= minimum ||
+                !fixUnderflow(path[level - 1].page, path[level - 1].index, level == path.size() - 1)) {
+                break;
+            }
+        }
+
+        if (levels == 1 && header(root)->count == 0) {
+            freePage(root);
+            root = 0;
+            levels = 0;
+        } else if (levels > 1 && header(root)->count == 0) {
+            const auto root_old = root;
+            root = branchChildren(root)[0];
+            freePage(root_old);
+            levels--;
+        }
+
+        count--;
+        updated();
+        return true;
+    }
+
+    // The child at the index of the parent is underfilled. Returns whether it was merged: the parent lost a separator.
+    bool fixUnderflow(page_id parent, size_t index, bool leaf) {
+        const auto minimum = leaf ? leaf_minimum : branch_minimum;
+        auto children = branchChildren(parent);
+        if (index > 0 && header(children[index - 1])->count > minimum) {
+            children[index - 1] = writablePage(children[index - 1]);
+            borrowFromLeft(parent, index - 1, children[index - 1], children[index], leaf);
+            return false;
+        }
+
+        if (index < header(parent)->count && header(children[index + 1])->count > minimum) {
+            children[index + 1] = writablePage(children[index + 1]);
+            borrowFromRight(parent, index, children[index], children[index + 1], leaf);
+            return false;
+        }
+
+        const auto index_left = index > 0 ? index - 1 : index;
+        children[index_left] = writablePage(children[index_left]);
+        mergePages(parent, index_left, children[index_left], children[index_left + 1], leaf);
+        return true;
+    }
+
+    // The last key of the left page moves to the right page through the separator.
+    void borrowFromLeft(page_id parent, size_t separator_index, page_id left, page_id right, bool leaf) {
+        const auto count_left = header(left)->count;
+        const auto count_right = header(right)->count;
+        auto separator = branchKeys(parent) + separator_index;
+        if (leaf) {
+            auto keys_right = leafKeys(right);
+            std::copy_backward(keys_right, keys_right + count_right, keys_right + count_right + 1);
+            keys_right[0] = leafKeys(left)[count_left - 1];
+            *separator = keys_right[0];
+        } else {
+            auto keys_right = branchKeys(right);
+            auto children_right = branchChildren(right);
+            std::copy_backward(keys_right, keys_right + count_right, keys_right + count_right + 1);
+            std::copy_backward(children_right, children_right + count_right + 1, children_right + count_right + 2);
+            keys_right[0] = *separator;
+            children_right[0] = branchChildren(left)[count_left];
+            *separator = branchKeys(left)[count_left - 1];
+        }
+
+        header(left)->count--;
+        header(right)->count++;
+    }
+
+    // The first key of the right page moves to the left page through the separator.
+    void borrowFromRight(page_id parent, size_t separator_index, page_id left, page_id right, bool leaf) {
+        const auto count_left = header(left)->count;
+        const auto count_right = header(right)->count;
+        auto separator = branchKeys(parent) + separator_index;
+        if (leaf) {
+            auto keys_right = leafKeys(right);
+            leafKeys(left)[count_left] = keys_right[0];
+            std::copy(keys_right + 1, keys_right + count_right, keys_right);
+            *separator = keys_right[0];
+        } else {
+            auto keys_right = branchKeys(right);
+            auto children_right = branchChildren(right);
+            branchKeys(left)[count_left] = *separator;
+            branchChildren(left)[count_left + 1] = children_right[0];
+            *separator = keys_right[0];
+            std::copy(keys_right + 1, keys_right + count_right, keys_right);
+            std::copy(children_right + 1, children_right + count_right + 1, children_right);
+        }
+
+        header(left)->count++;
+        header(right)->count--;
+    }
+
+    // The right page joins the left one and is freed, a branch takes the separator between them.
+    void mergePages(page_id parent, size_t separator_index, page_id left, page_id right, bool leaf) {
+        const auto count_left = header(left)->count;
+        const auto count_right = header(right)->count;
+        auto keys_parent = branchKeys(parent);
+        if (leaf) {
+            std::copy(leafKeys(right), leafKeys(right) + count_right, leafKeys(left) + count_left);
+            header(left)->count = count_left + count_right;
+        } else {
+            branchKeys(left)[count_left] = keys_parent[separator_index];
+            std::copy(branchKeys(right), branchKeys(right) + count_right, branchKeys(left) + count_left + 1);
+            std::copy(branchChildren(right), branchChildren(right) + count_right + 1, branchChildren(left) + count_left + 1);
+            header(left)->count = count_left + count_right + 1;
+        }
+
+        const auto parent_count = header(parent)->count;
+        auto children_parent = branchChildren(parent);
+        std::copy(keys_parent + separator_index + 1, keys_parent + parent_count, keys_parent + separator_index);
+        std::copy(children_parent + separator_index + 2, children_parent + parent_count + 1, children_parent + separator_index + 1);
+        header(parent)->count--;
+        freePage(right);
+    }
+
+    // The keys of the page are within [lower, upper), nullptr is no bound.
+    void verifyPage(page_id id, size_type level, const value_type* lower, const value_type* upper,
+                    bool& valid, size_type& keys_count) const {
+        if (id < 2 || id >= pages_count || header(id)->txn > txn) {
+            valid = false;
+            return;
+        }
+
+        const auto page_header = header(id);
+        const bool leaf = level == levels;
+        const auto capacity = leaf ? leaf_capacity : branch_capacity;
+        const auto minimum = id == root ? 1 : (leaf ? leaf_minimum : branch_minimum);
+        if (page_header->kind != (leaf ? PageKind::leaf : PageKind::branch) ||
+            page_header->count < minimum || page_header->count > capacity) {
+            valid = false;
+            return;
+        }
+
+        const auto keys = leaf ? leafKeys(id) : branchKeys(id);
+        for (size_t index = 0; index < page_header->count; index++) {
+            if ((index > 0 && !isLess(keys[index - 1], keys[index])) ||
+                (lower && isLess(keys[index], *lower)) || (upper && !isLess(keys[index], *upper))) {
+                valid = false;
+            }
+        }
+
+        if (leaf) {
+            keys_count += page_header->count;
+            return;
+        }
+
+        const auto children = branchChildren(id);
+        for (size_t index = 0; index <= page_header->count; index++) {
+            verifyPage(children[index], level + 1, index == 0 ? lower : keys + index - 1,
+                       index == page_header->count ? upper : keys + index, valid, keys_count);
+        }
+    }
+
+    template<class T>
+    NODISCARD bool isLess(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return value_a < value_b;
+    }
+};
@@ -0,0 +1,263 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "mappedbplustree.h"
+
+using test_data_type = int;
+using test_data_count = size_t;
+
+// Small pages: a few thousand keys make a tree of four levels.
+constexpr size_t test_page_size = 256;
+using small_tree_type = MappedBPlusTree<test_data_type, test_page_size>;
+
+class MappedBPlusTreeTest : public ::testing::Test {
+protected:
+    MappedBPlusTreeTest() = default;
+
+    // The index files of a test, removed after it.
+    std::string tempPath(const std::string& name) {
+        const auto path = std::filesystem::temp_directory_path() /
+                          ("mappedbplustree_" + std::to_string(::getpid()) + "_" + name);
+        std::filesystem::remove(path);
+        paths.push_back(path);
+        return path.string();
+    }
+
+    void TearDown() override {
+        for (const auto& path : paths) {
+            std::filesystem::remove(path);
+        }
+    }
+
+    std::vector<test_data_type> array_values {30, 35, 40, 20, 10, 24, 39};
+
+private:
+    std::vector<std::filesystem::path> paths{};
+};
+
+template<class Tree>
+std::vector<test_data_type> collectKeys(const Tree& tree) {
+    std::vector<test_data_type> keys{};
+    tree.forEachInOrder([&keys](test_data_type key) {
+        keys.push_back(key);
+    });
+
+    return keys;
+}
+
+// The file as a crash would leave it: the pages written so far, the meta page of the last commit.
+void copyFile(const std::string& from, const std::string& to) {
+    std::filesystem::copy_file(from, to, std::filesystem::copy_options::overwrite_existing);
+}
+
+void damageByte(const std::string& path, size_t offset) {
+    std::fstream file{ path, std::ios::in | std::ios::out | std::ios::binary };
+    file.seekg(static_cast<std::streamoff>(offset));
+    const auto byte = static_cast<char>(file.get() ^ 0x5A);
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.put(byte);
+}
+
+TEST_F(MappedBPlusTreeTest, InsertSearchDelete) {
+    std::cout << "TEST_F(MappedBPlusTreeTest, InsertSearchDelete) start" << std::endl;
+    const auto path = tempPath("InsertSearchDelete");
+    {
+        MappedBPlusTree<test_data_type> tree{ path };
+        ASSERT_TRUE(tree.isEmpty());
+        ASSERT_FALSE(tree.search(30));
+        ASSERT_FALSE(tree.deleteValue(30));
+        ASSERT_TRUE(tree.verifyProperties());
+
+        for (const auto value : array_values) {
+            ASSERT_TRUE(tree.insert(value));
+        }
+        ASSERT_FALSE(tree.insert(30));
+        ASSERT_EQ(tree.size(), array_values.size());
+        for (const auto value : array_values) {
+            ASSERT_TRUE(tree.search(value));
+        }
+        ASSERT_FALSE(tree.search(25));
+
+        ASSERT_TRUE(tree.deleteValue(30));
+        ASSERT_FALSE(tree.deleteValue(31));
+        ASSERT_FALSE(tree.search(30));
+        ASSERT_TRUE(tree.verifyProperties());
+        ASSERT_EQ(collectKeys(tree), (std::vector<test_data_type>{ 10, 20, 24, 35, 39, 40 }));
+    }
+
+    // The destructor commits.
+    const MappedBPlusTree<test_data_type> tree{ path };
+    ASSERT_EQ(collectKeys(tree), (std::vector<test_data_type>{ 10, 20, 24, 35, 39, 40 }));
+    ASSERT_TRUE(tree.verifyProperties());
+    std::cout << "TEST_F(MappedBPlusTreeTest, InsertSearchDelete) end" << std::endl;
+}
+
+TEST_F(MappedBPlusTreeTest, RandomInsertDelete) {
+    std::cout << "TEST_F(MappedBPlusTreeTest, RandomInsertDelete) start" << std::endl;
+    const auto path = tempPath("RandomInsertDelete");
+    std::mt19937 generator{ 1337 };
+    std::set<test_data_type> expected{};
+    {
+        // Commits in the middle of the stream: the pages of the last commit are copied again.
+        small_tree_type tree{ path, 997 };
+        for (test_data_count index = 0; index < 40000; index++) {
+            const auto value = static_cast<test_data_type>(generator() % 8000);
+            if (generator() % 3 != 0) {
+                ASSERT_EQ(tree.insert(value), expected.insert(value).second);
+            } else {
+                ASSERT_EQ(tree.deleteValue(value), expected.erase(value) == 1);
+            }
+
+            if (index % 2000 == 0) {
+                ASSERT_TRUE(tree.verifyProperties()) << index;
+            }
+        }
+
+        ASSERT_GE(tree.height(), 3u);
+        ASSERT_TRUE(tree.verifyProperties());
+        ASSERT_EQ(collectKeys(tree), std::vector<test_data_type>(expected.begin(), expected.end()));
+
+        // Delete down to the empty tree.
+        for (const auto value : std::vector<test_data_type>(expected.begin(), expected.end())) {
+            ASSERT_TRUE(tree.deleteValue(value));
+        }
+        ASSERT_TRUE(tree.isEmpty());
+        ASSERT_TRUE(tree.verifyProperties());
+
+        for (test_data_type value = 0; value < 5000; value++) {
+            tree.insert(value);
+        }
+    }
+
+    const small_tree_type tree{ path };
+    ASSERT_EQ(tree.size(), 5000u);
+    ASSERT_TRUE(tree.verifyProperties());
+    std::cout << "TEST_F(MappedBPlusTreeTest, RandomInsertDelete) end" << std::endl;
+}
+
+TEST_F(MappedBPlusTreeTest, CrashRecovery) {
+    std::cout << "TEST_F(MappedBPlusTreeTest, CrashRecovery) start" << std::endl;
+    const auto path = tempPath("CrashRecovery");
+    const auto path_crash = tempPath("CrashRecovery_crash");
+    small_tree_type tree{ path };
+    for (test_data_type value = 0; value < 3000; value++) {
+        tree.insert(value);
+    }
+    tree.commit();
+
+    // The updates after the commit write new pages only: the copy opens at the commit.
+    for (test_data_type value = 0; value < 3000; value += 2) {
+        tree.deleteValue(value);
+    }
+    for (test_data_type value = 3000; value < 4000; value++) {
+        tree.insert(value);
+    }
+    copyFile(path, path_crash);
+    {
+        const small_tree_type tree_crash{ path_crash };
+        ASSERT_EQ(tree_crash.size(), 3000u);
+        ASSERT_TRUE(tree_crash.verifyProperties());
+        ASSERT_TRUE(tree_crash.search(0));
+        ASSERT_FALSE(tree_crash.search(3000));
+    }
+
+    // After the next commit both meta pages are valid: damaging the newer one falls back to the older commit.
+    tree.commit();
+    std::set<test_data_type> sizes{};
+    for (size_t slot = 0; slot < 2; slot++) {
+        copyFile(path, path_crash);
+        damageByte(path_crash, slot * test_page_size + 40);
+        const small_tree_type tree_crash{ path_crash };
+        ASSERT_TRUE(tree_crash.verifyProperties());
+        sizes.insert(static_cast<test_data_type>(tree_crash.size()));
+    }
+    ASSERT_EQ(sizes, (std::set<test_data_type>{ 2500, 3000 }));
+
+    // Both meta pages damaged, another page size, another key type.
+    copyFile(path, path_crash);
+    damageByte(path_crash, 40);
+    damageByte(path_crash, test_page_size + 40);
+    ASSERT_THROW(small_tree_type{ path_crash }, std::runtime_error);
+    copyFile(path, path_crash);
+    ASSERT_THROW((MappedBPlusTree<test_data_type, 512>{ path_crash }), std::runtime_error);
+    ASSERT_THROW((MappedBPlusTree<long long, test_page_size>{ path_crash }), std::runtime_error);
+    std::cout << "TEST_F(MappedBPlusTreeTest, CrashRecovery) end" << std::endl;
+}
+
+TEST_F(MappedBPlusTreeTest, CommitEvery) {
+    std::cout << "TEST_F(MappedBPlusTreeTest, CommitEvery) start" << std::endl;
+    const auto path = tempPath("CommitEvery");
+    const auto path_crash = tempPath("CommitEvery_crash");
+    // One flush per 100 updates: a crash loses the updates since the last one.
+    small_tree_type tree{ path, 100 };
+    for (test_data_type value = 0; value < 250; value++) {
+        tree.insert(value);
+    }
+
+    copyFile(path, path_crash);
+    const small_tree_type tree_crash{ path_crash };
+    ASSERT_EQ(tree_crash.size(), 200u);
+    ASSERT_TRUE(tree_crash.search(199));
+    ASSERT_FALSE(tree_crash.search(200));
+    std::cout << "TEST_F(MappedBPlusTreeTest, CommitEvery) end" << std::endl;
+}
+
+TEST_F(MappedBPlusTreeTest, FreePagesReuse) {
+    std::cout << "TEST_F(MappedBPlusTreeTest, FreePagesReuse) start" << std::endl;
+    const auto path = tempPath("FreePagesReuse");
+    std::mt19937 generator{ 1337 };
+    small_tree_type::page_id pages_count = 0;
+    for (size_t round = 0; round < 8; round++) {
+        // Every round reopens the file: the free list is saved by the commits.
+        small_tree_type tree{ path, 500 };
+        for (test_data_type value = 0; value < 4000; value++) {
+            tree.insert(static_cast<test_data_type>(generator() % 100000));
+        }
+
+        std::vector<test_data_type> keys = collectKeys(tree);
+        for (const auto key : keys) {
+            tree.deleteValue(key);
+        }
+        ASSERT_TRUE(tree.isEmpty());
+        tree.commit();
+
+        // The file stops growing after the first rounds, without the reuse every round would add its pages.
+        if (round == 2) {
+            pages_count = tree.pagesCount();
+        } else if (round > 2) {
+            ASSERT_LE(tree.pagesCount(), pages_count * 5 / 4) << round;
+        }
+    }
+    std::cout << "TEST_F(MappedBPlusTreeTest, FreePagesReuse) end" << std::endl;
+}
+
+TEST_F(MappedBPlusTreeTest, Stats) {
+    std::cout << "TEST_F(MappedBPlusTreeTest, Stats) start" << std::endl;
+    using stats_type = CountingStats<struct MappedBPlusTreeStatsTag>;
+    const auto path = tempPath("Stats");
+    MappedBPlusTree<test_data_type, test_page_size, stats_type> tree{ path };
+    for (test_data_type value = 0; value < 1000; value++) {
+        tree.insert(value);
+    }
+    tree.commit();
+
+    // A search reads one page per level. An update after a commit copies the pages of its path.
+    stats_type::reset();
+    ASSERT_TRUE(tree.search(500));
+    ASSERT_EQ(stats_type::snapshot()[StatsEvent::allocation], 0u);
+    tree.insert(1000);
+    ASSERT_EQ(stats_type::snapshot()[StatsEvent::allocation], tree.height());
+
+    // The copies are changed in place until the next commit.
+    stats_type::reset();
+    tree.insert(1001);
+    ASSERT_EQ(stats_type::snapshot()[StatsEvent::allocation], 0u);
+    std::cout << "TEST_F(MappedBPlusTreeTest, Stats) end" << std::endl;
+}
@@ -0,0 +1,220 @@
+// MultiQueue: concurrent relaxed priority queue built on Heap shards.
+// + Every shard is a Heap guarded by its own mutex, threads rarely wait for the same lock.
+// + insert puts the element into a random shard.
+// + tryRemove samples `choices` random shards and removes the best of their peeks (the power of choices).
+//   The removed element is close to the global peek: the expected rank error is O(shards count).
+// + Strictness is configurable: 1 shard is a strict locked heap, choices >= shards count compares every shard.
+// + Stats is passed to the shards. The shards are used by many threads: count with ThreadLocalStats.
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "head.h"
+#include "comparators.h"
+#include "heap.h"
+
+template <class DataType, class Comparator = ComparatorGreater<DataType>, class Stats = NoStats>
+class MultiQueue {
+private:
+    using value_type = DataType;
+    using size_type = size_t;
+    using heap_type = Heap<value_type, Comparator, Stats>;
+
+    // Shards are aligned to the cache line, so the locks of neighbour shards don't share a line.
+    struct alignas(64) Shard {
+        std::mutex mutex{};
+        heap_type heap{};
+        // Size of the heap, read without the lock to skip empty shards.
+        std::atomic<size_type> size{ 0 };
+    };
+
+    // Attempts to take a random shard without waiting before taking the lock of the last one.
+    static constexpr size_type try_lock_attempts = 4;
+
+    std::unique_ptr<Shard[]> shards{};
+    size_type shards_count{ 1 };
+    size_type choices{ 2 };
+    StatsComparator<Comparator, Stats> comp{};
+
+public:
+    // shards_count = 1 gives a strict priority queue. More shards scale better and relax the order more,
+    // a common choice is 2-4 shards per thread. choices >= shards_count compares the peeks of all shards.
+    explicit MultiQueue(size_type shards_count = 4 * defaultThreadsCount(), size_type choices = 2) :
+            shards_count{ shards_count != 0 ? shards_count : 1 },
+            choices{ choices != 0 ? choices : 1 }
+    {
+        shards = std::make_unique<Shard[]>(this->shards_count);
+    }
+
+    MultiQueue(const MultiQueue&) = delete;
+    MultiQueue& operator=(const MultiQueue&) = delete;
+
+    // Thread-safe.
+    void insert(value_type&& value) {
+        auto& shard = lockRandomShard();
+        shard.heap.insert(std::move(value));
+        shard.size.store(shard.heap.size(), std::memory_order_relaxed);
+        shard.mutex.unlock();
+    }
+
+    void insert(const value_type& value) {
+        value_type copy = value;
+        insert(std::move(copy));
+    }
+
+    // Thread-safe. Remove one of the best elements into value.
+    // Returns false if all shards were found empty.
+    bool tryRemove(value_type& value) {
+        if (choices >= shards_count) {
+            return removeBestOfAll(value);
+        }
+
+        for (size_type attempt = 0; attempt < shards_count; attempt++) {
+            if (removeBestOfChoices(value)) {
+                return true;
+            }
+        }
+
+        // The sampled shards were empty or busy: fall back to a scan of all shards.
+        return removeBestOfAll(value);
+    }
+
+    // Approximate while other threads modify the queue.
+    NODISCARD size_type size() const {
+        size_type size = 0;
+        for (size_type index = 0; index < shards_count; index++) {
+            size += shards[index].size.load(std::memory_order_relaxed);
+        }
+
+        return size;
+    }
+
+    NODISCARD bool isEmpty() const {
+        return size() == 0;
+    }
+
+    NODISCARD size_type getShardsCount() const {
+        return shards_count;
+    }
+
+    NODISCARD size_type getChoices() const {
+        return choices;
+    }
+
+private:
+    NODISCARD static size_type defaultThreadsCount() {
+        const auto threads_count = std::thread::hardware_concurrency();
+        return threads_count != 0 ? threads_count : 1;
+    }
+
+    NODISCARD static std::minstd_rand& generator() {
+        thread_local std::minstd_rand random{ std::random_device{}() };
+        return random;
+    }
+
+    NODISCARD size_type randomShardIndex() const {
+        return generator()() % shards_count;
+    }
+
+    // Lock a random shard, busy shards are skipped a few times before waiting.
+    NODISCARD Shard& lockRandomShard() {
+        for (size_type attempt = 0; attempt < try_lock_attempts; attempt++) {
+            auto& shard = shards[randomShardIndex()];
+            if (shard.mutex.try_lock()) {
+                return shard;
+            }
+        }
+
+        auto& shard = shards[randomShardIndex()];
+        shard.mutex.lock();
+        return shard;
+    }
+
+    // Locks held by the current remove. The buffer is reused by the thread, the locks are released on scope exit.
+    struct LocksGuard {
+        std::vector<std::unique_lock<std::mutex>>& locks{ buffer() };
+
+        ~LocksGuard() {
+            locks.clear();
+        }
+
+        NODISCARD static std::vector<std::unique_lock<std::mutex>>& buffer() {
+            thread_local std::vector<std::unique_lock<std::mutex>> locks_buffer{};
+            return locks_buffer;
+        }
+    };
+
+    void removePeek(Shard& shard, value_type& value) {
+        value = shard.heap.extract();
+        shard.size.store(shard.heap.size(), std::memory_order_relaxed);
+    }
+
+    // Lock up to `choices` random non-empty shards without waiting and remove the best peek among them.
+    bool removeBestOfChoices(value_type& value) {
+        LocksGuard guard{};
+        auto& locks = guard.locks;
+        Shard* best = nullptr;
+
+        for (size_type choice = 0; choice < choices; choice++) {
+            auto& shard = shards[randomShardIndex()];
+            if (shard.size.load(std::memory_order_relaxed) == 0) {
+                continue;
+            }
+
+            // The same shard may be sampled twice.
+            bool is_locked = false;
+            for (const auto& lock : locks) {
+                is_locked = is_locked || lock.mutex() == &shard.mutex;
+            }
+            if (is_locked) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock{ shard.mutex, std::try_to_lock };
+            if (!lock.owns_lock() || shard.heap.isEmpty()) {
+                continue;
+            }
+
+            if (!best || comp(shard.heap.peek(), best->heap.peek())) {
+                best = &shard;
+            }
+            locks.push_back(std::move(lock));
+        }
+
+        if (!best) {
+            return false;
+        }
+
+        removePeek(*best, value);
+        return true;
+    }
+
+    // Compare the peeks of all shards. The shards are locked in order, so it's deadlock-free.
+    bool removeBestOfAll(value_type& value) {
+        LocksGuard guard{};
+        auto& locks = guard.locks;
+        Shard* best = nullptr;
+
+        for (size_type index = 0; index < shards_count; index++) {
+            auto& shard = shards[index];
+            if (choices < shards_count && shard.size.load(std::memory_order_relaxed) == 0) {
+                continue;
+            }
+
+            locks.emplace_back(shard.mutex);
+            if (!shard.heap.isEmpty() && (!best || comp(shard.heap.peek(), best->heap.peek()))) {
+                best = &shard;
+            }
+        }
+
+        if (!best) {
+            return false;
+        }
+
+        removePeek(*best, value);
+        return true;
+    }
+};
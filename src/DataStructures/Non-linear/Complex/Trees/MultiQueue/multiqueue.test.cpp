@@ -0,0 +1,213 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "multiqueue.h"
+
+using test_data_type = int;
+using test_data_count = size_t;
+
+class MultiQueueTest : public ::testing::Test {
+protected:
+    MultiQueueTest() :
+            array_values{ 3, 9, min_value_second, 5, min_value, 4, max_value_second, 7, max_value, 6 }
+    {
+    }
+
+    const test_data_type max_value{ 100 };
+    const test_data_type max_value_second{ 99 };
+    const test_data_type min_value{ 1 };
+    const test_data_type min_value_second{ 2 };
+    static const test_data_count array_values_elements_count{ 10 };
+    test_data_type array_values[array_values_elements_count];
+
+public:
+    class ObjectA {
+    public:
+        CONSTEXPR20 ObjectA() = default;
+
+        CONSTEXPR20 explicit ObjectA(test_data_type value) :
+                value{ value }
+        {
+        }
+
+        NODISCARD CONSTEXPR20 bool operator> (const ObjectA& obj) const {
+            return this->value > obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 bool operator< (const ObjectA& obj) const {
+            return this->value < obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 test_data_type get() const {
+            return value;
+        }
+
+    private:
+        test_data_type value{};
+    };
+};
+
+// GCC: "undefined reference" if variables defined inside MultiQueueTest
+const test_data_count MultiQueueTest::array_values_elements_count;
+
+using object_type = MultiQueueTest::ObjectA;
+using store_smart_ptr_type = std::shared_ptr<object_type>;
+
+TEST_F(MultiQueueTest, StrictSingleShard) {
+    MultiQueue<test_data_type> queue{ 1 };
+    for (const auto value : array_values) {
+        queue.insert(value);
+    }
+
+    ASSERT_EQ(queue.size(), array_values_elements_count);
+
+    test_data_type value{};
+    ASSERT_TRUE(queue.tryRemove(value));
+    ASSERT_EQ(value, max_value);
+    ASSERT_TRUE(queue.tryRemove(value));
+    ASSERT_EQ(value, max_value_second);
+}
+
+TEST_F(MultiQueueTest, StrictAllChoices) {
+    MultiQueue<test_data_type, ComparatorLess<test_data_type>> queue{ 8, 8 };
+    std::vector<test_data_type> values{};
+    for (test_data_count index = 0; index < 1000; index++) {
+        values.push_back(static_cast<test_data_type>((index * 7919) % 1009));
+        queue.insert(values.back());
+    }
+
+    std::sort(values.begin(), values.end());
+    for (const auto expected_value : values) {
+        test_data_type value{};
+        ASSERT_TRUE(queue.tryRemove(value));
+        ASSERT_EQ(value, expected_value);
+    }
+
+    test_data_type value{};
+    ASSERT_FALSE(queue.tryRemove(value));
+    ASSERT_TRUE(queue.isEmpty());
+}
+
+TEST_F(MultiQueueTest, RelaxedRemovesEverything) {
+    MultiQueue<test_data_type> queue{ 8, 2 };
+    ASSERT_EQ(queue.getShardsCount(), static_cast<test_data_count>(8));
+    ASSERT_EQ(queue.getChoices(), static_cast<test_data_count>(2));
+
+    std::vector<test_data_type> values{};
+    for (test_data_count index = 0; index < 5000; index++) {
+        values.push_back(static_cast<test_data_type>((index * 7919) % 5003));
+        queue.insert(values.back());
+    }
+
+    std::vector<test_data_type> removed{};
+    test_data_type value{};
+    while (queue.tryRemove(value)) {
+        removed.push_back(value);
+    }
+
+    // The order is relaxed, the first removed elements are still among the biggest ones.
+    ASSERT_GE(removed.front(), 4000);
+    std::sort(values.begin(), values.end());
+    std::sort(removed.begin(), removed.end());
+    ASSERT_EQ(removed, values);
+}
+
+TEST_F(MultiQueueTest, PointersWithCustomComparator) {
+    MultiQueue<store_smart_ptr_type, decltype(compPtrMin<store_smart_ptr_type>)> queue{ 4, 4 };
+    for (const auto value : array_values) {
+        queue.insert(std::make_shared<object_type>(value));
+    }
+
+    store_smart_ptr_type value{};
+    ASSERT_TRUE(queue.tryRemove(value));
+    ASSERT_EQ(value->get(), min_value);
+    ASSERT_TRUE(queue.tryRemove(value));
+    ASSERT_EQ(value->get(), min_value_second);
+}
+
+TEST_F(MultiQueueTest, ConcurrentProducersConsumers) {
+    constexpr test_data_count threads_count = 4;
+    constexpr test_data_count values_per_thread = 20000;
+    MultiQueue<test_data_type> queue{ 4 * threads_count };
+
+    std::atomic<test_data_count> producers_left{ threads_count };
+    std::mutex removed_mutex{};
+    std::vector<test_data_type> removed{};
+
+    std::vector<std::thread> threads{};
+    for (test_data_count thread_index = 0; thread_index < threads_count; thread_index++) {
+        threads.emplace_back([&queue, &producers_left, thread_index]() {
+            for (test_data_count index = 0; index < values_per_thread; index++) {
+                queue.insert(static_cast<test_data_type>(thread_index * values_per_thread + index));
+            }
+            producers_left--;
+        });
+
+        threads.emplace_back([&queue, &producers_left, &removed_mutex, &removed]() {
+            std::vector<test_data_type> local_removed{};
+            test_data_type value{};
+            while (true) {
+                if (queue.tryRemove(value)) {
+                    local_removed.push_back(value);
+                } else if (producers_left == 0 && queue.isEmpty()) {
+                    break;
+                }
+            }
+
+            std::lock_guard<std::mutex> lock{ removed_mutex };
+            removed.insert(removed.end(), local_removed.begin(), local_removed.end());
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(removed.size(), threads_count * values_per_thread);
+    std::sort(removed.begin(), removed.end());
+    for (test_data_count index = 0; index < removed.size(); index++) {
+        ASSERT_EQ(removed[index], static_cast<test_data_type>(index));
+    }
+}
+
+TEST_F(MultiQueueTest, Stats) {
+    // The shards are used by many threads: ThreadLocalStats sums the counters of all threads.
+    using stats_type = ThreadLocalStats<struct MultiQueueStatsTag>;
+    const test_data_count threads_count = 4;
+    const test_data_count values_per_thread = 1000;
+    MultiQueue<test_data_type, ComparatorLess<test_data_type>, stats_type> queue{ 8 };
+
+    std::vector<std::thread> threads{};
+    for (test_data_count thread_index = 0; thread_index < threads_count; thread_index++) {
+        threads.emplace_back([&queue, thread_index, values_per_thread]() {
+            for (test_data_count index = 0; index < values_per_thread; index++) {
+                queue.insert(static_cast<test_data_type>(thread_index * values_per_thread + index));
+            }
+        });
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // The counters of the finished threads are kept.
+    const auto stats = stats_type::snapshot();
+    ASSERT_NE(stats[StatsEvent::comparison], 0u);
+    ASSERT_NE(stats[StatsEvent::allocation], 0u);
+
+    test_data_type value{};
+    test_data_count removed_count = 0;
+    while (queue.tryRemove(value)) {
+        removed_count++;
+    }
+
+    ASSERT_EQ(removed_count, threads_count * values_per_thread);
+    ASSERT_GT(stats_type::snapshot()[StatsEvent::swap], stats[StatsEvent::swap]);
+
+    stats_type::reset();
+    ASSERT_EQ(stats_type::snapshot()[StatsEvent::comparison], 0u);
+}
@@ -0,0 +1,280 @@
+// Pairing heap: a heap-ordered multiway tree.
+// + insert, meld and decreaseKey are O(1): they only link two trees.
+// + remove (the peek) is amortized O(log n) with the two-pass pairing of the root children.
+// + Nodes are allocated from a NodePool, handles returned by insert stay valid until the element is removed.
+#pragma once
+#include <type_traits>
+#include "head.h"
+#include "comparators.h"
+#include "node_pool.h"
+
+template <class DataType>
+struct PairingHeapNode {
+    using value_type = DataType;
+    using node_type = PairingHeapNode<value_type>;
+
+    value_type value{};
+    // The first child.
+    node_type* child{};
+    // The next sibling.
+    node_type* sibling{};
+    // The previous sibling or the parent for the first child.
+    node_type* prev{};
+
+    CONSTEXPR20 PairingHeapNode() = default;
+    CONSTEXPR20 explicit PairingHeapNode(const value_type& value) : value(value) {}
+    CONSTEXPR20 explicit PairingHeapNode(value_type&& value) : value(std::move(value)) {}
+
+    CONSTEXPR20 ~PairingHeapNode() = default;
+};
+
+template <class DataType, class Comparator = ComparatorGreater<DataType>>
+class PairingHeap {
+private:
+    using value_type = DataType;
+    using const_reference = const DataType&;
+    using size_type = size_t;
+    using node_type = PairingHeapNode<value_type>;
+    using pool_type = NodePool<node_type>;
+
+    node_type* root{};
+    pool_type pool{};
+    Comparator comp{};
+
+public:
+    // Reference to an element of the heap. Valid until the element is removed.
+    class Handle {
+    public:
+        CONSTEXPR20 Handle() = default;
+
+        NODISCARD CONSTEXPR20 const_reference value() const {
+            return node->value;
+        }
+
+        NODISCARD CONSTEXPR20 explicit operator bool() const {
+            return node != nullptr;
+        }
+
+    private:
+        friend class PairingHeap;
+
+        CONSTEXPR20 explicit Handle(node_type* node) : node(node) {}
+
+        node_type* node{};
+    };
+
+    CONSTEXPR20 PairingHeap() = default;
+
+    CONSTEXPR20 explicit PairingHeap(const value_type* start, const value_type* end) {
+        for (auto it = start; it != end; it++) {
+            insert(*it);
+        }
+    }
+
+    PairingHeap(const PairingHeap&) = delete;
+    PairingHeap& operator=(const PairingHeap&) = delete;
+
+    PairingHeap(PairingHeap&& other) noexcept :
+            root{ other.root },
+            pool{ std::move(other.pool) },
+            comp{ other.comp }
+    {
+        other.root = nullptr;
+    }
+
+    PairingHeap& operator=(PairingHeap&& other) noexcept {
+        if (this != &other) {
+            clear();
+            root = other.root;
+            pool = std::move(other.pool);
+            comp = other.comp;
+            other.root = nullptr;
+        }
+
+        return *this;
+    }
+
+    ~PairingHeap() {
+        clear();
+    }
+
+    CONSTEXPR20 Handle insert(value_type&& value) {
+        return insertNode(pool.create(std::move(value)));
+    }
+
+    CONSTEXPR20 Handle insert(const value_type& value) {
+        return insertNode(pool.create(value));
+    }
+
+    // Remove the peek.
+    CONSTEXPR20 void remove() {
+        if (!root) {
+            return;
+        }
+
+        auto node = root;
+        root = mergePairs(root->child);
+        pool.destroy(node);
+    }
+
+    // Remove any element.
+    CONSTEXPR20 void remove(Handle handle) {
+        auto node = handle.node;
+        if (node == root) {
+            remove();
+            return;
+        }
+
+        cut(node);
+        auto subtree = mergePairs(node->child);
+        pool.destroy(node);
+
+        if (subtree) {
+            root = link(root, subtree);
+        }
+    }
+
+    // Move the element closer to the peek. The new value must not go after the old one by the comparator.
+    CONSTEXPR20 void decreaseKey(Handle handle, const value_type& value) {
+        auto node = handle.node;
+        node->value = value;
+
+        if (node != root) {
+            cut(node);
+            root = link(root, node);
+        }
+    }
+
+    // Take all elements of the other heap. O(1), the other heap becomes empty.
+    CONSTEXPR20 void meld(PairingHeap& other) {
+        if (this == &other || !other.root) {
+            return;
+        }
+
+        pool.splice(other.pool);
+        root = root ? link(root, other.root) : other.root;
+        other.root = nullptr;
+    }
+
+    NODISCARD CONSTEXPR20 const_reference peek() const {
+        // Return value from root node
+        return root->value;
+    }
+
+    NODISCARD CONSTEXPR20 size_type size() const {
+        return pool.size();
+    }
+
+    NODISCARD CONSTEXPR20 bool isEmpty() const {
+        return root == nullptr;
+    }
+
+    // Destroy all elements without recursion.
+    void clear() {
+        if constexpr (!std::is_trivially_destructible_v<value_type>) {
+            // Flatten the tree: children of the current node are appended to the chain of siblings.
+            auto node = root;
+            while (node) {
+                if (node->child) {
+                    auto last_child = node->child;
+                    while (last_child->sibling) {
+                        last_child = last_child->sibling;
+                    }
+
+                    last_child->sibling = node->sibling;
+                    node->sibling = node->child;
+                    node->child = nullptr;
+                }
+
+                auto next = node->sibling;
+                pool.destroy(node);
+                node = next;
+            }
+        }
+
+        root = nullptr;
+        pool.release();
+    }
+
+private:
+    CONSTEXPR20 Handle insertNode(node_type* node) {
+        root = root ? link(root, node) : node;
+        return Handle{ node };
+    }
+
+    // Link two roots: the one which goes after becomes the first child of the other one.
+    NODISCARD CONSTEXPR20 node_type* link(node_type* first, node_type* second) const {
+        if (comp(second->value, first->value)) {
+            std::swap(first, second);
+        }
+
+        second->sibling = first->child;
+        if (first->child) {
+            first->child->prev = second;
+        }
+
+        second->prev = first;
+        first->child = second;
+        first->sibling = nullptr;
+        first->prev = nullptr;
+        return first;
+    }
+
+    // Detach the subtree of the node from its parent.
+    CONSTEXPR20 void cut(node_type* node) const {
+        if (node->prev->child == node) {
+            node->prev->child = node->sibling;
+        } else {
+            node->prev->sibling = node->sibling;
+        }
+
+        if (node->sibling) {
+            node->sibling->prev = node->prev;
+        }
+
+        node->sibling = nullptr;
+        node->prev = nullptr;
+    }
+
+    // Two-pass pairing of the siblings list.
+    NODISCARD CONSTEXPR20 node_type* mergePairs(node_type* first) const {
+        if (!first) {
+            return nullptr;
+        }
+
+        // First pass: link the siblings by pairs from left to right. The results are chained in reverse order.
+        node_type* paired = nullptr;
+        while (first) {
+            auto node_first = first;
+            auto node_second = first->sibling;
+
+            if (!node_second) {
+                first = nullptr;
+                node_first->sibling = paired;
+                node_first->prev = nullptr;
+                paired = node_first;
+                break;
+            }
+
+            first = node_second->sibling;
+            auto linked = link(node_first, node_second);
+            linked->sibling = paired;
+            paired = linked;
+        }
+
+        // Second pass: link the pairs from right to left.
+        auto result = paired;
+        paired = paired->sibling;
+        result->sibling = nullptr;
+
+        while (paired) {
+            auto next = paired->sibling;
+            paired->sibling = nullptr;
+            result = link(result, paired);
+            paired = next;
+        }
+
+        result->prev = nullptr;
+        return result;
+    }
+};
@@ -0,0 +1,239 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <set>
+#include "pairingheap.h"
+
+using test_data_type = int;
+using test_data_count = size_t;
+
+class PairingHeapTest : public ::testing::Test {
+protected:
+    PairingHeapTest() :
+            array_values{ 3, 9, min_value_second, 5, min_value, 4, max_value_second, 7, max_value, 6 }
+    {
+    }
+
+    const test_data_type max_value{ 100 };
+    const test_data_type max_value_second{ 99 };
+    const test_data_type min_value{ 1 };
+    const test_data_type min_value_second{ 2 };
+    static const test_data_count array_values_elements_count{ 10 };
+    test_data_type array_values[array_values_elements_count];
+
+public:
+    class ObjectA {
+    public:
+        CONSTEXPR20 ObjectA() = default;
+
+        CONSTEXPR20 explicit ObjectA(test_data_type value) :
+                value{ value }
+        {
+        }
+
+        NODISCARD CONSTEXPR20 bool operator> (const ObjectA& obj) const {
+            return this->value > obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 bool operator< (const ObjectA& obj) const {
+            return this->value < obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 test_data_type get() const {
+            return value;
+        }
+
+    private:
+        test_data_type value{};
+    };
+};
+
+// GCC: "undefined reference" if variables defined inside PairingHeapTest
+const test_data_count PairingHeapTest::array_values_elements_count;
+
+using object_type = PairingHeapTest::ObjectA;
+using store_smart_ptr_type = std::shared_ptr<object_type>;
+
+TEST_F(PairingHeapTest, PeekMax) {
+    PairingHeap<test_data_type> heap{ array_values, array_values + array_values_elements_count };
+    ASSERT_EQ(heap.peek(), max_value);
+    ASSERT_EQ(heap.size(), array_values_elements_count);
+}
+
+TEST_F(PairingHeapTest, PeekMin) {
+    PairingHeap<test_data_type, ComparatorLess<test_data_type>> heap{ array_values, array_values + array_values_elements_count };
+    ASSERT_EQ(heap.peek(), min_value);
+}
+
+TEST_F(PairingHeapTest, RemoveMax) {
+    PairingHeap<test_data_type> heap{ array_values, array_values + array_values_elements_count };
+    auto prev_value = heap.peek();
+
+    for (test_data_count index = 0; index < array_values_elements_count; index++) {
+        auto current_value = heap.peek();
+        ASSERT_GE(prev_value, current_value) << "Pairing is incorrect when deleting.";
+        prev_value = current_value;
+        heap.remove();
+    }
+
+    ASSERT_TRUE(heap.isEmpty());
+    // Remove from the empty heap. Nothing will happen. This is for code coverage.
+    heap.remove();
+}
+
+TEST_F(PairingHeapTest, RemoveMinObject) {
+    PairingHeap<object_type, ComparatorLess<object_type>> heap{};
+    for (const auto value : array_values) {
+        heap.insert(object_type{ value });
+    }
+
+    auto prev_value = heap.peek().get();
+    for (test_data_count index = 0; index < array_values_elements_count; index++) {
+        auto current_value = heap.peek().get();
+        ASSERT_LE(prev_value, current_value) << "Pairing is incorrect when deleting.";
+        prev_value = current_value;
+        heap.remove();
+    }
+}
+
+TEST_F(PairingHeapTest, PointersWithCustomComparator) {
+    PairingHeap<store_smart_ptr_type, decltype(compPtrMax<store_smart_ptr_type>)> heap{};
+    for (const auto value : array_values) {
+        heap.insert(std::make_shared<object_type>(value));
+    }
+
+    ASSERT_EQ(heap.peek()->get(), max_value);
+    heap.remove();
+    ASSERT_EQ(heap.peek()->get(), max_value_second);
+}
+
+TEST_F(PairingHeapTest, DecreaseKey) {
+    PairingHeap<test_data_type, ComparatorLess<test_data_type>> heap{};
+    std::vector<PairingHeap<test_data_type, ComparatorLess<test_data_type>>::Handle> handles{};
+    for (const auto value : array_values) {
+        handles.push_back(heap.insert(value));
+    }
+
+    // 7 becomes the new minimum.
+    heap.decreaseKey(handles[7], 0);
+    ASSERT_EQ(heap.peek(), 0);
+    ASSERT_EQ(handles[7].value(), 0);
+
+    // The peek itself.
+    heap.decreaseKey(handles[7], -1);
+    ASSERT_EQ(heap.peek(), -1);
+
+    // 100 moves in the middle.
+    heap.decreaseKey(handles[8], 5);
+    heap.remove();
+    ASSERT_EQ(heap.peek(), min_value);
+    heap.remove();
+    ASSERT_EQ(heap.peek(), min_value_second);
+}
+
+TEST_F(PairingHeapTest, RemoveByHandle) {
+    PairingHeap<test_data_type> heap{};
+    std::vector<PairingHeap<test_data_type>::Handle> handles{};
+    for (const auto value : array_values) {
+        handles.push_back(heap.insert(value));
+    }
+
+    // Remove the peek by handle.
+    heap.remove(handles[8]);
+    ASSERT_EQ(heap.peek(), max_value_second);
+    // Remove a node in the middle.
+    heap.remove(handles[1]);
+    heap.remove(handles[0]);
+    ASSERT_EQ(heap.size(), array_values_elements_count - 3);
+
+    std::vector<test_data_type> rest{};
+    while (!heap.isEmpty()) {
+        rest.push_back(heap.peek());
+        heap.remove();
+    }
+
+    ASSERT_EQ(rest, std::vector<test_data_type>({ 99, 7, 6, 5, 4, 2, 1 }));
+}
+
+TEST_F(PairingHeapTest, Meld) {
+    PairingHeap<test_data_type> heap_first{ array_values, array_values + 5 };
+    PairingHeap<test_data_type> heap_second{ array_values + 5, array_values + array_values_elements_count };
+    auto handle = heap_second.insert(-5);
+
+    heap_first.meld(heap_second);
+    ASSERT_TRUE(heap_second.isEmpty());
+    ASSERT_EQ(heap_second.size(), static_cast<test_data_count>(0));
+    ASSERT_EQ(heap_first.size(), array_values_elements_count + 1);
+    ASSERT_EQ(heap_first.peek(), max_value);
+
+    // Handles of the melded heap stay valid.
+    heap_first.decreaseKey(handle, 1000);
+    ASSERT_EQ(heap_first.peek(), 1000);
+
+    // Meld with an empty heap.
+    heap_first.meld(heap_second);
+    heap_second.meld(heap_first);
+    ASSERT_TRUE(heap_first.isEmpty());
+    ASSERT_EQ(heap_second.peek(), 1000);
+}
+
+TEST_F(PairingHeapTest, RandomOperations) {
+    std::mt19937 generator{ 1337 };
+    PairingHeap<test_data_type, ComparatorLess<test_data_type>> heap{};
+    std::multiset<test_data_type> expected{};
+    std::vector<std::pair<PairingHeap<test_data_type, ComparatorLess<test_data_type>>::Handle, test_data_type>> handles{};
+
+    for (test_data_count step = 0; step < 20000; step++) {
+        const auto operation = generator() % 4;
+        if (operation < 2 || expected.empty()) {
+            const auto value = static_cast<test_data_type>(generator() % 100000);
+            handles.emplace_back(heap.insert(value), value);
+            expected.insert(value);
+        } else if (operation == 2) {
+            // Pop the peek. The popped node is one of the handles with this value, drop them all.
+            const auto value = heap.peek();
+            ASSERT_EQ(value, *expected.begin());
+            expected.erase(expected.begin());
+            heap.remove();
+            handles.erase(std::remove_if(handles.begin(), handles.end(), [value](const auto& item) {
+                return item.second == value;
+            }), handles.end());
+        } else if (!handles.empty()) {
+            // Decrease or remove a random element.
+            const auto index = generator() % handles.size();
+            auto [handle, value] = handles[index];
+            expected.erase(expected.find(value));
+            if (generator() % 2) {
+                const auto new_value = value - static_cast<test_data_type>(generator() % 1000);
+                heap.decreaseKey(handle, new_value);
+                expected.insert(new_value);
+                handles[index].second = new_value;
+            } else {
+                heap.remove(handle);
+                handles.erase(handles.begin() + static_cast<std::ptrdiff_t>(index));
+            }
+        }
+
+        ASSERT_EQ(heap.size(), expected.size());
+        if (!expected.empty()) {
+            ASSERT_EQ(heap.peek(), *expected.begin());
+        }
+    }
+}
+
+TEST_F(PairingHeapTest, NonTrivialValuesAreDestroyed) {
+    auto counter = std::make_shared<test_data_type>(0);
+    {
+        PairingHeap<std::shared_ptr<test_data_type>, decltype(compPtrMax<std::shared_ptr<test_data_type>>)> heap{};
+        for (test_data_count index = 0; index < 1000; index++) {
+            heap.insert(counter);
+        }
+
+        ASSERT_EQ(counter.use_count(), 1001);
+        heap.remove();
+        ASSERT_EQ(counter.use_count(), 1000);
+    }
+
+    ASSERT_EQ(counter.use_count(), 1);
+}
@@ -0,0 +1,503 @@
+// Red-black tree with compact nodes.
+// + The nodes live in an IndexPool and are linked by SizeType indices instead of shared_ptr: no reference counts,
+//   12 bytes per node for int keys with uint32_t links instead of about 100 bytes of RedBlackTreeLoop.
+// + No parent link: insert and delete keep the path from the root in a fixed array on the stack.
+// + The color is the top bit of the left link, so the tree holds up to 2^31 - 1 nodes with uint32_t links.
+#pragma once
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "head.h"
+#include "comparators.h"
+#include "index_pool.h"
+#include "stats.h"
+
+template <class DataType, class SizeType = uint32_t>
+struct RedBlackTreeNodeCompact {
+    using value_type = DataType;
+    using size_type = SizeType;
+
+    static constexpr size_type red_bit = static_cast<size_type>(size_type{ 1 } << (std::numeric_limits<size_type>::digits - 1));
+    static constexpr size_type index_mask = static_cast<size_type>(~red_bit);
+
+    value_type key{};
+    // Index of the left child. The top bit is set for a red node.
+    size_type left_color{};
+    size_type right{};
+
+    CONSTEXPR20 RedBlackTreeNodeCompact() = default;
+    // A new node is red.
+    CONSTEXPR20 explicit RedBlackTreeNodeCompact(const value_type& key) : key(key), left_color{ red_bit } {}
+
+    NODISCARD CONSTEXPR20 size_type getLeft() const {
+        return static_cast<size_type>(left_color & index_mask);
+    }
+
+    CONSTEXPR20 void setLeft(size_type index) {
+        left_color = static_cast<size_type>((left_color & red_bit) | index);
+    }
+
+    NODISCARD CONSTEXPR20 bool isRed() const {
+        return (left_color & red_bit) != 0;
+    }
+
+    CONSTEXPR20 void setRed(bool red) {
+        left_color = static_cast<size_type>(red ? (left_color | red_bit) : (left_color & index_mask));
+    }
+};
+
+// Stats: instrumentation policy (stats.h), reports key comparisons, node allocations, rotations and rebalance steps.
+template <class DataType, class SizeType = uint32_t, class Stats = NoStats>
+class RedBlackTreeCompact {
+private:
+    using value_type = DataType;
+    using const_reference = const DataType &;
+    using size_type = SizeType;
+    using node_type = RedBlackTreeNodeCompact<value_type, size_type>;
+    using pool_type = IndexPool<node_type, size_type>;
+
+    static constexpr size_type null_index = 0;
+    // The height is at most 2 * log2(n + 1). The delete fixup may put one more node on the path.
+    static constexpr size_t max_path_length = 2 * std::numeric_limits<size_type>::digits + 2;
+    using path_type = std::array<size_type, max_path_length>;
+
+    pool_type pool{ node_type::index_mask };
+    size_type root{ null_index };
+
+public:
+    CONSTEXPR20 RedBlackTreeCompact() = default;
+
+    CONSTEXPR20 explicit RedBlackTreeCompact(const std::vector<value_type> &vec) {
+        pool.reserve(vec.size());
+        for (const auto& value : vec) {
+            insert(value);
+        }
+    }
+
+    CONSTEXPR20 explicit RedBlackTreeCompact(const value_type *start, const value_type *end) {
+        pool.reserve(static_cast<size_t>(end - start));
+        for (auto it = start; it != end; it++) {
+            insert(*it);
+        }
+    }
+
+    CONSTEXPR20 ~RedBlackTreeCompact() = default;
+
+    NODISCARD CONSTEXPR20 bool search(const value_type &&value) const {
+        return searchElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 bool search(const value_type &value) const {
+        return searchElement(value);
+    }
+
+    // Throws std::length_error when SizeType can't index more nodes.
+    CONSTEXPR20 void insert(const value_type &&value) {
+        insertElement(value);
+    }
+
+    CONSTEXPR20 void insert(const value_type &value) {
+        insertElement(value);
+    }
+
+    CONSTEXPR20 void deleteValue(const value_type &&value) {
+        deleteElement(value);
+    }
+
+    CONSTEXPR20 void deleteValue(const value_type &value) {
+        deleteElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 size_t size() const {
+        return pool.size();
+    }
+
+    NODISCARD CONSTEXPR20 bool isEmpty() const {
+        return root == null_index;
+    }
+
+    CONSTEXPR20 void reserve(size_t count) {
+        pool.reserve(count);
+    }
+
+    // Bytes held by the nodes.
+    NODISCARD CONSTEXPR20 size_t memoryUsage() const {
+        return pool.memoryUsage();
+    }
+
+    // Visit the keys in ascending order without recursion. The stack holds the path to the current node.
+    template<class Visitor>
+    CONSTEXPR20 void forEachInOrder(Visitor&& visitor) const {
+        path_type stack{};
+        size_t depth = 0;
+        auto node_current = root;
+
+        while (node_current != null_index || depth != 0) {
+            // Move down to the leftmost node.
+            while (node_current != null_index) {
+                stack[depth++] = node_current;
+                node_current = pool[node_current].getLeft();
+            }
+
+            node_current = stack[--depth];
+            visitor(pool[node_current].key);
+            node_current = pool[node_current].right;
+        }
+    }
+
+    // Check the order of the keys, the colors and the black heights.
+    NODISCARD CONSTEXPR20 bool verifyProperties() const {
+        if (pool[root].isRed()) {
+            return false;
+        }
+
+        bool valid = true;
+        size_t count = 0;
+        verifyNode(root, valid, count);
+        return valid && count == size();
+    }
+
+private:
+    CONSTEXPR20 bool searchElement(const value_type &key) const {
+        auto node_current = root;
+        while (node_current != null_index) {
+            const auto& node = pool[node_current];
+            if (isLess(key, node.key)) {
+                node_current = node.getLeft();
+            } else if (isGreater(key, node.key)) {
+                node_current = node.right;
+            } else {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    CONSTEXPR20 void insertElement(const value_type &key) {
+        if (root == null_index) {
+            root = createNewNode(key);
+            pool[root].setRed(false);
+            return;
+        }
+
+        // Search the parent of the new node.
+        path_type path{};
+        size_t depth = 0;
+        bool insert_left = false;
+        auto node_current = root;
+        while (node_current != null_index) {
+            path[depth++] = node_current;
+            const auto& node = pool[node_current];
+            if (isLess(key, node.key)) {
+                insert_left = true;
+                node_current = node.getLeft();
+            } else if (isGreater(key, node.key)) {
+                insert_left = false;
+                node_current = node.right;
+            } else {
+                // The key is already in the tree.
+                return;
+            }
+        }
+
+        // The pool may move the nodes: no references are held across createNewNode().
+        const auto node_new = createNewNode(key);
+        if (insert_left) {
+            pool[path[depth - 1]].setLeft(node_new);
+        } else {
+            pool[path[depth - 1]].right = node_new;
+        }
+
+        rebalanceInsert(path, depth, node_new);
+    }
+
+    // path[0, depth) is the path from the root to the parent of node.
+    CONSTEXPR20 void rebalanceInsert(path_type &path, size_t depth, size_type node) {
+        auto node_current = node;
+
+        // A red parent is never the root, so the grandparent exists.
+        while (depth != 0 && pool[path[depth - 1]].isRed()) {
+            Stats::add(StatsEvent::rebalance);
+            const auto node_parent = path[depth - 1];
+            const auto node_grandparent = path[depth - 2];
+            const auto node_great_grandparent = depth >= 3 ? path[depth - 3] : null_index;
+
+            if (node_parent == pool[node_grandparent].getLeft()) {
+                const auto node_uncle = pool[node_grandparent].right;
+
+                if (pool[node_uncle].isRed()) {
+                    pool[node_parent].setRed(false);
+                    pool[node_uncle].setRed(false);
+                    pool[node_grandparent].setRed(true);
+                    node_current = node_grandparent;
+                    depth -= 2;
+                    continue;
+                }
+
+                auto node_top = node_parent;
+                if (node_current == pool[node_parent].right) {
+                    node_top = rotateLeft(node_parent, node_grandparent);
+                }
+
+                rotateRight(node_grandparent, node_great_grandparent);
+                pool[node_top].setRed(false);
+                pool[node_grandparent].setRed(true);
+                break;
+            } else {
+                const auto node_uncle = pool[node_grandparent].getLeft();
+
+                if (pool[node_uncle].isRed()) {
+                    pool[node_parent].setRed(false);
+                    pool[node_uncle].setRed(false);
+                    pool[node_grandparent].setRed(true);
+                    node_current = node_grandparent;
+                    depth -= 2;
+                    continue;
+                }
+
+                auto node_top = node_parent;
+                if (node_current == pool[node_parent].getLeft()) {
+                    node_top = rotateRight(node_parent, node_grandparent);
+                }
+
+                rotateLeft(node_grandparent, node_great_grandparent);
+                pool[node_top].setRed(false);
+                pool[node_grandparent].setRed(true);
+                break;
+            }
+        }
+
+        pool[root].setRed(false);
+    }
+
+    CONSTEXPR20 void deleteElement(const value_type &key) {
+        path_type path{};
+        size_t depth = 0;
+        auto node_current = root;
+        while (node_current != null_index) {
+            const auto& node = pool[node_current];
+            if (isLess(key, node.key)) {
+                path[depth++] = node_current;
+                node_current = node.getLeft();
+            } else if (isGreater(key, node.key)) {
+                path[depth++] = node_current;
+                node_current = node.right;
+            } else {
+                break;
+            }
+        }
+
+        if (node_current == null_index) {
+            // The key was not found.
+            return;
+        }
+
+        // A node with two children takes the key of its successor, the node of the successor is deleted instead.
+        auto node_delete = node_current;
+        if (pool[node_current].getLeft() != null_index && pool[node_current].right != null_index) {
+            path[depth++] = node_current;
+            node_delete = pool[node_current].right;
+            while (pool[node_delete].getLeft() != null_index) {
+                path[depth++] = node_delete;
+                node_delete = pool[node_delete].getLeft();
+            }
+
+            pool[node_current].key = std::move(pool[node_delete].key);
+        }
+
+        // The deleted node has one child at most.
+        const auto node_parent = depth != 0 ? path[depth - 1] : null_index;
+        const auto node_child = pool[node_delete].getLeft() != null_index ? pool[node_delete].getLeft() : pool[node_delete].right;
+        const bool deleted_left = node_parent != null_index && pool[node_parent].getLeft() == node_delete;
+        const bool deleted_red = pool[node_delete].isRed();
+        replaceChild(node_parent, node_delete, node_child);
+        deleteNode(node_delete);
+
+        if (deleted_red) {
+            return;
+        }
+
+        if (pool[node_child].isRed()) {
+            pool[node_child].setRed(false);
+            return;
+        }
+
+        // The path through node_child lost one black node.
+        rebalanceDelete(path, depth, node_child, deleted_left);
+    }
+
+    // path[0, depth) is the path from the root to the parent of node. node may be null, so its side is passed.
+    CONSTEXPR20 void rebalanceDelete(path_type &path, size_t depth, size_type node, bool is_left) {
+        auto node_current = node;
+
+        while (depth != 0) {
+            Stats::add(StatsEvent::rebalance);
+            const auto node_parent = path[depth - 1];
+
+            if (is_left) {
+                auto node_sibling = pool[node_parent].right;
+
+                if (pool[node_sibling].isRed()) {
+                    pool[node_sibling].setRed(false);
+                    pool[node_parent].setRed(true);
+                    rotateLeft(node_parent, parentOf(path, depth - 1));
+                    // The sibling is the new parent of node_parent.
+                    path[depth - 1] = node_sibling;
+                    path[depth++] = node_parent;
+                    node_sibling = pool[node_parent].right;
+                }
+
+                if (!pool[pool[node_sibling].getLeft()].isRed() && !pool[pool[node_sibling].right].isRed()) {
+                    pool[node_sibling].setRed(true);
+                    node_current = node_parent;
+                    depth--;
+                    if (pool[node_current].isRed()) {
+                        break;
+                    }
+
+                    is_left = depth != 0 && pool[path[depth - 1]].getLeft() == node_current;
+                    continue;
+                }
+
+                if (!pool[pool[node_sibling].right].isRed()) {
+                    pool[pool[node_sibling].getLeft()].setRed(false);
+                    pool[node_sibling].setRed(true);
+                    node_sibling = rotateRight(node_sibling, node_parent);
+                }
+
+                pool[node_sibling].setRed(pool[node_parent].isRed());
+                pool[node_parent].setRed(false);
+                pool[pool[node_sibling].right].setRed(false);
+                rotateLeft(node_parent, parentOf(path, depth - 1));
+            } else {
+                auto node_sibling = pool[node_parent].getLeft();
+
+                if (pool[node_sibling].isRed()) {
+                    pool[node_sibling].setRed(false);
+                    pool[node_parent].setRed(true);
+                    rotateRight(node_parent, parentOf(path, depth - 1));
+                    // The sibling is the new parent of node_parent.
+                    path[depth - 1] = node_sibling;
+                    path[depth++] = node_parent;
+                    node_sibling = pool[node_parent].getLeft();
+                }
+
+                if (!pool[pool[node_sibling].getLeft()].isRed() && !pool[pool[node_sibling].right].isRed()) {
+                    pool[node_sibling].setRed(true);
+                    node_current = node_parent;
+                    depth--;
+                    if (pool[node_current].isRed()) {
+                        break;
+                    }
+
+                    is_left = depth != 0 && pool[path[depth - 1]].getLeft() == node_current;
+                    continue;
+                }
+
+                if (!pool[pool[node_sibling].getLeft()].isRed()) {
+                    pool[pool[node_sibling].right].setRed(false);
+                    pool[node_sibling].setRed(true);
+                    node_sibling = rotateLeft(node_sibling, node_parent);
+                }
+
+                pool[node_sibling].setRed(pool[node_parent].isRed());
+                pool[node_parent].setRed(false);
+                pool[pool[node_sibling].getLeft()].setRed(false);
+                rotateRight(node_parent, parentOf(path, depth - 1));
+            }
+
+            node_current = root;
+            break;
+        }
+
+        if (node_current != null_index) {
+            pool[node_current].setRed(false);
+        }
+    }
+
+    NODISCARD CONSTEXPR20 size_type parentOf(const path_type &path, size_t position) const {
+        return position != 0 ? path[position - 1] : null_index;
+    }
+
+    // Rotations return the new root of the subtree and link it to node_parent (the root if null).
+    CONSTEXPR20 size_type rotateLeft(size_type node, size_type node_parent) {
+        Stats::add(StatsEvent::rotation);
+        const auto right_node = pool[node].right;
+        pool[node].right = pool[right_node].getLeft();
+        pool[right_node].setLeft(node);
+        replaceChild(node_parent, node, right_node);
+        return right_node;
+    }
+
+    CONSTEXPR20 size_type rotateRight(size_type node, size_type node_parent) {
+        Stats::add(StatsEvent::rotation);
+        const auto left_node = pool[node].getLeft();
+        pool[node].setLeft(pool[left_node].right);
+        pool[left_node].right = node;
+        replaceChild(node_parent, node, left_node);
+        return left_node;
+    }
+
+    CONSTEXPR20 void replaceChild(size_type node_parent, size_type node_old, size_type node_new) {
+        if (node_parent == null_index) {
+            root = node_new;
+        } else if (pool[node_parent].getLeft() == node_old) {
+            pool[node_parent].setLeft(node_new);
+        } else {
+            pool[node_parent].right = node_new;
+        }
+    }
+
+    NODISCARD CONSTEXPR20 size_type createNewNode(const value_type& key) {
+        Stats::add(StatsEvent::allocation);
+        return pool.create(key);
+    }
+
+    CONSTEXPR20 void deleteNode(size_type node) {
+        pool.destroy(node);
+    }
+
+    // Returns the black height of the subtree.
+    CONSTEXPR20 size_t verifyNode(size_type node, bool &valid, size_t &count) const {
+        if (node == null_index) {
+            return 1;
+        }
+
+        count++;
+        const auto& node_ref = pool[node];
+        const auto left = node_ref.getLeft();
+        const auto right = node_ref.right;
+        if (node_ref.isRed() && (pool[left].isRed() || pool[right].isRed())) {
+            valid = false;
+        }
+
+        if ((left != null_index && !isLess(pool[left].key, node_ref.key)) ||
+            (right != null_index && !isGreater(pool[right].key, node_ref.key))) {
+            valid = false;
+        }
+
+        const auto black_height_left = verifyNode(left, valid, count);
+        const auto black_height_right = verifyNode(right, valid, count);
+        if (black_height_left != black_height_right) {
+            valid = false;
+        }
+
+        return black_height_left + (node_ref.isRed() ? 0 : 1);
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isGreater(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) > comparedKey(value_b);
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isLess(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) < comparedKey(value_b);
+    }
+};
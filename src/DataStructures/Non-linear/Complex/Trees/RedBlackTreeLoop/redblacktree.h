@@ -1,7 +1,22 @@
 ﻿#pragma once
+#include <algorithm>
+#include <bit>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <span>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "duplicate_keys.h"
 #include "head.h"
+#include "comparators.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "thread_pool.h"
 
 #define SENTINEL_DATA 0xDEADBEAF
 
@@ -10,15 +25,17 @@ enum class Node_Color {
     red
 };
 
-template <class DataType, class SizeType = size_t>
+template <class DataType, class SizeType = size_t, class Duplicates = UniqueKeys>
 struct RedBlackTreeNodeLoop {
     using value_type = DataType;
     using size_type = SizeType;
     using signed_size_type = std::make_signed_t<size_type>;
-    using node_type = RedBlackTreeNodeLoop<value_type, size_type>;
+    using node_type = RedBlackTreeNodeLoop<value_type, size_type, Duplicates>;
     using node_type_ptr = std::shared_ptr<node_type>;
 
     value_type key {0};
+    // The keys equal to the key, nothing for UniqueKeys.
+    NO_UNIQUE_ADDRESS NodeDuplicates<value_type, size_type, Duplicates> duplicates{};
     node_type_ptr left{};
     node_type_ptr right{};
     node_type_ptr parent{};
@@ -30,20 +47,142 @@ struct RedBlackTreeNodeLoop {
     CONSTEXPR20 ~RedBlackTreeNodeLoop() = default;
 };
 
-template <class DataType, class SizeType = size_t>
+// Stats: instrumentation policy (stats.h), reports key comparisons, node allocations, rotations and rebalance steps.
+// Duplicates: duplicate key policy (duplicate_keys.h), UniqueKeys, CountedKeys or ChainedKeys.
+template <class DataType, class SizeType = size_t, class Stats = NoStats, class Duplicates = UniqueKeys>
 class RedBlackTreeLoop {
 private:
     using value_type = DataType;
     using const_reference = const DataType &;
     using size_type = SizeType;
     using signed_size_type = std::make_signed_t<size_type>;
-    using node_type = RedBlackTreeNodeLoop<value_type, size_type>;
+    using node_type = RedBlackTreeNodeLoop<value_type, size_type, Duplicates>;
     using node_type_ptr = std::shared_ptr<node_type>;
 
+    static constexpr bool unique_keys = std::is_same_v<Duplicates, UniqueKeys>;
+
     node_type_ptr node_sentinel{initSentinel()};
     node_type_ptr root{node_sentinel};
+    // The finger of insert(): the last inserted node and its neighbours in the key order, nullptr is the end of the keys.
+    // node_last is the maximum or nullptr if unknown. Dropped by the operations which remove nodes.
+    node_type *node_finger{};
+    node_type *node_finger_prev{};
+    node_type *node_finger_next{};
+    node_type *node_last{};
 
 public:
+    // Read-only bidirectional iterator over the keys in ascending order, it steps along the parent links.
+    // The equal keys of ChainedKeys come in insertion order, the count of CountedKeys repeats the key.
+    // Invalidated by the operations which take the tree apart. Removing a key invalidates only the iterators to it:
+    // the nodes of the other keys stay where they are in memory.
+    class ConstIterator {
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = DataType;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const DataType *;
+        using reference = const DataType &;
+
+        CONSTEXPR20 ConstIterator() = default;
+
+        NODISCARD CONSTEXPR20 reference operator*() const {
+            return node->duplicates.key(node->key, index);
+        }
+
+        NODISCARD CONSTEXPR20 pointer operator->() const {
+            return &**this;
+        }
+
+        CONSTEXPR20 ConstIterator &operator++() {
+            if (++index == node->duplicates.count()) {
+                node = tree->successorNode(node);
+                index = 0;
+            }
+
+            return *this;
+        }
+
+        CONSTEXPR20 ConstIterator operator++(int) {
+            auto iterator = *this;
+            ++*this;
+            return iterator;
+        }
+
+        // The end steps back to the maximum.
+        CONSTEXPR20 ConstIterator &operator--() {
+            if (node && index != 0) {
+                index--;
+                return *this;
+            }
+
+            node = node ? tree->predecessorNode(node) : tree->maximumNode(tree->root.get());
+            index = node->duplicates.count() - 1;
+            return *this;
+        }
+
+        CONSTEXPR20 ConstIterator operator--(int) {
+            auto iterator = *this;
+            --*this;
+            return iterator;
+        }
+
+        NODISCARD CONSTEXPR20 bool operator==(const ConstIterator &other) const {
+            return node == other.node && index == other.index;
+        }
+
+        NODISCARD CONSTEXPR20 bool operator!=(const ConstIterator &other) const {
+            return !(*this == other);
+        }
+
+    private:
+        friend class RedBlackTreeLoop;
+
+        CONSTEXPR20 ConstIterator(node_type *node, const RedBlackTreeLoop *tree, size_type index = 0) :
+                node{ node },
+                tree{ tree },
+                index{ index }
+        {
+        }
+
+        node_type *node{};
+        const RedBlackTreeLoop *tree{};
+        // The position among the equal keys of the node.
+        size_type index{};
+    };
+
+    // A node unlinked by extract(). insert(NodeHandle&&) links it into a tree of the same type without an allocation.
+    // The node carries all the keys equal to its key.
+    class NodeHandle {
+    public:
+        CONSTEXPR20 NodeHandle() = default;
+        CONSTEXPR20 NodeHandle(NodeHandle &&) noexcept = default;
+        CONSTEXPR20 NodeHandle &operator=(NodeHandle &&) noexcept = default;
+        NodeHandle(const NodeHandle &) = delete;
+        NodeHandle &operator=(const NodeHandle &) = delete;
+
+        NODISCARD CONSTEXPR20 bool empty() const {
+            return !node;
+        }
+
+        CONSTEXPR20 explicit operator bool() const {
+            return !empty();
+        }
+
+        NODISCARD CONSTEXPR20 const value_type &value() const {
+            return node->key;
+        }
+
+    private:
+        friend class RedBlackTreeLoop;
+
+        CONSTEXPR20 explicit NodeHandle(node_type_ptr node) :
+                node{ std::move(node) }
+        {
+        }
+
+        node_type_ptr node{};
+    };
+
     CONSTEXPR20 RedBlackTreeLoop() = default;
 
     CONSTEXPR20 explicit RedBlackTreeLoop(const std::vector<value_type> &vec) {
@@ -60,7 +199,50 @@ public:
         }
     }
 
-    CONSTEXPR20 ~RedBlackTreeLoop() = default;
+    // The moved-from tree gets a new sentinel: the erase fixup writes the parent of the sentinel, so two trees
+    // with one sentinel couldn't be changed by different threads. The allocation of it may throw.
+    CONSTEXPR20 RedBlackTreeLoop(RedBlackTreeLoop &&other) :
+            node_sentinel{ std::exchange(other.node_sentinel, other.initSentinel()) },
+            root{ std::exchange(other.root, other.node_sentinel) },
+            node_finger{ std::exchange(other.node_finger, nullptr) },
+            node_finger_prev{ std::exchange(other.node_finger_prev, nullptr) },
+            node_finger_next{ std::exchange(other.node_finger_next, nullptr) },
+            node_last{ std::exchange(other.node_last, nullptr) }
+    {
+    }
+
+    CONSTEXPR20 RedBlackTreeLoop &operator=(RedBlackTreeLoop &&other) {
+        if (this != &other) {
+            clear();
+            node_sentinel = std::exchange(other.node_sentinel, other.initSentinel());
+            root = std::exchange(other.root, other.node_sentinel);
+            node_finger = std::exchange(other.node_finger, nullptr);
+            node_finger_prev = std::exchange(other.node_finger_prev, nullptr);
+            node_finger_next = std::exchange(other.node_finger_next, nullptr);
+            node_last = std::exchange(other.node_last, nullptr);
+        }
+
+        return *this;
+    }
+
+    // Structural copy: the nodes are copied level by level with their colors, so nothing is rebalanced. O(n).
+    CONSTEXPR20 RedBlackTreeLoop(const RedBlackTreeLoop &other) :
+            root{ cloneNodes(other.root, other.node_sentinel) }
+    {
+    }
+
+    CONSTEXPR20 RedBlackTreeLoop &operator=(const RedBlackTreeLoop &other) {
+        if (this != &other) {
+            *this = RedBlackTreeLoop{ other };
+        }
+
+        return *this;
+    }
+
+    // The parent links make cycles of shared_ptr: the nodes must be unlinked to be released.
+    CONSTEXPR20 ~RedBlackTreeLoop() {
+        clear();
+    }
 
     NODISCARD CONSTEXPR20 bool search(const value_type &&value) const {
         return searchElement(value);
@@ -70,14 +252,61 @@ public:
         return searchElement(value);
     }
 
-    CONSTEXPR20 void insert(const value_type &&value) {
-        insertElement(value);
+    // Search many keys at once: results[i] = search(keys[i]). results must be at least as long as keys.
+    // The lookups of a group advance together one level per step. The next node of every lookup is prefetched
+    // while the other lookups of the group are compared, so their cache misses overlap instead of being serialized.
+    CONSTEXPR20 void searchBatch(std::span<const value_type> keys, std::span<bool> results) const {
+        searchBatchGroups(keys, [&results](size_type index, const node_type* node) {
+            results[index] = node != nullptr;
+        });
+    }
+
+    // Same, found[i] points to the key stored in the tree or is nullptr.
+    CONSTEXPR20 void searchBatch(std::span<const value_type> keys, std::span<const value_type*> found) const {
+        searchBatchGroups(keys, [&found](size_type index, const node_type* node) {
+            found[index] = node ? &node->key : nullptr;
+        });
+    }
+
+    // The last inserted node and its neighbours are kept as a finger: a key which goes between them
+    // (an append, a near-sorted stream) is linked without the search from the root.
+    // Returns the iterator to the key in the tree and whether it was inserted.
+    // CountedKeys and ChainedKeys add the equal key to the node of the key in O(1) and always insert.
+    CONSTEXPR20 std::pair<ConstIterator, bool> insert(const value_type &&value) {
+        return insert(value);
+    }
+
+    CONSTEXPR20 std::pair<ConstIterator, bool> insert(const value_type &value) {
+        return insertAt(searchPosition(value), value);
     }
 
-    CONSTEXPR20 void insert(const value_type &value) {
-        insertElement(value);
+    // Insert the key next to the hint, like std::set::insert(hint, key). O(1) search if the key goes right before
+    // or right after the hint, otherwise the search climbs from the hint only up to the lowest ancestor whose subtree
+    // holds the key and descends from there. Returns the iterator to the key in the tree.
+    // The equal keys of ChainedKeys stay in insertion order whatever the hint.
+    CONSTEXPR20 ConstIterator insert(ConstIterator hint, const value_type &key) {
+        return insertAt(searchPositionNearHint(hint.node, key), key).first;
     }
 
+    // Link the node of the handle without an allocation. If the key is in the tree, the handle keeps the node.
+    CONSTEXPR20 std::pair<ConstIterator, bool> insert(NodeHandle &&handle) {
+        if (handle.empty()) {
+            return { end(), false };
+        }
+
+        const auto position = searchPosition(handle.node->key);
+        if (position.found) {
+            return { { position.node, this }, false };
+        }
+
+        auto &node = handle.node;
+        node->left = node_sentinel;
+        node->right = node_sentinel;
+        node->color = Node_Color::red;
+        return { { linkNode(position, std::move(node)), this }, true };
+    }
+
+    // Removes the key with all its equal keys.
     CONSTEXPR20 void deleteValue(const value_type &&value) {
         deleteElement(value);
     }
@@ -86,10 +315,297 @@ public:
         deleteElement(value);
     }
 
+    // Erase the key at the iterator without a search. Returns the iterator to the next key.
+    // An equal key of CountedKeys and ChainedKeys is removed from its node, the node stays.
+    CONSTEXPR20 ConstIterator erase(ConstIterator position) {
+        auto node = position.node;
+        if constexpr (!unique_keys) {
+            auto &duplicates = node->duplicates;
+            if (duplicates.count() > 1) {
+                duplicates.remove(node->key, position.index);
+                if (position.index < duplicates.count()) {
+                    return { node, this, position.index };
+                }
+
+                return { successorNode(node), this };
+            }
+        }
+
+        auto node_next = successorNode(node);
+        eraseNode(sharedNode(node));
+        return { node_next, this };
+    }
+
+    // Unlink the node of the key at the iterator without a search, the handle owns it with all the equal keys.
+    NODISCARD CONSTEXPR20 NodeHandle extract(ConstIterator position) {
+        return NodeHandle{ eraseNode(sharedNode(position.node)) };
+    }
+
+    // The handle is empty if the key is not in the tree.
+    NODISCARD CONSTEXPR20 NodeHandle extract(const value_type &key) {
+        const auto position = find(key);
+        if (position == end()) {
+            return {};
+        }
+
+        return extract(position);
+    }
+
+    NODISCARD CONSTEXPR20 ConstIterator begin() const {
+        return { minimumNode(root.get()), this };
+    }
+
+    NODISCARD CONSTEXPR20 ConstIterator end() const {
+        return { nullptr, this };
+    }
+
+    // The first of the equal keys.
+    NODISCARD CONSTEXPR20 ConstIterator find(const value_type &key) const {
+        const auto [node, found] = lowerBoundNode(key);
+        return found ? ConstIterator{ node, this } : end();
+    }
+
+    // The number of the keys equal to the key: the count of its node. O(log n).
+    NODISCARD CONSTEXPR20 size_type count(const value_type &key) const {
+        const auto [node, found] = lowerBoundNode(key);
+        return found ? node->duplicates.count() : 0;
+    }
+
+    // The first key not less than the key.
+    NODISCARD CONSTEXPR20 ConstIterator lower_bound(const value_type &key) const {
+        return { lowerBoundNode(key).first, this };
+    }
+
+    // The first key greater than the key.
+    NODISCARD CONSTEXPR20 ConstIterator upper_bound(const value_type &key) const {
+        const auto [node, found] = lowerBoundNode(key);
+        return { found ? successorNode(node) : node, this };
+    }
+
+    // The keys equal to the key. One search: the equal keys share a node, the range ends at its successor. O(log n).
+    NODISCARD CONSTEXPR20 std::pair<ConstIterator, ConstIterator> equal_range(const value_type &key) const {
+        const auto [node, found] = lowerBoundNode(key);
+        const ConstIterator first{ node, this };
+        return { first, found ? ConstIterator{ successorNode(node), this } : first };
+    }
+
+    // Join the trees and the key, the keys of left go before the key and the keys of right go after it.
+    // O(|bh(left) - bh(right)| + 1) for the trees which share the sentinel (e.g. the parts of one split()),
+    // otherwise the leaves of the lower tree are re-pointed to the sentinel of the higher one first.
+    // The operand trees become empty.
+    NODISCARD static RedBlackTreeLoop join(RedBlackTreeLoop &&left, const value_type &key, RedBlackTreeLoop &&right) {
+        auto result = shareSentinel(left, right);
+        result.setSubtree(result.joinNodes(left.takeRoot(), result.createNewNode(key), right.takeRoot()));
+        return result;
+    }
+
+    // Join the trees, the keys of left go before the keys of right. O(log n) like join().
+    NODISCARD static RedBlackTreeLoop join2(RedBlackTreeLoop &&left, RedBlackTreeLoop &&right) {
+        auto result = shareSentinel(left, right);
+        result.setSubtree(result.join2Nodes(left.takeRoot(), right.takeRoot()));
+        return result;
+    }
+
+    // Split the tree into the keys before the key and the keys after it. O(log n).
+    // The flag tells whether the key was in the tree. The tree becomes empty.
+    // The parts share the sentinel of the tree, so they must not be modified concurrently.
+    NODISCARD std::tuple<RedBlackTreeLoop, bool, RedBlackTreeLoop> split(const value_type &key) {
+        auto [left, found, right] = splitNodes(takeRoot(), key);
+        RedBlackTreeLoop left_tree{ node_sentinel, node_sentinel };
+        RedBlackTreeLoop right_tree{ node_sentinel, node_sentinel };
+        left_tree.setSubtree(left);
+        right_tree.setSubtree(right);
+        return { std::move(left_tree), found, std::move(right_tree) };
+    }
+
+    // Set operations on join and split: the work is O(m log(n / m + 1)) for the sizes m <= n.
+    // Both halves of a subproblem go to the pool while the subtrees hold about grain_size keys or more.
+    // The operand trees become empty.
+    NODISCARD static RedBlackTreeLoop setUnion(RedBlackTreeLoop &&first, RedBlackTreeLoop &&second, ThreadPool &pool,
+                                               size_type grain_size = default_grain_size) {
+        static_assert(unique_keys, "The set operations are defined for UniqueKeys.");
+        auto result = shareSentinel(first, second);
+        result.setSubtree(result.unionNodes(first.takeRoot(), second.takeRoot(), pool, parallelBlackHeight(grain_size)));
+        return result;
+    }
+
+    NODISCARD static RedBlackTreeLoop setIntersection(RedBlackTreeLoop &&first, RedBlackTreeLoop &&second, ThreadPool &pool,
+                                                      size_type grain_size = default_grain_size) {
+        static_assert(unique_keys, "The set operations are defined for UniqueKeys.");
+        auto result = shareSentinel(first, second);
+        result.setSubtree(result.intersectionNodes(first.takeRoot(), second.takeRoot(), pool, parallelBlackHeight(grain_size)));
+        return result;
+    }
+
+    // The keys of first which are not in second.
+    NODISCARD static RedBlackTreeLoop setDifference(RedBlackTreeLoop &&first, RedBlackTreeLoop &&second, ThreadPool &pool,
+                                                    size_type grain_size = default_grain_size) {
+        static_assert(unique_keys, "The set operations are defined for UniqueKeys.");
+        auto result = shareSentinel(first, second);
+        result.setSubtree(result.differenceNodes(first.takeRoot(), second.takeRoot(), pool, parallelBlackHeight(grain_size)));
+        return result;
+    }
+
+    NODISCARD CONSTEXPR20 bool isEmpty() const {
+        return root == node_sentinel;
+    }
+
+    // Release the nodes without recursion and without extra memory in O(n): the left child is rotated up
+    // until the node has none, then the node goes with all links empty.
+    CONSTEXPR20 void clear() {
+        setFinger(nullptr, nullptr, nullptr);
+        // The delete fixup leaves a parent in the sentinel.
+        node_sentinel->parent = nullptr;
+        auto node = std::exchange(root, node_sentinel);
+        while (node != node_sentinel) {
+            node->parent = nullptr;
+            if (node->left != node_sentinel) {
+                auto node_left = std::move(node->left);
+                node->left = std::move(node_left->right);
+                node_left->right = std::move(node);
+                node = std::move(node_left);
+            } else {
+                node = std::move(node->right);
+            }
+        }
+    }
+
     CONSTEXPR20 auto getRoot() const {
         return root;
     }
 
+    // Visit the keys in ascending order without recursion, the equal keys in the order of the iterator.
+    // The stack holds the path to the current node.
+    template<class Visitor>
+    CONSTEXPR20 void forEachInOrder(Visitor&& visitor) const {
+        forEachInSubtree(root.get(), visitor);
+    }
+
+    // Parallel traversals: the top levels of the tree are cut into pieces in key order, the nodes above the subtrees
+    // of about grain_size keys and those subtrees. The pieces are spread over the pool and every subtree is walked
+    // without recursion like forEachInOrder(). The tree must not be modified meanwhile.
+
+    // Call visitor(key) for every key, concurrently and in no particular order.
+    template<class Visitor>
+    void parallelForEach(Visitor&& visitor, ThreadPool &pool, size_type grain_size = default_grain_size) const {
+        const auto pieces = splitTraversalPieces(grain_size);
+        pool.parallelFor(0, pieces.size(), 1, [this, &pieces, &visitor](size_t first, size_t last) {
+            for (auto index = first; index < last; index++) {
+                forEachInPiece(pieces[index], visitor);
+            }
+        });
+    }
+
+    // Fold the keys in ascending order: operation(result, key) adds a key to a result, operation(result, result)
+    // joins the results of two runs of keys. The operation must be associative with the identity, not commutative.
+    template<class ResultType, class Operation>
+    NODISCARD ResultType parallelReduce(ResultType identity, Operation&& operation, ThreadPool &pool,
+                                        size_type grain_size = default_grain_size) const {
+        // Not std::vector<bool>: the pieces write their results concurrently.
+        struct PieceResult {
+            ResultType value;
+        };
+
+        const auto pieces = splitTraversalPieces(grain_size);
+        std::vector<PieceResult> results(pieces.size(), PieceResult{ identity });
+        pool.parallelFor(0, pieces.size(), 1, [this, &pieces, &results, &operation](size_t first, size_t last) {
+            for (auto index = first; index < last; index++) {
+                auto &result = results[index].value;
+                auto add_key = [&result, &operation](const value_type &key) {
+                    result = operation(std::move(result), key);
+                };
+                forEachInPiece(pieces[index], add_key);
+            }
+        });
+
+        auto result = std::move(identity);
+        for (auto &piece_result : results) {
+            result = operation(std::move(result), std::move(piece_result.value));
+        }
+
+        return result;
+    }
+
+    // The keys in ascending order. The first pass counts the keys of the pieces, the second one writes every piece
+    // at its offset into the vector allocated once in between.
+    NODISCARD std::vector<value_type> parallelExport(ThreadPool &pool, size_type grain_size = default_grain_size) const {
+        const auto pieces = splitTraversalPieces(grain_size);
+        std::vector<size_type> offsets(pieces.size() + 1, 0);
+        pool.parallelFor(0, pieces.size(), 1, [this, &pieces, &offsets](size_t first, size_t last) {
+            for (auto index = first; index < last; index++) {
+                size_type keys_count = 0;
+                auto count_key = [&keys_count](const value_type &) {
+                    keys_count++;
+                };
+                forEachInPiece(pieces[index], count_key);
+                offsets[index + 1] = keys_count;
+            }
+        });
+
+        for (size_t index = 1; index < offsets.size(); index++) {
+            offsets[index] += offsets[index - 1];
+        }
+
+        std::vector<value_type> keys(offsets.back());
+        pool.parallelFor(0, pieces.size(), 1, [this, &pieces, &offsets, &keys](size_t first, size_t last) {
+            for (auto index = first; index < last; index++) {
+                auto output = keys.begin() + static_cast<std::ptrdiff_t>(offsets[index]);
+                auto write_key = [&output](const value_type &key) {
+                    *output++ = key;
+                };
+                forEachInPiece(pieces[index], write_key);
+            }
+        });
+
+        return keys;
+    }
+
+    // Build the tree from the keys in strictly ascending order in O(n) without comparisons.
+    NODISCARD static RedBlackTreeLoop fromSorted(const value_type *start, const value_type *end) {
+        static_assert(unique_keys, "The bulk build is defined for UniqueKeys.");
+        RedBlackTreeLoop tree{};
+        auto key_next = start;
+        tree.buildSorted(static_cast<size_type>(end - start), [&key_next]() {
+            return *key_next++;
+        });
+        return tree;
+    }
+
+    // Binary snapshot (snapshot.h): the keys in ascending order. One pass counts the keys for the header,
+    // the second one streams them through the buffer of the writer.
+    void writeSnapshot(int descriptor, size_t buffer_size = default_snapshot_buffer_size) const {
+        static_assert(unique_keys, "The snapshot is defined for UniqueKeys.");
+        uint64_t keys_count = 0;
+        forEachInOrder([&keys_count](const value_type &) {
+            keys_count++;
+        });
+
+        SnapshotWriter writer{ descriptor, buffer_size };
+        writer.writeHeader<value_type>(SnapshotKind::sorted_keys, keys_count);
+        forEachInOrder([&writer](const value_type &key) {
+            writer.write(key);
+        });
+        writer.finish();
+    }
+
+    // Restore the tree of a snapshot in O(n) without comparisons: the keys are already in order.
+    // Throws std::runtime_error if the snapshot is damaged, the nodes built so far are released.
+    NODISCARD static RedBlackTreeLoop readSnapshot(int descriptor, size_t buffer_size = default_snapshot_buffer_size) {
+        static_assert(unique_keys, "The snapshot is defined for UniqueKeys.");
+        SnapshotReader reader{ descriptor, buffer_size };
+        const auto keys_count = reader.readHeader<value_type>(SnapshotKind::sorted_keys);
+        if (keys_count > std::numeric_limits<size_type>::max()) {
+            throw std::runtime_error("Snapshot: too many keys for the size type");
+        }
+
+        RedBlackTreeLoop tree{};
+        tree.buildSorted(static_cast<size_type>(keys_count), [&reader]() {
+            return reader.read<value_type>();
+        });
+        reader.finish();
+        return tree;
+    }
+
     // Print the tree
     void printTree(node_type_ptr node, bool leftNode = false) {
         if (node == node_sentinel) {
@@ -183,6 +699,15 @@ public:
     }
 
 private:
+    // A detached subtree and its black height: the count of the black nodes on a path from its root to the sentinel.
+    using subtree_type = std::pair<node_type_ptr, size_type>;
+
+    CONSTEXPR20 RedBlackTreeLoop(node_type_ptr sentinel, node_type_ptr node_root) :
+            node_sentinel{ sentinel },
+            root{ node_root }
+    {
+    }
+
     CONSTEXPR20 void setRoot(const node_type_ptr node) {
         root = node;
     }
@@ -220,63 +745,373 @@ private:
         return true;
     }
 
-    CONSTEXPR20 void insertElement(const value_type &key) {
-        if (root != node_sentinel) {
-            insertNodeInTree(root, key);
-        } else {
-            root = createNewNode(key);
-            root->color = Node_Color::black;
+    // Number of lookups advanced together by searchBatch(). Enough misses in flight to use the memory-level parallelism.
+    static constexpr size_type batch_group_size = 16;
+
+    template<class OnResult>
+    CONSTEXPR20 void searchBatchGroups(std::span<const value_type> keys, OnResult&& on_result) const {
+        const node_type* const node_end = node_sentinel.get();
+        const node_type* nodes[batch_group_size];
+        const size_type keys_count = keys.size();
+
+        for (size_type group_first = 0; group_first < keys_count; group_first += batch_group_size) {
+            const size_type group_size = keys_count - group_first < batch_group_size ? keys_count - group_first : batch_group_size;
+            const node_type* const node_root = root.get();
+            for (size_type index = 0; index < group_size; index++) {
+                nodes[index] = node_root;
+            }
+
+            // Every step moves each unfinished lookup one level down.
+            size_type active_count = node_root != node_end ? group_size : 0;
+            while (active_count != 0) {
+                active_count = 0;
+
+                for (size_type index = 0; index < group_size; index++) {
+                    auto node_current = nodes[index];
+                    if (!node_current) {
+                        // The lookup is finished.
+                        continue;
+                    }
+
+                    const auto& key = keys[group_first + index];
+                    if (isLess(key, node_current->key)) {
+                        // left subtree
+                        node_current = node_current->left.get();
+                    } else if (isGreater(key, node_current->key)) {
+                        // right subtree
+                        node_current = node_current->right.get();
+                    } else {
+                        // Node found.
+                        on_result(group_first + index, node_current);
+                        nodes[index] = nullptr;
+                        continue;
+                    }
+
+                    if (node_current == node_end) {
+                        // The Node was not found.
+                        on_result(group_first + index, nullptr);
+                        nodes[index] = nullptr;
+                        continue;
+                    }
+
+                    // Fetch the next node while the other lookups of the group are processed.
+                    PREFETCH(node_current);
+                    nodes[index] = node_current;
+                    active_count++;
+                }
+            }
+
+            if (node_root == node_end) {
+                for (size_type index = 0; index < group_size; index++) {
+                    on_result(group_first + index, nullptr);
+                }
+            }
         }
     }
 
-    CONSTEXPR20 void insertNodeInTree(node_type_ptr node, const value_type &key) {
-        // Search the node to insert.
-        auto node_current = searchNodeForInsert(node, key);
-        if (!node_current) {
-            // The same key value already exist in tree.
-            return;
+    // Where the key goes: the node with the key if it is found, otherwise the parent of the new leaf
+    // (nullptr in the empty tree), the side of the leaf and its neighbours in the key order.
+    struct InsertPosition {
+        node_type *node{};
+        bool found{};
+        bool right_child{};
+        node_type *node_prev{};
+        node_type *node_next{};
+    };
+
+    // A found key is not inserted again, CountedKeys and ChainedKeys add it to the node.
+    CONSTEXPR20 std::pair<ConstIterator, bool> insertAt(const InsertPosition &position, const value_type &key) {
+        if (position.found) {
+            if constexpr (unique_keys) {
+                return {{position.node, this}, false};
+            } else {
+                auto &duplicates = position.node->duplicates;
+                duplicates.add(key);
+                return {{position.node, this, duplicates.count() - 1}, true};
+            }
         }
 
-        // Create and insert node.
-        auto node_new = createNewNode(key);
-        // Make a link with the previous node.
-        makeLinkWithPreviousNode(node_new, node_current);
+        return {{linkNode(position, createNewNode(key)), this}, true};
+    }
 
-        // We must start rebalance from new node.
-        node_current = node_new;
+    NODISCARD CONSTEXPR20 InsertPosition searchPosition(const value_type &key) const {
+        if (root == node_sentinel) {
+            return {};
+        }
 
-        // Node has inserted in tree.
-        if (node_current->parent->color == Node_Color::red) {
-            rebalanceInsert(node_current);
+        if (node_finger) {
+            return searchPositionNearFinger(key);
         }
+
+        return searchPositionInSubtree(root.get(), key, nullptr, nullptr);
     }
 
-    CONSTEXPR20 node_type_ptr searchNodeForInsert(node_type_ptr node, const value_type &key) {
-        auto node_next = node;
-        node_type_ptr node_current;
+    // Between the finger and its neighbours or after the maximum, otherwise search from the neighbour on its side.
+    NODISCARD CONSTEXPR20 InsertPosition searchPositionNearFinger(const value_type &key) const {
+        if (isGreater(key, node_finger->key)) {
+            if (!node_finger_next || isLess(key, node_finger_next->key)) {
+                return positionBetween(node_finger, node_finger_next);
+            }
+
+            if (node_last && isGreater(key, node_last->key)) {
+                // A new maximum.
+                return positionBetween(node_last, nullptr);
+            }
+
+            return searchPositionFromNode(node_finger_next, key, finger_climb_limit);
+        }
+
+        if (isLess(key, node_finger->key)) {
+            if (!node_finger_prev || isGreater(key, node_finger_prev->key)) {
+                return positionBetween(node_finger_prev, node_finger);
+            }
+
+            return searchPositionFromNode(node_finger_prev, key, finger_climb_limit);
+        }
+
+        return {node_finger, true};
+    }
+
+    // Right before or right after the hint, otherwise search from the neighbour on the side of the key.
+    // nullptr is the end().
+    NODISCARD CONSTEXPR20 InsertPosition searchPositionNearHint(node_type *node_hint, const value_type &key) const {
+        if (root == node_sentinel) {
+            return {};
+        }
+
+        if (!node_hint || isLess(key, node_hint->key)) {
+            auto node_before = node_hint ? predecessorNode(node_hint) : lastNode();
+            if (!node_before || isGreater(key, node_before->key)) {
+                return positionBetween(node_before, node_hint);
+            }
+
+            return searchPositionFromNode(node_before, key, std::numeric_limits<size_type>::max());
+        }
+
+        if (isGreater(key, node_hint->key)) {
+            auto node_after = successorNode(node_hint);
+            if (!node_after || isLess(key, node_after->key)) {
+                return positionBetween(node_hint, node_after);
+            }
+
+            if (node_last && isGreater(key, node_last->key)) {
+                // A new maximum.
+                return positionBetween(node_last, nullptr);
+            }
+
+            return searchPositionFromNode(node_after, key, std::numeric_limits<size_type>::max());
+        }
+
+        return {node_hint, true};
+    }
+
+    // Between the adjacent nodes, nullptr is the end of the keys. No comparisons:
+    // either the right child of the predecessor is free or the successor is the leftmost node of that subtree.
+    NODISCARD CONSTEXPR20 InsertPosition positionBetween(node_type *node_prev, node_type *node_next) const {
+        if (node_prev && node_prev->right == node_sentinel) {
+            return {node_prev, false, true, node_prev, node_next};
+        }
+
+        return {node_next, false, false, node_prev, node_next};
+    }
+
+    // The keys far from the finger are searched from the root: the climb of the random key would go up to the root
+    // and double the search. The subtree of this height holds at least 2^(limit / 2) nodes around the finger.
+    static constexpr size_type finger_climb_limit = 4;
+
+    // Finger search: climb from the node while the key is outside of its subtree, then descend from there.
+    // A right child is climbed without a comparison when the key is greater than the node, a left child when it is less.
+    // The key equal to an ancestor is found by the descent. After climb_limit levels the search starts from the root.
+    NODISCARD CONSTEXPR20 InsertPosition searchPositionFromNode(node_type *node, const value_type &key, size_type climb_limit) const {
+        node_type *node_prev = nullptr;
+        node_type *node_next = nullptr;
+
+        if (isGreater(key, node->key)) {
+            for (auto node_parent = node->parent.get(); node_parent; node = node_parent, node_parent = node->parent.get()) {
+                if (climb_limit-- == 0) {
+                    return searchPositionInSubtree(root.get(), key, nullptr, nullptr);
+                }
+
+                if (node_parent->left.get() == node && isLess(key, node_parent->key)) {
+                    node_next = node_parent;
+                    break;
+                }
+            }
+        } else if (isLess(key, node->key)) {
+            for (auto node_parent = node->parent.get(); node_parent; node = node_parent, node_parent = node->parent.get()) {
+                if (climb_limit-- == 0) {
+                    return searchPositionInSubtree(root.get(), key, nullptr, nullptr);
+                }
+
+                if (node_parent->right.get() == node && isGreater(key, node_parent->key)) {
+                    node_prev = node_parent;
+                    break;
+                }
+            }
+        } else {
+            return {node, true};
+        }
+
+        return searchPositionInSubtree(node, key, node_prev, node_next);
+    }
+
+    // Search the subtree, node_prev and node_next are the nearest keys around it.
+    // The bounds narrow down on the way, so they are the neighbours of the new leaf at the end.
+    NODISCARD CONSTEXPR20 InsertPosition searchPositionInSubtree(node_type *node, const value_type &key,
+                                                                node_type *node_prev, node_type *node_next) const {
+        const node_type* const node_end = node_sentinel.get();
+        auto node_next_step = node;
+        node_type *node_current;
 
         do {
-            node_current = node_next;
+            node_current = node_next_step;
 
             if (isLess(key, node_current->key)) {
                 // left subtree
-                node_next = node_current->left;
+                node_next = node_current;
+                node_next_step = node_current->left.get();
             } else if (isGreater(key, node_current->key)) {
                 // right subtree
-                node_next = node_current->right;
+                node_prev = node_current;
+                node_next_step = node_current->right.get();
             } else {
                 // The same key value already exist in tree.
-                return nullptr;
+                return {node_current, true};
             }
-        } while (node_next != node_sentinel);
+        } while (node_next_step != node_end);
 
-        return node_current;
+        return {node_current, false, node_prev == node_current, node_prev, node_next};
+    }
+
+    // Link the node as a new leaf at the position and rebalance.
+    CONSTEXPR20 node_type *linkNode(const InsertPosition &position, node_type_ptr node_new) {
+        const auto node = node_new.get();
+        const auto node_parent = position.node;
+        if (!node_parent) {
+            root = std::move(node_new);
+            root->color = Node_Color::black;
+            setFinger(node, nullptr, nullptr);
+            return node;
+        }
+
+        node_new->parent = sharedNode(node_parent);
+        (position.right_child ? node_parent->right : node_parent->left) = std::move(node_new);
+        setFinger(node, position.node_prev, position.node_next);
+
+        // Node has inserted in tree, we must start rebalance from new node.
+        if (node_parent->color == Node_Color::red) {
+            rebalanceInsert(sharedNode(node));
+        }
+
+        return node;
+    }
+
+    CONSTEXPR20 void setFinger(node_type *node, node_type *node_prev, node_type *node_next) {
+        node_finger = node;
+        node_finger_prev = node_prev;
+        node_finger_next = node_next;
+        if (!node_next) {
+            node_last = node;
+        }
+    }
+
+    // The owning pointer of the node: the link from its parent or the root.
+    NODISCARD CONSTEXPR20 const node_type_ptr &sharedNode(const node_type *node) const {
+        const auto &node_parent = node->parent;
+        if (!node_parent) {
+            return root;
+        }
+
+        return node_parent->left.get() == node ? node_parent->left : node_parent->right;
+    }
+
+    // The node with the key, otherwise the node of the first greater key or nullptr.
+    NODISCARD CONSTEXPR20 std::pair<node_type *, bool> lowerBoundNode(const value_type &key) const {
+        const node_type* const node_end = node_sentinel.get();
+        node_type *node_bound = nullptr;
+        auto node_current = root.get();
+        while (node_current != node_end) {
+            if (isLess(key, node_current->key)) {
+                node_bound = node_current;
+                node_current = node_current->left.get();
+            } else if (isGreater(key, node_current->key)) {
+                node_current = node_current->right.get();
+            } else {
+                return {node_current, true};
+            }
+        }
+
+        return {node_bound, false};
+    }
+
+    NODISCARD CONSTEXPR20 node_type *minimumNode(node_type *node) const {
+        if (node == node_sentinel.get()) {
+            return nullptr;
+        }
+
+        while (node->left != node_sentinel) {
+            node = node->left.get();
+        }
+
+        return node;
+    }
+
+    NODISCARD CONSTEXPR20 node_type *maximumNode(node_type *node) const {
+        if (node == node_sentinel.get()) {
+            return nullptr;
+        }
+
+        while (node->right != node_sentinel) {
+            node = node->right.get();
+        }
+
+        return node;
+    }
+
+    NODISCARD CONSTEXPR20 node_type *lastNode() const {
+        if (node_last) {
+            return node_last;
+        }
+
+        return maximumNode(root.get());
+    }
+
+    // The next node in the key order or nullptr.
+    NODISCARD CONSTEXPR20 node_type *successorNode(node_type *node) const {
+        if (node->right != node_sentinel) {
+            return minimumNode(node->right.get());
+        }
+
+        // Climb while the node is the right child.
+        auto node_parent = node->parent.get();
+        while (node_parent && node_parent->right.get() == node) {
+            node = node_parent;
+            node_parent = node->parent.get();
+        }
+
+        return node_parent;
+    }
+
+    NODISCARD CONSTEXPR20 node_type *predecessorNode(node_type *node) const {
+        if (node->left != node_sentinel) {
+            return maximumNode(node->left.get());
+        }
+
+        // Climb while the node is the left child.
+        auto node_parent = node->parent.get();
+        while (node_parent && node_parent->left.get() == node) {
+            node = node_parent;
+            node_parent = node->parent.get();
+        }
+
+        return node_parent;
     }
 
     CONSTEXPR20 void rebalanceInsert(node_type_ptr node) {
         auto node_current = node;
 
         do {
+            Stats::add(StatsEvent::rebalance);
             auto node_parent = node_current->parent;
             auto node_grandparent = node_parent->parent;
 
@@ -340,26 +1175,26 @@ private:
     CONSTEXPR20 void deleteNodeInTree(node_type_ptr node, const value_type &key) {
         // Search the node to delete.
         auto node_current = searchNodeForDelete(node, key);
-        if (node_current == node_sentinel) {
-            // The Node was not found.
-            return;
+        if (node_current != node_sentinel) {
+            eraseNode(node_current);
         }
+    }
+
+    // Unlink the node and rebalance. Returns the unlinked node. The other nodes keep their keys,
+    // so the iterators to them stay valid.
+    CONSTEXPR20 node_type_ptr eraseNode(node_type_ptr node) {
+        setFinger(nullptr, nullptr, nullptr);
 
         // Delete the node.
-        auto node_parent = node_current->parent;
-        Node_Color original_color;
-        std::tie(node_current, original_color) = deleteNodePreProcess(node_current, node_parent);
-        if (!node_current) {
-            // The node has no children and rebalance is not needed.
-            if (!node_parent) {
-                return;
-            }
-        }
+        auto node_parent = node->parent;
+        const auto [node_current, original_color] = deleteNodePreProcess(node, node_parent);
 
-        // Fix colors.
-        if (original_color == Node_Color::black) {
+        // Fix colors. Nothing to fix if the tree has become empty.
+        if (node_current && original_color == Node_Color::black) {
             rebalanceDelete(node_current);
         }
+
+        return node;
     }
 
     CONSTEXPR20 node_type_ptr searchNodeForDelete(node_type_ptr node, const value_type &key) {
@@ -386,12 +1221,33 @@ private:
 
         if (node->left != node_sentinel && node->right != node_sentinel) {
             // Node has two children.
-            // Get inorder successor. Smallest in the right tree.
+            // Get inorder successor. Smallest in the right tree. It has no left child.
             auto [node_min, node_min_parent] = getMinimumValueNode(node->right, node);
-            node->key = node_min->key;
-            // Delete the old value's node.
-            // This one time recursion. The min node will never have a left child, only a right child maybe that grater than current node.
-            std::tie(node, original_color) = deleteNodePreProcess(node_min, node_min_parent);
+            original_color = node_min->color;
+            // The successor node itself takes the place of the node, like std::map: the keys don't move between nodes.
+            auto node_min_right = node_min->right;
+            if (node_min_parent == node) {
+                node_min_right->parent = node_min;
+            } else {
+                node_min_parent->left = node_min_right;
+                node_min_right->parent = node_min_parent;
+                node_min->right = node->right;
+                node_min->right->parent = node_min;
+            }
+
+            if (node_parent) {
+                swapChildNodeForParent(node, node_parent, node_min);
+            } else {
+                removeParentLink(node_min);
+                setRoot(node_min);
+            }
+
+            node_min->left = node->left;
+            node_min->left->parent = node_min;
+            node_min->color = node->color;
+            deleteNode(node);
+            // rebalanceDelete() starts from the old place of the successor, the sentinel there got its parent above.
+            return {node_min_right, original_color};
         } else {
             if (node->left != node_sentinel) {
                 // Node has only left child.
@@ -449,6 +1305,7 @@ private:
         auto node_current = node;
 
         while (node_current != root && node_current->color == Node_Color::black) {
+            Stats::add(StatsEvent::rebalance);
             auto node_parent = node_current->parent;
 
             if (node_current == node_parent->left) {
@@ -526,6 +1383,7 @@ private:
     }
 
     CONSTEXPR20 auto rotateLeft(node_type_ptr node) const {
+        Stats::add(StatsEvent::rotation);
         const auto right_node = node->right;
 
         node->right = right_node->left;
@@ -547,6 +1405,7 @@ private:
     }
 
     CONSTEXPR20 auto rotateRight(node_type_ptr node) const {
+        Stats::add(StatsEvent::rotation);
         const auto left_node = node->left;
 
         node->left = left_node->right;
@@ -567,23 +1426,562 @@ private:
         return left_node;
     }
 
-    NODISCARD CONSTEXPR20 node_type_ptr createNewNode(const value_type& key) {
-        auto node = std::make_shared<node_type>(key);
-        node->left = node_sentinel;
-        node->right = node_sentinel;
+    // The operands of join and the set operations must share the sentinel: the lower tree adopts the sentinel
+    // of the higher one in O(its size). Returns an empty tree with the common sentinel for the result.
+    NODISCARD static RedBlackTreeLoop shareSentinel(RedBlackTreeLoop &first, RedBlackTreeLoop &second) {
+        if (first.node_sentinel != second.node_sentinel) {
+            const bool first_is_lower = first.blackHeight(first.root) < second.blackHeight(second.root);
+            auto &lower = first_is_lower ? first : second;
+            auto &higher = first_is_lower ? second : first;
+
+            higher.adoptSubtree(lower.root, lower.node_sentinel);
+            if (lower.root == lower.node_sentinel) {
+                lower.root = higher.node_sentinel;
+            }
+            lower.node_sentinel = higher.node_sentinel;
+        }
+
+        return RedBlackTreeLoop{ first.node_sentinel, first.node_sentinel };
+    }
+
+    // Re-point the leaves of the subtree from the sentinel of another tree to the sentinel of this tree.
+    CONSTEXPR20 void adoptSubtree(node_type_ptr node, const node_type_ptr &sentinel_other) const {
+        std::vector<node_type_ptr> stack{};
+        if (node != sentinel_other) {
+            stack.push_back(node);
+        }
+
+        while (!stack.empty()) {
+            auto node_current = stack.back();
+            stack.pop_back();
+
+            if (node_current->left == sentinel_other) {
+                node_current->left = node_sentinel;
+            } else {
+                stack.push_back(node_current->left);
+            }
+
+            if (node_current->right == sentinel_other) {
+                node_current->right = node_sentinel;
+            } else {
+                stack.push_back(node_current->right);
+            }
+        }
+    }
+
+    NODISCARD CONSTEXPR20 subtree_type takeRoot() {
+        setFinger(nullptr, nullptr, nullptr);
+        auto node = std::exchange(root, node_sentinel);
+        if (node != node_sentinel) {
+            removeParentLink(node);
+        }
+
+        return {node, blackHeight(node)};
+    }
+
+    // The root of a tree is black.
+    CONSTEXPR20 void setSubtree(const subtree_type &subtree) {
+        root = subtree.first;
+        if (root != node_sentinel) {
+            removeParentLink(root);
+            root->color = Node_Color::black;
+        }
+    }
+
+    NODISCARD CONSTEXPR20 size_type blackHeight(node_type_ptr node) const {
+        size_type black_height = 0;
+        for (; node != node_sentinel; node = node->left) {
+            if (node->color == Node_Color::black) {
+                black_height++;
+            }
+        }
+
+        return black_height;
+    }
+
+    CONSTEXPR20 void makeRootBlack(subtree_type &subtree) const {
+        if (subtree.first->color == Node_Color::red) {
+            subtree.first->color = Node_Color::black;
+            subtree.second++;
+        }
+    }
+
+    // Cut the node out of its subtree, the children become roots.
+    CONSTEXPR20 std::pair<subtree_type, subtree_type> detachChildren(const subtree_type &subtree) const {
+        const auto &node = subtree.first;
+        const size_type child_black_height = subtree.second - (node->color == Node_Color::black ? 1 : 0);
+        auto left_node = std::exchange(node->left, node_sentinel);
+        auto right_node = std::exchange(node->right, node_sentinel);
+        if (left_node != node_sentinel) {
+            removeParentLink(left_node);
+        }
+
+        if (right_node != node_sentinel) {
+            removeParentLink(right_node);
+        }
+
+        removeParentLink(node);
+        return {{std::move(left_node), child_black_height}, {std::move(right_node), child_black_height}};
+    }
+
+    CONSTEXPR20 const node_type_ptr &linkChildren(const node_type_ptr &node, const node_type_ptr &left_node, const node_type_ptr &right_node) const {
+        node->left = left_node;
+        if (left_node != node_sentinel) {
+            left_node->parent = node;
+        }
+
+        node->right = right_node;
+        if (right_node != node_sentinel) {
+            right_node->parent = node;
+        }
+
         return node;
     }
 
-    CONSTEXPR20 void makeLinkWithPreviousNode(node_type_ptr node, node_type_ptr node_prev) const {
-        node->parent = node_prev;
+    // Join two detached subtrees and the detached middle node, the keys of left < the middle key < the keys of right.
+    NODISCARD CONSTEXPR20 subtree_type joinNodes(subtree_type left, node_type_ptr node_middle, subtree_type right) const {
+        makeRootBlack(left);
+        makeRootBlack(right);
+
+        if (left.second == right.second) {
+            node_middle->color = Node_Color::black;
+            linkChildren(node_middle, left.first, right.first);
+            removeParentLink(node_middle);
+            return {std::move(node_middle), left.second + 1};
+        }
 
-        if (isLess(node->key, node_prev->key)) {
-            // left subtree
-            node_prev->left = node;
-        } else if (isGreater(node->key, node_prev->key)) {
-            // right subtree
-            node_prev->right = node;
+        node_middle->color = Node_Color::red;
+        auto node_top = left.second > right.second ? joinRight(left, node_middle, right) : joinLeft(left, node_middle, right);
+        size_type black_height = std::max(left.second, right.second);
+        if (node_top->color == Node_Color::red
+            && (node_top->left->color == Node_Color::red || node_top->right->color == Node_Color::red)) {
+            node_top->color = Node_Color::black;
+            black_height++;
         }
+
+        removeParentLink(node_top);
+        return {std::move(node_top), black_height};
+    }
+
+    // The left tree is higher: the red middle node replaces the first black subtree of its right spine with the black
+    // height of the right tree. A red-red pair is fixed by a recolor and a left rotation at the black node above,
+    // which may move the pair one black level up, so the cost is O(bh(left) - bh(right) + 1).
+    CONSTEXPR20 node_type_ptr joinRight(const subtree_type &left, const node_type_ptr &node_middle, const subtree_type &right) const {
+        node_type_ptr node_parent;
+        auto node_current = left.first;
+        size_type black_height = left.second;
+        do {
+            if (node_current->color == Node_Color::black) {
+                black_height--;
+            }
+
+            node_parent = node_current;
+            node_current = node_current->right;
+        } while (black_height > right.second || node_current->color == Node_Color::red);
+
+        node_parent->right = linkChildren(node_middle, node_current, right.first);
+        node_middle->parent = node_parent;
+
+        node_type_ptr node_top;
+        node_current = node_parent;
+        while (node_current) {
+            if (node_current->color == Node_Color::black
+                && node_current->right->color == Node_Color::red
+                && node_current->right->right->color == Node_Color::red) {
+                node_current->right->right->color = Node_Color::black;
+                node_current = rotateLeft(node_current);
+            }
+
+            node_top = node_current;
+            node_current = node_current->parent;
+        }
+
+        return node_top;
+    }
+
+    // Mirror of joinRight().
+    CONSTEXPR20 node_type_ptr joinLeft(const subtree_type &left, const node_type_ptr &node_middle, const subtree_type &right) const {
+        node_type_ptr node_parent;
+        auto node_current = right.first;
+        size_type black_height = right.second;
+        do {
+            if (node_current->color == Node_Color::black) {
+                black_height--;
+            }
+
+            node_parent = node_current;
+            node_current = node_current->left;
+        } while (black_height > left.second || node_current->color == Node_Color::red);
+
+        node_parent->left = linkChildren(node_middle, left.first, node_current);
+        node_middle->parent = node_parent;
+
+        node_type_ptr node_top;
+        node_current = node_parent;
+        while (node_current) {
+            if (node_current->color == Node_Color::black
+                && node_current->left->color == Node_Color::red
+                && node_current->left->left->color == Node_Color::red) {
+                node_current->left->left->color = Node_Color::black;
+                node_current = rotateRight(node_current);
+            }
+
+            node_top = node_current;
+            node_current = node_current->parent;
+        }
+
+        return node_top;
+    }
+
+    // Cut the search path out of the tree, then join the subtrees hanging off it bottom-up.
+    // The joins of one side have increasing black heights, so their costs telescope to O(log n).
+    CONSTEXPR20 std::tuple<subtree_type, bool, subtree_type> splitNodes(subtree_type subtree, const value_type &key) const {
+        std::vector<subtree_type> path{};
+        subtree_type left_part{node_sentinel, 0};
+        subtree_type right_part{node_sentinel, 0};
+        bool found = false;
+        auto [node_current, black_height] = std::move(subtree);
+
+        while (node_current != node_sentinel) {
+            removeParentLink(node_current);
+            node_type_ptr node_next;
+            if (isLess(key, node_current->key)) {
+                // left subtree
+                node_next = std::exchange(node_current->left, node_sentinel);
+            } else if (isGreater(key, node_current->key)) {
+                // right subtree
+                node_next = std::exchange(node_current->right, node_sentinel);
+            } else {
+                // Node found, its subtrees start the parts.
+                std::tie(left_part, right_part) = detachChildren({node_current, black_height});
+                found = true;
+                break;
+            }
+
+            const size_type child_black_height = black_height - (node_current->color == Node_Color::black ? 1 : 0);
+            path.emplace_back(std::move(node_current), black_height);
+            node_current = std::move(node_next);
+            black_height = child_black_height;
+        }
+
+        for (auto it = path.rbegin(); it != path.rend(); it++) {
+            const bool key_before = isLess(key, it->first->key);
+            auto [left_subtree, right_subtree] = detachChildren(*it);
+            if (key_before) {
+                // The node and its right subtree go after the key.
+                right_part = joinNodes(std::move(right_part), std::move(it->first), std::move(right_subtree));
+            } else {
+                left_part = joinNodes(std::move(left_subtree), std::move(it->first), std::move(left_part));
+            }
+        }
+
+        return {std::move(left_part), found, std::move(right_part)};
+    }
+
+    // Cut the maximum node out of the tree. Returns the rest of the tree and the detached node.
+    CONSTEXPR20 std::pair<subtree_type, node_type_ptr> splitLast(subtree_type subtree) const {
+        std::vector<subtree_type> path{};
+        auto [node_current, black_height] = std::move(subtree);
+        while (node_current->right != node_sentinel) {
+            removeParentLink(node_current);
+            auto node_next = std::exchange(node_current->right, node_sentinel);
+            const size_type child_black_height = black_height - (node_current->color == Node_Color::black ? 1 : 0);
+            path.emplace_back(std::move(node_current), black_height);
+            node_current = std::move(node_next);
+            black_height = child_black_height;
+        }
+
+        auto rest = std::move(detachChildren({node_current, black_height}).first);
+        for (auto it = path.rbegin(); it != path.rend(); it++) {
+            auto left_subtree = std::move(detachChildren(*it).first);
+            rest = joinNodes(std::move(left_subtree), std::move(it->first), std::move(rest));
+        }
+
+        return {std::move(rest), std::move(node_current)};
+    }
+
+    NODISCARD CONSTEXPR20 subtree_type join2Nodes(subtree_type left, subtree_type right) const {
+        if (left.first == node_sentinel) {
+            return right;
+        }
+
+        auto [rest, node_last] = splitLast(std::move(left));
+        return joinNodes(std::move(rest), std::move(node_last), std::move(right));
+    }
+
+    // Build the tree of the count keys taken from key_next() in ascending order. The range of every node is split
+    // in the middle, so the leaves are on two adjacent levels: the nodes of the last level, if it is not full, are red
+    // and the others are black. A node is linked as soon as it is created and gets its key when the in-order walk
+    // reaches it, so the tree owns every node even if key_next() throws.
+    template<class KeyNext>
+    CONSTEXPR20 void buildSorted(size_type count, KeyNext &&key_next) {
+        clear();
+        // The levels above the red one are full: floor(log2(count + 1)).
+        const auto red_depth = static_cast<size_type>(std::bit_width(static_cast<uint64_t>(count) + 1) - 1);
+        // A node waiting for its key and the size of its right range.
+        struct BuildFrame {
+            node_type_ptr node;
+            size_type count_right;
+            size_type depth;
+        };
+
+        std::vector<BuildFrame> stack{};
+        node_type_ptr node_parent{};
+        bool left_side = true;
+        size_type count_range = count;
+        size_type depth = 0;
+        while (true) {
+            // Create the nodes down the left spine of the range.
+            while (count_range != 0) {
+                auto node = createNewNode(value_type{});
+                node->color = depth == red_depth ? Node_Color::red : Node_Color::black;
+                if (!node_parent) {
+                    root = node;
+                } else {
+                    node->parent = node_parent;
+                    (left_side ? node_parent->left : node_parent->right) = node;
+                }
+
+                const auto count_left = (count_range - 1) / 2;
+                stack.push_back({ node, count_range - 1 - count_left, depth });
+                node_parent = std::move(node);
+                left_side = true;
+                count_range = count_left;
+                depth++;
+            }
+
+            if (stack.empty()) {
+                break;
+            }
+
+            auto frame = std::move(stack.back());
+            stack.pop_back();
+            frame.node->key = key_next();
+            node_parent = std::move(frame.node);
+            left_side = false;
+            count_range = frame.count_right;
+            depth = frame.depth + 1;
+        }
+    }
+
+    // A piece of a parallel traversal: a node of the top levels alone or a whole subtree below them.
+    struct TraversalPiece {
+        const node_type *node;
+        bool subtree;
+    };
+
+    // In-order walk of the top levels: the nodes whose black height is parallelBlackHeight(grain_size) or more.
+    NODISCARD std::vector<TraversalPiece> splitTraversalPieces(size_type grain_size) const {
+        const auto parallel_black_height = parallelBlackHeight(grain_size);
+        const node_type* const node_end = node_sentinel.get();
+        std::vector<TraversalPiece> pieces{};
+        std::vector<std::pair<const node_type*, size_type>> stack{};
+        const node_type* node_current = root.get();
+        auto black_height = blackHeight(root);
+
+        while (true) {
+            // Move down to the leftmost node of the top levels.
+            while (node_current != node_end && black_height >= parallel_black_height) {
+                stack.emplace_back(node_current, black_height);
+                black_height -= node_current->color == Node_Color::black ? 1 : 0;
+                node_current = node_current->left.get();
+            }
+
+            if (node_current != node_end) {
+                pieces.push_back({ node_current, true });
+            }
+
+            if (stack.empty()) {
+                break;
+            }
+
+            const auto [node, node_black_height] = stack.back();
+            stack.pop_back();
+            pieces.push_back({ node, false });
+            black_height = node_black_height - (node->color == Node_Color::black ? 1 : 0);
+            node_current = node->right.get();
+        }
+
+        return pieces;
+    }
+
+    template<class Visitor>
+    CONSTEXPR20 void forEachInPiece(const TraversalPiece &piece, Visitor &visitor) const {
+        if (piece.subtree) {
+            forEachInSubtree(piece.node, visitor);
+        } else {
+            visitKeys(piece.node, visitor);
+        }
+    }
+
+    // The stack holds the path to the current node.
+    template<class Visitor>
+    CONSTEXPR20 void forEachInSubtree(const node_type *node, Visitor &visitor) const {
+        const node_type* const node_end = node_sentinel.get();
+        std::vector<const node_type*> stack{};
+        const node_type* node_current = node;
+
+        while (node_current != node_end || !stack.empty()) {
+            // Move down to the leftmost node.
+            while (node_current != node_end) {
+                stack.push_back(node_current);
+                node_current = node_current->left.get();
+            }
+
+            node_current = stack.back();
+            stack.pop_back();
+            visitKeys(node_current, visitor);
+            node_current = node_current->right.get();
+        }
+    }
+
+    // The keys of the node, the equal keys in the order of the iterator.
+    template<class Visitor>
+    CONSTEXPR20 void visitKeys(const node_type *node, Visitor &visitor) const {
+        const auto &duplicates = node->duplicates;
+        for (size_type index = 0; index < duplicates.count(); index++) {
+            visitor(duplicates.key(node->key, index));
+        }
+    }
+
+    // A tree of the black height b holds from 2^b - 1 to 4^b - 1 keys: take the middle.
+    NODISCARD static CONSTEXPR20 size_type parallelBlackHeight(size_type grain_size) {
+        return static_cast<size_type>(std::bit_width(grain_size)) * 2 / 3;
+    }
+
+    // The subtrees are moved through the recursion: a copied shared_ptr costs two atomic operations.
+    NODISCARD CONSTEXPR20 subtree_type unionNodes(subtree_type first, subtree_type second, ThreadPool &pool, size_type parallel_black_height) const {
+        if (first.first == node_sentinel) {
+            return second;
+        }
+
+        if (second.first == node_sentinel) {
+            return first;
+        }
+
+        // The root of the first tree splits the second one, the equal key of the second tree is dropped.
+        const bool parallel = std::max(first.second, second.second) >= parallel_black_height;
+        auto [first_left, first_right] = detachChildren(first);
+        auto [second_left, found, second_right] = splitNodes(std::move(second), first.first->key);
+        auto [left, right] = pool.forkJoin(parallel,
+            [&, first_left = std::move(first_left), second_left = std::move(second_left)]() mutable {
+                return unionNodes(std::move(first_left), std::move(second_left), pool, parallel_black_height);
+            },
+            [&, first_right = std::move(first_right), second_right = std::move(second_right)]() mutable {
+                return unionNodes(std::move(first_right), std::move(second_right), pool, parallel_black_height);
+            });
+        return joinNodes(std::move(left), std::move(first.first), std::move(right));
+    }
+
+    NODISCARD CONSTEXPR20 subtree_type intersectionNodes(subtree_type first, subtree_type second, ThreadPool &pool, size_type parallel_black_height) const {
+        if (first.first == node_sentinel || second.first == node_sentinel) {
+            releaseSubtree(std::move(first.first));
+            releaseSubtree(std::move(second.first));
+            return {node_sentinel, 0};
+        }
+
+        const bool parallel = std::max(first.second, second.second) >= parallel_black_height;
+        auto [first_left, first_right] = detachChildren(first);
+        auto [second_left, found, second_right] = splitNodes(std::move(second), first.first->key);
+        auto [left, right] = pool.forkJoin(parallel,
+            [&, first_left = std::move(first_left), second_left = std::move(second_left)]() mutable {
+                return intersectionNodes(std::move(first_left), std::move(second_left), pool, parallel_black_height);
+            },
+            [&, first_right = std::move(first_right), second_right = std::move(second_right)]() mutable {
+                return intersectionNodes(std::move(first_right), std::move(second_right), pool, parallel_black_height);
+            });
+        if (found) {
+            return joinNodes(std::move(left), std::move(first.first), std::move(right));
+        }
+
+        return join2Nodes(std::move(left), std::move(right));
+    }
+
+    NODISCARD CONSTEXPR20 subtree_type differenceNodes(subtree_type first, subtree_type second, ThreadPool &pool, size_type parallel_black_height) const {
+        if (first.first == node_sentinel || second.first == node_sentinel) {
+            releaseSubtree(std::move(second.first));
+            return first;
+        }
+
+        // The root of the second tree splits the first one and is dropped with the equal key.
+        const bool parallel = std::max(first.second, second.second) >= parallel_black_height;
+        auto [second_left, second_right] = detachChildren(second);
+        auto [first_left, found, first_right] = splitNodes(std::move(first), second.first->key);
+        auto [left, right] = pool.forkJoin(parallel,
+            [&, first_left = std::move(first_left), second_left = std::move(second_left)]() mutable {
+                return differenceNodes(std::move(first_left), std::move(second_left), pool, parallel_black_height);
+            },
+            [&, first_right = std::move(first_right), second_right = std::move(second_right)]() mutable {
+                return differenceNodes(std::move(first_right), std::move(second_right), pool, parallel_black_height);
+            });
+        return join2Nodes(std::move(left), std::move(right));
+    }
+
+    // The parent links form cycles with the child links: break them, otherwise the dropped nodes are never freed.
+    CONSTEXPR20 void releaseSubtree(node_type_ptr node) const {
+        std::vector<node_type_ptr> stack{};
+        if (node != node_sentinel) {
+            stack.push_back(node);
+        }
+
+        while (!stack.empty()) {
+            auto node_current = stack.back();
+            stack.pop_back();
+            removeParentLink(node_current);
+            if (node_current->left != node_sentinel) {
+                stack.push_back(std::exchange(node_current->left, node_sentinel));
+            }
+
+            if (node_current->right != node_sentinel) {
+                stack.push_back(std::exchange(node_current->right, node_sentinel));
+            }
+        }
+    }
+
+    // Copy the subtree of another tree level by level without recursion, the copy has the same shape.
+    NODISCARD CONSTEXPR20 node_type_ptr cloneNodes(const node_type_ptr &node, const node_type_ptr &sentinel_other) {
+        if (node == sentinel_other) {
+            return node_sentinel;
+        }
+
+        auto node_root = cloneNode(*node);
+        std::vector<std::pair<const node_type *, node_type_ptr>> level{ { node.get(), node_root } };
+        std::vector<std::pair<const node_type *, node_type_ptr>> level_next{};
+        while (!level.empty()) {
+            for (const auto &[node_source, node_copy] : level) {
+                if (node_source->left != sentinel_other) {
+                    node_copy->left = cloneNode(*node_source->left);
+                    node_copy->left->parent = node_copy;
+                    level_next.emplace_back(node_source->left.get(), node_copy->left);
+                }
+
+                if (node_source->right != sentinel_other) {
+                    node_copy->right = cloneNode(*node_source->right);
+                    node_copy->right->parent = node_copy;
+                    level_next.emplace_back(node_source->right.get(), node_copy->right);
+                }
+            }
+
+            level.swap(level_next);
+            level_next.clear();
+        }
+
+        return node_root;
+    }
+
+    NODISCARD CONSTEXPR20 node_type_ptr cloneNode(const node_type &node) {
+        auto node_copy = createNewNode(node.key);
+        node_copy->duplicates = node.duplicates;
+        node_copy->color = node.color;
+        return node_copy;
+    }
+
+    NODISCARD CONSTEXPR20 node_type_ptr createNewNode(const value_type& key) {
+        Stats::add(StatsEvent::allocation);
+        auto node = std::make_shared<node_type>(key);
+        node->left = node_sentinel;
+        node->right = node_sentinel;
+        return node;
     }
 
     CONSTEXPR20 void swapChildNodeForParent(node_type_ptr node, node_type_ptr node_parent, node_type_ptr node_new_child) const {
@@ -712,33 +2110,20 @@ private:
         return true;
     }
 
-    template<class T>
-    NODISCARD CONSTEXPR20 bool areEqual(std::shared_ptr<T> smart_obj_a, std::shared_ptr<T> smart_obj_b) const {
-        return *smart_obj_a == *smart_obj_b;
-    }
-
     template<class T>
     NODISCARD CONSTEXPR20 bool areEqual(const T& value_a, const T& value_b) const {
-        return value_a == value_b;
-    }
-
-    template<class T>
-    NODISCARD CONSTEXPR20 bool isGreater(std::shared_ptr<T> smart_obj_a, std::shared_ptr<T> smart_obj_b) const {
-        return *smart_obj_a > *smart_obj_b;
+        return comparedKey(value_a) == comparedKey(value_b);
     }
 
     template<class T>
     NODISCARD CONSTEXPR20 bool isGreater(const T& value_a, const T& value_b) const {
-        return value_a > value_b;
-    }
-
-    template<class T>
-    NODISCARD CONSTEXPR20 bool isLess(std::shared_ptr<T> smart_obj_a, std::shared_ptr<T> smart_obj_b) const {
-        return *smart_obj_a < *smart_obj_b;
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) > comparedKey(value_b);
     }
 
     template<class T>
     NODISCARD CONSTEXPR20 bool isLess(const T& value_a, const T& value_b) const {
-        return value_a < value_b;
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) < comparedKey(value_b);
     }
 };
\ No newline at end of file
@@ -1,4 +1,17 @@
 ﻿#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <set>
+#include <span>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
 #include <vector>
 #include "redblacktree.h"
 
@@ -85,6 +98,60 @@ std::ostream& operator<<(std::ostream& os, const std::shared_ptr<T> &psobj) {
 using object_type = RedBlackTreeLoopTest::ObjectA;
 using store_smart_ptr_type = std::shared_ptr<object_type>;
 
+// Check the red-black properties and the parent links below the node and collect its keys in order.
+// Returns the black height or -1. The sentinel is the only node without children links.
+template<class NodePtr>
+int checkRedBlackNode(const NodePtr& node, const NodePtr& parent, std::vector<test_data_type>& keys) {
+    if (!node->left) {
+        return node->color == Node_Color::black ? 0 : -1;
+    }
+
+    if (node->parent != parent) {
+        return -1;
+    }
+
+    if (node->color == Node_Color::red
+        && (node->left->color == Node_Color::red || node->right->color == Node_Color::red)) {
+        return -1;
+    }
+
+    const int left_height = checkRedBlackNode(node->left, node, keys);
+    keys.push_back(node->key);
+    const int right_height = checkRedBlackNode(node->right, node, keys);
+    if (left_height < 0 || left_height != right_height) {
+        return -1;
+    }
+
+    return left_height + (node->color == Node_Color::black ? 1 : 0);
+}
+
+// The tree is a valid red-black tree with exactly the expected keys, one node per key.
+template<class Tree>
+bool isValidRedBlackTree(const Tree& rbtree, const std::set<test_data_type>& expected) {
+    const auto root = rbtree.getRoot();
+    if (root->left && root->color != Node_Color::black) {
+        return false;
+    }
+
+    std::vector<test_data_type> keys{};
+    if (checkRedBlackNode(root, decltype(root){}, keys) < 0) {
+        return false;
+    }
+
+    return std::equal(keys.begin(), keys.end(), expected.begin(), expected.end());
+}
+
+// The owning pointer of the node with the key.
+template<class Tree>
+auto sharedNodeOf(const Tree& tree, test_data_type key) {
+    auto node = tree.getRoot();
+    while (node->key != key) {
+        node = key < node->key ? node->left : node->right;
+    }
+
+    return node;
+}
+
 /*
 input: 33 13 53 9 21 61 8 11 32 14 54 10
 
@@ -361,6 +428,57 @@ TEST_F(RedBlackTreeLoopTest, Search) {
     std::cout << "TEST_F(RedBlackTreeLoopTest, Search) end" << std::endl;
 }
 
+TEST_F(RedBlackTreeLoopTest, SearchBatch) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, SearchBatch) start" << std::endl;
+    // More keys than one group, the last group is not full.
+    std::vector<test_data_type> keys{};
+    for (test_data_type key = 0; key < 45; key++) {
+        keys.push_back(key);
+    }
+
+    const auto results = std::make_unique<bool[]>(keys.size());
+    std::vector<const test_data_type*> found(keys.size());
+    RedBlackTreeLoop<test_data_type> rbtree{};
+    // Search in empty structure.
+    rbtree.searchBatch(keys, std::span<bool>{ results.get(), keys.size() });
+    rbtree.searchBatch(keys, found);
+    for (test_data_count index = 0; index < keys.size(); index++) {
+        ASSERT_FALSE(results[index]);
+        ASSERT_EQ(found[index], nullptr);
+    }
+
+    rbtree = RedBlackTreeLoop<test_data_type>{array_values};
+    rbtree.searchBatch(keys, std::span<bool>{ results.get(), keys.size() });
+    rbtree.searchBatch(keys, found);
+    for (test_data_count index = 0; index < keys.size(); index++) {
+        ASSERT_EQ(results[index], rbtree.search(keys[index])) << keys[index];
+        if (results[index]) {
+            ASSERT_EQ(*found[index], keys[index]);
+        } else {
+            ASSERT_EQ(found[index], nullptr);
+        }
+    }
+    std::cout << "TEST_F(RedBlackTreeLoopTest, SearchBatch) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, ForEachInOrder) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, ForEachInOrder) start" << std::endl;
+    std::vector<test_data_type> keys{};
+    RedBlackTreeLoop<test_data_type> rbtree{};
+    // Empty structure.
+    rbtree.forEachInOrder([&keys](const test_data_type& key) { keys.push_back(key); });
+    ASSERT_TRUE(keys.empty());
+
+    rbtree = RedBlackTreeLoop<test_data_type>{array_values};
+    rbtree.forEachInOrder([&keys](const test_data_type& key) { keys.push_back(key); });
+
+    auto expected = array_values;
+    std::sort(expected.begin(), expected.end());
+    expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+    ASSERT_EQ(keys, expected);
+    std::cout << "TEST_F(RedBlackTreeLoopTest, ForEachInOrder) end" << std::endl;
+}
+
 TEST_F(RedBlackTreeLoopTest, FailedVerify) {
     std::cout << "TEST_F(RedBlackTreeLoopTest, Search) start" << std::endl;
     RedBlackTreeLoop<test_data_type> rbtree{};
@@ -374,4 +492,765 @@ TEST_F(RedBlackTreeLoopTest, FailedVerify) {
     ASSERT_TRUE(rbtree.verifyCorrectness(std::vector<test_data_result_pair>{{31, Node_Color::black}, {13, Node_Color::red}}));
     rbtree.printTree(rbtree.getRoot());
     std::cout << "TEST_F(RedBlackTreeLoopTest, Search) end" << std::endl;
-}
\ No newline at end of file
+}
+
+TEST_F(RedBlackTreeLoopTest, JoinSplit) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, JoinSplit) start" << std::endl;
+    // Trees of very different black heights.
+    RedBlackTreeLoop<test_data_type> left{};
+    RedBlackTreeLoop<test_data_type> right{};
+    std::set<test_data_type> expected{};
+    for (test_data_type value = 0; value < 1000; value++) {
+        left.insert(value);
+        expected.insert(value);
+    }
+    for (test_data_type value = 1001; value < 1004; value++) {
+        right.insert(value);
+        expected.insert(value);
+    }
+    expected.insert(1000);
+
+    auto joined = RedBlackTreeLoop<test_data_type>::join(std::move(left), 1000, std::move(right));
+    ASSERT_TRUE(isValidRedBlackTree(joined, expected));
+    ASSERT_TRUE(isValidRedBlackTree(left, {}));
+    ASSERT_TRUE(isValidRedBlackTree(right, {}));
+
+    // Split by every kind of key: present, absent, out of range.
+    for (const test_data_type key : {500, 1000, 1003, 0, -5, 5000}) {
+        auto [before, found, after] = joined.split(key);
+        ASSERT_EQ(found, expected.count(key) == 1) << key;
+        ASSERT_TRUE(isValidRedBlackTree(before, { expected.begin(), expected.lower_bound(key) })) << key;
+        ASSERT_TRUE(isValidRedBlackTree(after, { expected.upper_bound(key), expected.end() })) << key;
+        ASSERT_TRUE(isValidRedBlackTree(joined, {}));
+
+        // Put the parts back together.
+        joined = found ? RedBlackTreeLoop<test_data_type>::join(std::move(before), key, std::move(after))
+                       : RedBlackTreeLoop<test_data_type>::join2(std::move(before), std::move(after));
+        ASSERT_TRUE(isValidRedBlackTree(joined, expected)) << key;
+    }
+
+    // The parts stay usable trees.
+    auto [before, found, after] = joined.split(500);
+    before.insert(2000);
+    after.deleteValue(501);
+    ASSERT_TRUE(before.search(2000));
+    ASSERT_FALSE(after.search(501));
+    std::cout << "TEST_F(RedBlackTreeLoopTest, JoinSplit) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, Join2) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, Join2) start" << std::endl;
+    RedBlackTreeLoop<test_data_type> empty_left{};
+    RedBlackTreeLoop<test_data_type> empty_right{};
+    auto joined = RedBlackTreeLoop<test_data_type>::join2(std::move(empty_left), std::move(empty_right));
+    ASSERT_TRUE(isValidRedBlackTree(joined, {}));
+
+    std::set<test_data_type> expected{ array_values.begin(), array_values.end() };
+    RedBlackTreeLoop<test_data_type> left{ array_values };
+    RedBlackTreeLoop<test_data_type> right{};
+    for (test_data_type value = 100; value < 400; value += 3) {
+        right.insert(value);
+        expected.insert(value);
+    }
+
+    joined = RedBlackTreeLoop<test_data_type>::join2(std::move(left), std::move(right));
+    ASSERT_TRUE(isValidRedBlackTree(joined, expected));
+    std::cout << "TEST_F(RedBlackTreeLoopTest, Join2) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, SetOperations) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, SetOperations) start" << std::endl;
+    ThreadPool pool{ 4 };
+    std::mt19937 generator{ 1337 };
+
+    // Sizes from equal to very different. The small grain size forces the parallel recursion.
+    for (const test_data_count second_count : {0, 10, 3000}) {
+        std::set<test_data_type> first_keys{};
+        std::set<test_data_type> second_keys{};
+        for (test_data_count index = 0; index < 3000; index++) {
+            first_keys.insert(static_cast<test_data_type>(generator() % 6000));
+        }
+        for (test_data_count index = 0; index < second_count; index++) {
+            second_keys.insert(static_cast<test_data_type>(generator() % 6000));
+        }
+
+        std::set<test_data_type> union_keys{ first_keys };
+        union_keys.insert(second_keys.begin(), second_keys.end());
+        std::set<test_data_type> intersection_keys{};
+        std::set<test_data_type> difference_keys{};
+        std::set_intersection(first_keys.begin(), first_keys.end(), second_keys.begin(), second_keys.end(),
+                              std::inserter(intersection_keys, intersection_keys.end()));
+        std::set_difference(first_keys.begin(), first_keys.end(), second_keys.begin(), second_keys.end(),
+                            std::inserter(difference_keys, difference_keys.end()));
+
+        const std::vector<test_data_type> first_values{ first_keys.begin(), first_keys.end() };
+        const std::vector<test_data_type> second_values{ second_keys.begin(), second_keys.end() };
+        using tree_type = RedBlackTreeLoop<test_data_type>;
+
+        auto result = tree_type::setUnion(tree_type{ first_values }, tree_type{ second_values }, pool, 16);
+        ASSERT_TRUE(isValidRedBlackTree(result, union_keys)) << second_count;
+        result = tree_type::setIntersection(tree_type{ first_values }, tree_type{ second_values }, pool, 16);
+        ASSERT_TRUE(isValidRedBlackTree(result, intersection_keys)) << second_count;
+        result = tree_type::setDifference(tree_type{ first_values }, tree_type{ second_values }, pool, 16);
+        ASSERT_TRUE(isValidRedBlackTree(result, difference_keys)) << second_count;
+        // Second operand smaller than the first one and the serial path.
+        result = tree_type::setDifference(tree_type{ second_values }, tree_type{ first_values }, pool);
+        std::set<test_data_type> reverse_difference_keys{};
+        std::set_difference(second_keys.begin(), second_keys.end(), first_keys.begin(), first_keys.end(),
+                            std::inserter(reverse_difference_keys, reverse_difference_keys.end()));
+        ASSERT_TRUE(isValidRedBlackTree(result, reverse_difference_keys)) << second_count;
+    }
+    std::cout << "TEST_F(RedBlackTreeLoopTest, SetOperations) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, Stats) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, Stats) start" << std::endl;
+    using stats_type = CountingStats<struct RedBlackTreeLoopStatsTag>;
+    RedBlackTreeLoop<test_data_type, size_t, stats_type> tree{};
+    RedBlackTreeLoop<test_data_type> tree_plain{};
+    const test_data_type keys_count = 127;
+
+    stats_type::reset();
+    // Ascending keys make the tree rotate on every level.
+    for (test_data_type key = 0; key < keys_count; key++) {
+        tree.insert(key);
+        tree_plain.insert(key);
+    }
+
+    auto stats = stats_type::snapshot();
+    ASSERT_EQ(stats[StatsEvent::allocation], static_cast<uint64_t>(keys_count));
+    ASSERT_NE(stats[StatsEvent::comparison], 0u);
+    ASSERT_NE(stats[StatsEvent::rotation], 0u);
+    ASSERT_NE(stats[StatsEvent::rebalance], 0u);
+
+    for (test_data_type key = 0; key < keys_count; key += 2) {
+        tree.deleteValue(key);
+        tree_plain.deleteValue(key);
+    }
+
+    ASSERT_GT(stats_type::snapshot()[StatsEvent::rebalance], stats[StatsEvent::rebalance]);
+
+    // The instrumentation doesn't change the tree.
+    stats = stats_type::snapshot();
+    for (test_data_type key = 0; key < keys_count; key++) {
+        ASSERT_EQ(tree.search(key), tree_plain.search(key)) << key;
+    }
+    ASSERT_GE(stats_type::snapshot()[StatsEvent::comparison], stats[StatsEvent::comparison] + keys_count);
+    std::cout << "TEST_F(RedBlackTreeLoopTest, Stats) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, Iterator) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, Iterator) start" << std::endl;
+    RedBlackTreeLoop<test_data_type> tree{};
+    ASSERT_TRUE(tree.begin() == tree.end());
+    ASSERT_TRUE(tree.find(30) == tree.end());
+
+    tree = RedBlackTreeLoop<test_data_type>{ array_values };
+    auto expected = array_values;
+    std::sort(expected.begin(), expected.end());
+    ASSERT_EQ(std::vector<test_data_type>(tree.begin(), tree.end()), expected);
+
+    // Backwards from the end.
+    std::vector<test_data_type> keys{};
+    for (auto it = tree.end(); it != tree.begin();) {
+        keys.push_back(*--it);
+    }
+    std::reverse(keys.begin(), keys.end());
+    ASSERT_EQ(keys, expected);
+
+    auto it = tree.find(30);
+    ASSERT_EQ(*it, 30);
+    ASSERT_EQ(*++it, 35);
+    ASSERT_EQ(*--it, 30);
+    ASSERT_TRUE(tree.find(31) == tree.end());
+    std::cout << "TEST_F(RedBlackTreeLoopTest, Iterator) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, HintedInsert) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, HintedInsert) start" << std::endl;
+    std::mt19937 generator{ 1337 };
+    RedBlackTreeLoop<test_data_type> tree{};
+    std::set<test_data_type> expected{};
+
+    // Near-sorted keys, the hints are right, wrong or the end.
+    auto hint = tree.end();
+    for (test_data_type index = 0; index < 3000; index++) {
+        const auto key = index * 4 + static_cast<test_data_type>(generator() % 64) - 32;
+        switch (generator() % 4) {
+            case 0:
+                tree.insert(key);
+                break;
+            case 1:
+                hint = tree.insert(tree.end(), key);
+                ASSERT_EQ(*hint, key);
+                break;
+            case 2:
+                hint = tree.insert(hint, key);
+                ASSERT_EQ(*hint, key);
+                break;
+            default:
+                hint = tree.insert(tree.find(static_cast<test_data_type>(generator() % 12000)), key);
+                ASSERT_EQ(*hint, key);
+                break;
+        }
+        expected.insert(key);
+
+        // The finger is dropped by the delete.
+        if (index % 100 == 0) {
+            tree.deleteValue(key);
+            expected.erase(key);
+            hint = tree.end();
+        }
+
+        if (index % 500 == 0) {
+            ASSERT_TRUE(isValidRedBlackTree(tree, expected)) << index;
+        }
+    }
+
+    ASSERT_TRUE(isValidRedBlackTree(tree, expected));
+    std::cout << "TEST_F(RedBlackTreeLoopTest, HintedInsert) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, FingerInsertStats) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, FingerInsertStats) start" << std::endl;
+    using stats_type = CountingStats<struct RedBlackTreeLoopFingerStatsTag>;
+    RedBlackTreeLoop<test_data_type, size_t, stats_type> tree{};
+    RedBlackTreeLoop<test_data_type, size_t, stats_type> tree_hinted{};
+    const test_data_type keys_count = 4096;
+
+    // The appended keys don't search from the root.
+    stats_type::reset();
+    for (test_data_type key = 0; key < keys_count; key++) {
+        tree.insert(key);
+    }
+    ASSERT_LE(stats_type::snapshot()[StatsEvent::comparison], static_cast<uint64_t>(2 * keys_count));
+
+    stats_type::reset();
+    for (test_data_type key = 0; key < keys_count; key++) {
+        tree_hinted.insert(tree_hinted.end(), key);
+    }
+    ASSERT_LE(stats_type::snapshot()[StatsEvent::comparison], static_cast<uint64_t>(2 * keys_count));
+    ASSERT_TRUE(std::equal(tree.begin(), tree.end(), tree_hinted.begin(), tree_hinted.end()));
+    std::cout << "TEST_F(RedBlackTreeLoopTest, FingerInsertStats) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, InsertReturnsIterator) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, InsertReturnsIterator) start" << std::endl;
+    RedBlackTreeLoop<test_data_type> tree{ array_values };
+
+    auto [inserted_it, inserted] = tree.insert(25);
+    ASSERT_TRUE(inserted);
+    ASSERT_EQ(*inserted_it, 25);
+    ASSERT_EQ(*++inserted_it, 30);
+
+    auto [found_it, found_inserted] = tree.insert(39);
+    ASSERT_FALSE(found_inserted);
+    ASSERT_TRUE(found_it == tree.find(39));
+    std::cout << "TEST_F(RedBlackTreeLoopTest, InsertReturnsIterator) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, EraseByIterator) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, EraseByIterator) start" << std::endl;
+    std::mt19937 generator{ 1337 };
+    RedBlackTreeLoop<test_data_type> tree{};
+    std::set<test_data_type> expected{};
+
+    // Upsert and expire: the iterator from insert erases the key without a search.
+    for (test_data_type index = 0; index < 2000; index++) {
+        const auto key = static_cast<test_data_type>(generator() % 1000);
+        auto [it, inserted] = tree.insert(key);
+        expected.insert(key);
+        if (!inserted) {
+            auto next = tree.erase(it);
+            auto expected_next = expected.erase(expected.find(key));
+            ASSERT_EQ(next == tree.end(), expected_next == expected.end()) << index;
+            if (next != tree.end()) {
+                ASSERT_EQ(*next, *expected_next) << index;
+            }
+        }
+    }
+    ASSERT_TRUE(isValidRedBlackTree(tree, expected));
+
+    // Erase everything from the begin.
+    for (auto it = tree.begin(); it != tree.end();) {
+        it = tree.erase(it);
+    }
+    ASSERT_TRUE(isValidRedBlackTree(tree, {}));
+    std::cout << "TEST_F(RedBlackTreeLoopTest, EraseByIterator) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, EraseKeepsIterators) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, EraseKeepsIterators) start" << std::endl;
+    // The successor of a node with two children takes its place: the iterator to the successor stays valid.
+    RedBlackTreeLoop<test_data_type> small{ std::vector<test_data_type>{ 50, 30, 70, 20, 40, 60, 80 } };
+    const auto it_50 = small.find(50);
+    const auto it_60 = small.find(60);
+    ASSERT_EQ(small.erase(it_50), it_60);
+    ASSERT_EQ(*it_60, 60);
+    ASSERT_TRUE(isValidRedBlackTree(small, { 20, 30, 40, 60, 70, 80 }));
+
+    // Keep the iterators of all the keys and erase them in random order.
+    std::mt19937 generator{ 1337 };
+    RedBlackTreeLoop<test_data_type> tree{};
+    std::set<test_data_type> expected{};
+    std::vector<std::pair<test_data_type, RedBlackTreeLoop<test_data_type>::ConstIterator>> iterators{};
+    for (test_data_type key = 0; key < 2000; key++) {
+        iterators.emplace_back(key, tree.insert(key).first);
+        expected.insert(key);
+    }
+    std::shuffle(iterators.begin(), iterators.end(), generator);
+
+    while (!iterators.empty()) {
+        tree.erase(iterators.back().second);
+        expected.erase(iterators.back().first);
+        iterators.pop_back();
+        for (const auto& [key, it] : iterators) {
+            ASSERT_EQ(*it, key);
+        }
+
+        if (iterators.size() % 100 == 0) {
+            ASSERT_TRUE(isValidRedBlackTree(tree, expected)) << iterators.size();
+        }
+    }
+    ASSERT_TRUE(tree.isEmpty());
+    std::cout << "TEST_F(RedBlackTreeLoopTest, EraseKeepsIterators) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, ExtractInsertHandle) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, ExtractInsertHandle) start" << std::endl;
+    RedBlackTreeLoop<test_data_type> source{ array_values };
+    RedBlackTreeLoop<test_data_type> target{ std::vector<test_data_type>{ 1, 2, 35 } };
+
+    ASSERT_TRUE(source.extract(31).empty());
+
+    // The node moves to the other tree.
+    auto handle = source.extract(source.find(20));
+    ASSERT_FALSE(handle.empty());
+    ASSERT_EQ(handle.value(), 20);
+    auto [it, inserted] = target.insert(std::move(handle));
+    ASSERT_TRUE(inserted);
+    ASSERT_EQ(*it, 20);
+    ASSERT_TRUE(handle.empty());
+
+    // The key is in the target already: the handle keeps the node.
+    handle = source.extract(35);
+    auto [it_found, inserted_found] = target.insert(std::move(handle));
+    ASSERT_FALSE(inserted_found);
+    ASSERT_EQ(*it_found, 35);
+    ASSERT_EQ(handle.value(), 35);
+
+    // A node with two children is unlinked itself too.
+    handle = source.extract(source.find(30));
+    ASSERT_EQ(handle.value(), 30);
+    target.insert(std::move(handle));
+
+    ASSERT_TRUE(isValidRedBlackTree(source, { 10, 24, 39, 40 }));
+    ASSERT_TRUE(isValidRedBlackTree(target, { 1, 2, 20, 30, 35 }));
+    std::cout << "TEST_F(RedBlackTreeLoopTest, ExtractInsertHandle) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, MultisetCountedKeys) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, MultisetCountedKeys) start" << std::endl;
+    RedBlackTreeLoop<test_data_type, size_t, NoStats, CountedKeys> tree{ array_values };
+    std::multiset<test_data_type> expected{ array_values.begin(), array_values.end() };
+    for (const auto value : { 30, 30, 10, 39, 30 }) {
+        const auto [it, inserted] = tree.insert(value);
+        ASSERT_TRUE(inserted);
+        ASSERT_EQ(*it, value);
+        expected.insert(value);
+    }
+
+    // The equal keys share a node.
+    ASSERT_TRUE(isValidRedBlackTree(tree, { 10, 20, 24, 30, 35, 39, 40 }));
+    ASSERT_EQ(tree.count(30), 4u);
+    ASSERT_EQ(tree.count(35), 1u);
+    ASSERT_EQ(tree.count(31), 0u);
+
+    const auto [first, last] = tree.equal_range(30);
+    ASSERT_EQ(std::distance(first, last), 4);
+    ASSERT_EQ(*last, 35);
+    ASSERT_TRUE(std::all_of(first, last, [](test_data_type key) { return key == 30; }));
+    const auto [first_absent, last_absent] = tree.equal_range(31);
+    ASSERT_TRUE(first_absent == last_absent);
+    ASSERT_EQ(*first_absent, 35);
+    ASSERT_TRUE(tree.upper_bound(40) == tree.end());
+
+    ASSERT_TRUE(std::equal(tree.begin(), tree.end(), expected.begin(), expected.end()));
+    std::vector<test_data_type> keys{};
+    tree.forEachInOrder([&keys](test_data_type key) {
+        keys.push_back(key);
+    });
+    ASSERT_TRUE(std::equal(keys.begin(), keys.end(), expected.begin(), expected.end()));
+    // Backwards over the counts.
+    ASSERT_TRUE(std::equal(std::make_reverse_iterator(tree.end()), std::make_reverse_iterator(tree.begin()),
+                           expected.rbegin(), expected.rend()));
+
+    // erase() takes one key, deleteValue() takes all of them.
+    auto it = tree.erase(tree.find(30));
+    ASSERT_EQ(*it, 30);
+    ASSERT_EQ(tree.count(30), 3u);
+    tree.deleteValue(10);
+    ASSERT_EQ(tree.count(10), 0u);
+    ASSERT_TRUE(isValidRedBlackTree(tree, { 20, 24, 30, 35, 39, 40 }));
+    std::cout << "TEST_F(RedBlackTreeLoopTest, MultisetCountedKeys) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, MultisetChainedKeys) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, MultisetChainedKeys) start" << std::endl;
+    // The objects with equal scores come out in insertion order.
+    RedBlackTreeLoop<store_smart_ptr_type, size_t, NoStats, ChainedKeys> scores{};
+    std::vector<store_smart_ptr_type> equal_scores{};
+    for (test_data_count index = 0; index < 4; index++) {
+        equal_scores.push_back(std::make_shared<object_type>(50));
+        scores.insert(equal_scores.back());
+        scores.insert(std::make_shared<object_type>(static_cast<test_data_type>(index * 25 + 10)));
+    }
+
+    ASSERT_EQ(scores.count(std::make_shared<object_type>(50)), 4u);
+    auto [first, last] = scores.equal_range(std::make_shared<object_type>(50));
+    std::vector<store_smart_ptr_type> range{ first, last };
+    ASSERT_EQ(range.size(), 4u);
+    ASSERT_TRUE(std::equal(equal_scores.begin(), equal_scores.end(), range.begin()));
+    ASSERT_EQ((*last)->get(), 60);
+
+    // The first key of the chain goes, the next one takes its place.
+    auto it = scores.erase(first);
+    ASSERT_EQ(*it, equal_scores[1]);
+    it = scores.erase(std::next(it));
+    ASSERT_EQ(*it, equal_scores[3]);
+    std::tie(first, last) = scores.equal_range(std::make_shared<object_type>(50));
+    range.assign(first, last);
+    ASSERT_EQ(range.size(), 2u);
+    ASSERT_EQ(range[0], equal_scores[1]);
+    ASSERT_EQ(range[1], equal_scores[3]);
+
+    // Random operations against std::multiset.
+    std::mt19937 generator{ 1337 };
+    RedBlackTreeLoop<test_data_type, size_t, NoStats, ChainedKeys> tree{};
+    std::multiset<test_data_type> expected{};
+    for (test_data_count index = 0; index < 20000; index++) {
+        const auto value = static_cast<test_data_type>(generator() % 300);
+        if (generator() % 3 != 0) {
+            tree.insert(value);
+            expected.insert(value);
+        } else if (const auto position = tree.find(value); position != tree.end()) {
+            tree.erase(position);
+            expected.erase(expected.find(value));
+        }
+
+        ASSERT_EQ(tree.count(value), expected.count(value));
+    }
+
+    ASSERT_TRUE(isValidRedBlackTree(tree, std::set<test_data_type>{ expected.begin(), expected.end() }));
+    ASSERT_TRUE(std::equal(tree.begin(), tree.end(), expected.begin(), expected.end()));
+    std::cout << "TEST_F(RedBlackTreeLoopTest, MultisetChainedKeys) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, Clear) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, Clear) start" << std::endl;
+    using node_type = RedBlackTreeNodeLoop<test_data_type>;
+    std::set<test_data_type> expected{};
+    std::vector<std::weak_ptr<node_type>> nodes_weak{};
+    {
+        RedBlackTreeLoop<test_data_type> tree{};
+        for (test_data_type key = 0; key < 1000; key++) {
+            tree.insert(key);
+            expected.insert(key);
+        }
+
+        // The delete fixup links the parents.
+        for (test_data_type key = 0; key < 1000; key += 3) {
+            tree.deleteValue(key);
+            expected.erase(key);
+        }
+
+        nodes_weak.push_back(tree.getRoot());
+        nodes_weak.push_back(sharedNodeOf(tree, *tree.begin()));
+        nodes_weak.push_back(sharedNodeOf(tree, *std::prev(tree.end())));
+
+        // The moved tree owns the nodes.
+        auto tree_moved = std::move(tree);
+        ASSERT_TRUE(tree.isEmpty());
+        ASSERT_TRUE(isValidRedBlackTree(tree_moved, expected));
+        tree.insert(5);
+        ASSERT_TRUE(isValidRedBlackTree(tree, { 5 }));
+    }
+
+    // The parent links do not keep the nodes alive.
+    for (const auto &node_weak : nodes_weak) {
+        ASSERT_TRUE(node_weak.expired());
+    }
+
+    RedBlackTreeLoop<test_data_type> tree{ array_values };
+    const std::weak_ptr<node_type> root_weak = tree.getRoot();
+    tree.clear();
+    ASSERT_TRUE(tree.isEmpty());
+    ASSERT_TRUE(root_weak.expired());
+    ASSERT_TRUE(tree.begin() == tree.end());
+    ASSERT_TRUE(isValidRedBlackTree(tree, {}));
+    tree.insert(31);
+    ASSERT_TRUE(isValidRedBlackTree(tree, { 31 }));
+    std::cout << "TEST_F(RedBlackTreeLoopTest, Clear) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, Move) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, Move) start" << std::endl;
+    RedBlackTreeLoop<test_data_type> tree{};
+    for (test_data_type key = 0; key < 2000; key++) {
+        tree.insert(key);
+    }
+
+    // The moved-from tree gets its own sentinel: both trees may be changed by different threads.
+    RedBlackTreeLoop<test_data_type> moved{ std::move(tree) };
+    RedBlackTreeLoop<test_data_type> assigned{ std::vector<test_data_type>{ 1, 2, 3 } };
+    assigned = std::move(moved);
+    for (test_data_type key = 0; key < 10; key++) {
+        tree.insert(key);
+        moved.insert(key);
+    }
+    ASSERT_NE(sharedNodeOf(tree, 0)->left, sharedNodeOf(assigned, 0)->left);
+    ASSERT_NE(sharedNodeOf(moved, 0)->left, sharedNodeOf(assigned, 0)->left);
+    ASSERT_NE(sharedNodeOf(tree, 0)->left, sharedNodeOf(moved, 0)->left);
+
+    const auto update = [](RedBlackTreeLoop<test_data_type> &target, test_data_type first) {
+        for (test_data_type key = first; key < first + 1000; key++) {
+            target.insert(key);
+            target.deleteValue(key - 500);
+        }
+    };
+    std::thread thread_tree{ update, std::ref(tree), 10000 };
+    std::thread thread_moved{ update, std::ref(moved), 20000 };
+    update(assigned, 30000);
+    thread_tree.join();
+    thread_moved.join();
+
+    std::set<test_data_type> expected{};
+    for (test_data_type key = 0; key < 2000; key++) {
+        expected.insert(key);
+    }
+    for (test_data_type key = 30500; key < 31000; key++) {
+        expected.insert(key);
+    }
+    ASSERT_TRUE(isValidRedBlackTree(assigned, expected));
+    expected.clear();
+    for (test_data_type key = 0; key < 10; key++) {
+        expected.insert(key);
+    }
+    for (test_data_type key = 10500; key < 11000; key++) {
+        expected.insert(key);
+    }
+    ASSERT_TRUE(isValidRedBlackTree(tree, expected));
+    std::cout << "TEST_F(RedBlackTreeLoopTest, Move) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, Copy) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, Copy) start" << std::endl;
+    RedBlackTreeLoop<test_data_type> rbtree{ array_values };
+
+    // The copy has the same shape and colors, its own nodes and its own sentinel.
+    auto rbtree_copy = rbtree;
+    ASSERT_TRUE(rbtree_copy.verifyCorrectness(array_values_result));
+    ASSERT_NE(rbtree_copy.getRoot(), rbtree.getRoot());
+
+    // Delete down to the empty tree in the copy.
+    for (const auto value : array_values) {
+        rbtree_copy.deleteValue(value);
+        ASSERT_TRUE(rbtree.search(value));
+    }
+    ASSERT_TRUE(rbtree_copy.isEmpty());
+    ASSERT_TRUE(isValidRedBlackTree(rbtree, { array_values.begin(), array_values.end() }));
+
+    rbtree.insert(50);
+    rbtree_copy = rbtree;
+    rbtree_copy.insert(51);
+    ASSERT_TRUE(isValidRedBlackTree(rbtree_copy, { 10, 20, 24, 30, 35, 39, 40, 50, 51 }));
+    ASSERT_FALSE(rbtree.search(51));
+
+    // The duplicates are copied with their nodes.
+    RedBlackTreeLoop<test_data_type, size_t, NoStats, CountedKeys> multiset{};
+    for (test_data_type key = 0; key < 100; key++) {
+        multiset.insert(key % 10);
+    }
+
+    const auto multiset_copy = multiset;
+    ASSERT_EQ(multiset_copy.count(3), 10u);
+    ASSERT_TRUE(std::equal(multiset.begin(), multiset.end(), multiset_copy.begin(), multiset_copy.end()));
+
+    const RedBlackTreeLoop<test_data_type> rbtree_empty{};
+    rbtree_copy = rbtree_empty;
+    ASSERT_TRUE(rbtree_copy.isEmpty());
+    ASSERT_TRUE(isValidRedBlackTree(rbtree_copy, {}));
+    std::cout << "TEST_F(RedBlackTreeLoopTest, Copy) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, ParallelTraversal) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, ParallelTraversal) start" << std::endl;
+    ThreadPool pool{ 4 };
+    std::mt19937 generator{ 1337 };
+
+    // Not commutative: the runs of keys must be joined in order.
+    const auto concatenate = [](std::vector<test_data_type> result, const auto &value) {
+        if constexpr (std::is_same_v<std::decay_t<decltype(value)>, test_data_type>) {
+            result.push_back(value);
+        } else {
+            result.insert(result.end(), value.begin(), value.end());
+        }
+        return result;
+    };
+
+    for (const test_data_count keys_count : {0, 1, 100, 20000}) {
+        std::set<test_data_type> keys{};
+        for (test_data_count index = 0; index < keys_count; index++) {
+            keys.insert(static_cast<test_data_type>(generator() % 100000));
+        }
+
+        const std::vector<test_data_type> expected{ keys.begin(), keys.end() };
+        const RedBlackTreeLoop<test_data_type> tree{ expected };
+        long long expected_sum = 0;
+        for (const auto key : expected) {
+            expected_sum += key;
+        }
+
+        // The small grain size cuts the tree into many pieces, the default one keeps small trees in one piece.
+        for (const test_data_count grain_size : {16, 16384}) {
+            std::atomic<long long> sum{ 0 };
+            std::atomic<size_t> visited{ 0 };
+            tree.parallelForEach([&sum, &visited](test_data_type key) {
+                sum += key;
+                visited++;
+            }, pool, grain_size);
+            ASSERT_EQ(sum.load(), expected_sum) << keys_count;
+            ASSERT_EQ(visited.load(), expected.size()) << keys_count;
+
+            const auto reduced_sum = tree.parallelReduce(0LL, [](long long result, long long value) {
+                return result + value;
+            }, pool, grain_size);
+            ASSERT_EQ(reduced_sum, expected_sum) << keys_count;
+            ASSERT_EQ(tree.parallelReduce(std::vector<test_data_type>{}, concatenate, pool, grain_size), expected) << keys_count;
+            ASSERT_EQ(tree.parallelExport(pool, grain_size), expected) << keys_count;
+        }
+    }
+
+    // The equal keys are exported with their nodes.
+    RedBlackTreeLoop<test_data_type, size_t, NoStats, CountedKeys> multiset{};
+    std::vector<test_data_type> expected{};
+    for (test_data_type key = 0; key < 3000; key++) {
+        multiset.insert(key / 3);
+        expected.push_back(key / 3);
+    }
+    ASSERT_EQ(multiset.parallelExport(pool, 16), expected);
+    std::cout << "TEST_F(RedBlackTreeLoopTest, ParallelTraversal) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, ParallelTraversalThrows) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, ParallelTraversalThrows) start" << std::endl;
+    ThreadPool pool{ 4 };
+
+    // The chunk of the calling thread throws at once: the other chunks still finish before the exception leaves.
+    std::atomic<size_t> chunks_finished{ 0 };
+    ASSERT_THROW(pool.parallelFor(0, 64, 1, [&chunks_finished](size_t, size_t last) {
+        if (last == 64) {
+            throw std::runtime_error("chunk failed");
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        chunks_finished++;
+    }), std::runtime_error);
+    ASSERT_EQ(chunks_finished.load(), pool.size() * 4 - 1);
+
+    std::atomic<bool> second_finished{ false };
+    ASSERT_THROW(static_cast<void>(pool.forkJoin([]() -> int {
+        throw std::runtime_error("first failed");
+    }, [&second_finished]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        second_finished = true;
+        return 0;
+    })), std::runtime_error);
+    ASSERT_TRUE(second_finished.load());
+
+    // A visitor which throws on one key: the traversal stops with its exception and the pool stays usable.
+    std::vector<test_data_type> keys(20000);
+    for (size_t index = 0; index < keys.size(); index++) {
+        keys[index] = static_cast<test_data_type>(index);
+    }
+    const RedBlackTreeLoop<test_data_type> tree{ keys };
+    ASSERT_THROW(tree.parallelForEach([](test_data_type key) {
+        if (key == 12345) {
+            throw std::runtime_error("visitor failed");
+        }
+    }, pool, 16), std::runtime_error);
+    ASSERT_THROW(static_cast<void>(tree.parallelReduce(0LL, [](long long result, long long value) {
+        if (value == 777) {
+            throw std::runtime_error("operation failed");
+        }
+        return result + value;
+    }, pool, 16)), std::runtime_error);
+    ASSERT_EQ(tree.parallelExport(pool, 16), keys);
+    std::cout << "TEST_F(RedBlackTreeLoopTest, ParallelTraversalThrows) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeLoopTest, BulkBuildSnapshot) {
+    std::cout << "TEST_F(RedBlackTreeLoopTest, BulkBuildSnapshot) start" << std::endl;
+    using stats_type = CountingStats<struct RedBlackTreeLoopSnapshotStatsTag>;
+    using tree_type = RedBlackTreeLoop<test_data_type, size_t, stats_type>;
+
+    // Full and partial last levels.
+    for (const test_data_count keys_count : {0, 1, 2, 3, 4, 7, 8, 100, 1000}) {
+        std::vector<test_data_type> keys{};
+        for (test_data_count index = 0; index < keys_count; index++) {
+            keys.push_back(static_cast<test_data_type>(index * 3));
+        }
+
+        stats_type::reset();
+        auto tree = tree_type::fromSorted(keys.data(), keys.data() + keys.size());
+        ASSERT_EQ(stats_type::snapshot()[StatsEvent::comparison], 0u);
+        ASSERT_TRUE(isValidRedBlackTree(tree, { keys.begin(), keys.end() })) << keys_count;
+
+        // The built tree takes updates like any other.
+        tree.insert(1);
+        tree.deleteValue(0);
+        tree.insert(static_cast<test_data_type>(keys_count * 3));
+        std::set<test_data_type> expected{ keys.begin(), keys.end() };
+        expected.insert(1);
+        expected.erase(0);
+        expected.insert(static_cast<test_data_type>(keys_count * 3));
+        ASSERT_TRUE(isValidRedBlackTree(tree, expected)) << keys_count;
+    }
+
+    std::mt19937 generator{ 1337 };
+    std::set<test_data_type> keys{};
+    while (keys.size() < 100000) {
+        keys.insert(static_cast<test_data_type>(generator()));
+    }
+    const tree_type tree{ std::vector<test_data_type>{ keys.begin(), keys.end() } };
+
+    std::FILE *file = std::tmpfile();
+    ASSERT_NE(file, nullptr);
+    const auto descriptor = snapshot_io::fileDescriptor(file);
+
+    // Two snapshots in one stream, the first one through a small buffer.
+    tree.writeSnapshot(descriptor, 4096);
+    tree_type{}.writeSnapshot(descriptor);
+    snapshot_io::seek(descriptor, 0);
+
+    stats_type::reset();
+    const auto tree_restored = tree_type::readSnapshot(descriptor, 4096);
+    ASSERT_EQ(stats_type::snapshot()[StatsEvent::comparison], 0u);
+    ASSERT_TRUE(isValidRedBlackTree(tree_restored, keys));
+    ASSERT_TRUE(tree_type::readSnapshot(descriptor).isEmpty());
+
+    // Another key type, a damaged key and a truncated stream are rejected.
+    snapshot_io::seek(descriptor, 0);
+    ASSERT_THROW(static_cast<void>(RedBlackTreeLoop<long long>::readSnapshot(descriptor)), std::runtime_error);
+    const uint64_t key_offset = sizeof(SnapshotHeader) + 5000 * sizeof(test_data_type);
+    const test_data_type key_damaged = 12345;
+    snapshot_io::seek(descriptor, key_offset);
+    snapshot_io::writeAll(descriptor, reinterpret_cast<const unsigned char*>(&key_damaged), sizeof(key_damaged));
+    snapshot_io::seek(descriptor, 0);
+    ASSERT_THROW(static_cast<void>(tree_type::readSnapshot(descriptor)), std::runtime_error);
+    snapshot_io::truncate(descriptor, key_offset);
+    snapshot_io::seek(descriptor, 0);
+    ASSERT_THROW(static_cast<void>(tree_type::readSnapshot(descriptor)), std::runtime_error);
+    std::fclose(file);
+    std::cout << "TEST_F(RedBlackTreeLoopTest, BulkBuildSnapshot) end" << std::endl;
+}
@@ -0,0 +1,414 @@
+// Persistent red-black tree: a tree is an immutable version.
+// + insert and deleteValue don't change the tree, they return a new version. The new version copies the nodes on the
+//   path to the key and a constant number of nodes per level to restore the colors, O(log n) new nodes,
+//   and shares every other subtree with the old one.
+// + The functional insert and delete of S. Kahrs ("Red-black trees with types"): insert fixes a red node with a red child
+//   on the way up in balance(), delete fuses the children of the deleted node and restores the black height
+//   on the way up in balanceLeft() and balanceRight().
+// + The nodes never change after construction, so any number of threads may read any versions without locks while
+//   a writer makes new versions from them. Only the reference counts of std::shared_ptr are written, atomically.
+// + A copy of a version is O(1). A node is released with the last version which reaches it, recursively,
+//   but never deeper than the height of the tree.
+#pragma once
+#include <memory>
+#include <utility>
+#include <vector>
+#include "head.h"
+#include "comparators.h"
+#include "stats.h"
+
+template <class DataType>
+struct RedBlackTreeNodePersistent {
+    using value_type = DataType;
+    using node_type = RedBlackTreeNodePersistent<value_type>;
+    using node_type_ptr = std::shared_ptr<const node_type>;
+
+    const value_type key;
+    const node_type_ptr left;
+    const node_type_ptr right;
+    const bool red;
+
+    CONSTEXPR20 RedBlackTreeNodePersistent(bool red, node_type_ptr left, const value_type& key, node_type_ptr right) :
+            key(key),
+            left(std::move(left)),
+            right(std::move(right)),
+            red(red)
+    {
+    }
+};
+
+// Stats: instrumentation policy (stats.h), reports key comparisons, node allocations and rebalance steps.
+template <class DataType, class SizeType = size_t, class Stats = NoStats>
+class RedBlackTreePersistent {
+public:
+    using value_type = DataType;
+    using size_type = SizeType;
+    using node_type = RedBlackTreeNodePersistent<value_type>;
+    using node_type_ptr = std::shared_ptr<const node_type>;
+
+private:
+    static constexpr bool red = true;
+    static constexpr bool black = false;
+
+    node_type_ptr root{};
+    size_type count{ 0 };
+
+    CONSTEXPR20 RedBlackTreePersistent(node_type_ptr root, size_type count) :
+            root{ std::move(root) },
+            count{ count }
+    {
+    }
+
+public:
+    CONSTEXPR20 RedBlackTreePersistent() = default;
+
+    CONSTEXPR20 explicit RedBlackTreePersistent(const std::vector<value_type>& vec) {
+        for (const auto& value : vec) {
+            *this = insert(value);
+        }
+    }
+
+    CONSTEXPR20 explicit RedBlackTreePersistent(const value_type* start, const value_type* end) {
+        for (auto it = start; it != end; it++) {
+            *this = insert(*it);
+        }
+    }
+
+    NODISCARD CONSTEXPR20 bool search(const value_type&& value) const {
+        return searchElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 bool search(const value_type& value) const {
+        return searchElement(value);
+    }
+
+    // The version with the key. The same version if the key is in the tree.
+    NODISCARD CONSTEXPR20 RedBlackTreePersistent insert(const value_type&& value) const {
+        return insertElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 RedBlackTreePersistent insert(const value_type& value) const {
+        return insertElement(value);
+    }
+
+    // The version without the key. The same version if the key is not in the tree.
+    NODISCARD CONSTEXPR20 RedBlackTreePersistent deleteValue(const value_type&& value) const {
+        return deleteElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 RedBlackTreePersistent deleteValue(const value_type& value) const {
+        return deleteElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 size_type size() const {
+        return count;
+    }
+
+    NODISCARD CONSTEXPR20 bool isEmpty() const {
+        return !root;
+    }
+
+    // The versions which share the root are equal.
+    NODISCARD CONSTEXPR20 const node_type_ptr& getRoot() const {
+        return root;
+    }
+
+    // Visit the keys in ascending order without recursion. The stack holds the path to the current node.
+    template<class Visitor>
+    CONSTEXPR20 void forEachInOrder(Visitor&& visitor) const {
+        std::vector<const node_type*> stack{};
+        const node_type* node_current = root.get();
+
+        while (node_current || !stack.empty()) {
+            // Move down to the leftmost node.
+            while (node_current) {
+                stack.push_back(node_current);
+                node_current = node_current->left.get();
+            }
+
+            node_current = stack.back();
+            stack.pop_back();
+            visitor(node_current->key);
+            node_current = node_current->right.get();
+        }
+    }
+
+    // Check the order of the keys, the colors and the black heights.
+    NODISCARD CONSTEXPR20 bool verifyProperties() const {
+        if (isRed(root)) {
+            return false;
+        }
+
+        bool valid = true;
+        size_type nodes_count = 0;
+        verifyNode(root, valid, nodes_count);
+        return valid && nodes_count == count;
+    }
+
+private:
+    CONSTEXPR20 bool searchElement(const value_type& key) const {
+        const node_type* node_current = root.get();
+        while (node_current) {
+            if (isLess(key, node_current->key)) {
+                node_current = node_current->left.get();
+            } else if (isGreater(key, node_current->key)) {
+                node_current = node_current->right.get();
+            } else {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    NODISCARD CONSTEXPR20 RedBlackTreePersistent insertElement(const value_type& key) const {
+        auto root_new = insertNode(root, key);
+        if (root_new == root) {
+            return *this;
+        }
+
+        return RedBlackTreePersistent{ paint(std::move(root_new), black), static_cast<size_type>(count + 1) };
+    }
+
+    // The new subtree with the key, the same subtree if the key is in it.
+    // The root of the new subtree may be red with a red child, the black parent fixes it in balance().
+    NODISCARD CONSTEXPR20 node_type_ptr insertNode(const node_type_ptr& node, const value_type& key) const {
+        if (!node) {
+            return createNewNode(red, nullptr, key, nullptr);
+        }
+
+        if (isLess(key, node->key)) {
+            // left subtree
+            auto node_left = insertNode(node->left, key);
+            if (node_left == node->left) {
+                return node;
+            }
+
+            return node->red ? createNewNode(red, std::move(node_left), node->key, node->right)
+                             : balance(std::move(node_left), node->key, node->right);
+        }
+
+        if (isGreater(key, node->key)) {
+            // right subtree
+            auto node_right = insertNode(node->right, key);
+            if (node_right == node->right) {
+                return node;
+            }
+
+            return node->red ? createNewNode(red, node->left, node->key, std::move(node_right))
+                             : balance(node->left, node->key, std::move(node_right));
+        }
+
+        // The same key value already exist in tree.
+        return node;
+    }
+
+    // The delete rebuilds the path even when the key is missing, so the key is searched first.
+    NODISCARD CONSTEXPR20 RedBlackTreePersistent deleteElement(const value_type& key) const {
+        if (!searchElement(key)) {
+            return *this;
+        }
+
+        return RedBlackTreePersistent{ paint(deleteNode(root, key), black), static_cast<size_type>(count - 1) };
+    }
+
+    // The subtree without the key. The subtree of a black node loses one black level, which the parent restores
+    // in balanceLeft() or balanceRight(). The subtree of a red node keeps its black height.
+    NODISCARD CONSTEXPR20 node_type_ptr deleteNode(const node_type_ptr& node, const value_type& key) const {
+        if (!node) {
+            return node;
+        }
+
+        if (isLess(key, node->key)) {
+            // left subtree
+            if (isBlack(node->left)) {
+                return balanceLeft(deleteNode(node->left, key), node->key, node->right);
+            }
+
+            return createNewNode(red, deleteNode(node->left, key), node->key, node->right);
+        }
+
+        if (isGreater(key, node->key)) {
+            // right subtree
+            if (isBlack(node->right)) {
+                return balanceRight(node->left, node->key, deleteNode(node->right, key));
+            }
+
+            return createNewNode(red, node->left, node->key, deleteNode(node->right, key));
+        }
+
+        // Node found.
+        return fuse(node->left, node->right);
+    }
+
+    // The new black node over two subtrees of the same black height, one of which may be red with a red child.
+    NODISCARD CONSTEXPR20 node_type_ptr balance(node_type_ptr left, const value_type& key, node_type_ptr right) const {
+        if (isRed(left) && isRed(right)) {
+            Stats::add(StatsEvent::rebalance);
+            return createNewNode(red, paint(std::move(left), black), key, paint(std::move(right), black));
+        }
+
+        if (isRed(left)) {
+            if (isRed(left->left)) {
+                Stats::add(StatsEvent::rebalance);
+                return createNewNode(red, paint(left->left, black), left->key,
+                                     createNewNode(black, left->right, key, std::move(right)));
+            }
+
+            if (isRed(left->right)) {
+                Stats::add(StatsEvent::rebalance);
+                const auto& node_middle = left->right;
+                return createNewNode(red, createNewNode(black, left->left, left->key, node_middle->left), node_middle->key,
+                                     createNewNode(black, node_middle->right, key, std::move(right)));
+            }
+        }
+
+        if (isRed(right)) {
+            if (isRed(right->right)) {
+                Stats::add(StatsEvent::rebalance);
+                return createNewNode(red, createNewNode(black, std::move(left), key, right->left), right->key,
+                                     paint(right->right, black));
+            }
+
+            if (isRed(right->left)) {
+                Stats::add(StatsEvent::rebalance);
+                const auto& node_middle = right->left;
+                return createNewNode(red, createNewNode(black, std::move(left), key, node_middle->left), node_middle->key,
+                                     createNewNode(black, node_middle->right, right->key, right->right));
+            }
+        }
+
+        return createNewNode(black, std::move(left), key, std::move(right));
+    }
+
+    // The new node over a left subtree which lost one black level and a right subtree which didn't.
+    NODISCARD CONSTEXPR20 node_type_ptr balanceLeft(node_type_ptr left, const value_type& key, node_type_ptr right) const {
+        Stats::add(StatsEvent::rebalance);
+        if (isRed(left)) {
+            return createNewNode(red, paint(std::move(left), black), key, std::move(right));
+        }
+
+        if (isBlack(right)) {
+            return balance(std::move(left), key, paint(std::move(right), red));
+        }
+
+        // The right node is red, its left child is black.
+        const auto& node_middle = right->left;
+        return createNewNode(red, createNewNode(black, std::move(left), key, node_middle->left), node_middle->key,
+                             balance(node_middle->right, right->key, paint(right->right, red)));
+    }
+
+    // The mirror of balanceLeft().
+    NODISCARD CONSTEXPR20 node_type_ptr balanceRight(node_type_ptr left, const value_type& key, node_type_ptr right) const {
+        Stats::add(StatsEvent::rebalance);
+        if (isRed(right)) {
+            return createNewNode(red, std::move(left), key, paint(std::move(right), black));
+        }
+
+        if (isBlack(left)) {
+            return balance(paint(std::move(left), red), key, std::move(right));
+        }
+
+        // The left node is red, its right child is black.
+        const auto& node_middle = left->right;
+        return createNewNode(red, balance(paint(left->left, red), left->key, node_middle->left), node_middle->key,
+                             createNewNode(black, node_middle->right, key, std::move(right)));
+    }
+
+    // The subtree of the keys of both subtrees, all the keys of left are less than the keys of right.
+    NODISCARD CONSTEXPR20 node_type_ptr fuse(const node_type_ptr& left, const node_type_ptr& right) const {
+        if (!left) {
+            return right;
+        }
+
+        if (!right) {
+            return left;
+        }
+
+        if (left->red && right->red) {
+            auto node_middle = fuse(left->right, right->left);
+            if (isRed(node_middle)) {
+                return createNewNode(red, createNewNode(red, left->left, left->key, node_middle->left), node_middle->key,
+                                     createNewNode(red, node_middle->right, right->key, right->right));
+            }
+
+            return createNewNode(red, left->left, left->key,
+                                 createNewNode(red, std::move(node_middle), right->key, right->right));
+        }
+
+        if (!left->red && !right->red) {
+            auto node_middle = fuse(left->right, right->left);
+            if (isRed(node_middle)) {
+                return createNewNode(red, createNewNode(black, left->left, left->key, node_middle->left), node_middle->key,
+                                     createNewNode(black, node_middle->right, right->key, right->right));
+            }
+
+            return balanceLeft(left->left, left->key, createNewNode(black, std::move(node_middle), right->key, right->right));
+        }
+
+        if (right->red) {
+            return createNewNode(red, fuse(left, right->left), right->key, right->right);
+        }
+
+        return createNewNode(red, left->left, left->key, fuse(left->right, right));
+    }
+
+    // The node with the color, a new node if the color is different.
+    NODISCARD CONSTEXPR20 node_type_ptr paint(node_type_ptr node, bool color) const {
+        if (!node || node->red == color) {
+            return node;
+        }
+
+        return createNewNode(color, node->left, node->key, node->right);
+    }
+
+    NODISCARD static CONSTEXPR20 bool isRed(const node_type_ptr& node) {
+        return node && node->red;
+    }
+
+    NODISCARD static CONSTEXPR20 bool isBlack(const node_type_ptr& node) {
+        return node && !node->red;
+    }
+
+    NODISCARD CONSTEXPR20 node_type_ptr createNewNode(bool color, node_type_ptr left, const value_type& key, node_type_ptr right) const {
+        Stats::add(StatsEvent::allocation);
+        return std::make_shared<const node_type>(color, std::move(left), key, std::move(right));
+    }
+
+    // Returns the black height of the subtree.
+    CONSTEXPR20 size_t verifyNode(const node_type_ptr& node, bool& valid, size_type& nodes_count) const {
+        if (!node) {
+            return 1;
+        }
+
+        nodes_count++;
+        if (node->red && (isRed(node->left) || isRed(node->right))) {
+            valid = false;
+        }
+
+        if ((node->left && !isLess(node->left->key, node->key)) ||
+            (node->right && !isGreater(node->right->key, node->key))) {
+            valid = false;
+        }
+
+        const auto black_height_left = verifyNode(node->left, valid, nodes_count);
+        const auto black_height_right = verifyNode(node->right, valid, nodes_count);
+        if (black_height_left != black_height_right) {
+            valid = false;
+        }
+
+        return black_height_left + (node->red ? 0 : 1);
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isGreater(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) > comparedKey(value_b);
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isLess(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) < comparedKey(value_b);
+    }
+};
@@ -0,0 +1,235 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+#include "redblacktreepersistent.h"
+
+using test_data_type = int;
+using test_data_count = size_t;
+
+class RedBlackTreePersistentTest : public ::testing::Test {
+protected:
+    RedBlackTreePersistentTest() = default;
+
+    std::vector<test_data_type> array_values {30, 35, 40, 20, 10, 24, 39};
+
+public:
+    class ObjectA {
+    public:
+        CONSTEXPR20 ObjectA() = default;
+
+        CONSTEXPR20 explicit ObjectA(test_data_type value) :
+                value{ value }
+        {
+        }
+
+        NODISCARD CONSTEXPR20 bool operator> (const ObjectA& obj) const {
+            return this->value > obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 bool operator< (const ObjectA& obj) const {
+            return this->value < obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 test_data_type get() const {
+            return value;
+        }
+
+    private:
+        test_data_type value{};
+    };
+};
+
+using object_type = RedBlackTreePersistentTest::ObjectA;
+using store_smart_ptr_type = std::shared_ptr<object_type>;
+
+template<class Tree>
+std::vector<test_data_type> collectKeys(const Tree& tree) {
+    std::vector<test_data_type> keys{};
+    tree.forEachInOrder([&keys](test_data_type key) {
+        keys.push_back(key);
+    });
+
+    return keys;
+}
+
+TEST_F(RedBlackTreePersistentTest, Empty) {
+    std::cout << "TEST_F(RedBlackTreePersistentTest, Empty) start" << std::endl;
+    const RedBlackTreePersistent<test_data_type> tree{};
+    ASSERT_TRUE(tree.isEmpty());
+    ASSERT_EQ(tree.size(), 0u);
+    ASSERT_FALSE(tree.search(10));
+    const auto tree_deleted = tree.deleteValue(10);
+    ASSERT_TRUE(tree_deleted.isEmpty());
+    ASSERT_TRUE(tree_deleted.verifyProperties());
+    std::cout << "TEST_F(RedBlackTreePersistentTest, Empty) end" << std::endl;
+}
+
+TEST_F(RedBlackTreePersistentTest, InsertSearchDelete) {
+    std::cout << "TEST_F(RedBlackTreePersistentTest, InsertSearchDelete) start" << std::endl;
+    const RedBlackTreePersistent<test_data_type> tree{ array_values };
+    ASSERT_EQ(tree.size(), array_values.size());
+    ASSERT_TRUE(tree.verifyProperties());
+    for (const auto value : array_values) {
+        ASSERT_TRUE(tree.search(value));
+    }
+    ASSERT_FALSE(tree.search(25));
+
+    // A new version, the old one doesn't change.
+    const auto tree_inserted = tree.insert(25);
+    ASSERT_TRUE(tree_inserted.search(25));
+    ASSERT_FALSE(tree.search(25));
+    ASSERT_EQ(tree_inserted.size(), tree.size() + 1);
+
+    const auto tree_deleted = tree_inserted.deleteValue(30);
+    ASSERT_FALSE(tree_deleted.search(30));
+    ASSERT_TRUE(tree_inserted.search(30));
+    ASSERT_TRUE(tree_deleted.verifyProperties());
+    ASSERT_TRUE(tree_inserted.verifyProperties());
+    ASSERT_EQ(collectKeys(tree), std::vector<test_data_type>({ 10, 20, 24, 30, 35, 39, 40 }));
+    ASSERT_EQ(collectKeys(tree_deleted), std::vector<test_data_type>({ 10, 20, 24, 25, 35, 39, 40 }));
+
+    // Nothing changes: the same version.
+    ASSERT_EQ(tree.insert(30).getRoot(), tree.getRoot());
+    ASSERT_EQ(tree.deleteValue(31).getRoot(), tree.getRoot());
+    std::cout << "TEST_F(RedBlackTreePersistentTest, InsertSearchDelete) end" << std::endl;
+}
+
+TEST_F(RedBlackTreePersistentTest, RandomVersions) {
+    std::cout << "TEST_F(RedBlackTreePersistentTest, RandomVersions) start" << std::endl;
+    // Every version keeps its keys while the later versions are made from it.
+    std::mt19937 generator{ 1337 };
+    std::vector<RedBlackTreePersistent<test_data_type>> versions{ RedBlackTreePersistent<test_data_type>{} };
+    std::vector<std::set<test_data_type>> expected{ {} };
+
+    for (test_data_count index = 0; index < 20000; index++) {
+        // Mostly from the last version, sometimes from an old one.
+        const auto base = generator() % 8 == 0 ? generator() % versions.size() : versions.size() - 1;
+        const auto value = static_cast<test_data_type>(generator() % 2000);
+        auto keys = expected[base];
+        if (generator() % 3 != 0) {
+            versions.push_back(versions[base].insert(value));
+            keys.insert(value);
+        } else {
+            versions.push_back(versions[base].deleteValue(value));
+            keys.erase(value);
+        }
+        expected.push_back(std::move(keys));
+
+        if (index % 1000 == 0) {
+            ASSERT_TRUE(versions.back().verifyProperties()) << index;
+        }
+    }
+
+    for (size_t index = 0; index < versions.size(); index += 97) {
+        ASSERT_TRUE(versions[index].verifyProperties()) << index;
+        ASSERT_EQ(versions[index].size(), expected[index].size());
+        ASSERT_EQ(collectKeys(versions[index]), std::vector<test_data_type>(expected[index].begin(), expected[index].end()));
+    }
+    std::cout << "TEST_F(RedBlackTreePersistentTest, RandomVersions) end" << std::endl;
+}
+
+TEST_F(RedBlackTreePersistentTest, PathCopying) {
+    std::cout << "TEST_F(RedBlackTreePersistentTest, PathCopying) start" << std::endl;
+    using stats_type = CountingStats<struct RedBlackTreePersistentTestStatsTag>;
+    using tree_type = RedBlackTreePersistent<test_data_type, size_t, stats_type>;
+    tree_type tree{};
+    const test_data_type keys_count = 4095;
+    for (test_data_type key = 0; key < keys_count; key++) {
+        tree = tree.insert(key * 2);
+    }
+
+    // An update allocates O(log n) nodes: about the height of the tree.
+    stats_type::reset();
+    const auto tree_inserted = tree.insert(1);
+    ASSERT_LE(stats_type::snapshot()[StatsEvent::allocation], 32u);
+    ASSERT_NE(tree_inserted.getRoot(), tree.getRoot());
+    // The key is in the left half: the right subtree of the root is shared.
+    ASSERT_EQ(tree_inserted.getRoot()->right, tree.getRoot()->right);
+
+    stats_type::reset();
+    const auto tree_deleted = tree.deleteValue(keys_count + 1);
+    ASSERT_LE(stats_type::snapshot()[StatsEvent::allocation], 32u);
+    ASSERT_FALSE(tree_deleted.search(keys_count + 1));
+    ASSERT_TRUE(tree_deleted.verifyProperties());
+
+    // The nodes of a dropped version go, the subtrees shared with the other versions stay.
+    const std::weak_ptr<const tree_type::node_type> root_weak = tree.getRoot();
+    const std::weak_ptr<const tree_type::node_type> right_weak = tree.getRoot()->right;
+    tree = tree_type{};
+    ASSERT_TRUE(root_weak.expired());
+    ASSERT_FALSE(right_weak.expired());
+    ASSERT_TRUE(tree_inserted.search(keys_count + 1));
+    ASSERT_TRUE(tree_inserted.verifyProperties());
+    std::cout << "TEST_F(RedBlackTreePersistentTest, PathCopying) end" << std::endl;
+}
+
+TEST_F(RedBlackTreePersistentTest, ConcurrentReaders) {
+    std::cout << "TEST_F(RedBlackTreePersistentTest, ConcurrentReaders) start" << std::endl;
+    // The readers walk an old version while the writer makes new versions from it, no locks.
+    const RedBlackTreePersistent<test_data_type> tree_base{ [] {
+        std::vector<test_data_type> values{};
+        for (test_data_type value = 0; value < 4000; value += 2) {
+            values.push_back(value);
+        }
+        return values;
+    }() };
+
+    std::atomic<bool> done{ false };
+    std::vector<std::thread> readers{};
+    std::vector<size_t> errors(4, 0);
+    for (size_t reader = 0; reader < errors.size(); reader++) {
+        readers.emplace_back([&tree_base, &done, &errors, reader]() {
+            do {
+                for (test_data_type value = 0; value < 4000; value++) {
+                    if (tree_base.search(value) != (value % 2 == 0)) {
+                        errors[reader]++;
+                    }
+                }
+            } while (!done.load());
+        });
+    }
+
+    auto tree = tree_base;
+    for (test_data_type value = 0; value < 4000; value++) {
+        tree = value % 2 == 0 ? tree.deleteValue(value) : tree.insert(value);
+    }
+    done.store(true);
+
+    for (auto& thread : readers) {
+        thread.join();
+    }
+
+    for (const auto reader_errors : errors) {
+        ASSERT_EQ(reader_errors, 0u);
+    }
+    ASSERT_TRUE(tree.verifyProperties());
+    ASSERT_EQ(tree.size(), 2000u);
+    ASSERT_TRUE(tree.search(1));
+    ASSERT_FALSE(tree.search(0));
+    std::cout << "TEST_F(RedBlackTreePersistentTest, ConcurrentReaders) end" << std::endl;
+}
+
+TEST_F(RedBlackTreePersistentTest, Pointers) {
+    std::cout << "TEST_F(RedBlackTreePersistentTest, Pointers) start" << std::endl;
+    RedBlackTreePersistent<store_smart_ptr_type> tree{};
+    for (const auto value : array_values) {
+        tree = tree.insert(std::make_shared<object_type>(value));
+    }
+
+    const auto tree_deleted = tree.deleteValue(std::make_shared<object_type>(24));
+    ASSERT_TRUE(tree.search(std::make_shared<object_type>(24)));
+    ASSERT_FALSE(tree_deleted.search(std::make_shared<object_type>(24)));
+    ASSERT_TRUE(tree_deleted.verifyProperties());
+
+    test_data_type prev_value = 0;
+    tree_deleted.forEachInOrder([&prev_value](const store_smart_ptr_type& key) {
+        ASSERT_LT(prev_value, key->get());
+        prev_value = key->get();
+    });
+    std::cout << "TEST_F(RedBlackTreePersistentTest, Pointers) end" << std::endl;
+}
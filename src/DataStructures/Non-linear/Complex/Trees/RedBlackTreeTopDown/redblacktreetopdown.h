@@ -0,0 +1,412 @@
+// Red-black tree rebalanced top-down in a single pass.
+// + Insert splits the 4-nodes (both children red) on the way down, delete pushes a red node down in front of it,
+//   so neither of them walks back up: there are no parent links and no path stack.
+// + Every step touches only the window of the last four nodes (great-grandparent, grandparent, parent, current),
+//   which is what hand-over-hand locking needs.
+// + The nodes live in an IndexPool and are linked by SizeType indices. The color is the top bit of the left link.
+// + A head node above the root (index 1) makes the root an ordinary child, so the root needs no special case.
+#pragma once
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "head.h"
+#include "comparators.h"
+#include "index_pool.h"
+#include "stats.h"
+
+template <class DataType, class SizeType = uint32_t>
+struct RedBlackTreeNodeTopDown {
+    using value_type = DataType;
+    using size_type = SizeType;
+
+    static constexpr size_type red_bit = static_cast<size_type>(size_type{ 1 } << (std::numeric_limits<size_type>::digits - 1));
+    static constexpr size_type index_mask = static_cast<size_type>(~red_bit);
+
+    value_type key{};
+    // Children by direction: 0 is left, 1 is right. The top bit of the left link is set for a red node.
+    std::array<size_type, 2> link{};
+
+    CONSTEXPR20 RedBlackTreeNodeTopDown() = default;
+    // A new node is red.
+    CONSTEXPR20 explicit RedBlackTreeNodeTopDown(const value_type& key) : key(key), link{ red_bit, 0 } {}
+
+    NODISCARD CONSTEXPR20 size_type getChild(size_t direction) const {
+        return static_cast<size_type>(link[direction] & index_mask);
+    }
+
+    CONSTEXPR20 void setChild(size_t direction, size_type index) {
+        link[direction] = static_cast<size_type>((link[direction] & red_bit) | index);
+    }
+
+    NODISCARD CONSTEXPR20 bool isRed() const {
+        return (link[0] & red_bit) != 0;
+    }
+
+    CONSTEXPR20 void setRed(bool red) {
+        link[0] = static_cast<size_type>(red ? (link[0] | red_bit) : (link[0] & index_mask));
+    }
+};
+
+// Stats: instrumentation policy (stats.h), reports key comparisons, node allocations, rotations and rebalance steps.
+template <class DataType, class SizeType = uint32_t, class Stats = NoStats>
+class RedBlackTreeTopDown {
+private:
+    using value_type = DataType;
+    using const_reference = const DataType &;
+    using size_type = SizeType;
+    using node_type = RedBlackTreeNodeTopDown<value_type, size_type>;
+    using pool_type = IndexPool<node_type, size_type>;
+
+    static constexpr size_type null_index = 0;
+    static constexpr size_t left = 0;
+    static constexpr size_t right = 1;
+    // The tree is the right child of the head.
+    static constexpr size_type head = 1;
+
+    pool_type pool{ node_type::index_mask };
+
+public:
+    CONSTEXPR20 RedBlackTreeTopDown() {
+        static_cast<void>(pool.create());
+    }
+
+    CONSTEXPR20 explicit RedBlackTreeTopDown(const std::vector<value_type> &vec) :
+            RedBlackTreeTopDown()
+    {
+        pool.reserve(vec.size() + 1);
+        for (const auto& value : vec) {
+            insert(value);
+        }
+    }
+
+    CONSTEXPR20 explicit RedBlackTreeTopDown(const value_type *start, const value_type *end) :
+            RedBlackTreeTopDown()
+    {
+        pool.reserve(static_cast<size_t>(end - start) + 1);
+        for (auto it = start; it != end; it++) {
+            insert(*it);
+        }
+    }
+
+    CONSTEXPR20 ~RedBlackTreeTopDown() = default;
+
+    NODISCARD CONSTEXPR20 bool search(const value_type &&value) const {
+        return searchElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 bool search(const value_type &value) const {
+        return searchElement(value);
+    }
+
+    // Throws std::length_error when SizeType can't index more nodes.
+    CONSTEXPR20 void insert(const value_type &&value) {
+        insertElement(value);
+    }
+
+    CONSTEXPR20 void insert(const value_type &value) {
+        insertElement(value);
+    }
+
+    CONSTEXPR20 void deleteValue(const value_type &&value) {
+        deleteElement(value);
+    }
+
+    CONSTEXPR20 void deleteValue(const value_type &value) {
+        deleteElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 size_t size() const {
+        // Without the head.
+        return pool.size() - 1;
+    }
+
+    NODISCARD CONSTEXPR20 bool isEmpty() const {
+        return getRoot() == null_index;
+    }
+
+    CONSTEXPR20 void reserve(size_t count) {
+        pool.reserve(count + 1);
+    }
+
+    // Bytes held by the nodes.
+    NODISCARD CONSTEXPR20 size_t memoryUsage() const {
+        return pool.memoryUsage();
+    }
+
+    // Visit the keys in ascending order. The stack holds the path to the current node.
+    template<class Visitor>
+    CONSTEXPR20 void forEachInOrder(Visitor&& visitor) const {
+        std::array<size_type, 2 * std::numeric_limits<size_type>::digits> stack{};
+        size_t depth = 0;
+        auto node_current = getRoot();
+
+        while (node_current != null_index || depth != 0) {
+            // Move down to the leftmost node.
+            while (node_current != null_index) {
+                stack[depth++] = node_current;
+                node_current = pool[node_current].getChild(left);
+            }
+
+            node_current = stack[--depth];
+            visitor(pool[node_current].key);
+            node_current = pool[node_current].getChild(right);
+        }
+    }
+
+    // Check the order of the keys, the colors and the black heights.
+    NODISCARD CONSTEXPR20 bool verifyProperties() const {
+        const auto root = getRoot();
+        if (pool[root].isRed()) {
+            return false;
+        }
+
+        bool valid = true;
+        size_t count = 0;
+        verifyNode(root, valid, count);
+        return valid && count == size();
+    }
+
+private:
+    NODISCARD CONSTEXPR20 size_type getRoot() const {
+        return pool[head].getChild(right);
+    }
+
+    CONSTEXPR20 bool searchElement(const value_type &key) const {
+        auto node_current = getRoot();
+        while (node_current != null_index) {
+            const auto& node = pool[node_current];
+            if (isLess(key, node.key)) {
+                node_current = node.getChild(left);
+            } else if (isGreater(key, node.key)) {
+                node_current = node.getChild(right);
+            } else {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    CONSTEXPR20 void insertElement(const value_type &key) {
+        if (getRoot() == null_index) {
+            const auto node_new = createNewNode(key);
+            pool[head].setChild(right, node_new);
+            pool[node_new].setRed(false);
+            return;
+        }
+
+        // The window moving down: great-grandparent, grandparent, parent and current node.
+        size_type node_great_grandparent = head;
+        size_type node_grandparent = null_index;
+        size_type node_parent = null_index;
+        size_type node_current = getRoot();
+        size_t direction = left;
+        size_t direction_last = left;
+
+        while (true) {
+            if (node_current == null_index) {
+                // Insert the new red node at the bottom. The splits above may have left the root red.
+                try {
+                    node_current = createNewNode(key);
+                } catch (...) {
+                    pool[getRoot()].setRed(false);
+                    throw;
+                }
+                pool[node_parent].setChild(direction, node_current);
+            } else if (isRed(pool[node_current].getChild(left)) && isRed(pool[node_current].getChild(right))) {
+                // Split the 4-node: the node becomes red, its children black.
+                Stats::add(StatsEvent::rebalance);
+                pool[node_current].setRed(true);
+                pool[pool[node_current].getChild(left)].setRed(false);
+                pool[pool[node_current].getChild(right)].setRed(false);
+            }
+
+            // The new or the recolored node may have a red parent: rotate at the grandparent.
+            if (isRed(node_current) && isRed(node_parent)) {
+                Stats::add(StatsEvent::rebalance);
+                const size_t direction_grandparent = pool[node_great_grandparent].getChild(right) == node_grandparent ? right : left;
+                const auto node_top = node_current == pool[node_parent].getChild(direction_last)
+                        ? rotateSingle(node_grandparent, 1 - direction_last)
+                        : rotateDouble(node_grandparent, 1 - direction_last);
+                pool[node_great_grandparent].setChild(direction_grandparent, node_top);
+            }
+
+            // Compare with the key of the current node, it is also the stop for the inserted node.
+            const bool go_right = isLess(pool[node_current].key, key);
+            if (!go_right && !isLess(key, pool[node_current].key)) {
+                break;
+            }
+
+            direction_last = direction;
+            direction = go_right ? right : left;
+            if (node_grandparent != null_index) {
+                node_great_grandparent = node_grandparent;
+            }
+
+            node_grandparent = node_parent;
+            node_parent = node_current;
+            node_current = pool[node_current].getChild(direction);
+        }
+
+        pool[getRoot()].setRed(false);
+    }
+
+    CONSTEXPR20 void deleteElement(const value_type &key) {
+        if (getRoot() == null_index) {
+            return;
+        }
+
+        // The window moving down: grandparent, parent and current node. The current node is kept red or with a red child,
+        // so the bottom node can be removed without a fixup.
+        size_type node_grandparent = null_index;
+        size_type node_parent = null_index;
+        size_type node_current = head;
+        size_type node_found = null_index;
+        size_t direction = right;
+
+        while (pool[node_current].getChild(direction) != null_index) {
+            const auto direction_last = direction;
+
+            node_grandparent = node_parent;
+            node_parent = node_current;
+            node_current = pool[node_current].getChild(direction);
+
+            const bool go_right = isLess(pool[node_current].key, key);
+            direction = go_right ? right : left;
+            if (!go_right && !isLess(key, pool[node_current].key)) {
+                node_found = node_current;
+            }
+
+            // Push the red node down.
+            if (isRed(node_current) || isRed(pool[node_current].getChild(direction))) {
+                continue;
+            }
+
+            Stats::add(StatsEvent::rebalance);
+            if (isRed(pool[node_current].getChild(1 - direction))) {
+                // The red child of the other side goes up, the current node becomes red.
+                const auto node_top = rotateSingle(node_current, direction);
+                pool[node_parent].setChild(direction_last, node_top);
+                node_parent = node_top;
+                continue;
+            }
+
+            const auto node_sibling = pool[node_parent].getChild(1 - direction_last);
+            if (node_sibling == null_index) {
+                continue;
+            }
+
+            if (!isRed(pool[node_sibling].getChild(left)) && !isRed(pool[node_sibling].getChild(right))) {
+                // Merge into a 4-node.
+                pool[node_parent].setRed(false);
+                pool[node_sibling].setRed(true);
+                pool[node_current].setRed(true);
+                continue;
+            }
+
+            // Borrow from the sibling.
+            const size_t direction_parent = pool[node_grandparent].getChild(right) == node_parent ? right : left;
+            const auto node_top = isRed(pool[node_sibling].getChild(direction_last))
+                    ? rotateDouble(node_parent, direction_last)
+                    : rotateSingle(node_parent, direction_last);
+            pool[node_grandparent].setChild(direction_parent, node_top);
+
+            pool[node_current].setRed(true);
+            pool[node_top].setRed(true);
+            pool[pool[node_top].getChild(left)].setRed(false);
+            pool[pool[node_top].getChild(right)].setRed(false);
+        }
+
+        if (node_found != null_index) {
+            // The bottom node holds the successor (or the key itself): move its key up and unlink it.
+            if (node_found != node_current) {
+                pool[node_found].key = std::move(pool[node_current].key);
+            }
+
+            const size_t direction_current = pool[node_parent].getChild(right) == node_current ? right : left;
+            const auto node_child = pool[node_current].getChild(left) == null_index
+                    ? pool[node_current].getChild(right)
+                    : pool[node_current].getChild(left);
+            pool[node_parent].setChild(direction_current, node_child);
+            deleteNode(node_current);
+        }
+
+        const auto root = getRoot();
+        if (root != null_index) {
+            pool[root].setRed(false);
+        }
+    }
+
+    // Rotate node to the direction. The node becomes red, the new top black. Returns the new top of the subtree.
+    CONSTEXPR20 size_type rotateSingle(size_type node, size_t direction) {
+        Stats::add(StatsEvent::rotation);
+        const auto node_top = pool[node].getChild(1 - direction);
+        pool[node].setChild(1 - direction, pool[node_top].getChild(direction));
+        pool[node_top].setChild(direction, node);
+        pool[node].setRed(true);
+        pool[node_top].setRed(false);
+        return node_top;
+    }
+
+    CONSTEXPR20 size_type rotateDouble(size_type node, size_t direction) {
+        pool[node].setChild(1 - direction, rotateSingle(pool[node].getChild(1 - direction), 1 - direction));
+        return rotateSingle(node, direction);
+    }
+
+    // The null node is black.
+    NODISCARD CONSTEXPR20 bool isRed(size_type node) const {
+        return pool[node].isRed();
+    }
+
+    NODISCARD CONSTEXPR20 size_type createNewNode(const value_type& key) {
+        Stats::add(StatsEvent::allocation);
+        return pool.create(key);
+    }
+
+    CONSTEXPR20 void deleteNode(size_type node) {
+        pool.destroy(node);
+    }
+
+    // Returns the black height of the subtree.
+    CONSTEXPR20 size_t verifyNode(size_type node, bool &valid, size_t &count) const {
+        if (node == null_index) {
+            return 1;
+        }
+
+        count++;
+        const auto& node_ref = pool[node];
+        const auto node_left = node_ref.getChild(left);
+        const auto node_right = node_ref.getChild(right);
+        if (node_ref.isRed() && (isRed(node_left) || isRed(node_right))) {
+            valid = false;
+        }
+
+        if ((node_left != null_index && !isLess(pool[node_left].key, node_ref.key)) ||
+            (node_right != null_index && !isGreater(pool[node_right].key, node_ref.key))) {
+            valid = false;
+        }
+
+        const auto black_height_left = verifyNode(node_left, valid, count);
+        const auto black_height_right = verifyNode(node_right, valid, count);
+        if (black_height_left != black_height_right) {
+            valid = false;
+        }
+
+        return black_height_left + (node_ref.isRed() ? 0 : 1);
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isGreater(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) > comparedKey(value_b);
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isLess(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) < comparedKey(value_b);
+    }
+};
@@ -0,0 +1,215 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <vector>
+#include "redblacktreetopdown.h"
+
+using test_data_type = int;
+using test_data_count = size_t;
+
+class RedBlackTreeTopDownTest : public ::testing::Test {
+protected:
+    RedBlackTreeTopDownTest() = default;
+
+    std::vector<test_data_type> array_values {30, 35, 40, 20, 10, 24, 39};
+
+public:
+    class ObjectA {
+    public:
+        CONSTEXPR20 ObjectA() = default;
+
+        CONSTEXPR20 explicit ObjectA(test_data_type value) :
+                value{ value }
+        {
+        }
+
+        NODISCARD CONSTEXPR20 bool operator> (const ObjectA& obj) const {
+            return this->value > obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 bool operator< (const ObjectA& obj) const {
+            return this->value < obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 test_data_type get() const {
+            return value;
+        }
+
+    private:
+        test_data_type value{};
+    };
+};
+
+using object_type = RedBlackTreeTopDownTest::ObjectA;
+using store_smart_ptr_type = std::shared_ptr<object_type>;
+
+template<class Tree>
+std::vector<test_data_type> collectKeys(const Tree& tree) {
+    std::vector<test_data_type> keys{};
+    tree.forEachInOrder([&keys](test_data_type key) {
+        keys.push_back(key);
+    });
+
+    return keys;
+}
+
+TEST_F(RedBlackTreeTopDownTest, Empty) {
+    std::cout << "TEST_F(RedBlackTreeTopDownTest, Empty) start" << std::endl;
+    RedBlackTreeTopDown<test_data_type> tree{};
+    ASSERT_TRUE(tree.isEmpty());
+    ASSERT_EQ(tree.size(), 0u);
+    ASSERT_FALSE(tree.search(10));
+    tree.deleteValue(10);
+    ASSERT_TRUE(tree.verifyProperties());
+    std::cout << "TEST_F(RedBlackTreeTopDownTest, Empty) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeTopDownTest, InsertSearch) {
+    std::cout << "TEST_F(RedBlackTreeTopDownTest, InsertSearch) start" << std::endl;
+    RedBlackTreeTopDown<test_data_type> tree{ array_values };
+    ASSERT_EQ(tree.size(), array_values.size());
+    ASSERT_TRUE(tree.verifyProperties());
+
+    for (const auto value : array_values) {
+        ASSERT_TRUE(tree.search(value));
+    }
+    ASSERT_FALSE(tree.search(0));
+    ASSERT_FALSE(tree.search(25));
+
+    // Duplicates are ignored.
+    tree.insert(30);
+    ASSERT_EQ(tree.size(), array_values.size());
+
+    auto sorted = array_values;
+    std::sort(sorted.begin(), sorted.end());
+    ASSERT_EQ(collectKeys(tree), sorted);
+    std::cout << "TEST_F(RedBlackTreeTopDownTest, InsertSearch) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeTopDownTest, RandomInsertDelete) {
+    std::cout << "TEST_F(RedBlackTreeTopDownTest, RandomInsertDelete) start" << std::endl;
+    std::mt19937 generator{ 1337 };
+    RedBlackTreeTopDown<test_data_type> tree{};
+    std::set<test_data_type> expected{};
+
+    for (test_data_count index = 0; index < 20000; index++) {
+        const auto value = static_cast<test_data_type>(generator() % 4000);
+        if (generator() % 3 != 0) {
+            tree.insert(value);
+            expected.insert(value);
+        } else {
+            tree.deleteValue(value);
+            expected.erase(value);
+        }
+
+        if (index % 1000 == 0) {
+            ASSERT_TRUE(tree.verifyProperties()) << index;
+        }
+    }
+
+    ASSERT_TRUE(tree.verifyProperties());
+    ASSERT_EQ(tree.size(), expected.size());
+    ASSERT_EQ(collectKeys(tree), std::vector<test_data_type>(expected.begin(), expected.end()));
+
+    // Delete everything: the freed indices are reused by the next inserts.
+    for (const auto value : expected) {
+        tree.deleteValue(value);
+    }
+    ASSERT_TRUE(tree.isEmpty());
+    const auto memory_usage = tree.memoryUsage();
+    for (test_data_type value = 0; value < 1000; value++) {
+        tree.insert(value);
+    }
+    ASSERT_TRUE(tree.verifyProperties());
+    ASSERT_EQ(tree.memoryUsage(), memory_usage);
+    std::cout << "TEST_F(RedBlackTreeTopDownTest, RandomInsertDelete) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeTopDownTest, Pointers) {
+    std::cout << "TEST_F(RedBlackTreeTopDownTest, Pointers) start" << std::endl;
+    RedBlackTreeTopDown<store_smart_ptr_type> tree{};
+    for (const auto value : array_values) {
+        tree.insert(std::make_shared<object_type>(value));
+    }
+
+    ASSERT_TRUE(tree.search(std::make_shared<object_type>(24)));
+    tree.deleteValue(std::make_shared<object_type>(24));
+    ASSERT_FALSE(tree.search(std::make_shared<object_type>(24)));
+    ASSERT_TRUE(tree.verifyProperties());
+
+    test_data_type prev_value = 0;
+    tree.forEachInOrder([&prev_value](const store_smart_ptr_type& key) {
+        ASSERT_LT(prev_value, key->get());
+        prev_value = key->get();
+    });
+    std::cout << "TEST_F(RedBlackTreeTopDownTest, Pointers) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeTopDownTest, Sequential) {
+    std::cout << "TEST_F(RedBlackTreeTopDownTest, Sequential) start" << std::endl;
+    // Sorted input makes every insert split and rotate, and every delete push the red node down the same side.
+    RedBlackTreeTopDown<test_data_type> tree{};
+    for (test_data_type value = 0; value < 512; value++) {
+        tree.insert(value);
+        ASSERT_TRUE(tree.verifyProperties()) << value;
+    }
+    for (test_data_type value = 1023; value >= 512; value--) {
+        tree.insert(value);
+        ASSERT_TRUE(tree.verifyProperties()) << value;
+    }
+    ASSERT_EQ(tree.size(), 1024u);
+
+    for (test_data_type value = 0; value < 1024; value += 2) {
+        tree.deleteValue(value);
+        ASSERT_TRUE(tree.verifyProperties()) << value;
+    }
+    for (test_data_type value = 1023; value > 0; value -= 2) {
+        ASSERT_TRUE(tree.search(value));
+        tree.deleteValue(value);
+        ASSERT_FALSE(tree.search(value));
+        ASSERT_TRUE(tree.verifyProperties()) << value;
+    }
+    ASSERT_TRUE(tree.isEmpty());
+    std::cout << "TEST_F(RedBlackTreeTopDownTest, Sequential) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeTopDownTest, IndexLimit) {
+    std::cout << "TEST_F(RedBlackTreeTopDownTest, IndexLimit) start" << std::endl;
+    // 8-bit links leave 127 indices, the head takes one of them.
+    RedBlackTreeTopDown<test_data_type, uint8_t> tree{};
+    for (test_data_type value = 0; value < 126; value++) {
+        tree.insert(value);
+    }
+    ASSERT_TRUE(tree.verifyProperties());
+    ASSERT_THROW(tree.insert(126), std::length_error);
+
+    // A freed index can be used again.
+    tree.deleteValue(0);
+    tree.insert(126);
+    ASSERT_TRUE(tree.search(126));
+    ASSERT_TRUE(tree.verifyProperties());
+    std::cout << "TEST_F(RedBlackTreeTopDownTest, IndexLimit) end" << std::endl;
+}
+
+TEST_F(RedBlackTreeTopDownTest, Stats) {
+    std::cout << "TEST_F(RedBlackTreeTopDownTest, Stats) start" << std::endl;
+    using stats_type = CountingStats<struct RedBlackTreeTopDownStatsTag>;
+    RedBlackTreeTopDown<test_data_type, uint32_t, stats_type> tree{};
+    const test_data_type keys_count = 127;
+
+    stats_type::reset();
+    for (test_data_type key = 0; key < keys_count; key++) {
+        tree.insert(key);
+    }
+
+    const auto stats = stats_type::snapshot();
+    ASSERT_EQ(stats[StatsEvent::allocation], static_cast<uint64_t>(keys_count));
+    ASSERT_NE(stats[StatsEvent::comparison], 0u);
+    ASSERT_NE(stats[StatsEvent::rotation], 0u);
+    ASSERT_NE(stats[StatsEvent::rebalance], 0u);
+    std::cout << "TEST_F(RedBlackTreeTopDownTest, Stats) end" << std::endl;
+}
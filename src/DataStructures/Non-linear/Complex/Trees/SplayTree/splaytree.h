@@ -0,0 +1,445 @@
+// Splay tree with top-down splaying (Sleator and Tarjan).
+// + Every access moves the node to the root: hot keys stay near the top, a skewed stream of lookups pays for
+//   the depth of its working set instead of log2(n). All operations are amortized O(log n).
+// + The splay runs top-down in one pass without recursion, parent links or a path stack: the nodes left of the search
+//   path and right of it are collected in two trees and joined under the found node at the end.
+// + search() restructures the tree, so it is not const and a tree can't be read by several threads.
+//   setSearchSplayPeriod(k) splays only every k-th search, the other searches are read-only descents.
+// + Nodes are allocated from a NodePool.
+#pragma once
+#include <iostream>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "head.h"
+#include "comparators.h"
+#include "node_pool.h"
+#include "stats.h"
+
+template <class DataType, class SizeType = size_t>
+struct SplayTreeNode {
+    using value_type = DataType;
+    using size_type = SizeType;
+    using node_type = SplayTreeNode<value_type, size_type>;
+
+    value_type key{};
+    node_type* left{};
+    node_type* right{};
+
+    CONSTEXPR20 SplayTreeNode() = default;
+    CONSTEXPR20 explicit SplayTreeNode(const value_type& key) : key(key) {}
+
+    CONSTEXPR20 ~SplayTreeNode() = default;
+};
+
+// Stats: instrumentation policy (stats.h), reports key comparisons, node allocations and rotations.
+template <class DataType, class SizeType = size_t, class Stats = NoStats>
+class SplayTree {
+private:
+    using value_type = DataType;
+    using const_reference = const DataType &;
+    using size_type = SizeType;
+    using node_type = SplayTreeNode<value_type, size_type>;
+    using pool_type = NodePool<node_type>;
+
+    node_type* root{};
+    pool_type pool{};
+    // Splay on every search_splay_period-th search.
+    size_type search_splay_period{ 1 };
+    size_type searches_until_splay{ 1 };
+
+public:
+    CONSTEXPR20 SplayTree() = default;
+
+    CONSTEXPR20 explicit SplayTree(const std::vector<value_type> &vec) {
+        for (const auto& value : vec) {
+            insert(value);
+        }
+    }
+
+    CONSTEXPR20 explicit SplayTree(const value_type *start, const value_type *end) {
+        for (auto it = start; it != end; it++) {
+            insert(*it);
+        }
+    }
+
+    SplayTree(const SplayTree&) = delete;
+    SplayTree& operator=(const SplayTree&) = delete;
+
+    SplayTree(SplayTree&& other) noexcept :
+            root{ other.root },
+            pool{ std::move(other.pool) },
+            search_splay_period{ other.search_splay_period },
+            searches_until_splay{ other.searches_until_splay }
+    {
+        other.root = nullptr;
+    }
+
+    SplayTree& operator=(SplayTree&& other) noexcept {
+        if (this != &other) {
+            clear();
+            root = other.root;
+            pool = std::move(other.pool);
+            search_splay_period = other.search_splay_period;
+            searches_until_splay = other.searches_until_splay;
+            other.root = nullptr;
+        }
+
+        return *this;
+    }
+
+    ~SplayTree() {
+        clear();
+    }
+
+    NODISCARD CONSTEXPR20 bool search(const value_type &&value) {
+        return searchElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 bool search(const value_type &value) {
+        return searchElement(value);
+    }
+
+    CONSTEXPR20 void insert(const value_type &&value) {
+        insertElement(value);
+    }
+
+    CONSTEXPR20 void insert(const value_type &value) {
+        insertElement(value);
+    }
+
+    CONSTEXPR20 void deleteValue(const value_type &&value) {
+        deleteElement(value);
+    }
+
+    CONSTEXPR20 void deleteValue(const value_type &value) {
+        deleteElement(value);
+    }
+
+    // 1 (the default) splays on every search, k splays on every k-th search only. Insert and delete always splay.
+    CONSTEXPR20 void setSearchSplayPeriod(size_type period) {
+        search_splay_period = period != 0 ? period : 1;
+        searches_until_splay = search_splay_period;
+    }
+
+    NODISCARD CONSTEXPR20 size_type getSearchSplayPeriod() const {
+        return search_splay_period;
+    }
+
+    CONSTEXPR20 auto getRoot() const {
+        return static_cast<const node_type*>(root);
+    }
+
+    NODISCARD CONSTEXPR20 size_t size() const {
+        return pool.size();
+    }
+
+    NODISCARD CONSTEXPR20 bool isEmpty() const {
+        return root == nullptr;
+    }
+
+    // Destroy all nodes without recursion: the left children are rotated up until the node can be freed.
+    // The nodes without destructors are not visited, the slabs are freed at once.
+    void clear() {
+        if constexpr (!std::is_trivially_destructible_v<node_type>) {
+            auto node = root;
+            while (node) {
+                if (node->left) {
+                    auto node_left = node->left;
+                    node->left = node_left->right;
+                    node_left->right = node;
+                    node = node_left;
+                } else {
+                    auto node_next = node->right;
+                    pool.destroy(node);
+                    node = node_next;
+                }
+            }
+        }
+
+        root = nullptr;
+        pool.release();
+    }
+
+    // Visit the keys in ascending order without recursion. The stack holds the path to the current node.
+    template<class Visitor>
+    CONSTEXPR20 void forEachInOrder(Visitor&& visitor) const {
+        const node_type* const node_end = nullptr;
+        std::vector<const node_type*> stack{};
+        const node_type* node_current = root;
+
+        while (node_current != node_end || !stack.empty()) {
+            // Move down to the leftmost node.
+            while (node_current != node_end) {
+                stack.push_back(node_current);
+                node_current = node_current->left;
+            }
+
+            node_current = stack.back();
+            stack.pop_back();
+            visitor(node_current->key);
+            node_current = node_current->right;
+        }
+    }
+
+    // Print the tree
+    void printTree(const node_type* node) const {
+        if (node) {
+            std::string indent{};
+            printNodeInfo(node, indent, false);
+        }
+    }
+
+    void printNodeInfo(const node_type* node, std::string indent, bool leftNode) const {
+        std::string output = indent;
+
+        if (leftNode) {
+            output += "L----";
+            indent += "|  ";
+        } else {
+            output += "R----";
+            indent += "   ";
+        }
+
+        std::cout << output << node->key << std::endl;
+
+        if (node->left) {
+            printNodeInfo(node->left, indent, true);
+        }
+
+        if (node->right) {
+            printNodeInfo(node->right, indent, false);
+        }
+    }
+
+    // Compare the keys in pre-order with key_array: checks the shape of the tree.
+    NODISCARD CONSTEXPR20 bool verifyCorrectness(const std::vector<value_type>& key_array) const {
+        size_t index = 0;
+        bool result = true;
+        std::vector<const node_type*> stack{};
+        if (root) {
+            stack.push_back(root);
+        }
+
+        while (!stack.empty() && result) {
+            const auto node = stack.back();
+            stack.pop_back();
+            result = index < key_array.size() && !isLess(node->key, key_array[index]) && !isGreater(node->key, key_array[index]);
+            index++;
+
+            if (node->right) {
+                stack.push_back(node->right);
+            }
+
+            if (node->left) {
+                stack.push_back(node->left);
+            }
+        }
+
+        return result && index == key_array.size();
+    }
+
+    // Check the order of the keys.
+    NODISCARD CONSTEXPR20 bool verifyProperties() const {
+        bool valid = true;
+        size_t count = 0;
+        const value_type* key_prev = nullptr;
+        forEachInOrder([&](const value_type& key) {
+            if (key_prev && !isLess(*key_prev, key)) {
+                valid = false;
+            }
+
+            key_prev = &key;
+            count++;
+        });
+
+        return valid && count == size();
+    }
+
+private:
+    CONSTEXPR20 bool searchElement(const value_type &key) {
+        if (!root) {
+            return false;
+        }
+
+        if (--searches_until_splay != 0) {
+            return searchNode(key);
+        }
+
+        searches_until_splay = search_splay_period;
+        root = splay(root, key);
+        return isEqual(root->key, key);
+    }
+
+    // Plain descent, the tree is not changed.
+    CONSTEXPR20 bool searchNode(const value_type &key) const {
+        auto node_current = root;
+        while (node_current) {
+            if (isLess(key, node_current->key)) {
+                node_current = node_current->left;
+            } else if (isGreater(key, node_current->key)) {
+                node_current = node_current->right;
+            } else {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    CONSTEXPR20 void insertElement(const value_type &key) {
+        if (!root) {
+            root = createNewNode(key);
+            return;
+        }
+
+        // The root becomes the neighbour of the key, the new node goes above it.
+        root = splay(root, key);
+        if (isLess(key, root->key)) {
+            auto node_new = createNewNode(key);
+            node_new->left = root->left;
+            node_new->right = root;
+            root->left = nullptr;
+            root = node_new;
+        } else if (isGreater(key, root->key)) {
+            auto node_new = createNewNode(key);
+            node_new->right = root->right;
+            node_new->left = root;
+            root->right = nullptr;
+            root = node_new;
+        }
+    }
+
+    CONSTEXPR20 void deleteElement(const value_type &key) {
+        if (!root) {
+            return;
+        }
+
+        root = splay(root, key);
+        if (!isEqual(root->key, key)) {
+            return;
+        }
+
+        // Splaying the left subtree for the key brings its maximum up: it has no right child and takes the right subtree.
+        auto node_delete = root;
+        if (!node_delete->left) {
+            root = node_delete->right;
+        } else {
+            root = splay(node_delete->left, key);
+            root->right = node_delete->right;
+        }
+
+        pool.destroy(node_delete);
+    }
+
+    // Top-down splay of the subtree for the key. Returns the new top: the node with the key or the last node on its path.
+    CONSTEXPR20 node_type* splay(node_type* node, const value_type &key) {
+        // The nodes less than the key hang on the rightmost path of the left tree, the greater ones on the leftmost
+        // path of the right tree. The *_last pointers are the ends of these paths.
+        node_type* tree_left = nullptr;
+        node_type* tree_left_last = nullptr;
+        node_type* tree_right = nullptr;
+        node_type* tree_right_last = nullptr;
+        auto node_current = node;
+
+        while (true) {
+            if (isLess(key, node_current->key)) {
+                if (!node_current->left) {
+                    break;
+                }
+
+                if (isLess(key, node_current->left->key)) {
+                    // Zig-zig: rotate right.
+                    node_current = rotateRight(node_current);
+                    if (!node_current->left) {
+                        break;
+                    }
+                }
+
+                // Link right.
+                if (tree_right_last) {
+                    tree_right_last->left = node_current;
+                } else {
+                    tree_right = node_current;
+                }
+                tree_right_last = node_current;
+                node_current = node_current->left;
+            } else if (isGreater(key, node_current->key)) {
+                if (!node_current->right) {
+                    break;
+                }
+
+                if (isGreater(key, node_current->right->key)) {
+                    // Zig-zig: rotate left.
+                    node_current = rotateLeft(node_current);
+                    if (!node_current->right) {
+                        break;
+                    }
+                }
+
+                // Link left.
+                if (tree_left_last) {
+                    tree_left_last->right = node_current;
+                } else {
+                    tree_left = node_current;
+                }
+                tree_left_last = node_current;
+                node_current = node_current->right;
+            } else {
+                break;
+            }
+        }
+
+        // Assemble: the subtrees of the top go to the ends of the side trees, the side trees become its subtrees.
+        if (tree_left_last) {
+            tree_left_last->right = node_current->left;
+            node_current->left = tree_left;
+        }
+
+        if (tree_right_last) {
+            tree_right_last->left = node_current->right;
+            node_current->right = tree_right;
+        }
+
+        return node_current;
+    }
+
+    CONSTEXPR20 node_type* rotateRight(node_type* node) const {
+        Stats::add(StatsEvent::rotation);
+        auto node_top = node->left;
+        node->left = node_top->right;
+        node_top->right = node;
+        return node_top;
+    }
+
+    CONSTEXPR20 node_type* rotateLeft(node_type* node) const {
+        Stats::add(StatsEvent::rotation);
+        auto node_top = node->right;
+        node->right = node_top->left;
+        node_top->left = node;
+        return node_top;
+    }
+
+    CONSTEXPR20 node_type* createNewNode(const value_type& key) {
+        Stats::add(StatsEvent::allocation);
+        return pool.create(key);
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isEqual(const T& value_a, const T& value_b) const {
+        return !isLess(value_a, value_b) && !isGreater(value_a, value_b);
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isGreater(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) > comparedKey(value_b);
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isLess(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) < comparedKey(value_b);
+    }
+};
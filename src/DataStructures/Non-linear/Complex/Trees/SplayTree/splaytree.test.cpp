@@ -0,0 +1,215 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <set>
+#include <vector>
+#include "splaytree.h"
+
+using test_data_type = int;
+using test_data_count = size_t;
+
+class SplayTreeTest : public ::testing::Test {
+protected:
+    SplayTreeTest() = default;
+
+    std::vector<test_data_type> array_values {30, 35, 40, 20, 10, 24, 39};
+
+public:
+    class ObjectA {
+    public:
+        CONSTEXPR20 ObjectA() = default;
+
+        CONSTEXPR20 explicit ObjectA(test_data_type value) :
+                value{ value }
+        {
+        }
+
+        NODISCARD CONSTEXPR20 bool operator> (const ObjectA& obj) const {
+            return this->value > obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 bool operator< (const ObjectA& obj) const {
+            return this->value < obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 test_data_type get() const {
+            return value;
+        }
+
+    private:
+        test_data_type value{};
+    };
+};
+
+using object_type = SplayTreeTest::ObjectA;
+using store_smart_ptr_type = std::shared_ptr<object_type>;
+
+template<class Tree>
+std::vector<test_data_type> collectKeys(const Tree& tree) {
+    std::vector<test_data_type> keys{};
+    tree.forEachInOrder([&keys](test_data_type key) {
+        keys.push_back(key);
+    });
+
+    return keys;
+}
+
+TEST_F(SplayTreeTest, Empty) {
+    std::cout << "TEST_F(SplayTreeTest, Empty) start" << std::endl;
+    SplayTree<test_data_type> tree{};
+    ASSERT_TRUE(tree.isEmpty());
+    ASSERT_EQ(tree.size(), 0u);
+    ASSERT_FALSE(tree.search(10));
+    tree.deleteValue(10);
+    ASSERT_TRUE(tree.verifyProperties());
+    ASSERT_TRUE(tree.verifyCorrectness({}));
+    std::cout << "TEST_F(SplayTreeTest, Empty) end" << std::endl;
+}
+
+TEST_F(SplayTreeTest, InsertSearch) {
+    std::cout << "TEST_F(SplayTreeTest, InsertSearch) start" << std::endl;
+    SplayTree<test_data_type> tree{ array_values };
+    ASSERT_EQ(tree.size(), array_values.size());
+    ASSERT_TRUE(tree.verifyProperties());
+    // The last inserted key is the root.
+    ASSERT_EQ(tree.getRoot()->key, 39);
+
+    for (const auto value : array_values) {
+        ASSERT_TRUE(tree.search(value));
+        // The found key is splayed to the root.
+        ASSERT_EQ(tree.getRoot()->key, value);
+    }
+    ASSERT_FALSE(tree.search(0));
+    ASSERT_FALSE(tree.search(25));
+    ASSERT_TRUE(tree.verifyProperties());
+
+    // Duplicates are ignored.
+    tree.insert(30);
+    ASSERT_EQ(tree.size(), array_values.size());
+
+    auto sorted = array_values;
+    std::sort(sorted.begin(), sorted.end());
+    ASSERT_EQ(collectKeys(tree), sorted);
+    std::cout << "TEST_F(SplayTreeTest, InsertSearch) end" << std::endl;
+}
+
+TEST_F(SplayTreeTest, Shape) {
+    std::cout << "TEST_F(SplayTreeTest, Shape) start" << std::endl;
+    // Ascending inserts build a left path, searching the minimum halves its depth (zig-zig steps).
+    SplayTree<test_data_type> tree{};
+    for (test_data_type value = 1; value <= 7; value++) {
+        tree.insert(value);
+    }
+    ASSERT_TRUE(tree.verifyCorrectness({ 7, 6, 5, 4, 3, 2, 1 }));
+
+    ASSERT_TRUE(tree.search(1));
+    ASSERT_TRUE(tree.verifyCorrectness({ 1, 6, 4, 2, 3, 5, 7 }));
+    std::cout << "TEST_F(SplayTreeTest, Shape) end" << std::endl;
+}
+
+TEST_F(SplayTreeTest, RandomInsertDelete) {
+    std::cout << "TEST_F(SplayTreeTest, RandomInsertDelete) start" << std::endl;
+    std::mt19937 generator{ 1337 };
+    SplayTree<test_data_type> tree{};
+    std::set<test_data_type> expected{};
+
+    for (test_data_count index = 0; index < 20000; index++) {
+        const auto value = static_cast<test_data_type>(generator() % 4000);
+        const auto action = generator() % 3;
+        if (action == 0) {
+            tree.insert(value);
+            expected.insert(value);
+        } else if (action == 1) {
+            tree.deleteValue(value);
+            expected.erase(value);
+        } else {
+            ASSERT_EQ(tree.search(value), expected.count(value) != 0) << index;
+        }
+
+        if (index % 1000 == 0) {
+            ASSERT_TRUE(tree.verifyProperties()) << index;
+        }
+    }
+
+    ASSERT_TRUE(tree.verifyProperties());
+    ASSERT_EQ(tree.size(), expected.size());
+    ASSERT_EQ(collectKeys(tree), std::vector<test_data_type>(expected.begin(), expected.end()));
+
+    for (const auto value : expected) {
+        tree.deleteValue(value);
+    }
+    ASSERT_TRUE(tree.isEmpty());
+    std::cout << "TEST_F(SplayTreeTest, RandomInsertDelete) end" << std::endl;
+}
+
+TEST_F(SplayTreeTest, Pointers) {
+    std::cout << "TEST_F(SplayTreeTest, Pointers) start" << std::endl;
+    SplayTree<store_smart_ptr_type> tree{};
+    for (const auto value : array_values) {
+        tree.insert(std::make_shared<object_type>(value));
+    }
+
+    ASSERT_TRUE(tree.search(std::make_shared<object_type>(24)));
+    tree.deleteValue(std::make_shared<object_type>(24));
+    ASSERT_FALSE(tree.search(std::make_shared<object_type>(24)));
+    ASSERT_TRUE(tree.verifyProperties());
+
+    test_data_type prev_value = 0;
+    tree.forEachInOrder([&prev_value](const store_smart_ptr_type& key) {
+        ASSERT_LT(prev_value, key->get());
+        prev_value = key->get();
+    });
+    std::cout << "TEST_F(SplayTreeTest, Pointers) end" << std::endl;
+}
+
+TEST_F(SplayTreeTest, SearchSplayPeriod) {
+    std::cout << "TEST_F(SplayTreeTest, SearchSplayPeriod) start" << std::endl;
+    SplayTree<test_data_type> tree{ array_values };
+    tree.setSearchSplayPeriod(3);
+    ASSERT_EQ(tree.getSearchSplayPeriod(), 3u);
+
+    // Two read-only searches, the third one splays.
+    ASSERT_TRUE(tree.search(10));
+    ASSERT_EQ(tree.getRoot()->key, 39);
+    ASSERT_TRUE(tree.search(10));
+    ASSERT_EQ(tree.getRoot()->key, 39);
+    ASSERT_TRUE(tree.search(10));
+    ASSERT_EQ(tree.getRoot()->key, 10);
+    ASSERT_FALSE(tree.search(11));
+    ASSERT_EQ(tree.getRoot()->key, 10);
+
+    // Updates always splay.
+    tree.insert(11);
+    ASSERT_EQ(tree.getRoot()->key, 11);
+    ASSERT_TRUE(tree.verifyProperties());
+
+    // 0 is taken as 1.
+    tree.setSearchSplayPeriod(0);
+    ASSERT_TRUE(tree.search(40));
+    ASSERT_EQ(tree.getRoot()->key, 40);
+    std::cout << "TEST_F(SplayTreeTest, SearchSplayPeriod) end" << std::endl;
+}
+
+TEST_F(SplayTreeTest, Stats) {
+    std::cout << "TEST_F(SplayTreeTest, Stats) start" << std::endl;
+    using stats_type = CountingStats<struct SplayTreeStatsTag>;
+    SplayTree<test_data_type, size_t, stats_type> tree{};
+    const test_data_type keys_count = 127;
+
+    stats_type::reset();
+    for (test_data_type key = 0; key < keys_count; key++) {
+        tree.insert(key);
+    }
+
+    // Ascending inserts only link, the search of the minimum rotates along the left path.
+    auto stats = stats_type::snapshot();
+    ASSERT_EQ(stats[StatsEvent::allocation], static_cast<uint64_t>(keys_count));
+    ASSERT_NE(stats[StatsEvent::comparison], 0u);
+    ASSERT_EQ(stats[StatsEvent::rotation], 0u);
+
+    ASSERT_TRUE(tree.search(0));
+    stats = stats_type::snapshot();
+    ASSERT_EQ(stats[StatsEvent::rotation], static_cast<uint64_t>(keys_count / 2));
+    std::cout << "TEST_F(SplayTreeTest, Stats) end" << std::endl;
+}
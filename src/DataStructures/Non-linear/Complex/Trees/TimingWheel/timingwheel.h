@@ -0,0 +1,431 @@
+// TimingWheel: hierarchical timing wheel, a timer queue with O(1) schedule and cancel.
+// + levels_count wheels of slots_count slots, a slot of level l spans slots_count^l ticks. A timer goes to the level
+//   of the highest group of slot_bits bits where its deadline differs from the current time, it moves down a level
+//   when the time reaches its slot: at most levels_count - 1 moves per timer, amortized O(1) expiry.
+// + The timers of a slot are a doubly linked list of IndexPool indices, cancel unlinks a timer in O(1).
+//   Heap as a timer queue cancels by the O(n) search of the element and remove(index).
+// + advance() moves the time in one batch: it jumps over the empty slots with the occupancy bitmaps of the levels.
+// + The deadlines past the span of the wheels (2^wheel_bits ticks) wait in a Heap overflow bucket. They are cancelled
+//   lazily, the bucket is rebuilt when most of it is cancelled, and they move to the wheels when the time comes
+//   within the span.
+// + Handles carry the generation of the pool index: cancel of a fired or cancelled timer is a no-op.
+// + Stats: allocation per scheduled timer, move per timer moved down a level or out of the overflow bucket,
+//   the comparisons of the overflow heap.
+#pragma once
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+#include "head.h"
+#include "comparators.h"
+#include "index_pool.h"
+#include "stats.h"
+#include "heap.h"
+
+template <class DataType, class Stats = NoStats>
+class TimingWheel {
+public:
+    using value_type = DataType;
+    using size_type = size_t;
+    using time_type = uint64_t;
+    using index_type = uint32_t;
+
+    static constexpr size_type slot_bits = 8;
+    static constexpr size_type slots_count = size_type{ 1 } << slot_bits;
+    static constexpr size_type levels_count = 4;
+    static constexpr size_type wheel_bits = slot_bits * levels_count;
+    static constexpr time_type no_event = std::numeric_limits<time_type>::max();
+
+private:
+    struct TimerNode {
+        value_type value{};
+        time_type deadline{};
+        index_type prev{};
+        index_type next{};
+        // The list of the timer: a wheel slot, the due or the expiring list, or the overflow bucket.
+        uint16_t list{};
+
+        TimerNode() = default;
+        explicit TimerNode(const value_type& value) : value(value) {}
+        explicit TimerNode(value_type&& value) : value(std::move(value)) {}
+    };
+
+    struct TimerList {
+        index_type head{};
+        index_type tail{};
+    };
+
+    // The generation tells a cancelled entry, its pool index may hold another timer since.
+    struct OverflowEntry {
+        time_type deadline{};
+        index_type index{};
+        uint32_t generation{};
+
+        NODISCARD bool operator<(const OverflowEntry& other) const {
+            return deadline < other.deadline;
+        }
+    };
+
+    using pool_type = IndexPool<TimerNode, index_type>;
+    using overflow_type = Heap<OverflowEntry, ComparatorLess<OverflowEntry>, Stats>;
+
+    // Lists 0 .. levels_count * slots_count - 1 are the wheel slots, level by level.
+    static constexpr uint16_t due_list = levels_count * slots_count;
+    static constexpr uint16_t expiring_list = due_list + 1;
+    static constexpr uint16_t overflow_list = due_list + 2;
+    static constexpr size_type bitmap_words = slots_count / 64;
+    // The overflow bucket is rebuilt when at least this many and more than half of its entries are cancelled.
+    static constexpr size_type overflow_compact_min = 64;
+
+    pool_type pool{};
+    // The generation of every pool index, bumped when its timer fires or is cancelled.
+    std::vector<uint32_t> generations = std::vector<uint32_t>(1);
+    std::array<TimerList, overflow_list> lists{};
+    std::array<std::array<uint64_t, bitmap_words>, levels_count> occupied{};
+    overflow_type overflow{};
+    size_type overflow_cancelled{};
+    size_type timers_count{};
+    time_type current_time{};
+
+public:
+    // Reference to a scheduled timer. Stays safe to pass to cancel() after the timer fires.
+    class Handle {
+    public:
+        Handle() = default;
+
+        NODISCARD explicit operator bool() const {
+            return index != 0;
+        }
+
+    private:
+        friend class TimingWheel;
+
+        Handle(index_type index, uint32_t generation) : index(index), generation(generation) {}
+
+        index_type index{};
+        uint32_t generation{};
+    };
+
+    explicit TimingWheel(time_type start_time = 0) : current_time{ start_time } {}
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+    TimingWheel(TimingWheel&&) = default;
+    TimingWheel& operator=(TimingWheel&&) = default;
+
+    ~TimingWheel() = default;
+
+    // A deadline not after the current time fires on the next advance().
+    Handle schedule(time_type deadline, value_type&& value) {
+        return scheduleNode(pool.create(std::move(value)), deadline);
+    }
+
+    Handle schedule(time_type deadline, const value_type& value) {
+        return scheduleNode(pool.create(value), deadline);
+    }
+
+    // Returns false for a timer which has fired or was cancelled. O(1), the overflow bucket is rebuilt in
+    // O(n log n) after n / 2 cancels of its timers.
+    bool cancel(Handle handle) {
+        if (!isPending(handle)) {
+            return false;
+        }
+
+        if (pool[handle.index].list == overflow_list) {
+            overflow_cancelled++;
+        } else {
+            unlink(handle.index);
+        }
+        release(handle.index);
+
+        if (overflow_cancelled >= overflow_compact_min && overflow_cancelled * 2 > overflow.size()) {
+            compactOverflow();
+        }
+
+        return true;
+    }
+
+    NODISCARD bool isPending(Handle handle) const {
+        return handle.index != 0 && handle.index < generations.size() && generations[handle.index] == handle.generation;
+    }
+
+    // Move the time forward to `time` and fire the timers due by it: on_expire(deadline, value) tick by tick,
+    // the timers of one tick in no particular order. The empty slots are skipped, so one call may cover any span.
+    // on_expire may schedule and cancel timers: the new ones due by `time` fire in this call, but the ones due by
+    // the tick being fired wait for the next tick fired or the next call. Returns the count of the fired timers.
+    template<class OnExpire>
+    size_type advance(time_type time, OnExpire&& on_expire) {
+        size_type expired = 0;
+        while (true) {
+            expired += expireDue(on_expire);
+            if (current_time >= time) {
+                break;
+            }
+
+            const auto next = nextWheelEvent();
+            if (next > time) {
+                current_time = time;
+                break;
+            }
+
+            current_time = next;
+            cascade();
+        }
+
+        return expired;
+    }
+
+    // A lower bound of the next deadline, no_event for an empty wheel: advance() before it fires nothing.
+    // The sleep time of an event loop.
+    NODISCARD time_type nextEventTime() {
+        if (lists[due_list].head != 0 || lists[expiring_list].head != 0) {
+            return current_time;
+        }
+
+        return nextWheelEvent();
+    }
+
+    NODISCARD time_type now() const {
+        return current_time;
+    }
+
+    NODISCARD size_type size() const {
+        return timers_count;
+    }
+
+    NODISCARD bool isEmpty() const {
+        return timers_count == 0;
+    }
+
+    void reserve(size_type count) {
+        pool.reserve(count);
+        generations.reserve(count + 1);
+    }
+
+private:
+    // The start of the first occupied slot after the current time, the start of the span of the wheels for
+    // the earliest overflow deadline, or no_event.
+    NODISCARD time_type nextWheelEvent() {
+        for (size_type level = 0; level < levels_count; level++) {
+            const auto slot = nextOccupied(level, slotOf(current_time, level) + 1);
+            if (slot < slots_count) {
+                const auto shift = level * slot_bits;
+                const auto high_shift = shift + slot_bits;
+                return ((current_time >> high_shift) << high_shift) | (static_cast<time_type>(slot) << shift);
+            }
+        }
+
+        dropCancelledOverflow();
+        if (overflow.isEmpty()) {
+            return no_event;
+        }
+
+        return (overflow.peek().deadline >> wheel_bits) << wheel_bits;
+    }
+
+    Handle scheduleNode(index_type index, time_type deadline) {
+        Stats::add(StatsEvent::allocation);
+        if (index == generations.size()) {
+            generations.push_back(0);
+        }
+
+        pool[index].deadline = deadline;
+        place(index);
+        timers_count++;
+        return Handle{ index, generations[index] };
+    }
+
+    // Put the timer into the list of its deadline relative to the current time.
+    void place(index_type index) {
+        const auto deadline = pool[index].deadline;
+        if (deadline <= current_time) {
+            append(due_list, index);
+            return;
+        }
+
+        const auto difference = deadline ^ current_time;
+        if ((difference >> wheel_bits) != 0) {
+            pool[index].list = overflow_list;
+            overflow.insert(OverflowEntry{ deadline, index, generations[index] });
+            return;
+        }
+
+        const auto level = static_cast<size_type>(std::bit_width(difference) - 1) / slot_bits;
+        const auto slot = slotOf(deadline, level);
+        append(static_cast<uint16_t>(level * slots_count + slot), index);
+        occupied[level][slot / 64] |= uint64_t{ 1 } << (slot % 64);
+    }
+
+    // The time has reached the start of a slot of a higher level: its timers move down. The start of a span of
+    // the wheels takes the overflow deadlines within the span.
+    void cascade() {
+        const auto level = static_cast<size_type>(std::countr_zero(current_time)) / slot_bits;
+        if (level >= levels_count) {
+            moveOverflow();
+            return;
+        }
+
+        const auto slot = slotOf(current_time, level);
+        const auto list = static_cast<uint16_t>(level * slots_count + slot);
+        if (level == 0) {
+            // The deadline of the slot is the current time.
+            spliceList(list, due_list);
+            occupied[0][slot / 64] &= ~(uint64_t{ 1 } << (slot % 64));
+            return;
+        }
+
+        auto index = lists[list].head;
+        lists[list] = TimerList{};
+        occupied[level][slot / 64] &= ~(uint64_t{ 1 } << (slot % 64));
+
+        while (index != 0) {
+            const auto next = pool[index].next;
+            Stats::add(StatsEvent::move);
+            place(index);
+            index = next;
+        }
+    }
+
+    void moveOverflow() {
+        const auto span = current_time >> wheel_bits;
+        while (!overflow.isEmpty() && (overflow.peek().deadline >> wheel_bits) == span) {
+            const auto entry = overflow.extract();
+            if (generations[entry.index] != entry.generation) {
+                overflow_cancelled--;
+                continue;
+            }
+
+            Stats::add(StatsEvent::move);
+            place(entry.index);
+        }
+    }
+
+    void dropCancelledOverflow() {
+        while (!overflow.isEmpty() && generations[overflow.peek().index] != overflow.peek().generation) {
+            overflow.remove(0);
+            overflow_cancelled--;
+        }
+    }
+
+    void compactOverflow() {
+        std::vector<OverflowEntry> entries{};
+        entries.reserve(overflow.size() - overflow_cancelled);
+        while (!overflow.isEmpty()) {
+            const auto entry = overflow.extract();
+            if (generations[entry.index] == entry.generation) {
+                entries.push_back(entry);
+            }
+        }
+
+        // Sorted already: the rebuild moves nothing.
+        overflow = entries.empty() ? overflow_type{} : overflow_type{ entries.data(), entries.data() + entries.size() };
+        overflow_cancelled = 0;
+    }
+
+    // Fire the due timers. They are moved to the expiring list first: on_expire may cancel the next of them,
+    // and the timers it schedules for the current time wait for the next call in the due list.
+    template<class OnExpire>
+    size_type expireDue(OnExpire& on_expire) {
+        spliceList(due_list, expiring_list);
+        auto& expiring = lists[expiring_list];
+        size_type expired = 0;
+        while (expiring.head != 0) {
+            const auto index = expiring.head;
+            unlink(index);
+            const auto deadline = pool[index].deadline;
+            auto value = std::move(pool[index].value);
+            release(index);
+            on_expire(deadline, value);
+            expired++;
+        }
+
+        return expired;
+    }
+
+    // Move the timers of one list to the end of another.
+    void spliceList(uint16_t from, uint16_t to) {
+        auto& source = lists[from];
+        auto& target = lists[to];
+        if (source.head == 0) {
+            return;
+        }
+
+        for (auto index = source.head; index != 0; index = pool[index].next) {
+            pool[index].list = to;
+        }
+
+        if (target.head == 0) {
+            target = source;
+        } else {
+            pool[target.tail].next = source.head;
+            pool[source.head].prev = target.tail;
+            target.tail = source.tail;
+        }
+        source = TimerList{};
+    }
+
+    void append(uint16_t list, index_type index) {
+        auto& node = pool[index];
+        auto& timers = lists[list];
+        node.list = list;
+        node.prev = timers.tail;
+        node.next = 0;
+        if (timers.tail != 0) {
+            pool[timers.tail].next = index;
+        } else {
+            timers.head = index;
+        }
+        timers.tail = index;
+    }
+
+    void unlink(index_type index) {
+        auto& node = pool[index];
+        auto& timers = lists[node.list];
+        if (node.prev != 0) {
+            pool[node.prev].next = node.next;
+        } else {
+            timers.head = node.next;
+        }
+
+        if (node.next != 0) {
+            pool[node.next].prev = node.prev;
+        } else {
+            timers.tail = node.prev;
+        }
+
+        if (timers.head == 0 && node.list < due_list) {
+            const auto level = node.list / slots_count;
+            const auto slot = node.list % slots_count;
+            occupied[level][slot / 64] &= ~(uint64_t{ 1 } << (slot % 64));
+        }
+    }
+
+    void release(index_type index) {
+        generations[index]++;
+        pool.destroy(index);
+        timers_count--;
+    }
+
+    // The first occupied slot of the level starting from `from`, slots_count if none.
+    NODISCARD size_type nextOccupied(size_type level, size_type from) const {
+        for (auto word = from / 64; word < bitmap_words; word++) {
+            auto bits = occupied[level][word];
+            if (word == from / 64) {
+                bits &= ~uint64_t{ 0 } << (from % 64);
+            }
+
+            if (bits != 0) {
+                return word * 64 + static_cast<size_type>(std::countr_zero(bits));
+            }
+        }
+
+        return slots_count;
+    }
+
+    NODISCARD static size_type slotOf(time_type time, size_type level) {
+        return static_cast<size_type>(time >> (level * slot_bits)) & (slots_count - 1);
+    }
+};
@@ -0,0 +1,223 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+#include "timingwheel.h"
+
+using test_data_type = int;
+using test_data_count = size_t;
+using wheel_type = TimingWheel<test_data_type>;
+using time_type = wheel_type::time_type;
+
+class TimingWheelTest : public ::testing::Test {
+protected:
+    TimingWheelTest() = default;
+
+    // Deadlines in the first slots, across the levels and past the span of the wheels.
+    std::vector<time_type> array_deadlines {5, 1, 255, 256, 300, 70000, 70000, 1ull << 31, (1ull << 32) + 7, 1ull << 40};
+};
+
+// The fired timers in the order of the calls: (deadline, value).
+using fired_type = std::vector<std::pair<time_type, test_data_type>>;
+
+template<class Wheel>
+fired_type advanceCollect(Wheel& wheel, time_type time) {
+    fired_type fired{};
+    const auto start_time = wheel.now();
+    wheel.advance(time, [&fired, &wheel, start_time](time_type deadline, test_data_type value) {
+        // Every timer fires at its own tick, the ones in the past at once.
+        EXPECT_EQ(wheel.now(), std::max(deadline, start_time));
+        fired.emplace_back(deadline, value);
+    });
+
+    return fired;
+}
+
+TEST_F(TimingWheelTest, ScheduleCancelAdvance) {
+    std::cout << "TEST_F(TimingWheelTest, ScheduleCancelAdvance) start" << std::endl;
+    wheel_type wheel{};
+    ASSERT_TRUE(wheel.isEmpty());
+    ASSERT_EQ(wheel.nextEventTime(), wheel_type::no_event);
+
+    std::vector<wheel_type::Handle> handles{};
+    for (size_t index = 0; index < array_deadlines.size(); index++) {
+        handles.push_back(wheel.schedule(array_deadlines[index], static_cast<test_data_type>(index)));
+    }
+    ASSERT_EQ(wheel.size(), array_deadlines.size());
+    ASSERT_TRUE(wheel.isPending(handles[6]));
+    ASSERT_TRUE(wheel.cancel(handles[6]));
+    ASSERT_FALSE(wheel.cancel(handles[6]));
+    ASSERT_FALSE(wheel.isPending(handles[6]));
+    ASSERT_FALSE(wheel.cancel(wheel_type::Handle{}));
+    ASSERT_EQ(wheel.nextEventTime(), 1u);
+
+    ASSERT_EQ(advanceCollect(wheel, 256), (fired_type{ { 1, 1 }, { 5, 0 }, { 255, 2 }, { 256, 3 } }));
+    ASSERT_EQ(wheel.now(), 256u);
+    // A fired timer can't be cancelled, even when its index holds a new timer.
+    ASSERT_FALSE(wheel.cancel(handles[0]));
+    const auto handle_new = wheel.schedule(1000, 10);
+    ASSERT_FALSE(wheel.cancel(handles[1]));
+    ASSERT_TRUE(wheel.isPending(handle_new));
+
+    ASSERT_EQ(advanceCollect(wheel, 1ull << 32), (fired_type{ { 300, 4 }, { 1000, 10 }, { 70000, 5 }, { 1ull << 31, 7 } }));
+    ASSERT_EQ(wheel.now(), 1ull << 32);
+    ASSERT_EQ(wheel.size(), 2u);
+
+    // A deadline in the past fires on the next call, even without a move of the time.
+    wheel.schedule(3, 11);
+    ASSERT_EQ(wheel.nextEventTime(), 1ull << 32);
+    ASSERT_EQ(advanceCollect(wheel, 1ull << 32), (fired_type{ { 3, 11 } }));
+
+    ASSERT_EQ(advanceCollect(wheel, 1ull << 41), (fired_type{ { (1ull << 32) + 7, 8 }, { 1ull << 40, 9 } }));
+    ASSERT_TRUE(wheel.isEmpty());
+    ASSERT_EQ(wheel.now(), 1ull << 41);
+    std::cout << "TEST_F(TimingWheelTest, ScheduleCancelAdvance) end" << std::endl;
+}
+
+TEST_F(TimingWheelTest, RandomAgainstMultimap) {
+    std::cout << "TEST_F(TimingWheelTest, RandomAgainstMultimap) start" << std::endl;
+    std::mt19937_64 generator{ 1337 };
+    // Start close to the end of a span of the wheels: the first batches cross it.
+    const time_type start_time = (1ull << 32) - 5000;
+    wheel_type wheel{ start_time };
+    std::multimap<time_type, test_data_type> expected{};
+    std::vector<std::pair<wheel_type::Handle, time_type>> handles{};
+
+    for (test_data_count round = 0; round < 4000; round++) {
+        for (test_data_count index = 0; index < 8; index++) {
+            // Near, across the levels and far deadlines.
+            const auto range = std::vector<time_type>{ 300, 1ull << 16, 1ull << 28, 1ull << 36 }[generator() % 4];
+            const auto deadline = wheel.now() + generator() % range;
+            const auto value = static_cast<test_data_type>(handles.size());
+            handles.emplace_back(wheel.schedule(deadline, value), deadline);
+            expected.emplace(deadline, value);
+        }
+
+        for (test_data_count index = 0; index < 6; index++) {
+            const auto position = generator() % handles.size();
+            const auto& [handle, deadline] = handles[position];
+            if (wheel.isPending(handle)) {
+                ASSERT_TRUE(wheel.cancel(handle));
+                const auto range = expected.equal_range(deadline);
+                for (auto it = range.first; it != range.second; it++) {
+                    if (it->second == static_cast<test_data_type>(position)) {
+                        expected.erase(it);
+                        break;
+                    }
+                }
+            } else {
+                ASSERT_FALSE(wheel.cancel(handle));
+            }
+        }
+
+        // Small steps and rare jumps.
+        const auto step = generator() % 16 == 0 ? generator() % (1ull << 30) : generator() % 512;
+        const auto time = wheel.now() + step;
+        const auto fired = advanceCollect(wheel, time);
+
+        auto expected_fired = std::multimap<time_type, test_data_type>(expected.begin(), expected.upper_bound(time));
+        expected.erase(expected.begin(), expected.upper_bound(time));
+        ASSERT_EQ(fired.size(), expected_fired.size()) << round;
+        for (size_t index = 0; index < fired.size(); index++) {
+            if (index != 0) {
+                ASSERT_LE(fired[index - 1].first, fired[index].first);
+            }
+
+            const auto range = expected_fired.equal_range(fired[index].first);
+            auto it = range.first;
+            while (it != range.second && it->second != fired[index].second) {
+                it++;
+            }
+            ASSERT_NE(it, range.second) << round;
+            expected_fired.erase(it);
+        }
+
+        ASSERT_EQ(wheel.size(), expected.size());
+        ASSERT_EQ(wheel.now(), time);
+        ASSERT_LE(wheel.nextEventTime(), expected.empty() ? wheel_type::no_event : expected.begin()->first);
+    }
+
+    // Fire the rest.
+    const auto fired = advanceCollect(wheel, wheel_type::no_event - 1);
+    ASSERT_EQ(fired.size(), expected.size());
+    ASSERT_TRUE(wheel.isEmpty());
+    std::cout << "TEST_F(TimingWheelTest, RandomAgainstMultimap) end" << std::endl;
+}
+
+TEST_F(TimingWheelTest, OverflowCancel) {
+    std::cout << "TEST_F(TimingWheelTest, OverflowCancel) start" << std::endl;
+    wheel_type wheel{};
+    std::vector<wheel_type::Handle> handles{};
+    for (test_data_type value = 0; value < 1000; value++) {
+        handles.push_back(wheel.schedule((1ull << 33) + static_cast<time_type>(value) * 1000, value));
+    }
+
+    // Cancels of the overflow timers are lazy, the bucket is rebuilt on the way.
+    for (test_data_type value = 0; value < 1000; value++) {
+        if (value % 10 != 0) {
+            ASSERT_TRUE(wheel.cancel(handles[value]));
+        }
+    }
+    ASSERT_EQ(wheel.size(), 100u);
+    ASSERT_EQ(wheel.nextEventTime(), 1ull << 33);
+
+    const auto fired = advanceCollect(wheel, 1ull << 34);
+    ASSERT_EQ(fired.size(), 100u);
+    for (size_t index = 0; index < fired.size(); index++) {
+        ASSERT_EQ(fired[index].second, static_cast<test_data_type>(index * 10));
+    }
+    ASSERT_TRUE(wheel.isEmpty());
+    ASSERT_EQ(wheel.nextEventTime(), wheel_type::no_event);
+    std::cout << "TEST_F(TimingWheelTest, OverflowCancel) end" << std::endl;
+}
+
+TEST_F(TimingWheelTest, CallbackScheduleCancel) {
+    std::cout << "TEST_F(TimingWheelTest, CallbackScheduleCancel) start" << std::endl;
+    wheel_type wheel{};
+    // A periodic timer re-armed by its callback, and a timer cancelled by the timer of the same tick before it.
+    wheel.schedule(100, 0);
+    const auto handle_cancelled = wheel.schedule(100, 1);
+    fired_type fired{};
+    wheel.advance(1000, [&](time_type deadline, test_data_type value) {
+        fired.emplace_back(deadline, value);
+        if (value == 0) {
+            wheel.cancel(handle_cancelled);
+            wheel.schedule(deadline + 300, 0);
+            // Due now: waits for the next tick fired.
+            wheel.schedule(deadline, 2);
+        }
+    });
+
+    ASSERT_EQ(fired, (fired_type{ { 100, 0 }, { 100, 2 }, { 400, 0 }, { 400, 2 }, { 700, 0 }, { 700, 2 }, { 1000, 0 } }));
+    ASSERT_EQ(wheel.size(), 2u);
+    ASSERT_EQ(advanceCollect(wheel, 1000), (fired_type{ { 1000, 2 } }));
+    std::cout << "TEST_F(TimingWheelTest, CallbackScheduleCancel) end" << std::endl;
+}
+
+TEST_F(TimingWheelTest, Stats) {
+    std::cout << "TEST_F(TimingWheelTest, Stats) start" << std::endl;
+    using stats_type = CountingStats<struct TimingWheelStatsTag>;
+    TimingWheel<test_data_type, stats_type> wheel{};
+
+    // The near timers never compare and move down at most levels_count - 1 times.
+    stats_type::reset();
+    for (test_data_type value = 0; value < 10000; value++) {
+        wheel.schedule(static_cast<time_type>(value) * 997, value);
+    }
+    ASSERT_EQ(wheel.advance(10000ull * 997, [](time_type, test_data_type) {}), 10000u);
+    ASSERT_EQ(stats_type::snapshot()[StatsEvent::allocation], 10000u);
+    ASSERT_EQ(stats_type::snapshot()[StatsEvent::comparison], 0u);
+    ASSERT_LE(stats_type::snapshot()[StatsEvent::move], 10000u * (wheel_type::levels_count - 1));
+
+    // The far timers go through the overflow heap once.
+    stats_type::reset();
+    for (test_data_type value = 0; value < 100; value++) {
+        wheel.schedule(1ull << 40, value);
+    }
+    ASSERT_GT(stats_type::snapshot()[StatsEvent::comparison], 0u);
+    ASSERT_EQ(wheel.advance(1ull << 40, [](time_type, test_data_type) {}), 100u);
+    ASSERT_LE(stats_type::snapshot()[StatsEvent::move], 100u * wheel_type::levels_count);
+    std::cout << "TEST_F(TimingWheelTest, Stats) end" << std::endl;
+}
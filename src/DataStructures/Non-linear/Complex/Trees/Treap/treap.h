@@ -0,0 +1,610 @@
+// Treap: a binary search tree by key and a heap by random priority.
+// + The random priorities keep the expected depth O(log n) without rebalancing data in the nodes.
+// + split and merge are O(log n) expected and iterative: they only relink the right spine of one part
+//   and the left spine of the other.
+// + eraseRange(lo, hi) is two splits and a merge: O(log n + removed). insertSortedBatch builds a treap of the batch
+//   in O(batch) and merges it in: O(log n + batch) when the batch falls into a gap between the keys of the tree.
+// + The priorities are ordered like the values of Heap: PriorityComparator(child, peek) is true when the child
+//   should be above the peek. The default ComparatorGreater puts the greatest priority at the root.
+// + Nodes are allocated from a NodePool. The treaps split from one treap share its pool, so they must not be used
+//   by different threads at the same time. A move takes the pool: the moved-from treap gets a new one on its next insert.
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "head.h"
+#include "comparators.h"
+#include "node_pool.h"
+#include "stats.h"
+
+template <class DataType, class PriorityType = uint32_t>
+struct TreapNode {
+    using value_type = DataType;
+    using priority_type = PriorityType;
+    using node_type = TreapNode<value_type, priority_type>;
+
+    value_type key{};
+    priority_type priority{};
+    node_type* left{};
+    node_type* right{};
+
+    CONSTEXPR20 TreapNode() = default;
+    CONSTEXPR20 TreapNode(const value_type& key, priority_type priority) : key(key), priority(priority) {}
+
+    CONSTEXPR20 ~TreapNode() = default;
+};
+
+// Stats: instrumentation policy (stats.h), reports key comparisons and node allocations.
+template <class DataType, class PriorityComparator = ComparatorGreater<uint32_t>, class Stats = NoStats>
+class Treap {
+private:
+    using value_type = DataType;
+    using const_reference = const DataType &;
+    using size_type = size_t;
+    using priority_type = uint32_t;
+    using node_type = TreapNode<value_type, priority_type>;
+    using pool_type = NodePool<node_type>;
+
+    node_type* root{};
+    // Null only in a moved-from treap, which has no nodes.
+    std::shared_ptr<pool_type> pool{ std::make_shared<pool_type>() };
+    // The count of the keys. The parts of a split don't know theirs: size() counts them once.
+    mutable size_type count{ 0 };
+    mutable bool count_known{ true };
+    // xorshift64* state of the priorities.
+    uint64_t random_state{ 0x9E3779B97F4A7C15ull };
+    PriorityComparator comp{};
+
+public:
+    CONSTEXPR20 Treap() = default;
+
+    // seed: the start of the random priorities, a fixed seed gives the same shapes for the same operations.
+    CONSTEXPR20 explicit Treap(uint64_t seed) :
+            random_state{ seed != 0 ? seed : 0x9E3779B97F4A7C15ull }
+    {
+    }
+
+    CONSTEXPR20 explicit Treap(const std::vector<value_type> &vec) {
+        for (const auto& value : vec) {
+            insert(value);
+        }
+    }
+
+    CONSTEXPR20 explicit Treap(const value_type *start, const value_type *end) {
+        for (auto it = start; it != end; it++) {
+            insert(*it);
+        }
+    }
+
+    Treap(const Treap&) = delete;
+    Treap& operator=(const Treap&) = delete;
+
+    Treap(Treap&& other) noexcept :
+            root{ std::exchange(other.root, nullptr) },
+            pool{ std::move(other.pool) },
+            count{ std::exchange(other.count, 0) },
+            count_known{ std::exchange(other.count_known, true) },
+            random_state{ other.random_state },
+            comp{ other.comp }
+    {
+    }
+
+    Treap& operator=(Treap&& other) noexcept {
+        if (this != &other) {
+            clear();
+            root = std::exchange(other.root, nullptr);
+            pool = std::move(other.pool);
+            count = std::exchange(other.count, 0);
+            count_known = std::exchange(other.count_known, true);
+            random_state = other.random_state;
+            comp = other.comp;
+        }
+
+        return *this;
+    }
+
+    ~Treap() {
+        clear();
+    }
+
+    NODISCARD CONSTEXPR20 bool search(const value_type &&value) const {
+        return searchElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 bool search(const value_type &value) const {
+        return searchElement(value);
+    }
+
+    CONSTEXPR20 void insert(const value_type &&value) {
+        insertElement(value);
+    }
+
+    CONSTEXPR20 void insert(const value_type &value) {
+        insertElement(value);
+    }
+
+    CONSTEXPR20 void deleteValue(const value_type &&value) {
+        deleteElement(value);
+    }
+
+    CONSTEXPR20 void deleteValue(const value_type &value) {
+        deleteElement(value);
+    }
+
+    // Move the keys not less than key to the returned treap, this treap keeps the keys less than key.
+    // The returned treap shares the pool of this one.
+    NODISCARD Treap split(const value_type &key) {
+        Treap other{ nextRandom(), pool };
+
+        node_type* node_left = nullptr;
+        node_type* node_right = nullptr;
+        splitNode(root, key, node_left, node_right);
+        root = node_left;
+        other.root = node_right;
+        // Counting the parts here would make the split O(n).
+        count_known = !root;
+        count = 0;
+        other.count_known = !other.root;
+        return other;
+    }
+
+    // Append the keys of other, all of them must be greater than the keys of this treap. other becomes empty.
+    void merge(Treap &other) {
+        if (this == &other || !other.root) {
+            return;
+        }
+
+        if (!adoptPool(other)) {
+            // The pools of both treaps are shared with other treaps: the keys are copied.
+            std::vector<value_type> keys{};
+            other.forEachInOrder([&keys](const value_type& key) {
+                keys.push_back(key);
+            });
+            other.clear();
+            insertSortedBatch(keys.data(), keys.data() + keys.size());
+            return;
+        }
+
+        root = mergeNodes(root, other.root);
+        other.root = nullptr;
+        count += other.count;
+        count_known = count_known && other.count_known;
+        other.count = 0;
+        other.count_known = true;
+    }
+
+    void merge(Treap &&other) {
+        merge(other);
+    }
+
+    // Delete the keys in [lo, hi). Returns the count of deleted keys.
+    size_type eraseRange(const value_type &lo, const value_type &hi) {
+        node_type* node_less = nullptr;
+        node_type* node_rest = nullptr;
+        splitNode(root, lo, node_less, node_rest);
+
+        node_type* node_range = nullptr;
+        node_type* node_greater = nullptr;
+        splitNode(node_rest, hi, node_range, node_greater);
+
+        root = mergeNodes(node_less, node_greater);
+        const auto erased_count = destroySubtree(node_range);
+        count -= erased_count;
+        return erased_count;
+    }
+
+    // Insert the keys of the ascending range [start, end), duplicates are skipped.
+    // O(log n + batch) when no key of the tree lies between the first and the last key of the batch,
+    // otherwise the keys of the tree in between are merged with the batch and rebuilt too.
+    void insertSortedBatch(const value_type *start, const value_type *end) {
+        if (start == end) {
+            return;
+        }
+
+        node_type* node_less = nullptr;
+        node_type* node_rest = nullptr;
+        splitNode(root, *start, node_less, node_rest);
+
+        // The keys of the tree from the first key of the batch to the last one.
+        node_type* node_middle = nullptr;
+        node_type* node_greater = nullptr;
+        splitNodeAfter(node_rest, *(end - 1), node_middle, node_greater);
+
+        std::vector<node_type*> nodes{};
+        if (!node_middle) {
+            appendBatch(nodes, start, end);
+        } else {
+            // Merge the nodes of the tree with the batch: the old nodes are reused, a key in both is taken once.
+            std::vector<node_type*> nodes_middle{};
+            collectNodes(node_middle, nodes_middle);
+
+            auto it = start;
+            for (const auto node : nodes_middle) {
+                while (it != end && isLess(*it, node->key)) {
+                    appendBatch(nodes, it, it + 1);
+                    it++;
+                }
+
+                if (it != end && !isGreater(*it, node->key)) {
+                    it++;
+                }
+
+                node->left = nullptr;
+                node->right = nullptr;
+                nodes.push_back(node);
+            }
+
+            appendBatch(nodes, it, end);
+        }
+
+        root = mergeNodes(mergeNodes(node_less, buildFromSorted(nodes)), node_greater);
+    }
+
+    void insertSortedBatch(const std::vector<value_type> &vec) {
+        insertSortedBatch(vec.data(), vec.data() + vec.size());
+    }
+
+    NODISCARD CONSTEXPR20 bool isEmpty() const {
+        return root == nullptr;
+    }
+
+    // O(1), the first call after a split is O(n).
+    NODISCARD size_type size() const {
+        if (!count_known) {
+            count = 0;
+            forEachInOrder([this](const value_type&) {
+                count++;
+            });
+            count_known = true;
+        }
+
+        return count;
+    }
+
+    // The treap which owns its pool frees the slabs at once, the nodes are visited only for the destructors of the keys.
+    // The pool shared with the other parts of a split keeps the slabs, the nodes go to its free list.
+    void clear() {
+        if (pool.use_count() != 1) {
+            destroySubtree(root);
+        } else {
+            if constexpr (!std::is_trivially_destructible_v<node_type>) {
+                destroySubtree(root);
+            }
+
+            pool->release();
+        }
+
+        root = nullptr;
+        count = 0;
+        count_known = true;
+    }
+
+    // Visit the keys in ascending order without recursion. The stack holds the path to the current node.
+    template<class Visitor>
+    CONSTEXPR20 void forEachInOrder(Visitor&& visitor) const {
+        const node_type* const node_end = nullptr;
+        std::vector<const node_type*> stack{};
+        const node_type* node_current = root;
+
+        while (node_current != node_end || !stack.empty()) {
+            // Move down to the leftmost node.
+            while (node_current != node_end) {
+                stack.push_back(node_current);
+                node_current = node_current->left;
+            }
+
+            node_current = stack.back();
+            stack.pop_back();
+            visitor(node_current->key);
+            node_current = node_current->right;
+        }
+    }
+
+    // Check the order of the keys and the heap order of the priorities.
+    NODISCARD CONSTEXPR20 bool verifyProperties() const {
+        bool valid = true;
+        size_t count = 0;
+        std::vector<std::pair<const node_type*, const node_type*>> stack{};
+        if (root) {
+            stack.push_back({ root, nullptr });
+        }
+
+        while (!stack.empty()) {
+            const auto [node, node_parent] = stack.back();
+            stack.pop_back();
+            count++;
+
+            if (node_parent && comp(node->priority, node_parent->priority)) {
+                valid = false;
+            }
+
+            if ((node->left && !isLess(node->left->key, node->key)) || (node->right && !isGreater(node->right->key, node->key))) {
+                valid = false;
+            }
+
+            if (node->left) {
+                stack.push_back({ node->left, node });
+            }
+
+            if (node->right) {
+                stack.push_back({ node->right, node });
+            }
+        }
+
+        size_t keys_count = 0;
+        const value_type* key_prev = nullptr;
+        forEachInOrder([&](const value_type& key) {
+            if (key_prev && !isLess(*key_prev, key)) {
+                valid = false;
+            }
+
+            key_prev = &key;
+            keys_count++;
+        });
+
+        return valid && count == keys_count;
+    }
+
+private:
+    // A part of a split: shares the pool of the split treap.
+    Treap(uint64_t seed, std::shared_ptr<pool_type> pool) :
+            pool{ std::move(pool) },
+            random_state{ seed != 0 ? seed : 0x9E3779B97F4A7C15ull }
+    {
+    }
+
+    CONSTEXPR20 bool searchElement(const value_type &key) const {
+        return findNode(root, key) != nullptr;
+    }
+
+    CONSTEXPR20 const node_type* findNode(const node_type* node, const value_type &key) const {
+        auto node_current = node;
+        while (node_current) {
+            if (isLess(key, node_current->key)) {
+                node_current = node_current->left;
+            } else if (isGreater(key, node_current->key)) {
+                node_current = node_current->right;
+            } else {
+                return node_current;
+            }
+        }
+
+        return nullptr;
+    }
+
+    void insertElement(const value_type &key) {
+        const auto priority = nextRandom();
+
+        // Descend while the nodes are above the new one. The new node takes the place of the first node below it.
+        node_type** link = &root;
+        while (*link && !comp(priority, (*link)->priority)) {
+            const auto node = *link;
+            if (isLess(key, node->key)) {
+                link = &node->left;
+            } else if (isGreater(key, node->key)) {
+                link = &node->right;
+            } else {
+                // The key is already in the tree.
+                return;
+            }
+        }
+
+        // The key may be below the place.
+        if (findNode(*link, key)) {
+            return;
+        }
+
+        auto node_new = createNewNode(key, priority);
+        splitNode(*link, key, node_new->left, node_new->right);
+        *link = node_new;
+    }
+
+    void deleteElement(const value_type &key) {
+        node_type** link = &root;
+        while (*link) {
+            const auto node = *link;
+            if (isLess(key, node->key)) {
+                link = &node->left;
+            } else if (isGreater(key, node->key)) {
+                link = &node->right;
+            } else {
+                *link = mergeNodes(node->left, node->right);
+                pool->destroy(node);
+                count--;
+                return;
+            }
+        }
+    }
+
+    // Split the subtree into the keys less than key and the others. The left part is built along its right spine,
+    // the right part along its left spine.
+    CONSTEXPR20 void splitNode(node_type* node, const value_type &key, node_type*& node_left, node_type*& node_right) const {
+        node_type** link_left = &node_left;
+        node_type** link_right = &node_right;
+
+        while (node) {
+            if (isLess(node->key, key)) {
+                *link_left = node;
+                link_left = &node->right;
+                node = node->right;
+            } else {
+                *link_right = node;
+                link_right = &node->left;
+                node = node->left;
+            }
+        }
+
+        *link_left = nullptr;
+        *link_right = nullptr;
+    }
+
+    // Split the subtree into the keys not greater than key and the others.
+    CONSTEXPR20 void splitNodeAfter(node_type* node, const value_type &key, node_type*& node_left, node_type*& node_right) const {
+        node_type** link_left = &node_left;
+        node_type** link_right = &node_right;
+
+        while (node) {
+            if (!isGreater(node->key, key)) {
+                *link_left = node;
+                link_left = &node->right;
+                node = node->right;
+            } else {
+                *link_right = node;
+                link_right = &node->left;
+                node = node->left;
+            }
+        }
+
+        *link_left = nullptr;
+        *link_right = nullptr;
+    }
+
+    // All keys of node_left are less than the keys of node_right. The upper root wins at every step.
+    CONSTEXPR20 node_type* mergeNodes(node_type* node_left, node_type* node_right) const {
+        node_type* node_top = nullptr;
+        node_type** link = &node_top;
+
+        while (node_left && node_right) {
+            if (!comp(node_right->priority, node_left->priority)) {
+                *link = node_left;
+                link = &node_left->right;
+                node_left = node_left->right;
+            } else {
+                *link = node_right;
+                link = &node_right->left;
+                node_right = node_right->left;
+            }
+        }
+
+        *link = node_left ? node_left : node_right;
+        return node_top;
+    }
+
+    // Build a treap of the nodes sorted by key in O(n): the right spine is kept on a stack.
+    node_type* buildFromSorted(const std::vector<node_type*> &nodes) const {
+        std::vector<node_type*> spine{};
+        for (const auto node : nodes) {
+            // The spine nodes below the new node become its left subtree.
+            node_type* node_last = nullptr;
+            while (!spine.empty() && comp(node->priority, spine.back()->priority)) {
+                node_last = spine.back();
+                spine.pop_back();
+            }
+
+            node->left = node_last;
+            node->right = nullptr;
+            if (!spine.empty()) {
+                spine.back()->right = node;
+            }
+
+            spine.push_back(node);
+        }
+
+        return spine.empty() ? nullptr : spine.front();
+    }
+
+    // Create the nodes of the keys of the ascending range, the duplicates inside the range are skipped.
+    void appendBatch(std::vector<node_type*> &nodes, const value_type *start, const value_type *end) {
+        for (auto it = start; it != end; it++) {
+            if (!nodes.empty() && !isLess(nodes.back()->key, *it)) {
+                continue;
+            }
+
+            nodes.push_back(createNewNode(*it, nextRandom()));
+        }
+    }
+
+    // The nodes of the subtree in key order.
+    void collectNodes(node_type* node, std::vector<node_type*> &nodes) const {
+        std::vector<node_type*> stack{};
+        auto node_current = node;
+        while (node_current || !stack.empty()) {
+            while (node_current) {
+                stack.push_back(node_current);
+                node_current = node_current->left;
+            }
+
+            node_current = stack.back();
+            stack.pop_back();
+            nodes.push_back(node_current);
+            node_current = node_current->right;
+        }
+    }
+
+    // Destroy the nodes without recursion: the left children are rotated up until the node can be freed.
+    size_type destroySubtree(node_type* node) {
+        size_type count = 0;
+        while (node) {
+            if (node->left) {
+                auto node_left = node->left;
+                node->left = node_left->right;
+                node_left->right = node;
+                node = node_left;
+            } else {
+                auto node_next = node->right;
+                pool->destroy(node);
+                node = node_next;
+                count++;
+            }
+        }
+
+        return count;
+    }
+
+    // Make the nodes of other destroyable by this pool. False if both pools are shared with other treaps.
+    bool adoptPool(Treap &other) {
+        if (pool == other.pool) {
+            return true;
+        }
+
+        if (!pool) {
+            pool = std::move(other.pool);
+            return true;
+        }
+
+        if (other.pool.use_count() == 1) {
+            pool->splice(*other.pool);
+            return true;
+        }
+
+        if (pool.use_count() == 1) {
+            other.pool->splice(*pool);
+            pool = other.pool;
+            return true;
+        }
+
+        return false;
+    }
+
+    node_type* createNewNode(const value_type& key, priority_type priority) {
+        Stats::add(StatsEvent::allocation);
+        if (!pool) {
+            pool = std::make_shared<pool_type>();
+        }
+
+        auto node = pool->create(key, priority);
+        count++;
+        return node;
+    }
+
+    priority_type nextRandom() {
+        random_state ^= random_state >> 12;
+        random_state ^= random_state << 25;
+        random_state ^= random_state >> 27;
+        return static_cast<priority_type>((random_state * 0x2545F4914F6CDD1Dull) >> 32);
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isGreater(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) > comparedKey(value_b);
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isLess(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) < comparedKey(value_b);
+    }
+};
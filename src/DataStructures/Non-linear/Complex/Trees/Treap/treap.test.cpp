@@ -0,0 +1,324 @@
+﻿#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <set>
+#include <vector>
+#include "treap.h"
+
+using test_data_type = int;
+using test_data_count = size_t;
+
+class TreapTest : public ::testing::Test {
+protected:
+    TreapTest() = default;
+
+    std::vector<test_data_type> array_values {30, 35, 40, 20, 10, 24, 39};
+
+public:
+    class ObjectA {
+    public:
+        CONSTEXPR20 ObjectA() = default;
+
+        CONSTEXPR20 explicit ObjectA(test_data_type value) :
+                value{ value }
+        {
+        }
+
+        NODISCARD CONSTEXPR20 bool operator> (const ObjectA& obj) const {
+            return this->value > obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 bool operator< (const ObjectA& obj) const {
+            return this->value < obj.value;
+        }
+
+        NODISCARD CONSTEXPR20 test_data_type get() const {
+            return value;
+        }
+
+    private:
+        test_data_type value{};
+    };
+};
+
+using object_type = TreapTest::ObjectA;
+using store_smart_ptr_type = std::shared_ptr<object_type>;
+
+template<class Tree>
+std::vector<test_data_type> collectKeys(const Tree& tree) {
+    std::vector<test_data_type> keys{};
+    tree.forEachInOrder([&keys](test_data_type key) {
+        keys.push_back(key);
+    });
+
+    return keys;
+}
+
+std::vector<test_data_type> makeRange(test_data_type first, test_data_type last) {
+    std::vector<test_data_type> values{};
+    for (auto value = first; value < last; value++) {
+        values.push_back(value);
+    }
+
+    return values;
+}
+
+TEST_F(TreapTest, InsertSearchDelete) {
+    std::cout << "TEST_F(TreapTest, InsertSearchDelete) start" << std::endl;
+    Treap<test_data_type> tree{ array_values };
+    ASSERT_TRUE(tree.verifyProperties());
+
+    for (const auto value : array_values) {
+        ASSERT_TRUE(tree.search(value));
+    }
+    ASSERT_FALSE(tree.search(25));
+
+    // Duplicates are ignored.
+    tree.insert(30);
+    auto sorted = array_values;
+    std::sort(sorted.begin(), sorted.end());
+    ASSERT_EQ(collectKeys(tree), sorted);
+
+    tree.deleteValue(30);
+    tree.deleteValue(31);
+    ASSERT_FALSE(tree.search(30));
+    ASSERT_TRUE(tree.verifyProperties());
+    std::cout << "TEST_F(TreapTest, InsertSearchDelete) end" << std::endl;
+}
+
+TEST_F(TreapTest, RandomInsertDelete) {
+    std::cout << "TEST_F(TreapTest, RandomInsertDelete) start" << std::endl;
+    std::mt19937 generator{ 1337 };
+    Treap<test_data_type> tree{};
+    std::set<test_data_type> expected{};
+
+    for (test_data_count index = 0; index < 20000; index++) {
+        const auto value = static_cast<test_data_type>(generator() % 4000);
+        if (generator() % 3 != 0) {
+            tree.insert(value);
+            expected.insert(value);
+        } else {
+            tree.deleteValue(value);
+            expected.erase(value);
+        }
+
+        if (index % 1000 == 0) {
+            ASSERT_TRUE(tree.verifyProperties()) << index;
+            ASSERT_EQ(tree.size(), expected.size()) << index;
+        }
+    }
+
+    ASSERT_TRUE(tree.verifyProperties());
+    ASSERT_EQ(tree.size(), expected.size());
+    ASSERT_EQ(collectKeys(tree), std::vector<test_data_type>(expected.begin(), expected.end()));
+    std::cout << "TEST_F(TreapTest, RandomInsertDelete) end" << std::endl;
+}
+
+TEST_F(TreapTest, SplitMerge) {
+    std::cout << "TEST_F(TreapTest, SplitMerge) start" << std::endl;
+    Treap<test_data_type> tree{ makeRange(0, 1000) };
+
+    auto greater = tree.split(600);
+    ASSERT_EQ(collectKeys(tree), makeRange(0, 600));
+    ASSERT_EQ(collectKeys(greater), makeRange(600, 1000));
+    ASSERT_TRUE(tree.verifyProperties());
+    ASSERT_TRUE(greater.verifyProperties());
+
+    ASSERT_EQ(tree.size(), 600u);
+    ASSERT_EQ(greater.size(), 400u);
+
+    // Both halves keep working on the shared pool.
+    greater.deleteValue(700);
+    tree.insert(-1);
+    ASSERT_FALSE(greater.search(700));
+
+    tree.merge(greater);
+    ASSERT_TRUE(greater.isEmpty());
+    ASSERT_EQ(greater.size(), 0u);
+    ASSERT_TRUE(tree.verifyProperties());
+    ASSERT_EQ(collectKeys(tree).size(), 1000u);
+    ASSERT_EQ(tree.size(), 1000u);
+
+    // Merge of a treap with its own pool: the nodes move with the slabs.
+    Treap<test_data_type> other{ makeRange(2000, 2100) };
+    tree.merge(other);
+    ASSERT_TRUE(other.isEmpty());
+    ASSERT_TRUE(tree.search(2050));
+    ASSERT_TRUE(tree.verifyProperties());
+    std::cout << "TEST_F(TreapTest, SplitMerge) end" << std::endl;
+}
+
+TEST_F(TreapTest, MergeSharedPools) {
+    std::cout << "TEST_F(TreapTest, MergeSharedPools) start" << std::endl;
+    // Both pools are shared with the other halves: the keys are copied.
+    Treap<test_data_type> first{ makeRange(0, 100) };
+    auto first_greater = first.split(50);
+    Treap<test_data_type> second{ makeRange(200, 300) };
+    auto second_greater = second.split(250);
+
+    first.merge(second);
+    ASSERT_TRUE(second.isEmpty());
+    ASSERT_TRUE(first.verifyProperties());
+    auto expected = makeRange(0, 50);
+    const auto tail = makeRange(200, 250);
+    expected.insert(expected.end(), tail.begin(), tail.end());
+    ASSERT_EQ(collectKeys(first), expected);
+    ASSERT_EQ(collectKeys(first_greater), makeRange(50, 100));
+    ASSERT_EQ(collectKeys(second_greater), makeRange(250, 300));
+    std::cout << "TEST_F(TreapTest, MergeSharedPools) end" << std::endl;
+}
+
+TEST_F(TreapTest, EraseRange) {
+    std::cout << "TEST_F(TreapTest, EraseRange) start" << std::endl;
+    Treap<test_data_type> tree{ makeRange(0, 1000) };
+
+    ASSERT_EQ(tree.eraseRange(100, 300), 200u);
+    ASSERT_EQ(tree.eraseRange(100, 300), 0u);
+    ASSERT_EQ(tree.eraseRange(500, 500), 0u);
+    // Drop everything older than 50.
+    ASSERT_EQ(tree.eraseRange(-1000, 50), 50u);
+    ASSERT_TRUE(tree.verifyProperties());
+    ASSERT_EQ(tree.size(), 750u);
+
+    auto expected = makeRange(50, 100);
+    const auto tail = makeRange(300, 1000);
+    expected.insert(expected.end(), tail.begin(), tail.end());
+    ASSERT_EQ(collectKeys(tree), expected);
+    std::cout << "TEST_F(TreapTest, EraseRange) end" << std::endl;
+}
+
+TEST_F(TreapTest, InsertSortedBatch) {
+    std::cout << "TEST_F(TreapTest, InsertSortedBatch) start" << std::endl;
+    Treap<test_data_type> tree{};
+    std::set<test_data_type> expected{};
+
+    // A batch into the empty tree, appended batches and a batch into a gap.
+    for (const auto& batch : { makeRange(100, 200), makeRange(200, 300), makeRange(0, 50), makeRange(60, 70) }) {
+        tree.insertSortedBatch(batch);
+        expected.insert(batch.begin(), batch.end());
+        ASSERT_TRUE(tree.verifyProperties());
+    }
+
+    // A batch overlapping the keys of the tree, with duplicates inside.
+    const std::vector<test_data_type> overlapping{ 40, 45, 45, 55, 65, 65, 150, 301, 301 };
+    tree.insertSortedBatch(overlapping);
+    expected.insert(overlapping.begin(), overlapping.end());
+    ASSERT_TRUE(tree.verifyProperties());
+    ASSERT_EQ(tree.size(), expected.size());
+    ASSERT_EQ(collectKeys(tree), std::vector<test_data_type>(expected.begin(), expected.end()));
+    std::cout << "TEST_F(TreapTest, InsertSortedBatch) end" << std::endl;
+}
+
+TEST_F(TreapTest, Pointers) {
+    std::cout << "TEST_F(TreapTest, Pointers) start" << std::endl;
+    Treap<store_smart_ptr_type> tree{};
+    for (const auto value : array_values) {
+        tree.insert(std::make_shared<object_type>(value));
+    }
+
+    ASSERT_TRUE(tree.search(std::make_shared<object_type>(24)));
+    tree.deleteValue(std::make_shared<object_type>(24));
+    ASSERT_FALSE(tree.search(std::make_shared<object_type>(24)));
+    ASSERT_EQ(tree.eraseRange(std::make_shared<object_type>(30), std::make_shared<object_type>(40)), 3u);
+    ASSERT_TRUE(tree.verifyProperties());
+
+    test_data_type prev_value = 0;
+    tree.forEachInOrder([&prev_value](const store_smart_ptr_type& key) {
+        ASSERT_LT(prev_value, key->get());
+        prev_value = key->get();
+    });
+    std::cout << "TEST_F(TreapTest, Pointers) end" << std::endl;
+}
+
+TEST_F(TreapTest, Clear) {
+    std::cout << "TEST_F(TreapTest, Clear) start" << std::endl;
+    Treap<test_data_type> tree{ makeRange(0, 1000) };
+    auto greater = tree.split(500);
+
+    // The pool is shared with the other part: it keeps the slabs.
+    tree.clear();
+    ASSERT_TRUE(tree.isEmpty());
+    ASSERT_EQ(collectKeys(greater), makeRange(500, 1000));
+    tree.insert(7);
+    ASSERT_TRUE(tree.search(7));
+    greater.clear();
+    ASSERT_TRUE(greater.isEmpty());
+    ASSERT_EQ(collectKeys(tree), std::vector<test_data_type>{ 7 });
+
+    // The keys with destructors are released.
+    auto object = std::make_shared<object_type>(24);
+    const std::weak_ptr<object_type> object_weak = object;
+    Treap<store_smart_ptr_type> pointers{};
+    pointers.insert(object);
+    pointers.insert(std::make_shared<object_type>(25));
+    object.reset();
+    pointers.clear();
+    ASSERT_TRUE(pointers.isEmpty());
+    ASSERT_TRUE(object_weak.expired());
+    std::cout << "TEST_F(TreapTest, Clear) end" << std::endl;
+}
+
+TEST_F(TreapTest, Move) {
+    std::cout << "TEST_F(TreapTest, Move) start" << std::endl;
+    Treap<test_data_type> tree{ makeRange(0, 1000) };
+    auto greater = tree.split(500);
+
+    // The move takes the pool shared with greater, the moved-from treap allocates from a new one.
+    Treap<test_data_type> moved{ std::move(tree) };
+    ASSERT_TRUE(tree.isEmpty());
+    ASSERT_EQ(tree.size(), 0u);
+    tree.insert(-1);
+    tree.insert(-2);
+    moved.deleteValue(100);
+    greater.insert(2000);
+    ASSERT_EQ(collectKeys(tree), (std::vector<test_data_type>{ -2, -1 }));
+    ASSERT_EQ(moved.size(), 499u);
+    ASSERT_EQ(greater.size(), 501u);
+    ASSERT_TRUE(moved.verifyProperties());
+
+    // The moved-from treap gets no pool: it creates one on its first insert, a merge into it takes the pool of the other.
+    Treap<test_data_type> assigned{};
+    assigned = std::move(moved);
+    ASSERT_TRUE(moved.isEmpty());
+    moved.merge(greater);
+    ASSERT_TRUE(greater.isEmpty());
+    ASSERT_EQ(moved.size(), 501u);
+    moved.insert(3000);
+    assigned.insert(600);
+    tree.merge(assigned);
+    ASSERT_TRUE(tree.verifyProperties());
+    ASSERT_EQ(tree.size(), 502u);
+    ASSERT_EQ(moved.size(), 502u);
+    std::cout << "TEST_F(TreapTest, Move) end" << std::endl;
+}
+
+TEST_F(TreapTest, PriorityComparator) {
+    std::cout << "TEST_F(TreapTest, PriorityComparator) start" << std::endl;
+    // The smallest priority at the root, like a min-heap.
+    Treap<test_data_type, ComparatorLess<uint32_t>> tree{ makeRange(0, 500) };
+    ASSERT_TRUE(tree.verifyProperties());
+    auto greater = tree.split(250);
+    tree.merge(greater);
+    ASSERT_EQ(collectKeys(tree), makeRange(0, 500));
+    ASSERT_TRUE(tree.verifyProperties());
+    std::cout << "TEST_F(TreapTest, PriorityComparator) end" << std::endl;
+}
+
+TEST_F(TreapTest, Stats) {
+    std::cout << "TEST_F(TreapTest, Stats) start" << std::endl;
+    using stats_type = CountingStats<struct TreapStatsTag>;
+    Treap<test_data_type, ComparatorGreater<uint32_t>, stats_type> tree{};
+    const test_data_type keys_count = 127;
+
+    stats_type::reset();
+    for (test_data_type key = 0; key < keys_count; key++) {
+        tree.insert(key);
+    }
+    tree.insertSortedBatch(makeRange(keys_count, 2 * keys_count));
+
+    const auto stats = stats_type::snapshot();
+    ASSERT_EQ(stats[StatsEvent::allocation], static_cast<uint64_t>(2 * keys_count));
+    ASSERT_NE(stats[StatsEvent::comparison], 0u);
+    std::cout << "TEST_F(TreapTest, Stats) end" << std::endl;
+}
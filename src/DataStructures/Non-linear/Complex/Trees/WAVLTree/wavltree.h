@@ -0,0 +1,494 @@
+// Weak AVL tree (rank-balanced tree, Haeupler, Sen and Tarjan).
+// + Every node has a rank. The rank difference of a child is 1 or 2 (a missing child has rank -1) and leaves have rank 0.
+//   Without deletes the tree is an AVL tree, with deletes its height stays below 2 * log2(n).
+// + Insert and delete do one single or one double rotation at most and amortized O(1) promotions and demotions,
+//   AVLTreeLoop can rotate all the way up the path on delete.
+// + The rank is not stored: the top bit of each link is set when that child is a 2-child.
+// + The nodes live in an IndexPool linked by SizeType indices, insert and delete keep the path in an array on the stack.
+#pragma once
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "head.h"
+#include "comparators.h"
+#include "index_pool.h"
+#include "stats.h"
+
+template <class DataType, class SizeType = uint32_t>
+struct WAVLTreeNode {
+    using value_type = DataType;
+    using size_type = SizeType;
+
+    static constexpr size_type two_bit = static_cast<size_type>(size_type{ 1 } << (std::numeric_limits<size_type>::digits - 1));
+    static constexpr size_type index_mask = static_cast<size_type>(~two_bit);
+
+    value_type key{};
+    // Children by direction: 0 is left, 1 is right. The top bit is set when the rank difference of the child is 2.
+    std::array<size_type, 2> link{};
+
+    CONSTEXPR20 WAVLTreeNode() = default;
+    // A new node is a leaf: rank 0, both missing children are 1-children.
+    CONSTEXPR20 explicit WAVLTreeNode(const value_type& key) : key(key) {}
+
+    NODISCARD CONSTEXPR20 size_type getChild(size_t direction) const {
+        return static_cast<size_type>(link[direction] & index_mask);
+    }
+
+    CONSTEXPR20 void setChild(size_t direction, size_type index) {
+        link[direction] = static_cast<size_type>((link[direction] & two_bit) | index);
+    }
+
+    // Rank difference of the child: 1 or 2.
+    NODISCARD CONSTEXPR20 size_t getRankDifference(size_t direction) const {
+        return (link[direction] & two_bit) != 0 ? 2 : 1;
+    }
+
+    CONSTEXPR20 void setRankDifference(size_t direction, size_t difference) {
+        link[direction] = static_cast<size_type>(difference == 2 ? (link[direction] | two_bit) : (link[direction] & index_mask));
+    }
+};
+
+// Stats: instrumentation policy (stats.h), reports key comparisons, node allocations, rotations and rebalance steps
+// (promotions and demotions).
+template <class DataType, class SizeType = uint32_t, class Stats = NoStats>
+class WAVLTree {
+private:
+    using value_type = DataType;
+    using const_reference = const DataType &;
+    using size_type = SizeType;
+    using node_type = WAVLTreeNode<value_type, size_type>;
+    using pool_type = IndexPool<node_type, size_type>;
+
+    static constexpr size_type null_index = 0;
+    static constexpr size_t left = 0;
+    static constexpr size_t right = 1;
+    // The height is below 2 * log2(n).
+    static constexpr size_t max_path_length = 2 * std::numeric_limits<size_type>::digits + 2;
+    using path_type = std::array<size_type, max_path_length>;
+
+    pool_type pool{ node_type::index_mask };
+    size_type root{ null_index };
+
+public:
+    CONSTEXPR20 WAVLTree() = default;
+
+    CONSTEXPR20 explicit WAVLTree(const std::vector<value_type> &vec) {
+        pool.reserve(vec.size());
+        for (const auto& value : vec) {
+            insert(value);
+        }
+    }
+
+    CONSTEXPR20 explicit WAVLTree(const value_type *start, const value_type *end) {
+        pool.reserve(static_cast<size_t>(end - start));
+        for (auto it = start; it != end; it++) {
+            insert(*it);
+        }
+    }
+
+    CONSTEXPR20 ~WAVLTree() = default;
+
+    NODISCARD CONSTEXPR20 bool search(const value_type &&value) const {
+        return searchElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 bool search(const value_type &value) const {
+        return searchElement(value);
+    }
+
+    // Throws std::length_error when SizeType can't index more nodes.
+    CONSTEXPR20 void insert(const value_type &&value) {
+        insertElement(value);
+    }
+
+    CONSTEXPR20 void insert(const value_type &value) {
+        insertElement(value);
+    }
+
+    CONSTEXPR20 void deleteValue(const value_type &&value) {
+        deleteElement(value);
+    }
+
+    CONSTEXPR20 void deleteValue(const value_type &value) {
+        deleteElement(value);
+    }
+
+    NODISCARD CONSTEXPR20 size_t size() const {
+        return pool.size();
+    }
+
+    NODISCARD CONSTEXPR20 bool isEmpty() const {
+        return root == null_index;
+    }
+
+    CONSTEXPR20 void reserve(size_t count) {
+        pool.reserve(count);
+    }
+
+    // Bytes held by the nodes.
+    NODISCARD CONSTEXPR20 size_t memoryUsage() const {
+        return pool.memoryUsage();
+    }
+
+    // Visit the keys in ascending order without recursion. The stack holds the path to the current node.
+    template<class Visitor>
+    CONSTEXPR20 void forEachInOrder(Visitor&& visitor) const {
+        path_type stack{};
+        size_t depth = 0;
+        auto node_current = root;
+
+        while (node_current != null_index || depth != 0) {
+            // Move down to the leftmost node.
+            while (node_current != null_index) {
+                stack[depth++] = node_current;
+                node_current = pool[node_current].getChild(left);
+            }
+
+            node_current = stack[--depth];
+            visitor(pool[node_current].key);
+            node_current = pool[node_current].getChild(right);
+        }
+    }
+
+    // Check the order of the keys and the rank rule: rank differences 1 or 2, leaves have rank 0.
+    NODISCARD CONSTEXPR20 bool verifyProperties() const {
+        bool valid = true;
+        size_t count = 0;
+        verifyNode(root, valid, count);
+        return valid && count == size();
+    }
+
+private:
+    CONSTEXPR20 bool searchElement(const value_type &key) const {
+        auto node_current = root;
+        while (node_current != null_index) {
+            const auto& node = pool[node_current];
+            if (isLess(key, node.key)) {
+                node_current = node.getChild(left);
+            } else if (isGreater(key, node.key)) {
+                node_current = node.getChild(right);
+            } else {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    CONSTEXPR20 void insertElement(const value_type &key) {
+        if (root == null_index) {
+            root = createNewNode(key);
+            return;
+        }
+
+        // Search the parent of the new node.
+        path_type path{};
+        size_t depth = 0;
+        size_t direction = left;
+        auto node_current = root;
+        while (node_current != null_index) {
+            path[depth++] = node_current;
+            const auto& node = pool[node_current];
+            if (isLess(key, node.key)) {
+                direction = left;
+            } else if (isGreater(key, node.key)) {
+                direction = right;
+            } else {
+                // The key is already in the tree.
+                return;
+            }
+
+            node_current = node.getChild(direction);
+        }
+
+        // The pool may move the nodes: no references are held across createNewNode().
+        const auto node_new = createNewNode(key);
+        const auto node_parent = path[depth - 1];
+        pool[node_parent].setChild(direction, node_new);
+
+        // The missing child had rank -1, the leaf has rank 0.
+        if (pool[node_parent].getRankDifference(direction) == 2) {
+            pool[node_parent].setRankDifference(direction, 1);
+            return;
+        }
+
+        rebalanceInsert(path, depth - 1, direction);
+    }
+
+    // The child of path[index] in the direction is a 0-child. path[0, index] is the path from the root.
+    CONSTEXPR20 void rebalanceInsert(const path_type &path, size_t index, size_t direction) {
+        while (true) {
+            const auto node_parent = path[index];
+
+            if (pool[node_parent].getRankDifference(1 - direction) == 1) {
+                // Promote the parent: the 0-child becomes a 1-child, the sibling a 2-child.
+                Stats::add(StatsEvent::rebalance);
+                pool[node_parent].setRankDifference(direction, 1);
+                pool[node_parent].setRankDifference(1 - direction, 2);
+                if (index == 0) {
+                    return;
+                }
+
+                // The parent moves one rank closer to its own parent.
+                const auto node_grandparent = path[index - 1];
+                const auto direction_parent = pool[node_grandparent].getChild(right) == node_parent ? right : left;
+                if (pool[node_grandparent].getRankDifference(direction_parent) == 2) {
+                    pool[node_grandparent].setRankDifference(direction_parent, 1);
+                    return;
+                }
+
+                direction = direction_parent;
+                index--;
+                continue;
+            }
+
+            // The sibling is a 2-child: one rotation fixes the rank rule for good.
+            // The 0-child was just promoted, so one of its children is a 1-child and the other one a 2-child.
+            const auto node_above = index != 0 ? path[index - 1] : null_index;
+            const auto node_child = pool[node_parent].getChild(direction);
+            if (pool[node_child].getRankDifference(direction) == 1) {
+                // The outer child is the 1-child: the child goes up, the parent is demoted.
+                rotate(node_parent, 1 - direction, node_above);
+                pool[node_child].setRankDifference(direction, 1);
+                pool[node_child].setRankDifference(1 - direction, 1);
+                pool[node_parent].setRankDifference(direction, 1);
+                pool[node_parent].setRankDifference(1 - direction, 1);
+            } else {
+                // The inner child is the 1-child: it goes up two levels and takes the rank of the parent.
+                const auto node_inner = pool[node_child].getChild(1 - direction);
+                const auto difference_to_child = pool[node_inner].getRankDifference(direction);
+                const auto difference_to_parent = pool[node_inner].getRankDifference(1 - direction);
+                rotate(node_child, direction, node_parent);
+                rotate(node_parent, 1 - direction, node_above);
+
+                pool[node_inner].setRankDifference(left, 1);
+                pool[node_inner].setRankDifference(right, 1);
+                pool[node_child].setRankDifference(direction, 1);
+                pool[node_child].setRankDifference(1 - direction, difference_to_child);
+                pool[node_parent].setRankDifference(direction, difference_to_parent);
+                pool[node_parent].setRankDifference(1 - direction, 1);
+            }
+
+            return;
+        }
+    }
+
+    CONSTEXPR20 void deleteElement(const value_type &key) {
+        path_type path{};
+        size_t depth = 0;
+        auto node_current = root;
+        while (node_current != null_index) {
+            const auto& node = pool[node_current];
+            size_t direction = left;
+            if (isLess(key, node.key)) {
+                direction = left;
+            } else if (isGreater(key, node.key)) {
+                direction = right;
+            } else {
+                break;
+            }
+
+            path[depth++] = node_current;
+            node_current = node.getChild(direction);
+        }
+
+        if (node_current == null_index) {
+            // The key was not found.
+            return;
+        }
+
+        // A node with two children takes the key of its successor, the node of the successor is deleted instead.
+        auto node_delete = node_current;
+        if (pool[node_current].getChild(left) != null_index && pool[node_current].getChild(right) != null_index) {
+            path[depth++] = node_current;
+            node_delete = pool[node_current].getChild(right);
+            while (pool[node_delete].getChild(left) != null_index) {
+                path[depth++] = node_delete;
+                node_delete = pool[node_delete].getChild(left);
+            }
+
+            pool[node_current].key = std::move(pool[node_delete].key);
+        }
+
+        // The deleted node is a leaf or has one leaf child: the child (or the missing child) has one rank less.
+        const auto node_child = pool[node_delete].getChild(left) != null_index
+                ? pool[node_delete].getChild(left)
+                : pool[node_delete].getChild(right);
+        if (depth == 0) {
+            root = node_child;
+            deleteNode(node_delete);
+            return;
+        }
+
+        const auto node_parent = path[depth - 1];
+        const auto direction = pool[node_parent].getChild(right) == node_delete ? right : left;
+        const auto difference = pool[node_parent].getRankDifference(direction) + 1;
+        pool[node_parent].setChild(direction, node_child);
+        deleteNode(node_delete);
+
+        rebalanceDelete(path, depth - 1, direction, difference);
+    }
+
+    // The child of path[index] in the direction has the rank difference 2 or 3, it isn't stored yet.
+    // path[0, index] is the path from the root.
+    CONSTEXPR20 void rebalanceDelete(const path_type &path, size_t index, size_t direction, size_t difference) {
+        while (true) {
+            const auto node_parent = path[index];
+
+            if (difference == 2) {
+                pool[node_parent].setRankDifference(direction, 2);
+
+                // A leaf must have rank 0: a 2,2 leaf is demoted.
+                const auto& parent = pool[node_parent];
+                if (parent.getChild(left) != null_index || parent.getChild(right) != null_index ||
+                    parent.getRankDifference(1 - direction) != 2) {
+                    return;
+                }
+
+                Stats::add(StatsEvent::rebalance);
+                pool[node_parent].setRankDifference(left, 1);
+                pool[node_parent].setRankDifference(right, 1);
+            } else {
+                // A 3-child. Its sibling has rank 0 at least, so it exists.
+                const auto node_sibling = pool[node_parent].getChild(1 - direction);
+                const auto& sibling = pool[node_sibling];
+
+                if (pool[node_parent].getRankDifference(1 - direction) == 2) {
+                    // Demote the parent.
+                    Stats::add(StatsEvent::rebalance);
+                    pool[node_parent].setRankDifference(direction, 2);
+                    pool[node_parent].setRankDifference(1 - direction, 1);
+                } else if (sibling.getRankDifference(left) == 2 && sibling.getRankDifference(right) == 2) {
+                    // Demote the parent and the 2,2 sibling.
+                    Stats::add(StatsEvent::rebalance);
+                    pool[node_parent].setRankDifference(direction, 2);
+                    pool[node_sibling].setRankDifference(left, 1);
+                    pool[node_sibling].setRankDifference(right, 1);
+                } else {
+                    rotateDelete(path, index, direction);
+                    return;
+                }
+            }
+
+            if (index == 0) {
+                return;
+            }
+
+            // The parent is one rank further from its own parent.
+            const auto node_grandparent = path[index - 1];
+            direction = pool[node_grandparent].getChild(right) == node_parent ? right : left;
+            difference = pool[node_grandparent].getRankDifference(direction) + 1;
+            index--;
+        }
+    }
+
+    // The child of path[index] in the direction is a 3-child, its sibling a 1-child with a 1-child.
+    CONSTEXPR20 void rotateDelete(const path_type &path, size_t index, size_t direction) {
+        const auto node_parent = path[index];
+        const auto node_above = index != 0 ? path[index - 1] : null_index;
+        const auto node_sibling = pool[node_parent].getChild(1 - direction);
+        const auto node_inner = pool[node_sibling].getChild(direction);
+
+        if (pool[node_sibling].getRankDifference(1 - direction) == 1) {
+            // The outer child of the sibling is a 1-child: the sibling goes up and is promoted, the parent is demoted.
+            const auto difference_inner = pool[node_sibling].getRankDifference(direction);
+            rotate(node_parent, direction, node_above);
+
+            pool[node_sibling].setRankDifference(1 - direction, 2);
+            pool[node_sibling].setRankDifference(direction, 1);
+            pool[node_parent].setRankDifference(direction, 2);
+            pool[node_parent].setRankDifference(1 - direction, difference_inner);
+
+            // A leaf must have rank 0: demote the parent once more.
+            if (pool[node_parent].getChild(left) == null_index && pool[node_parent].getChild(right) == null_index) {
+                pool[node_parent].setRankDifference(left, 1);
+                pool[node_parent].setRankDifference(right, 1);
+                pool[node_sibling].setRankDifference(direction, 2);
+            }
+        } else {
+            // The inner child of the sibling is the 1-child: it goes up two levels and is promoted twice,
+            // the sibling is demoted once and the parent twice.
+            const auto difference_to_parent = pool[node_inner].getRankDifference(direction);
+            const auto difference_to_sibling = pool[node_inner].getRankDifference(1 - direction);
+            rotate(node_sibling, 1 - direction, node_parent);
+            rotate(node_parent, direction, node_above);
+
+            pool[node_inner].setRankDifference(left, 2);
+            pool[node_inner].setRankDifference(right, 2);
+            pool[node_sibling].setRankDifference(1 - direction, 1);
+            pool[node_sibling].setRankDifference(direction, difference_to_sibling);
+            pool[node_parent].setRankDifference(direction, 1);
+            pool[node_parent].setRankDifference(1 - direction, difference_to_parent);
+        }
+    }
+
+    // Rotate node to the direction: its child on the other side takes its place under parent (null for the root).
+    // The rank differences of the moved links are left to the caller.
+    CONSTEXPR20 size_type rotate(size_type node, size_t direction, size_type parent) {
+        Stats::add(StatsEvent::rotation);
+        const auto node_top = pool[node].getChild(1 - direction);
+        pool[node].setChild(1 - direction, pool[node_top].getChild(direction));
+        pool[node_top].setChild(direction, node);
+
+        if (parent == null_index) {
+            root = node_top;
+        } else {
+            const auto direction_parent = pool[parent].getChild(right) == node ? right : left;
+            pool[parent].setChild(direction_parent, node_top);
+        }
+
+        return node_top;
+    }
+
+    NODISCARD CONSTEXPR20 size_type createNewNode(const value_type& key) {
+        Stats::add(StatsEvent::allocation);
+        return pool.create(key);
+    }
+
+    CONSTEXPR20 void deleteNode(size_type node) {
+        pool.destroy(node);
+    }
+
+    // Returns the rank of the subtree, -1 for the missing node.
+    CONSTEXPR20 long long verifyNode(size_type node, bool &valid, size_t &count) const {
+        if (node == null_index) {
+            return -1;
+        }
+
+        count++;
+        const auto& node_ref = pool[node];
+        const auto node_left = node_ref.getChild(left);
+        const auto node_right = node_ref.getChild(right);
+        if ((node_left != null_index && !isLess(pool[node_left].key, node_ref.key)) ||
+            (node_right != null_index && !isGreater(pool[node_right].key, node_ref.key))) {
+            valid = false;
+        }
+
+        const auto rank_left = verifyNode(node_left, valid, count) + static_cast<long long>(node_ref.getRankDifference(left));
+        const auto rank_right = verifyNode(node_right, valid, count) + static_cast<long long>(node_ref.getRankDifference(right));
+        if (rank_left != rank_right) {
+            valid = false;
+        }
+
+        if (node_left == null_index && node_right == null_index && rank_left != 0) {
+            valid = false;
+        }
+
+        return rank_left;
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isGreater(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) > comparedKey(value_b);
+    }
+
+    template<class T>
+    NODISCARD CONSTEXPR20 bool isLess(const T& value_a, const T& value_b) const {
+        Stats::add(StatsEvent::comparison);
+        return comparedKey(value_a) < comparedKey(value_b);
+    }
+};
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include "head.h"
+
+constexpr size_t cache_line_size = 64;
+
+// Allocator for containers whose memory must start at an aligned address (a cache line by default).
+template<class DataType, size_t Alignment = cache_line_size>
+class AlignedAllocator {
+public:
+    using value_type = DataType;
+
+    template<class OtherType>
+    struct rebind {
+        using other = AlignedAllocator<OtherType, Alignment>;
+    };
+
+    CONSTEXPR20 AlignedAllocator() noexcept = default;
+
+    template<class OtherType>
+    CONSTEXPR20 AlignedAllocator(const AlignedAllocator<OtherType, Alignment>&) noexcept {}
+
+    NODISCARD value_type* allocate(size_t count) {
+        return static_cast<value_type*>(::operator new(count * sizeof(value_type), std::align_val_t{ Alignment }));
+    }
+
+    void deallocate(value_type* pointer, size_t) noexcept {
+        ::operator delete(pointer, std::align_val_t{ Alignment });
+    }
+
+    template<class OtherType>
+    NODISCARD CONSTEXPR20 bool operator==(const AlignedAllocator<OtherType, Alignment>&) const noexcept {
+        return true;
+    }
+};
@@ -0,0 +1,264 @@
+#pragma once
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "head.h"
+#include "perf_counters.h"
+
+#if defined(_MSC_VER)
+#	include <intrin.h>
+#endif
+
+// Result of one benchmark case. The best (minimum) time of all repetitions is kept
+// together with the hardware counters of that repetition.
+struct BenchmarkResult {
+    std::string name{};
+    size_t elements{};
+    double seconds{};
+    PerfCounterValues counters{};
+};
+
+// Command line of the benchmarks: [elements count] [--perf] [--json=<file>]
+// + --perf reads the hardware counters around every repetition and reports them per element.
+// + --json writes all results to the file, the counters which can't be read are null.
+struct BenchmarkOptions {
+    bool perf_counters{ false };
+    std::string json_path{};
+};
+
+// Keep the value alive so the compiler can't drop the computation which produced it.
+template<class DataType>
+void doNotOptimize(const DataType& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    // The address only: any type works and nothing is copied inside the measured loop.
+    static const volatile void* sink;
+    sink = &value;
+#	if defined(_MSC_VER)
+    _ReadWriteBarrier();
+#	endif
+#endif
+}
+
+// Number of elements for the benchmark: the first command line argument which is not an option or the default value.
+NODISCARD inline size_t benchmarkElementsCount(int argc, char** argv, size_t default_count) {
+    for (int index = 1; index < argc; index++) {
+        if (std::strncmp(argv[index], "--", 2) == 0) {
+            continue;
+        }
+
+        const auto count = std::strtoull(argv[index], nullptr, 10);
+        if (count != 0) {
+            return static_cast<size_t>(count);
+        }
+
+        break;
+    }
+
+    return default_count;
+}
+
+NODISCARD inline BenchmarkOptions parseBenchmarkOptions(int argc, char** argv) {
+    BenchmarkOptions options{};
+    for (int index = 1; index < argc; index++) {
+        const std::string argument{ argv[index] };
+        if (argument == "--perf") {
+            options.perf_counters = true;
+        } else if (argument.rfind("--json=", 0) == 0) {
+            options.json_path = argument.substr(7);
+        }
+    }
+
+    return options;
+}
+
+// Minimal benchmark runner.
+// Every case is repeated, the minimum time is reported together with the time per element.
+class BenchmarkRunner {
+public:
+    using size_type = size_t;
+
+    explicit BenchmarkRunner(std::string suite_name, size_type repetitions = 3) :
+            BenchmarkRunner{ std::move(suite_name), BenchmarkOptions{}, repetitions }
+    {
+    }
+
+    // Without counters (no PMU, a VM, perf_event_paranoid) the --perf mode reports the time only.
+    explicit BenchmarkRunner(std::string suite_name, BenchmarkOptions options, size_type repetitions = 3) :
+            suite_name{ std::move(suite_name) },
+            repetitions{ repetitions != 0 ? repetitions : 1 },
+            options{ std::move(options) }
+    {
+        if (this->options.perf_counters) {
+            perf_counters = std::make_unique<PerfCounters>();
+            if (!perf_counters->getError().empty()) {
+                std::cerr << "Hardware counters are not available (" << perf_counters->getError() << ")" << std::endl;
+            }
+        }
+    }
+
+    BenchmarkRunner(const BenchmarkRunner&) = delete;
+    BenchmarkRunner& operator=(const BenchmarkRunner&) = delete;
+
+    ~BenchmarkRunner() {
+        if (!options.json_path.empty()) {
+            std::ofstream file{ options.json_path };
+            if (file) {
+                writeJson(file);
+            } else {
+                std::cerr << "Can't write " << options.json_path << std::endl;
+            }
+        }
+    }
+
+    // setup() prepares the state before every repetition and is not measured. body(state) is measured.
+    template<class Setup, class Body>
+    void run(const std::string& name, size_type elements, Setup&& setup, Body&& body) {
+        BenchmarkResult result{ name, elements, 0.0 };
+
+        for (size_type repetition = 0; repetition < repetitions; repetition++) {
+            auto state = setup();
+
+            if (perf_counters) {
+                perf_counters->start();
+            }
+            const auto start = std::chrono::steady_clock::now();
+            body(state);
+            const auto stop = std::chrono::steady_clock::now();
+            const auto counters = perf_counters ? perf_counters->stop() : PerfCounterValues{};
+
+            const double seconds = std::chrono::duration<double>(stop - start).count();
+            if (repetition == 0 || seconds < result.seconds) {
+                result.seconds = seconds;
+                result.counters = counters;
+            }
+        }
+
+        results.push_back(result);
+        printResult(std::cout, result, perf_counters != nullptr);
+    }
+
+    template<class Body>
+    void run(const std::string& name, size_type elements, Body&& body) {
+        run(name, elements, []() { return 0; }, [&body](int) { body(); });
+    }
+
+    NODISCARD const std::vector<BenchmarkResult>& getResults() const {
+        return results;
+    }
+
+    void printHeader(std::ostream& os) const {
+        os << "Benchmark: " << suite_name << " (best of " << repetitions << ")" << std::endl;
+        os << std::left << std::setw(48) << "case" << std::right << std::setw(12) << "elements"
+           << std::setw(14) << "total ms" << std::setw(14) << "ns/element";
+        if (perf_counters) {
+            // Counts per element.
+            os << std::setw(9) << "IPC";
+            for (size_type index = 0; index < perf_events_count; index++) {
+                os << std::setw(15) << perfEventName(static_cast<PerfEvent>(index));
+            }
+        }
+        os << std::endl;
+    }
+
+    // {"suite", "repetitions", "results": [{"name", "elements", "seconds", "ns_per_element", "ipc", "counters", "per_element"}]}
+    void writeJson(std::ostream& os) const {
+        os << "{\n  \"suite\": ";
+        writeJsonString(os, suite_name);
+        os << ",\n  \"repetitions\": " << repetitions << ",\n  \"results\": [";
+
+        for (size_type index = 0; index < results.size(); index++) {
+            const auto& result = results[index];
+            os << (index != 0 ? "," : "") << "\n    {\"name\": ";
+            writeJsonString(os, result.name);
+            os << ", \"elements\": " << result.elements << std::setprecision(9)
+               << ", \"seconds\": " << result.seconds << ", \"ns_per_element\": " << perElement(result.seconds * 1e9, result);
+
+            os << ", \"ipc\": ";
+            if (result.counters.has(PerfEvent::cycles) && result.counters.has(PerfEvent::instructions) && result.counters[PerfEvent::cycles] != 0) {
+                os << static_cast<double>(result.counters[PerfEvent::instructions]) / static_cast<double>(result.counters[PerfEvent::cycles]);
+            } else {
+                os << "null";
+            }
+
+            for (const auto per_element : { false, true }) {
+                os << (per_element ? ", \"per_element\": {" : ", \"counters\": {");
+                for (size_type event_index = 0; event_index < perf_events_count; event_index++) {
+                    const auto event = static_cast<PerfEvent>(event_index);
+                    os << (event_index != 0 ? ", " : "") << "\"" << perfEventName(event) << "\": ";
+                    if (!result.counters.has(event)) {
+                        os << "null";
+                    } else if (per_element) {
+                        os << perElement(static_cast<double>(result.counters[event]), result);
+                    } else {
+                        os << result.counters[event];
+                    }
+                }
+                os << "}";
+            }
+            os << "}";
+        }
+
+        os << "\n  ]\n}" << std::endl;
+    }
+
+private:
+    std::string suite_name{};
+    size_type repetitions{ 3 };
+    BenchmarkOptions options{};
+    std::unique_ptr<PerfCounters> perf_counters{};
+    std::vector<BenchmarkResult> results{};
+
+    NODISCARD static double perElement(double value, const BenchmarkResult& result) {
+        return result.elements != 0 ? value / static_cast<double>(result.elements) : 0.0;
+    }
+
+    static void printResult(std::ostream& os, const BenchmarkResult& result, bool print_counters) {
+        const double per_element = perElement(result.seconds * 1e9, result);
+
+        os << std::left << std::setw(48) << result.name << std::right << std::setw(12) << result.elements
+           << std::setw(14) << std::fixed << std::setprecision(3) << result.seconds * 1e3
+           << std::setw(14) << std::setprecision(2) << per_element;
+
+        if (print_counters) {
+            const auto& counters = result.counters;
+            if (counters.has(PerfEvent::cycles) && counters.has(PerfEvent::instructions) && counters[PerfEvent::cycles] != 0) {
+                os << std::setw(9) << static_cast<double>(counters[PerfEvent::instructions]) / static_cast<double>(counters[PerfEvent::cycles]);
+            } else {
+                os << std::setw(9) << "n/a";
+            }
+
+            for (size_type index = 0; index < perf_events_count; index++) {
+                const auto event = static_cast<PerfEvent>(index);
+                if (counters.has(event)) {
+                    os << std::setw(15) << perElement(static_cast<double>(counters[event]), result);
+                } else {
+                    os << std::setw(15) << "n/a";
+                }
+            }
+        }
+        os << std::endl;
+    }
+
+    static void writeJsonString(std::ostream& os, const std::string& value) {
+        os << '"';
+        for (const auto symbol : value) {
+            if (symbol == '"' || symbol == '\\') {
+                os << '\\' << symbol;
+            } else if (static_cast<unsigned char>(symbol) < 0x20) {
+                os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(symbol) << std::dec << std::setfill(' ');
+            } else {
+                os << symbol;
+            }
+        }
+        os << '"';
+    }
+};
@@ -1,4 +1,5 @@
 #pragma once
+#include <memory>
 #include "head.h"
 
 // Functors
@@ -18,6 +19,17 @@ public:
     }
 };
 
+// The key the trees compare: a shared_ptr key is compared by the object it points to.
+template<class DataType>
+NODISCARD CONSTEXPR20 const DataType& comparedKey(const DataType& key) {
+    return key;
+}
+
+template<class DataType>
+NODISCARD CONSTEXPR20 const DataType& comparedKey(const std::shared_ptr<DataType>& key) {
+    return *key;
+}
+
 // Lambdas are actually functors.
 template<typename DataType>
 CONSTEXPR20 auto compPtrMax = [](const DataType& child, const DataType& peek) -> bool {
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "head.h"
+
+// Duplicate key policies of the trees: what the tree does with a key equal to a key in the tree.
+// + UniqueKeys is the default: the key is not inserted, like std::set.
+// + CountedKeys collapses the equal keys into a count in the node, O(1) extra memory per node and none per duplicate.
+//   For the keys whose equal values are interchangeable: the tree stores only the first of them.
+// + ChainedKeys keeps all the equal keys in the node in insertion order, like std::multiset.
+//   For the keys which carry data besides the ordered part, e.g. the objects with equal scores.
+// Either way the equal keys share one node, so the search paths and the height of the tree do not grow with the duplicates.
+struct UniqueKeys {};
+struct CountedKeys {};
+struct ChainedKeys {};
+
+// The keys of a node equal to its key. The index of a key is its position in insertion order, 0 is the key of the node.
+template<class DataType, class SizeType, class Duplicates>
+class NodeDuplicates;
+
+template<class DataType, class SizeType>
+class NodeDuplicates<DataType, SizeType, UniqueKeys> {
+public:
+    NODISCARD CONSTEXPR20 SizeType count() const {
+        return 1;
+    }
+
+    NODISCARD CONSTEXPR20 const DataType &key(const DataType &node_key, SizeType) const {
+        return node_key;
+    }
+};
+
+template<class DataType, class SizeType>
+class NodeDuplicates<DataType, SizeType, CountedKeys> {
+public:
+    NODISCARD CONSTEXPR20 SizeType count() const {
+        return keys_count;
+    }
+
+    NODISCARD CONSTEXPR20 const DataType &key(const DataType &node_key, SizeType) const {
+        return node_key;
+    }
+
+    CONSTEXPR20 void add(const DataType &) {
+        keys_count++;
+    }
+
+    // The count must stay above zero: the last key goes with its node.
+    CONSTEXPR20 void remove(DataType &, SizeType) {
+        keys_count--;
+    }
+
+private:
+    SizeType keys_count{ 1 };
+};
+
+template<class DataType, class SizeType>
+class NodeDuplicates<DataType, SizeType, ChainedKeys> {
+public:
+    NODISCARD CONSTEXPR20 SizeType count() const {
+        return static_cast<SizeType>(chain.size()) + 1;
+    }
+
+    NODISCARD CONSTEXPR20 const DataType &key(const DataType &node_key, SizeType index) const {
+        return index == 0 ? node_key : chain[index - 1];
+    }
+
+    CONSTEXPR20 void add(const DataType &key) {
+        chain.push_back(key);
+    }
+
+    // The later keys move one position down, the first of the chain takes the place of the key of the node.
+    // The last key goes with its node.
+    CONSTEXPR20 void remove(DataType &node_key, SizeType index) {
+        if (index == 0) {
+            node_key = std::move(chain.front());
+            index = 1;
+        }
+
+        chain.erase(chain.begin() + static_cast<std::ptrdiff_t>(index - 1));
+    }
+
+private:
+    // The keys after the key of the node.
+    std::vector<DataType> chain{};
+};
@@ -15,4 +15,21 @@
 #	else
 #		define NODISCARD
 #	endif
-#endif
\ No newline at end of file
+#endif
+
+// Software prefetch of the cache line with the address into all cache levels. It never faults.
+#if defined(__GNUC__) || defined(__clang__)
+#	define PREFETCH(address) __builtin_prefetch(static_cast<const void*>(address))
+#elif defined(_MSC_VER)
+#	include <xmmintrin.h>
+#	define PREFETCH(address) _mm_prefetch(reinterpret_cast<const char*>(address), _MM_HINT_T0)
+#else
+#	define PREFETCH(address) static_cast<void>(address)
+#endif
+
+// An empty member takes no storage, e.g. the empty policy state of a node.
+#if defined(_MSC_VER) && !defined(__clang__)
+#	define NO_UNIQUE_ADDRESS [[msvc::no_unique_address]]
+#else
+#	define NO_UNIQUE_ADDRESS [[no_unique_address]]
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include "head.h"
+#include "thread_pool.h"
+
+// Parallel build of a binary heap stored in an array: heapify_node(index) sifts the node down within [0, size).
+// The subtrees of the nodes of one level don't intersect, so the nodes of a level are heapified concurrently.
+// Levels are processed from the deepest one with children up to the root. Arrays smaller than grain_size are built serially.
+template<class HeapifyNode>
+void heapifyLevelsParallel(size_t size, ThreadPool& pool, size_t grain_size, HeapifyNode&& heapify_node) {
+    // Nodes [0, size / 2) have children.
+    const auto internal_end = size / 2;
+    if (size < grain_size || pool.size() < 2) {
+        for (auto index = internal_end; index != 0; index--) {
+            heapify_node(index - 1);
+        }
+        return;
+    }
+
+    // The first node of the deepest level with children.
+    size_t level_first = 0;
+    while (2 * level_first + 1 < internal_end) {
+        level_first = 2 * level_first + 1;
+    }
+
+    // Maximum number of swaps made by heapify_node() for a node of the current level.
+    size_t level_height = 1;
+
+    while (true) {
+        const auto level_last = (2 * level_first + 1 < internal_end) ? 2 * level_first + 1 : internal_end;
+        // Upper levels do more work per node, so they are split into smaller chunks.
+        const auto level_grain_size = (grain_size / level_height) != 0 ? grain_size / level_height : 1;
+
+        pool.parallelFor(level_first, level_last, level_grain_size, [&heapify_node](size_t first, size_t last) {
+            for (auto index = first; index < last; index++) {
+                heapify_node(index);
+            }
+        });
+
+        if (level_first == 0) {
+            break;
+        }
+
+        level_first = (level_first - 1) / 2;
+        level_height++;
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "head.h"
+
+// Pool of nodes addressed by index instead of pointer.
+// + The nodes live in one array: no allocation per node and no reference count, a link is as wide as IndexType.
+// + Index 0 is the null node. It is never handed out, so a zero link means "no child".
+// + Freed indices go to a free list and are reused first.
+// create() may reallocate the array: indices stay valid, references to nodes don't.
+template<class NodeType, class IndexType = uint32_t>
+class IndexPool {
+public:
+    using node_type = NodeType;
+    using index_type = IndexType;
+    using size_type = size_t;
+
+    static_assert(std::numeric_limits<index_type>::is_integer && !std::numeric_limits<index_type>::is_signed,
+                  "IndexType must be an unsigned integer");
+
+    // max_index: the largest index which fits into the links of the owner.
+    explicit IndexPool(index_type max_index = std::numeric_limits<index_type>::max()) :
+            max_index{ max_index }
+    {
+    }
+
+    // Throws std::length_error when all indices up to max_index are in use.
+    template<class... Args>
+    NODISCARD index_type create(Args&&... args) {
+        if (!free_indices.empty()) {
+            const auto index = free_indices.back();
+            free_indices.pop_back();
+            nodes[index] = node_type(std::forward<Args>(args)...);
+            return index;
+        }
+
+        if (nodes.size() > static_cast<size_type>(max_index)) {
+            throw std::length_error("IndexPool: the index type is too narrow for more nodes");
+        }
+
+        nodes.emplace_back(std::forward<Args>(args)...);
+        return static_cast<index_type>(nodes.size() - 1);
+    }
+
+    // The slot is reset, so the resources of the key are released now.
+    void destroy(index_type index) {
+        nodes[index] = node_type{};
+        free_indices.push_back(index);
+    }
+
+    NODISCARD node_type& operator[](index_type index) {
+        return nodes[index];
+    }
+
+    NODISCARD const node_type& operator[](index_type index) const {
+        return nodes[index];
+    }
+
+    // Live nodes.
+    NODISCARD size_type size() const {
+        return nodes.size() - 1 - free_indices.size();
+    }
+
+    void reserve(size_type count) {
+        nodes.reserve(count + 1);
+    }
+
+    void clear() {
+        nodes.resize(1);
+        free_indices.clear();
+    }
+
+    // Bytes held by the pool.
+    NODISCARD size_type memoryUsage() const {
+        return nodes.capacity() * sizeof(node_type) + free_indices.capacity() * sizeof(index_type);
+    }
+
+private:
+    // Slot 0 is the null node.
+    std::vector<node_type> nodes = std::vector<node_type>(1);
+    std::vector<index_type> free_indices{};
+    index_type max_index{};
+};
@@ -0,0 +1,186 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <utility>
+#include "head.h"
+
+// Slab allocator for nodes of one type.
+// + Nodes are carved from slabs of SlabSize slots: one allocation per SlabSize nodes, nodes of one structure stay close in memory.
+// + Freed slots go to a free list and are reused first.
+// + Pools can be spliced in O(1), so nodes may move between structures (meld) without reallocation.
+// + release() frees all slabs at once without visiting the nodes.
+template<class NodeType, size_t SlabSize = 1024>
+class NodePool {
+public:
+    using node_type = NodeType;
+    using size_type = size_t;
+
+    CONSTEXPR20 NodePool() = default;
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    NodePool(NodePool&& other) noexcept {
+        swap(other);
+    }
+
+    NodePool& operator=(NodePool&& other) noexcept {
+        if (this != &other) {
+            release();
+            swap(other);
+        }
+
+        return *this;
+    }
+
+    // Live nodes must be destroyed by the owner before, the pool only frees the memory.
+    ~NodePool() {
+        release();
+    }
+
+    template<class... Args>
+    NODISCARD node_type* create(Args&&... args) {
+        return new (allocateSlot()) node_type(std::forward<Args>(args)...);
+    }
+
+    void destroy(node_type* node) noexcept {
+        node->~node_type();
+        auto slot = reinterpret_cast<Slot*>(node);
+        pushFreeSlot(slot);
+        nodes_count--;
+    }
+
+    // Take all slabs and free slots of the other pool. Nodes created by the other pool may be destroyed by this one afterwards.
+    void splice(NodePool& other) noexcept {
+        if (this == &other || !other.slab_head) {
+            return;
+        }
+
+        // Slabs.
+        other.slab_tail->next = slab_head;
+        if (!slab_head) {
+            slab_tail = other.slab_tail;
+        }
+        slab_head = other.slab_head;
+
+        // Keep the slab with more unused slots for the bump allocation.
+        if (SlabSize - other.slab_used > SlabSize - slab_used || !slab_current) {
+            slab_current = other.slab_current;
+            slab_used = other.slab_used;
+        }
+
+        // Free slots.
+        if (other.free_head) {
+            other.free_tail->next = free_head;
+            if (!free_head) {
+                free_tail = other.free_tail;
+            }
+            free_head = other.free_head;
+        }
+
+        nodes_count += other.nodes_count;
+        slabs_count += other.slabs_count;
+        other.reset();
+    }
+
+    // Free all slabs at once. Live nodes must not have non-trivial destructors or must be destroyed before.
+    void release() noexcept {
+        auto slab = slab_head;
+        while (slab) {
+            auto next = slab->next;
+            delete slab;
+            slab = next;
+        }
+
+        reset();
+    }
+
+    NODISCARD size_type size() const {
+        return nodes_count;
+    }
+
+    // Memory held by the pool in bytes.
+    NODISCARD size_type capacityBytes() const {
+        return slabs_count * sizeof(Slab);
+    }
+
+private:
+    union Slot {
+        Slot* next;
+        alignas(node_type) unsigned char storage[sizeof(node_type)];
+    };
+
+    struct Slab {
+        Slab* next{};
+        Slot slots[SlabSize];
+    };
+
+    Slab* slab_head{};
+    Slab* slab_tail{};
+    // Slab for the bump allocation.
+    Slab* slab_current{};
+    size_type slab_used{ SlabSize };
+    Slot* free_head{};
+    Slot* free_tail{};
+    size_type nodes_count{ 0 };
+    size_type slabs_count{ 0 };
+
+    NODISCARD void* allocateSlot() {
+        nodes_count++;
+
+        if (free_head) {
+            auto slot = free_head;
+            free_head = slot->next;
+            if (!free_head) {
+                free_tail = nullptr;
+            }
+
+            return slot->storage;
+        }
+
+        if (!slab_current || slab_used == SlabSize) {
+            auto slab = new Slab;
+            slab->next = slab_head;
+            slab_head = slab;
+            if (!slab_tail) {
+                slab_tail = slab;
+            }
+
+            slab_current = slab;
+            slab_used = 0;
+            slabs_count++;
+        }
+
+        return slab_current->slots[slab_used++].storage;
+    }
+
+    void pushFreeSlot(Slot* slot) noexcept {
+        slot->next = free_head;
+        if (!free_head) {
+            free_tail = slot;
+        }
+        free_head = slot;
+    }
+
+    void reset() noexcept {
+        slab_head = nullptr;
+        slab_tail = nullptr;
+        slab_current = nullptr;
+        slab_used = SlabSize;
+        free_head = nullptr;
+        free_tail = nullptr;
+        nodes_count = 0;
+        slabs_count = 0;
+    }
+
+    void swap(NodePool& other) noexcept {
+        std::swap(slab_head, other.slab_head);
+        std::swap(slab_tail, other.slab_tail);
+        std::swap(slab_current, other.slab_current);
+        std::swap(slab_used, other.slab_used);
+        std::swap(free_head, other.free_head);
+        std::swap(free_tail, other.free_tail);
+        std::swap(nodes_count, other.nodes_count);
+        std::swap(slabs_count, other.slabs_count);
+    }
+};
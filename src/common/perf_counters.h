@@ -0,0 +1,171 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include "head.h"
+
+#if defined(__linux__)
+#	include <cerrno>
+#	include <cstring>
+#	include <linux/perf_event.h>
+#	include <sys/ioctl.h>
+#	include <sys/syscall.h>
+#	include <unistd.h>
+#endif
+
+// Hardware performance counters read with perf_event_open (Linux only).
+// Every event is opened on its own: an event refused by the CPU, the hypervisor or perf_event_paranoid is marked
+// unavailable and the others keep counting. On other systems no event is available.
+// The counters count the user space of the calling thread and of the threads started after the counters are opened.
+enum class PerfEvent : size_t {
+    cycles = 0,
+    instructions,
+    l1d_misses,
+    llc_misses,
+    branch_misses,
+    dtlb_misses
+};
+
+constexpr size_t perf_events_count = 6;
+
+NODISCARD constexpr const char* perfEventName(PerfEvent event) {
+    constexpr const char* names[perf_events_count]{ "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses", "dtlb_misses" };
+    return names[static_cast<size_t>(event)];
+}
+
+// Counts of one measured interval.
+struct PerfCounterValues {
+    std::array<uint64_t, perf_events_count> values{};
+    std::array<bool, perf_events_count> available{};
+
+    NODISCARD bool has(PerfEvent event) const {
+        return available[static_cast<size_t>(event)];
+    }
+
+    NODISCARD uint64_t operator[](PerfEvent event) const {
+        return values[static_cast<size_t>(event)];
+    }
+};
+
+class PerfCounters {
+public:
+    PerfCounters() {
+        descriptors.fill(-1);
+#if defined(__linux__)
+        // Generic cache misses are the last level cache misses on the common CPUs.
+        const std::array<std::pair<uint32_t, uint64_t>, perf_events_count> events{ {
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_L1D) },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+            { PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_DTLB) }
+        } };
+
+        for (size_t index = 0; index < perf_events_count; index++) {
+            descriptors[index] = openEvent(events[index].first, events[index].second);
+            if (descriptors[index] < 0 && error.empty()) {
+                error = std::string{ perfEventName(static_cast<PerfEvent>(index)) } + ": " + std::strerror(errno);
+            }
+        }
+#else
+        error = "perf_event_open is not supported on this system";
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+#if defined(__linux__)
+        for (const auto descriptor : descriptors) {
+            if (descriptor >= 0) {
+                close(descriptor);
+            }
+        }
+#endif
+    }
+
+    // True if at least one event can be counted.
+    NODISCARD bool isAvailable() const {
+        for (const auto descriptor : descriptors) {
+            if (descriptor >= 0) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Reason why the first unavailable event was refused, empty if all events are available.
+    NODISCARD const std::string& getError() const {
+        return error;
+    }
+
+    void start() {
+#if defined(__linux__)
+        for (const auto descriptor : descriptors) {
+            if (descriptor >= 0) {
+                ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+                ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    NODISCARD PerfCounterValues stop() {
+        PerfCounterValues result{};
+#if defined(__linux__)
+        for (const auto descriptor : descriptors) {
+            if (descriptor >= 0) {
+                ioctl(descriptor, PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+
+        for (size_t index = 0; index < perf_events_count; index++) {
+            if (descriptors[index] < 0) {
+                continue;
+            }
+
+            // value, time enabled, time running.
+            uint64_t data[3]{};
+            if (read(descriptors[index], data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || data[2] == 0) {
+                continue;
+            }
+
+            // More events than hardware counters: the kernel multiplexes them, scale the count to the whole interval.
+            result.values[index] = data[2] < data[1]
+                    ? static_cast<uint64_t>(static_cast<double>(data[0]) * static_cast<double>(data[1]) / static_cast<double>(data[2]))
+                    : data[0];
+            result.available[index] = true;
+        }
+#endif
+        return result;
+    }
+
+private:
+    std::array<int, perf_events_count> descriptors{};
+    std::string error{};
+
+#if defined(__linux__)
+    NODISCARD static constexpr uint64_t cacheEvent(uint64_t cache) {
+        return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    }
+
+    NODISCARD static int openEvent(uint32_t type, uint64_t config) {
+        perf_event_attr attributes{};
+        attributes.size = sizeof(attributes);
+        attributes.type = type;
+        attributes.config = config;
+        attributes.disabled = 1;
+        attributes.inherit = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+    }
+#endif
+};
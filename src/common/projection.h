@@ -0,0 +1,76 @@
+#pragma once
+#include <functional>
+#include <type_traits>
+#include <vector>
+#include "head.h"
+
+// Compares projected keys: comp(proj(child), proj(peek)).
+// The sorts receive it as a regular comparator, so the projection costs nothing extra.
+template<class Comparator, class Projection>
+class ProjectedComparator {
+public:
+    CONSTEXPR20 ProjectedComparator(Comparator comp, Projection proj) :
+            comp{ comp },
+            proj{ proj }
+    {
+    }
+
+    template<class DataType>
+    NODISCARD CONSTEXPR20 bool operator()(const DataType& child, const DataType& peek) const {
+        return comp(std::invoke(proj, child), std::invoke(proj, peek));
+    }
+
+private:
+    Comparator comp;
+    Projection proj;
+};
+
+// Key decorated with the original position of its element.
+template<class KeyType>
+struct CachedKey {
+    KeyType key;
+    size_t index;
+};
+
+// Decorate-sort-undecorate (Schwartzian transform).
+// Every key is computed once, then "sorter" orders the (key, index) pairs and the elements are moved into place.
+// Equal keys are ordered by the original index, so the result is stable whatever sort is used.
+template<typename DataType, typename Comparator, typename Projection, typename Sorter>
+CONSTEXPR20 void sortByCachedKeys(std::vector<DataType>& vec, Comparator comp, Projection proj, Sorter sorter) {
+    using key_type = std::remove_cvref_t<std::invoke_result_t<Projection&, const DataType&>>;
+    using cached_key_type = CachedKey<key_type>;
+
+    const auto size = vec.size();
+    if (size < 2) {
+        return;
+    }
+
+    // Decorate.
+    std::vector<cached_key_type> keys{};
+    keys.reserve(size);
+    for (size_t index = 0; index < size; index++) {
+        keys.push_back(cached_key_type{ std::invoke(proj, vec[index]), index });
+    }
+
+    // Sort.
+    sorter(keys, [&comp](const cached_key_type& child, const cached_key_type& peek) -> bool {
+        if (comp(child.key, peek.key)) {
+            return true;
+        }
+
+        if (comp(peek.key, child.key)) {
+            return false;
+        }
+
+        return child.index < peek.index;
+    });
+
+    // Undecorate.
+    std::vector<DataType> sorted{};
+    sorted.reserve(size);
+    for (const auto& cached_key : keys) {
+        sorted.push_back(std::move(vec[cached_key.index]));
+    }
+
+    vec = std::move(sorted);
+}
@@ -0,0 +1,400 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "head.h"
+
+#if defined(_WIN32)
+#	include <io.h>
+#else
+#	include <cerrno>
+#	include <unistd.h>
+#endif
+
+// Binary snapshot of the keys of a container, streamed to and from a file descriptor through a large buffer.
+// Layout, all in the byte order of the host (the byte order mark of the header rejects a foreign one):
+//   SnapshotHeader: magic, format version, byte order mark, kind, key size, key count
+//   the keys, key size bytes each: ascending for the trees, the array order for Heap
+//   uint64_t checksum of the header and the keys
+// The keys are copied as bytes, so they must be trivially copyable: pointers and shared_ptr can't be saved.
+// The errors (I/O, a truncated or damaged stream, another format) throw std::runtime_error.
+enum class SnapshotKind : uint32_t {
+    sorted_keys = 1,
+    heap_array = 2
+};
+
+struct SnapshotHeader {
+    static constexpr uint64_t magic_value = 0x50414E5353444143;  // "CADSSNAP"
+    static constexpr uint32_t format_version_value = 1;
+    static constexpr uint32_t byte_order_value = 0x01020304;
+
+    uint64_t magic{ magic_value };
+    uint32_t format_version{ format_version_value };
+    uint32_t byte_order{ byte_order_value };
+    uint32_t kind{};
+    uint32_t key_size{};
+    uint64_t count{};
+};
+
+static_assert(sizeof(SnapshotHeader) == 32, "The header is written as bytes and must not have padding.");
+
+// Multiplicative hash of the 64-bit words of the stream, independent of how the stream is cut into pieces.
+// It detects a damaged or truncated snapshot, it is not a cryptographic hash.
+class SnapshotChecksum {
+public:
+    void update(const unsigned char* data, size_t size) {
+        length += size;
+        // Complete the word left over by the previous piece.
+        while (size != 0 && pending_size != 0) {
+            pending[pending_size++] = *data++;
+            size--;
+            if (pending_size == sizeof(uint64_t)) {
+                addWord(pending);
+                pending_size = 0;
+            }
+        }
+
+        for (; size >= sizeof(uint64_t); data += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+            addWord(data);
+        }
+
+        std::copy(data, data + size, pending + pending_size);
+        pending_size += size;
+    }
+
+    NODISCARD uint64_t value() const {
+        unsigned char tail[sizeof(uint64_t)]{};
+        std::copy(pending, pending + pending_size, tail);
+        auto result = mix(mix(hash, tail), reinterpret_cast<const unsigned char*>(&length));
+        // Final avalanche, so the last bytes reach all the bits.
+        result ^= result >> 33;
+        result *= 0xFF51AFD7ED558CCDull;
+        result ^= result >> 33;
+        return result;
+    }
+
+private:
+    void addWord(const unsigned char* data) {
+        hash = mix(hash, data);
+    }
+
+    NODISCARD static uint64_t mix(uint64_t hash, const unsigned char* data) {
+        uint64_t word = 0;
+        std::memcpy(&word, data, sizeof(word));
+        return (std::rotl(hash, 31) ^ word) * 0x9E3779B97F4A7C15ull;
+    }
+
+    uint64_t hash{ 0xCBF29CE484222325ull };
+    uint64_t length{};
+    unsigned char pending[sizeof(uint64_t)]{};
+    size_t pending_size{};
+};
+
+// 1 MiB: a few system calls per million keys.
+constexpr size_t default_snapshot_buffer_size = 1 << 20;
+
+namespace snapshot_io {
+    // Write all the bytes, the system call may take a part of them.
+    inline void writeAll(int descriptor, const unsigned char* data, size_t size) {
+        while (size != 0) {
+#if defined(_WIN32)
+            const auto written = ::_write(descriptor, data, static_cast<unsigned>(std::min<size_t>(size, 1u << 30)));
+#else
+            const auto written = ::write(descriptor, data, size);
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+#endif
+            if (written <= 0) {
+                throw std::runtime_error("Snapshot: write failed");
+            }
+
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+    }
+
+    // Read up to size bytes, fewer only at the end of the stream. Returns the count of the bytes read.
+    inline size_t readSome(int descriptor, unsigned char* data, size_t size) {
+        size_t total = 0;
+        while (total != size) {
+#if defined(_WIN32)
+            const auto bytes_read = ::_read(descriptor, data + total, static_cast<unsigned>(std::min<size_t>(size - total, 1u << 30)));
+#else
+            const auto bytes_read = ::read(descriptor, data + total, size - total);
+            if (bytes_read < 0 && errno == EINTR) {
+                continue;
+            }
+#endif
+            if (bytes_read < 0) {
+                throw std::runtime_error("Snapshot: read failed");
+            }
+
+            if (bytes_read == 0) {
+                break;
+            }
+
+            total += static_cast<size_t>(bytes_read);
+        }
+
+        return total;
+    }
+
+    // The descriptor of a stdio stream, e.g. of std::tmpfile().
+    inline int fileDescriptor(std::FILE* file) {
+#if defined(_WIN32)
+        return ::_fileno(file);
+#else
+        return ::fileno(file);
+#endif
+    }
+
+    // Move the position to offset bytes from the start, e.g. back to the snapshot before reading it.
+    inline void seek(int descriptor, uint64_t offset) {
+#if defined(_WIN32)
+        const bool moved = ::_lseeki64(descriptor, static_cast<long long>(offset), SEEK_SET) == static_cast<long long>(offset);
+#else
+        const bool moved = ::lseek(descriptor, static_cast<off_t>(offset), SEEK_SET) == static_cast<off_t>(offset);
+#endif
+        if (!moved) {
+            throw std::runtime_error("Snapshot: seek failed");
+        }
+    }
+
+    // Cut or extend the file to size bytes. The position doesn't move.
+    inline void truncate(int descriptor, uint64_t size) {
+#if defined(_WIN32)
+        const bool resized = ::_chsize_s(descriptor, static_cast<long long>(size)) == 0;
+#else
+        const bool resized = ::ftruncate(descriptor, static_cast<off_t>(size)) == 0;
+#endif
+        if (!resized) {
+            throw std::runtime_error("Snapshot: truncate failed");
+        }
+    }
+}
+
+// Write a snapshot: writeHeader(), count times write() or writeArray(), then finish(). The descriptor stays open.
+class SnapshotWriter {
+public:
+    explicit SnapshotWriter(int descriptor, size_t buffer_size = default_snapshot_buffer_size) :
+            descriptor{ descriptor },
+            buffer(std::max(buffer_size, sizeof(SnapshotHeader)))
+    {
+    }
+
+    template<class Key>
+    void writeHeader(SnapshotKind kind, uint64_t count) {
+        static_assert(std::is_trivially_copyable_v<Key>, "The snapshot copies the keys as bytes.");
+        SnapshotHeader header{};
+        header.kind = static_cast<uint32_t>(kind);
+        header.key_size = sizeof(Key);
+        header.count = count;
+        writeBytes(reinterpret_cast<const unsigned char*>(&header), sizeof(header));
+    }
+
+    template<class Key>
+    void write(const Key& key) {
+        static_assert(std::is_trivially_copyable_v<Key>, "The snapshot copies the keys as bytes.");
+        if (buffer.size() - buffer_used >= sizeof(Key)) {
+            std::memcpy(buffer.data() + buffer_used, &key, sizeof(Key));
+            buffer_used += sizeof(Key);
+            return;
+        }
+
+        writeBytes(reinterpret_cast<const unsigned char*>(&key), sizeof(Key));
+    }
+
+    template<class Key>
+    void writeArray(const Key* keys, size_t count) {
+        static_assert(std::is_trivially_copyable_v<Key>, "The snapshot copies the keys as bytes.");
+        writeBytes(reinterpret_cast<const unsigned char*>(keys), count * sizeof(Key));
+    }
+
+    // Flush the buffer and append the checksum.
+    void finish() {
+        flush();
+        const auto value = checksum.value();
+        snapshot_io::writeAll(descriptor, reinterpret_cast<const unsigned char*>(&value), sizeof(value));
+    }
+
+private:
+    // The runs longer than the buffer go around it.
+    void writeBytes(const unsigned char* data, size_t size) {
+        // The array of an empty container may be null.
+        if (size == 0) {
+            return;
+        }
+
+        if (buffer.size() - buffer_used < size) {
+            flush();
+        }
+
+        if (size >= buffer.size()) {
+            checksum.update(data, size);
+            snapshot_io::writeAll(descriptor, data, size);
+            return;
+        }
+
+        std::memcpy(buffer.data() + buffer_used, data, size);
+        buffer_used += size;
+    }
+
+    void flush() {
+        checksum.update(buffer.data(), buffer_used);
+        snapshot_io::writeAll(descriptor, buffer.data(), buffer_used);
+        buffer_used = 0;
+    }
+
+    int descriptor{};
+    std::vector<unsigned char> buffer{};
+    size_t buffer_used{};
+    SnapshotChecksum checksum{};
+};
+
+// Read a snapshot written by SnapshotWriter: readHeader(), count times read() or readArray(), then finish().
+// The reader takes nothing past the checksum out of the descriptor, so one stream may hold several snapshots.
+class SnapshotReader {
+public:
+    explicit SnapshotReader(int descriptor, size_t buffer_size = default_snapshot_buffer_size) :
+            descriptor{ descriptor },
+            buffer(std::max(buffer_size, sizeof(SnapshotHeader)))
+    {
+    }
+
+    // Returns the count of the keys.
+    template<class Key>
+    NODISCARD uint64_t readHeader(SnapshotKind kind) {
+        static_assert(std::is_trivially_copyable_v<Key>, "The snapshot copies the keys as bytes.");
+        SnapshotHeader header{};
+        readBytes(reinterpret_cast<unsigned char*>(&header), sizeof(header));
+        if (header.magic != SnapshotHeader::magic_value) {
+            throw std::runtime_error("Snapshot: not a snapshot");
+        }
+
+        if (header.format_version != SnapshotHeader::format_version_value) {
+            throw std::runtime_error("Snapshot: unsupported format version " + std::to_string(header.format_version));
+        }
+
+        if (header.byte_order != SnapshotHeader::byte_order_value) {
+            throw std::runtime_error("Snapshot: written with another byte order");
+        }
+
+        if (header.kind != static_cast<uint32_t>(kind) || header.key_size != sizeof(Key)) {
+            throw std::runtime_error("Snapshot: written by another container or with another key type");
+        }
+
+        if (header.count > (UINT64_MAX - sizeof(uint64_t)) / sizeof(Key)) {
+            throw std::runtime_error("Snapshot: damaged header");
+        }
+
+        keys_left = header.count;
+        stream_left = header.count * sizeof(Key) + sizeof(uint64_t);
+        return header.count;
+    }
+
+    template<class Key>
+    NODISCARD Key read() {
+        static_assert(std::is_trivially_copyable_v<Key>, "The snapshot copies the keys as bytes.");
+        takeKeys(1);
+        Key key;
+        if (buffer_end - buffer_position >= sizeof(Key)) {
+            std::memcpy(&key, buffer.data() + buffer_position, sizeof(Key));
+            buffer_position += sizeof(Key);
+        } else {
+            readBytes(reinterpret_cast<unsigned char*>(&key), sizeof(Key));
+        }
+
+        return key;
+    }
+
+    template<class Key>
+    void readArray(Key* keys, size_t count) {
+        static_assert(std::is_trivially_copyable_v<Key>, "The snapshot copies the keys as bytes.");
+        takeKeys(count);
+        readBytes(reinterpret_cast<unsigned char*>(keys), count * sizeof(Key));
+    }
+
+    // Compare the checksum after the last key.
+    void finish() {
+        if (keys_left != 0) {
+            throw std::runtime_error("Snapshot: the keys are not read to the end");
+        }
+
+        checkConsumed();
+        const auto expected = checksum.value();
+        uint64_t value = 0;
+        readBytes(reinterpret_cast<unsigned char*>(&value), sizeof(value));
+        if (value != expected) {
+            throw std::runtime_error("Snapshot: checksum mismatch");
+        }
+    }
+
+private:
+    void takeKeys(uint64_t count) {
+        if (count > keys_left) {
+            throw std::runtime_error("Snapshot: more keys requested than the snapshot holds");
+        }
+
+        keys_left -= count;
+    }
+
+    // The bytes taken out of the buffer are added to the checksum in bulk, before the buffer is refilled.
+    void checkConsumed() {
+        checksum.update(buffer.data() + buffer_checked, buffer_position - buffer_checked);
+        buffer_checked = buffer_position;
+    }
+
+    // Take the bytes from the buffer, the runs longer than the buffer are read directly into the destination.
+    void readBytes(unsigned char* data, size_t size) {
+        const auto buffered = std::min(size, buffer_end - buffer_position);
+        std::memcpy(data, buffer.data() + buffer_position, buffered);
+        buffer_position += buffered;
+        data += buffered;
+        size -= buffered;
+        if (size == 0) {
+            return;
+        }
+
+        checkConsumed();
+        if (size >= buffer.size()) {
+            readStream(data, size, size);
+            checksum.update(data, size);
+            return;
+        }
+
+        // Refill the buffer, but never past the end of the snapshot.
+        buffer_end = readStream(buffer.data(), static_cast<size_t>(std::min<uint64_t>(buffer.size(), stream_left)), size);
+        std::memcpy(data, buffer.data(), size);
+        buffer_position = size;
+        buffer_checked = 0;
+    }
+
+    // Read up to size bytes and at least the required ones.
+    size_t readStream(unsigned char* data, size_t size, size_t required) {
+        const auto bytes_read = snapshot_io::readSome(descriptor, data, size);
+        if (bytes_read < required) {
+            throw std::runtime_error("Snapshot: unexpected end of the stream");
+        }
+
+        stream_left -= std::min<uint64_t>(bytes_read, stream_left);
+        return bytes_read;
+    }
+
+    int descriptor{};
+    std::vector<unsigned char> buffer{};
+    size_t buffer_position{};
+    size_t buffer_checked{};
+    size_t buffer_end{};
+    uint64_t keys_left{};
+    // The bytes of the snapshot still in the stream, the header until it is read.
+    uint64_t stream_left{ sizeof(SnapshotHeader) };
+    SnapshotChecksum checksum{};
+};
@@ -0,0 +1,187 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include "head.h"
+
+// Instrumentation policies for the sorts, the heaps and the trees.
+// The algorithms take a Stats template parameter and report every event through the static Stats::add(event).
+// + NoStats is the default: the hook is an empty inline function, the instrumented code compiles to the same code as before.
+// + CountingStats counts into one global set of counters, for single-threaded workloads.
+// + ThreadLocalStats counts into the counters of the calling thread and sums all threads on snapshot().
+// The Tag parameter gives a workload its own counters: CountingStats<struct MyWorkload>.
+enum class StatsEvent : size_t {
+    comparison = 0,
+    move,
+    swap,
+    allocation,
+    rotation,
+    rebalance
+};
+
+constexpr size_t stats_events_count = 6;
+
+NODISCARD constexpr const char* statsEventName(StatsEvent event) {
+    constexpr const char* names[stats_events_count]{ "comparisons", "moves", "swaps", "allocations", "rotations", "rebalance steps" };
+    return names[static_cast<size_t>(event)];
+}
+
+// A snapshot of the counters.
+struct StatsCounters {
+    std::array<uint64_t, stats_events_count> values{};
+
+    NODISCARD CONSTEXPR20 uint64_t operator[](StatsEvent event) const {
+        return values[static_cast<size_t>(event)];
+    }
+
+    CONSTEXPR20 StatsCounters& operator+=(const StatsCounters& other) {
+        for (size_t index = 0; index < stats_events_count; index++) {
+            values[index] += other.values[index];
+        }
+
+        return *this;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, const StatsCounters& counters) {
+        for (size_t index = 0; index < stats_events_count; index++) {
+            os << (index != 0 ? ", " : "") << statsEventName(static_cast<StatsEvent>(index)) << ": " << counters.values[index];
+        }
+
+        return os;
+    }
+};
+
+class NoStats {
+public:
+    static CONSTEXPR20 void add(StatsEvent, uint64_t = 1) noexcept {}
+
+    NODISCARD static CONSTEXPR20 StatsCounters snapshot() noexcept {
+        return {};
+    }
+
+    static CONSTEXPR20 void reset() noexcept {}
+};
+
+template<class Tag = void>
+class CountingStats {
+public:
+    static void add(StatsEvent event, uint64_t count = 1) noexcept {
+        counters.values[static_cast<size_t>(event)] += count;
+    }
+
+    NODISCARD static StatsCounters snapshot() noexcept {
+        return counters;
+    }
+
+    static void reset() noexcept {
+        counters = StatsCounters{};
+    }
+
+private:
+    inline static StatsCounters counters{};
+};
+
+// Every thread owns a block of counters, so add() is a plain load and store without a lock prefix or a shared cache line.
+// The blocks are registered in a list. The counts of the finished threads are kept in the registry.
+// reset() must not run concurrently with add(): the counts of the other threads may survive it.
+template<class Tag = void>
+class ThreadLocalStats {
+public:
+    static void add(StatsEvent event, uint64_t count = 1) noexcept {
+        auto& counter = localBlock().counters[static_cast<size_t>(event)];
+        // The only writer is this thread: the relaxed atomics just make the reads of snapshot() well-defined.
+        counter.store(counter.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+    }
+
+    NODISCARD static StatsCounters snapshot() {
+        auto& registry = getRegistry();
+        std::lock_guard<std::mutex> lock{ registry.mutex };
+        auto result = registry.finished;
+        for (const auto block : registry.blocks) {
+            result += block->load();
+        }
+
+        return result;
+    }
+
+    static void reset() {
+        auto& registry = getRegistry();
+        std::lock_guard<std::mutex> lock{ registry.mutex };
+        registry.finished = StatsCounters{};
+        for (const auto block : registry.blocks) {
+            for (auto& counter : block->counters) {
+                counter.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+
+private:
+    struct alignas(64) Block {
+        std::array<std::atomic<uint64_t>, stats_events_count> counters{};
+
+        Block() {
+            auto& registry = getRegistry();
+            std::lock_guard<std::mutex> lock{ registry.mutex };
+            registry.blocks.push_back(this);
+        }
+
+        // Keep the counts of the finished thread.
+        ~Block() {
+            auto& registry = getRegistry();
+            std::lock_guard<std::mutex> lock{ registry.mutex };
+            registry.finished += load();
+            std::erase(registry.blocks, this);
+        }
+
+        NODISCARD StatsCounters load() const {
+            StatsCounters result{};
+            for (size_t index = 0; index < stats_events_count; index++) {
+                result.values[index] = counters[index].load(std::memory_order_relaxed);
+            }
+
+            return result;
+        }
+    };
+
+    struct Registry {
+        std::mutex mutex{};
+        std::vector<Block*> blocks{};
+        StatsCounters finished{};
+    };
+
+    // Constructed before the first block, so it is destroyed after the last one.
+    static Registry& getRegistry() {
+        static Registry registry{};
+        return registry;
+    }
+
+    static Block& localBlock() {
+        thread_local Block block{};
+        return block;
+    }
+};
+
+// Comparator which reports every comparison. The sorts wrap the user comparator with it.
+template<class Comparator, class Stats>
+class StatsComparator {
+public:
+    CONSTEXPR20 StatsComparator() = default;
+
+    CONSTEXPR20 explicit StatsComparator(Comparator comp) :
+            comp{ comp }
+    {
+    }
+
+    template<class DataTypeFirst, class DataTypeSecond>
+    NODISCARD CONSTEXPR20 bool operator()(const DataTypeFirst& child, const DataTypeSecond& peek) const {
+        Stats::add(StatsEvent::comparison);
+        return comp(child, peek);
+    }
+
+private:
+    Comparator comp{};
+};
@@ -1,9 +1,12 @@
 #pragma once
 #include <vector>
 #include "head.h"
+#include "stats.h"
 
-template<typename DataType, typename SizeType>
+// Reported as one swap event (three moves).
+template<typename Stats = NoStats, typename DataType, typename SizeType>
 CONSTEXPR20 void swap(std::vector<DataType>& vec, SizeType index_first, SizeType index_second) {
+    Stats::add(StatsEvent::swap);
     DataType value_temp = std::move(vec[index_first]);
     vec[index_first] = std::move(vec[index_second]);
     vec[index_second] = std::move(value_temp);
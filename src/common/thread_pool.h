@@ -0,0 +1,235 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "head.h"
+
+// Below this number of elements the parallel algorithms stay serial.
+constexpr size_t default_grain_size = 16384;
+
+// Fixed size pool of worker threads with a shared FIFO task queue.
+// wait() executes pending tasks while the awaited one is not finished, so tasks may fork and wait for subtasks
+// (recursive fork-join) without deadlocking the pool.
+class ThreadPool {
+public:
+    using size_type = size_t;
+
+    explicit ThreadPool(size_type threads_count = std::thread::hardware_concurrency()) {
+        if (threads_count == 0) {
+            threads_count = 1;
+        }
+
+        workers.reserve(threads_count);
+        for (size_type index = 0; index < threads_count; index++) {
+            workers.emplace_back([this]() {
+                workerLoop();
+            });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            stopping = true;
+        }
+
+        condition.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    NODISCARD size_type size() const {
+        return workers.size();
+    }
+
+    template<class Task>
+    NODISCARD std::future<std::invoke_result_t<Task>> submit(Task&& task) {
+        using result_type = std::invoke_result_t<Task>;
+
+        auto packaged_task = std::make_shared<std::packaged_task<result_type()>>(std::forward<Task>(task));
+        auto future = packaged_task->get_future();
+
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            tasks.emplace_back([packaged_task]() {
+                (*packaged_task)();
+            });
+        }
+
+        condition.notify_one();
+        return future;
+    }
+
+    // Wait for the future helping the pool: pending tasks are executed by the waiting thread.
+    template<class ResultType>
+    ResultType wait(std::future<ResultType>& future) {
+        while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if (!runPendingTask()) {
+                std::this_thread::yield();
+            }
+        }
+
+        return future.get();
+    }
+
+    // Fork-join of two tasks: the second task goes to the pool, the first one runs in the calling thread.
+    // Returns both results. Recursive algorithms may call it from the tasks.
+    // If the first task throws, the second one still finishes before the exception leaves: it may reference the frame
+    // of the caller.
+    template<class TaskFirst, class TaskSecond>
+    NODISCARD std::pair<std::invoke_result_t<TaskFirst>, std::invoke_result_t<TaskSecond>> forkJoin(TaskFirst&& first, TaskSecond&& second) {
+        auto future = submit(std::forward<TaskSecond>(second));
+        try {
+            auto first_result = first();
+            return { std::move(first_result), wait(future) };
+        } catch (...) {
+            waitDiscard(future);
+            throw;
+        }
+    }
+
+    // Same, but both tasks run in the calling thread unless parallel is set: small subproblems skip the queue.
+    template<class TaskFirst, class TaskSecond>
+    NODISCARD std::pair<std::invoke_result_t<TaskFirst>, std::invoke_result_t<TaskSecond>> forkJoin(bool parallel, TaskFirst&& first, TaskSecond&& second) {
+        if (parallel) {
+            return forkJoin(std::forward<TaskFirst>(first), std::forward<TaskSecond>(second));
+        }
+
+        auto first_result = first();
+        return { std::move(first_result), second() };
+    }
+
+    // Execute one task from the queue in the calling thread. Returns false if the queue is empty.
+    bool runPendingTask() {
+        std::function<void()> task;
+
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            if (tasks.empty()) {
+                return false;
+            }
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        task();
+        return true;
+    }
+
+    // Call body(first, last) for chunks of [begin, end) of at least grain_size elements.
+    // The calling thread processes the last chunk and returns when all chunks are done, even when some of them throw:
+    // the first exception is rethrown after that.
+    template<class Body>
+    void parallelFor(size_type begin, size_type end, size_type grain_size, Body&& body) {
+        if (begin >= end) {
+            return;
+        }
+
+        const auto count = end - begin;
+        if (grain_size == 0) {
+            grain_size = 1;
+        }
+
+        auto chunks_count = count / grain_size;
+        if (chunks_count > size() * 4) {
+            chunks_count = size() * 4;
+        }
+
+        if (chunks_count < 2) {
+            body(begin, end);
+            return;
+        }
+
+        const auto chunk_size = count / chunks_count;
+        std::vector<std::future<void>> futures{};
+        futures.reserve(chunks_count - 1);
+
+        std::exception_ptr exception{};
+        try {
+            auto first = begin;
+            for (size_type chunk = 0; chunk < chunks_count - 1; chunk++) {
+                const auto last = first + chunk_size;
+                futures.push_back(submit([&body, first, last]() {
+                    body(first, last);
+                }));
+                first = last;
+            }
+
+            body(first, end);
+        } catch (...) {
+            exception = std::current_exception();
+        }
+
+        // The chunks reference body: every one of them finishes before this frame is left.
+        for (auto& future : futures) {
+            try {
+                wait(future);
+            } catch (...) {
+                if (!exception) {
+                    exception = std::current_exception();
+                }
+            }
+        }
+
+        if (exception) {
+            std::rethrow_exception(exception);
+        }
+    }
+
+private:
+    std::vector<std::thread> workers{};
+    std::deque<std::function<void()>> tasks{};
+    std::mutex mutex{};
+    std::condition_variable condition{};
+    bool stopping{ false };
+
+    // Wait for the task and drop its result or exception: used while another exception unwinds the caller.
+    template<class ResultType>
+    void waitDiscard(std::future<ResultType>& future) noexcept {
+        if (!future.valid()) {
+            return;
+        }
+
+        try {
+            static_cast<void>(wait(future));
+        } catch (...) {
+        }
+    }
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> task;
+
+            {
+                std::unique_lock<std::mutex> lock{ mutex };
+                condition.wait(lock, [this]() {
+                    return stopping || !tasks.empty();
+                });
+
+                if (tasks.empty()) {
+                    // Stopping and nothing left to do.
+                    return;
+                }
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+};